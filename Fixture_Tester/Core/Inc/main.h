@@ -61,10 +61,15 @@ void Error_Handler(void);
 #define T_C_GPIO_Port GPIOA
 #define R_C_Pin GPIO_PIN_3
 #define R_C_GPIO_Port GPIOB
+#define R_C2_Pin GPIO_PIN_4
+#define R_C2_GPIO_Port GPIOB
+#define T_C2_Pin GPIO_PIN_5
+#define T_C2_GPIO_Port GPIOB
 #define KEY_C_Pin GPIO_PIN_9
 #define KEY_C_GPIO_Port GPIOB
 
 /* USER CODE BEGIN Private defines */
+#define ADC_SCAN_RATE_HZ 1000U   // ADC 扫描频率（TIM2_CC2 触发，改动时同步修改 tim.c 中 TIM2 的分频 / 周期）
 
 /* USER CODE END Private defines */
 
@@ -54,7 +54,7 @@ void MX_GPIO_Init(void)
   HAL_GPIO_WritePin(T_C_GPIO_Port, T_C_Pin, GPIO_PIN_RESET);
 
   /*Configure GPIO pin Output Level */
-  HAL_GPIO_WritePin(R_C_GPIO_Port, R_C_Pin, GPIO_PIN_RESET);
+  HAL_GPIO_WritePin(GPIOB, R_C_Pin|R_C2_Pin|T_C2_Pin, GPIO_PIN_RESET);
 
   /*Configure GPIO pin : T_C_Pin */
   GPIO_InitStruct.Pin = T_C_Pin;
@@ -63,19 +63,23 @@ void MX_GPIO_Init(void)
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
   HAL_GPIO_Init(T_C_GPIO_Port, &GPIO_InitStruct);
 
-  /*Configure GPIO pin : R_C_Pin */
-  GPIO_InitStruct.Pin = R_C_Pin;
+  /*Configure GPIO pins : R_C_Pin R_C2_Pin T_C2_Pin */
+  GPIO_InitStruct.Pin = R_C_Pin|R_C2_Pin|T_C2_Pin;
   GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
   GPIO_InitStruct.Pull = GPIO_PULLUP;
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-  HAL_GPIO_Init(R_C_GPIO_Port, &GPIO_InitStruct);
+  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
   /*Configure GPIO pin : KEY_C_Pin */
   GPIO_InitStruct.Pin = KEY_C_Pin;
-  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
   GPIO_InitStruct.Pull = GPIO_PULLUP;
   HAL_GPIO_Init(KEY_C_GPIO_Port, &GPIO_InitStruct);
 
+  /* EXTI interrupt init*/
+  HAL_NVIC_SetPriority(EXTI9_5_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+
 }
 
 /* USER CODE BEGIN 2 */
@@ -29,6 +29,18 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include "../../icode/oled.h"
+#include "../../icode/adc_block.h"
+#include "../../icode/key.h"
+#include "../../icode/sched.h"
+#include "../../icode/telemetry.h"
+#include "../../icode/host.h"
+#include "../../icode/transient.h"
+#include "../../icode/relay.h"
+#include "../../icode/cal.h"
+#include "../../icode/stats.h"
+#include "../../icode/log.h"
+#include "../../icode/prof.h"
+#include "../../icode/measure.h"
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
@@ -44,32 +56,88 @@ typedef enum {
 } MeasurementState;
 
 /* Private define ------------------------------------------------------------*/
-#define TX_R_MIN  28.0   // 发送端电阻最小值
-#define TX_R_MAX  29.0   // 发送端电阻最大值
-#define RX_R_MIN  38.0   // 接收端电阻最小值
-#define RX_R_MAX  39.0   // 接收端电阻最大值
-#define EPS 0.05         // 允许的误差范围，用于放宽判定条件
-#define FILTER_DEPTH 16  // 移动平均滤波器的深度（采样点数）
-#define VREF 3.3         // ADC的参考电压
+// 判定上下限与换算常数的默认值、通道位置、稳定判据见 measure.h
+// （运行时使用 limits / cal：上电从 flash 载入，可由上位机修改并保存，见 cal.h）
+
+// 夹具工位：每个工位一对线圈、一组继电器和独立的状态机，各工位的测量阶段互相重叠
+// （例如工位 2 测电阻时工位 1 的磁场正在稳定），工位 i 的四路在 adc_smp.val[i × ADC_SLOT_CHANNELS] 起
+#define FIXTURE_SLOTS 2          // 启用的工位数（1..ADC_SLOTS；只接一个工位时设为 1，其余通道照常采样但不处理）
+
+// 自动模式工件检测：两路电阻都落在检测窗口内视为已放入，都不在窗口内视为已取走
+// 窗口比判定上下限宽，阻值不合格的工件同样会被测试并判为不合格；开路时读数远在窗口之外
+#define AUTO_MODE_DEFAULT 1      // 上电默认开启自动模式（上位机 HOST_CMD_SET_AUTO 可修改）
+#define DUT_R_MIN  2000          // 检测窗口下限（20.00 Ω）
+#define DUT_R_MAX  5000          // 检测窗口上限（50.00 Ω）
+#define DUT_DETECT_COUNT 3       // 连续这么多个抽取输出（约 190 ms）一致才确认放入 / 取走，滤掉接触抖动
+
+// 继电器切换瞬态（adc_block.c 高速采集 + transient.c 特征提取）
+#define TRANSIENT_DECIDE    1    // 1 = 两路磁场在采集窗口（约 51 ms）内稳定时直接用末段平均值判定，不再等抽取输出稳定
+#define WAVE_UPLOAD_DEFAULT 0    // 上电默认不上传瞬态波形（上位机 HOST_CMD_SET_WAVE 可修改）
+
+#define IDLE_PAGE_MS 3000        // 空闲时欢迎界面与统计页的轮换间隔（本班尚无测试时只显示欢迎界面）
+#define UI_RESULT_HOLD_MS 1500   // 一个工位的结果至少显示这么久，期间其它工位的进度推迟显示
+#define UI_IDLE 0xFF             // ui_slot：所有工位空闲，显示欢迎界面 / 统计页
+
+// 任务调度（sched.c）：周期与单次运行时间预算
+#define DISPLAY_PERIOD_MS       20   // 显示任务周期（脏页最多 20 ms 后开始发送）
+#define TASK_MEASURE_BUDGET_US  500  // 测量任务：各工位状态处理 + 写显存
+#define TASK_HOST_BUDGET_US     300  // 上位机任务：解析至多一个接收缓冲的字节并执行命令
+#define TASK_DISPLAY_BUDGET_US  100  // 显示任务：只启动 DMA，不等传输
+#define WAVE_PERIOD_MS          5    // 波形上传任务周期（115200 bps 下 5 ms 约发出 57 字节）
+#define TASK_WAVE_BUDGET_US     200  // 波形上传任务：按缓冲余量写入若干帧
+#define LOG_PERIOD_MS           5    // 日志任务周期（空闲时写 flash、导出日志）
+#define TASK_LOG_BUDGET_US      25000 // 日志任务：换页时擦除一页约 20 ms（只在所有工位都空闲 / 完成时）
+
+#if FIXTURE_SLOTS < 1 || FIXTURE_SLOTS > ADC_SLOTS
+#error "FIXTURE_SLOTS must be 1..ADC_SLOTS"
+#endif
 
 /* Private variables ---------------------------------------------------------*/
-volatile uint16_t ADC_value[4] = {0}; // 用于存放DMA传输的4通道ADC采样原始值
-volatile uint8_t adc_ready = 0;       // ADC采样完成标志位，在DMA中断中设置
+adc_sample_t adc_smp;                 // 最近取到的ADC抽取输出（ADC_CHANNELS 通道，ADC_RES_BITS 位，见 adc_block.h）
 
-// 移动平均滤波相关变量
-double tx_R_buf[FILTER_DEPTH]={0}, rx_R_buf[FILTER_DEPTH]={0}, tx_B_buf[FILTER_DEPTH]={0}, rx_B_buf[FILTER_DEPTH]={0}; // 存储四个测量值的历史数据缓冲区
-double tx_R_sum=0, rx_R_sum=0, tx_B_sum=0, rx_B_sum=0; // 四个测量值的累加和
-int tx_R_idx=0, rx_R_idx=0, tx_B_idx=0, rx_B_idx=0;   // 当前缓冲区索引
+// 一个工位的状态机、工件检测和本次测试
+typedef struct {
+    MeasurementState state;          // 当前状态
+    meas_run_t run;                  // 本次测试的阶段、稳定检测和测量值（measure.c）
+    uint32_t test_no;                // 本次测试的序号（开始时分配）
+    uint8_t pass;                    // 本次测试的判定结果（完成状态下有效）
+    uint8_t dut_armed;               // 1 = 待命：下一次确认放入时自动开始（测试开始后清零，取走后置位）
+    uint8_t dut_present_cnt, dut_absent_cnt; // 连续判为放入 / 取走的抽取输出个数
+    transient_feat_t tx_B_feat, rx_B_feat;   // 最近一次瞬态特征
+} slot_t;
 
 // 状态机和计时相关变量
-MeasurementState current_state = STATE_IDLE; // 当前状态机的状态，初始为空闲
-uint32_t capture_tick = 0;                   // 用于计时的变量，记录某一时刻的系统滴答数
+slot_t slots[FIXTURE_SLOTS];                 // 各工位（状态初始为空闲，dut_armed 在 main 中置位）
+static const meas_cfg_t meas_cfg = MEAS_CFG_DEFAULT;
+uint32_t test_count = 0;                     // 已开始的测试次数（分配测试序号；中止的测试不发结果帧）
+tlm_result_t last_result;                    // 最近一次完成的测试结果（上位机 HOST_CMD_GET_RESULT 重发）
+cal_limits_t limits = { TX_R_MIN, TX_R_MAX, RX_R_MIN, RX_R_MAX, EPS };
+cal_consts_t cal = { VREF_UV, R_CENTI_PER_V, R_ZERO_CENTI, B_UV_PER_CENTI };
+
+meas_conv_t conv;                            // 由 cal 预先算好的定点换算系数（cal_apply 计算）
+
+// 自动模式工件检测
+uint8_t auto_mode = AUTO_MODE_DEFAULT;       // 1 = 工件放入即开始测试
+
+// 屏幕一次只显示一个工位：某工位开始、测完电阻、出结果时切到该工位，
+// 结果显示后 UI_RESULT_HOLD_MS 内其它工位的更新先登记在 ui_pending，到期后再切过去
+uint8_t ui_slot = UI_IDLE;                   // 正在显示的工位
+uint8_t ui_pending;                          // bit i = 工位 i 有推迟的显示更新
+uint32_t ui_hold_tick;                       // 正在显示的结果开始显示的时刻
+
+// 空闲界面轮换
+uint8_t idle_page = 0;                       // 0 = 欢迎界面，1 = 统计页
+uint32_t idle_page_tick = 0;                 // 当前页开始显示的时刻
 
-// 测量结果相关变量
-double tx_B_offset=0, rx_B_offset=0;         // 磁场测量的背景偏移量
-double final_tx_R=0, final_rx_R=0, final_tx_B=0, final_rx_B=0; // 存储最终计算出的四个测量值
+// 界面模板：固定标签开机时画一次存下，换屏时整屏载入，之后只画数值
+uint8_t tpl_welcome[OLED_TPL_SIZE];          // 欢迎界面
+uint8_t tpl_test[OLED_TPL_SIZE];             // 测量界面的标签（UI_Init）
+static const uint8_t txt_pass[] = { 14, 15, 17, 18 };     // “测试合格”（Hzk 编号）
+static const uint8_t txt_fail[] = { 14, 15, 16, 17, 18 }; // “测试不合格”
 
-uint8_t show_welcome_flag=1; // 是否显示欢迎界面的标志位
+// 继电器切换瞬态
+uint8_t wave_upload = WAVE_UPLOAD_DEFAULT;   // 1 = 每次测试后上传瞬态波形
+const uint16_t *burst_wave;                  // 最近一次瞬态采集的波形（ADC_Burst_Take，下次采集前有效）
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
@@ -77,19 +145,11 @@ void UI_Init(void);            // 初始化OLED显示界面的函数
 
 /* Private user code ---------------------------------------------------------*/
 /**
-  * @brief  移动平均滤波函数
-  * @param  new_val: 新的采样值
-  * @param  buf: 存放历史数据的缓冲区
-  * @param  sum: 历史数据的累加和
-  * @param  idx: 当前缓冲区的索引
-  * @retval 滤波后的平均值
+  * @brief  由换算常数 cal 计算定点换算系数（上电载入标定、上位机修改标定后调用）
+  * @note   满量程计数 4095 × ADC_OUT_SCALE
   */
-double filter_average(double new_val, double *buf, double *sum, int *idx) {
-    *sum -= buf[*idx];
-    buf[*idx] = new_val;
-    *sum += new_val;
-    *idx = (*idx + 1) % FILTER_DEPTH;
-    return *sum / FILTER_DEPTH;
+static void cal_apply(void) {
+    Meas_ConvInit(&conv, &cal, 4095 * (int32_t)ADC_OUT_SCALE);
 }
 
 /**
@@ -103,145 +163,604 @@ void UI_Init(void) {
     OLED_ShowCHinese(0,6,8,0); OLED_ShowCHinese(16,6,9,0);
 }
 
+/**
+  * @brief  生成界面模板（OLED_Init 之后调用一次）
+  * @note   模板内容与逐字绘制完全相同；生成后显存全屏为脏，下一次刷新整屏发送
+  */
+static void ui_templates_init(void) {
+    static const uint8_t welcome[] = { 10, 11, 12, 13, 14, 15 };
+    OLED_Clear();
+    UI_Init();
+    OLED_SaveTemplate(tpl_test);
+    OLED_Clear();
+    OLED_ShowCHineseStr(16, 3, welcome, sizeof(welcome), 0);
+    OLED_SaveTemplate(tpl_welcome);
+}
+
+/**
+  * @brief  显示欢迎界面（所有工位回到空闲时调用）
+  */
+static void show_welcome(void) {
+    idle_page = 0;
+    idle_page_tick = HAL_GetTick();
+    OLED_LoadTemplate(tpl_welcome);
+}
+
+/**
+  * @brief  显示本班统计页（空闲时与欢迎界面轮换）：测试数、合格率，四个测量值的均值和标准差
+  */
+static void show_stats(void) {
+    static const char *const name[STATS_QTY] = { "TxR", "RxR", "TxB", "RxB" };
+    char line[24];
+    uint16_t y = Stats_YieldPermille();
+    uint8_t i;
+    int32_t m;
+    uint32_t s;
+
+    idle_page = 1;
+    idle_page_tick = HAL_GetTick();
+    OLED_Clear();
+    snprintf(line, sizeof(line), "N %lu  Y %u.%u%%", (unsigned long)Stats_Get()->count, y / 10, y % 10);
+    OLED_ShowString(0, 0, line, 12, 0);
+    for (i = 0; i < STATS_QTY; i++) {
+        m = Stats_Mean_x10(i);   // 0.001 单位
+        s = Stats_Std_x10(i);
+        snprintf(line, sizeof(line), "%s %s%ld.%03ld s%lu.%03lu", name[i], m < 0 ? "-" : "",
+                 (long)(m < 0 ? -m : m) / 1000, (long)(m < 0 ? -m : m) % 1000,
+                 (unsigned long)s / 1000, (unsigned long)s % 1000);
+        OLED_ShowString(0, 2 + i, line, 12, 0);
+    }
+}
+
+/**
+  * @brief  整屏画出一个工位的测量界面：标签模板、工位号（多工位时），已测得的电阻、磁场和判定
+  */
+static void ui_draw_slot(uint8_t i) {
+    const slot_t *s = &slots[i];
+    char tag[4] = { '#', (char)('1' + i), 0 };
+
+    OLED_LoadTemplate(tpl_test);  // 标签整屏载入，只有与上一屏不同的列会发送
+    if (FIXTURE_SLOTS > 1) OLED_ShowString(0, 0, tag, 12, 0);
+    if (s->run.phase >= MEAS_PHASE_B) {
+				// 在OLED上显示电阻值
+        OLED_ShowFloat(32, 2, s->run.tx_R / 100.0f, 2, 1, 16, 0);
+				OLED_ShowFloat(85, 2, s->run.rx_R / 100.0f, 2, 1, 16, 0);
+    }
+    if (s->state == STATE_DONE) {
+				// 在OLED上显示磁场值
+        OLED_ShowFloat(32, 6, s->run.tx_B / 100.0f, 2, 1, 16, 0);
+				OLED_ShowFloat(85, 6, s->run.rx_B / 100.0f, 2, 1, 16, 0);
+        if (s->pass)
+            OLED_ShowCHineseStr(32, 4, txt_pass, sizeof(txt_pass), 0);  // “测试合格”
+        else
+            OLED_ShowCHineseStr(24, 4, txt_fail, sizeof(txt_fail), 0);  // “测试不合格”
+    }
+}
+
+// 1 = 正在显示的结果还在保持期内
+static uint8_t ui_holding(void) {
+    return ui_slot != UI_IDLE && slots[ui_slot].state == STATE_DONE &&
+           HAL_GetTick() - ui_hold_tick < UI_RESULT_HOLD_MS;
+}
+
+/**
+  * @brief  工位 i 的显示内容有变化：切到该工位并重画；另一个工位的结果正在保持期内时推迟到期满
+  */
+static void ui_update(uint8_t i) {
+    if (ui_slot != i && ui_holding()) {
+        ui_pending |= (uint8_t)(1u << i);
+        return;
+    }
+    ui_pending &= (uint8_t)~(1u << i);
+    ui_slot = i;
+    ui_draw_slot(i);
+    if (slots[i].state == STATE_DONE) ui_hold_tick = HAL_GetTick();
+}
+
+/**
+  * @brief  工位 i 回到空闲：所有工位都空闲时显示欢迎界面，否则正在显示它时切到另一个仍在测试的工位
+  */
+static void ui_slot_idle(uint8_t i) {
+    uint8_t k;
+    ui_pending &= (uint8_t)~(1u << i);
+    if (ui_slot != i && ui_slot != UI_IDLE) return;
+    for (k = 0; k < FIXTURE_SLOTS; k++) {
+        if (slots[k].state != STATE_IDLE) {
+            ui_update(k);
+            return;
+        }
+    }
+    ui_slot = UI_IDLE;
+    ui_pending = 0;
+    show_welcome();
+}
+
+/**
+  * @brief  每个抽取输出调用一次：保持期满后显示推迟的更新；所有工位空闲时按 IDLE_PAGE_MS 轮换欢迎界面与统计页
+  */
+static void ui_poll(void) {
+    uint8_t i;
+    if (ui_pending && !ui_holding()) {
+        for (i = 0; !(ui_pending & (1u << i)); i++) {}
+        ui_update(i);
+    }
+    if (ui_slot == UI_IDLE && Stats_Get()->count && HAL_GetTick() - idle_page_tick >= IDLE_PAGE_MS) {
+        if (idle_page) show_welcome();
+        else show_stats();
+    }
+}
+
+// 1 = 有工位正在测量（等待 / 捕获状态）
+static uint8_t any_measuring(void) {
+    uint8_t i;
+    for (i = 0; i < FIXTURE_SLOTS; i++)
+        if (slots[i].state == STATE_WAIT_FOR_2S || slots[i].state == STATE_CAPTURE_R) return 1;
+    return 0;
+}
+
+/**
+  * @brief  开始测量工位 i（空闲状态按下按键，或上位机 HOST_CMD_START）
+  */
+static void start_test(uint8_t i) {
+    slot_t *s = &slots[i];
+    s->dut_armed = 0;             // 本工件取走之前不再自动开始
+    s->test_no = ++test_count;
+    Meas_Begin(&s->run, HAL_GetTick());
+    s->state = STATE_WAIT_FOR_2S; // 切换到等待状态
+    ui_update(i);
+}
+
+/**
+  * @brief  等待状态收到抽取输出：读数稳定（最长等待 WAIT_TIMEOUT_MS）后，捕获背景值和电阻值
+  */
+static void wait_on_sample(uint8_t i) {
+    slot_t *s = &slots[i];
+    meas_ev_t ev;
+    PROF_CALL(PROF_CONVERT, ev = Meas_Sample(&s->run, &meas_cfg, &conv, adc_smp.val + i * ADC_SLOT_CHANNELS, HAL_GetTick()));
+    if (ev != MEAS_EV_R_DONE) return;   // 背景值和电阻值已捕获到 run，稳定检测已重新开始
+
+		// 启动测量磁场的电路：TIM2 下一个更新事件时两路同时接通，并在同一时刻开始高速采集切换瞬态
+		// （另一个工位的瞬态采集尚未结束时本次不采集，只按抽取输出判断稳定）
+    Transient_UploadCancel();        // 上一次的波形缓冲即将被覆盖
+    Relay_Set(i, 1, 1);
+    Telemetry_SendExcite(s->test_no, i);   // 板端相机以此为触发时刻抓拍（coil_trigger_capture）
+
+    s->state = STATE_CAPTURE_R; // 切换到捕获状态
+    ui_update(i);               // 显示电阻值
+}
+
+/**
+  * @brief  磁场值已确定（run.tx_B / run.rx_B）：断开继电器、判定并发送结果，进入完成状态并显示
+  */
+static void finish_test(uint8_t i) {
+    slot_t *s = &slots[i];
+    tlm_result_t *res = &last_result;
+
+		// 关闭测量磁场的电路（下一个扫描周期内生效）
+    Relay_Set(i, 0, 0);
+
+    // 判定逻辑：检查所有四个测量值是否在预设的范围内
+    s->pass = Meas_Judge(&s->run, &limits);
+
+    // 结果帧写入遥测缓冲，由 DMA 在后台发出
+    res->test_no = s->test_no;
+    res->cycle_ms = HAL_GetTick() - s->run.start_ms;
+    res->tx_R = s->run.tx_R;
+    res->rx_R = s->run.rx_R;
+    res->tx_B = s->run.tx_B;
+    res->rx_B = s->run.rx_B;
+    res->pass = s->pass;
+    res->slot = i;
+    Telemetry_SendResult(res);
+    Stats_Add(res);
+    Log_Append(res);              // 先排队，所有工位都回到空闲 / 完成状态后由日志任务写入 flash
+
+    s->state = STATE_DONE; // 切换到完成状态
+    ui_update(i);          // 显示磁场值和“测试合格” / “测试不合格”
+}
+
+/**
+  * @brief  捕获状态收到抽取输出：磁场读数稳定（最长等待 CAPTURE_TIMEOUT_MS）后，捕获磁场值并判定
+  */
+static void capture_on_sample(uint8_t i) {
+    slot_t *s = &slots[i];
+    meas_ev_t ev;
+    PROF_CALL(PROF_CONVERT, ev = Meas_Sample(&s->run, &meas_cfg, &conv, adc_smp.val + i * ADC_SLOT_CHANNELS, HAL_GetTick()));
+    if (ev == MEAS_EV_B_DONE)
+        finish_test(i);
+}
+
+/**
+  * @brief  捕获状态瞬态采集完成：提取并发送特征，两路都已在窗口内稳定时直接判定（TRANSIENT_DECIDE）
+  */
+static void capture_on_burst(uint8_t i) {
+    slot_t *s = &slots[i];
+    Transient_Extract(burst_wave, 0, s->run.tx_B_offset, &s->tx_B_feat);
+    Transient_Extract(burst_wave, 1, s->run.rx_B_offset, &s->rx_B_feat);
+    Telemetry_SendTransient(s->test_no, i, &s->tx_B_feat, &s->rx_B_feat);
+    if (wave_upload) Transient_Upload(burst_wave);
+
+    if (!TRANSIENT_DECIDE || s->tx_B_feat.settle_us == TRANSIENT_NA || s->rx_B_feat.settle_us == TRANSIENT_NA)
+        return;                      // 未稳定：继续按抽取输出判断稳定
+    Meas_SetB(&s->run, &conv, s->tx_B_feat.final, s->rx_B_feat.final);
+    finish_test(i);
+}
+
+/**
+  * @brief  用一个抽取输出更新工位 i 的工件检测计数（空闲 / 完成状态下继电器断开，读到的是电阻通道）
+  */
+static void dut_update(uint8_t i) {
+    slot_t *s = &slots[i];
+    const uint16_t *val = adc_smp.val + i * ADC_SLOT_CHANNELS;
+    int32_t tx = Meas_R(&conv, val[CH_TX_R]);
+    int32_t rx = Meas_R(&conv, val[CH_RX_R]);
+    uint8_t tx_in = tx >= DUT_R_MIN && tx <= DUT_R_MAX;
+    uint8_t rx_in = rx >= DUT_R_MIN && rx <= DUT_R_MAX;
+
+    if (tx_in && rx_in) {
+        s->dut_absent_cnt = 0;
+        if (s->dut_present_cnt < 255) s->dut_present_cnt++;
+    } else if (!tx_in && !rx_in) {
+        s->dut_present_cnt = 0;
+        if (s->dut_absent_cnt < 255) s->dut_absent_cnt++;
+    } else {                      // 只有一路接触上：正在放入或取走，保持不确定
+        s->dut_present_cnt = s->dut_absent_cnt = 0;
+    }
+    if (s->dut_absent_cnt >= DUT_DETECT_COUNT)
+        s->dut_armed = 1;
+}
+
+/**
+  * @brief  空闲状态收到抽取输出：自动模式下确认工件放入即开始测量
+  */
+static void idle_on_sample(uint8_t i) {
+    dut_update(i);
+    if (auto_mode && slots[i].dut_armed && slots[i].dut_present_cnt >= DUT_DETECT_COUNT)
+        start_test(i);
+}
+
+/**
+  * @brief  完成状态收到抽取输出：自动模式下确认工件取走后回到空闲，等待下一个工件
+  */
+static void done_on_sample(uint8_t i) {
+    dut_update(i);
+    if (auto_mode && slots[i].dut_armed) {
+        slots[i].state = STATE_IDLE;
+        ui_slot_idle(i);
+    }
+}
+
+/**
+  * @brief  完成状态按下按键：返回空闲状态
+  */
+static void done_on_key(uint8_t i) {
+    slots[i].state = STATE_IDLE;
+    ui_slot_idle(i);
+}
+
+/**
+  * @brief  按键作用的工位：正在显示的工位；欢迎界面下为第一个检测到工件的空闲工位（都没有时为工位 1）
+  */
+static uint8_t key_slot(void) {
+    uint8_t i;
+    if (ui_slot != UI_IDLE) return ui_slot;
+    for (i = 0; i < FIXTURE_SLOTS; i++)
+        if (slots[i].dut_present_cnt >= DUT_DETECT_COUNT) return i;
+    return 0;
+}
+
+// 状态表：各状态对按键按下、新抽取输出、瞬态采集完成的处理（NULL = 该状态忽略此事件；参数为工位）
+static const struct {
+    void (*on_key)(uint8_t i);
+    void (*on_sample)(uint8_t i);
+    void (*on_burst)(uint8_t i);
+} state_table[] = {
+    [STATE_IDLE]        = { start_test,  idle_on_sample,    NULL },
+    [STATE_WAIT_FOR_2S] = { NULL,        wait_on_sample,    NULL },
+    [STATE_CAPTURE_R]   = { NULL,        capture_on_sample, capture_on_burst },
+    [STATE_DONE]        = { done_on_key, done_on_sample,    NULL },
+};
+
+/**
+  * @brief  测量任务（SCHED_EVT_KEY / SCHED_EVT_ADC 触发）：把按键事件、瞬态采集和抽取输出交给各工位的当前状态处理
+  * @note   ADC 按 2^ADC_OSR_LOG2 轮扫描（默认 64 轮，约 64 ms）累加-倾倒出一个值，这里取最近的输出，
+  *         同一个输出依次交给每个工位（各自取 ADC_SLOT_CHANNELS 路）；
+  *         换算成电阻和磁场强度（Meas_R / Meas_B）只在捕获时做一次
+  */
+static void Task_Measure(void) {
+    key_event_t key;
+    uint8_t i, first;
+    while ((key = Key_GetEvent()) != KEY_EVT_NONE) {
+        i = key_slot();
+        if (key == KEY_EVT_PRESS && state_table[slots[i].state].on_key)
+            state_table[slots[i].state].on_key(i);
+    }
+    if ((burst_wave = ADC_Burst_Take(&first)) != NULL) {
+        i = first / ADC_SLOT_CHANNELS;  // 波形所属的工位
+        if (i < FIXTURE_SLOTS && state_table[slots[i].state].on_burst)
+            state_table[slots[i].state].on_burst(i);
+    }
+    if (!ADC_Block_Get(&adc_smp)) return;
+    Telemetry_SendSample(&adc_smp);     // 实时采样流（按抽取比，默认关闭）
+    for (i = 0; i < FIXTURE_SLOTS; i++)
+        if (state_table[slots[i].state].on_sample)
+            PROF_CALL(PROF_STATE_IDLE + slots[i].state, state_table[slots[i].state].on_sample(i));
+    ui_poll();
+}
+
+/**
+  * @brief  中止工位 i 的测试：断开继电器，回到空闲（上位机 HOST_CMD_ABORT）
+  */
+static void abort_test(uint8_t i) {
+    Relay_Set(i, 0, 0);
+    slots[i].state = STATE_IDLE;
+    ui_slot_idle(i);
+    // dut_armed 保持为 0：工件仍在夹具上，取走之前不自动重测
+}
+
+/**
+  * @brief  回一帧 TLM_TYPE_LIMITS（5 × i16，顺序同 cal_limits_t）
+  */
+static void send_limits(void) {
+    const int16_t v[5] = { limits.tx_r_min, limits.tx_r_max, limits.rx_r_min, limits.rx_r_max, limits.eps };
+    uint8_t buf[10], i;
+    for (i = 0; i < 5; i++) {
+        buf[2 * i] = (uint8_t)v[i];
+        buf[2 * i + 1] = (uint8_t)((uint16_t)v[i] >> 8);
+    }
+    Telemetry_Send(TLM_TYPE_LIMITS, buf, sizeof(buf));
+}
+
+/**
+  * @brief  回一帧 TLM_TYPE_CAL（4 × i32，顺序同 cal_consts_t；u32 flash 记录序号，0 = 编译期默认值）
+  */
+static void send_cal(void) {
+    const uint32_t v[5] = { (uint32_t)cal.vref_uv, (uint32_t)cal.r_centi_per_v, (uint32_t)cal.r_zero_centi,
+                            (uint32_t)cal.b_uv_per_centi, Cal_Seq() };
+    uint8_t buf[20], i, k;
+    for (i = 0; i < 5; i++)
+        for (k = 0; k < 4; k++)
+            buf[4 * i + k] = (uint8_t)(v[i] >> (8 * k));
+    Telemetry_Send(TLM_TYPE_CAL, buf, sizeof(buf));
+}
+
+/**
+  * @brief  上位机命令处理（Host_Poll 回调，命令定义见 host.h）
+  */
+static void host_on_cmd(uint8_t type, const uint8_t *p, uint8_t len) {
+    int16_t v[5];
+    int32_t c[4];
+    uint8_t i;
+
+    switch (type) {
+    case HOST_CMD_START:
+        if (len > 1) {
+            Host_Ack(type, HOST_ERR_LEN);
+            return;
+        }
+        i = len ? p[0] : 0;
+        if (i >= FIXTURE_SLOTS) {
+            Host_Ack(type, HOST_ERR_RANGE);
+            return;
+        }
+        // 完成状态直接开始下一次测试，不必先回空闲，产线可背靠背连续测试
+        if (slots[i].state != STATE_IDLE && slots[i].state != STATE_DONE) {
+            Host_Ack(type, HOST_ERR_BUSY);
+            return;
+        }
+        start_test(i);
+        Host_Ack(type, HOST_OK);
+        return;
+    case HOST_CMD_ABORT:
+        if (len > 1) {
+            Host_Ack(type, HOST_ERR_LEN);
+            return;
+        }
+        if (len && p[0] >= FIXTURE_SLOTS) {
+            Host_Ack(type, HOST_ERR_RANGE);
+            return;
+        }
+        for (i = 0; i < FIXTURE_SLOTS; i++)
+            if (!len || i == p[0]) abort_test(i);
+        Host_Ack(type, HOST_OK);
+        return;
+    case HOST_CMD_GET_RESULT:
+        if (last_result.test_no == 0) Host_Ack(type, HOST_ERR_NODATA);
+        else Telemetry_SendResult(&last_result);
+        return;
+    case HOST_CMD_GET_LIMITS:
+        send_limits();
+        return;
+    case HOST_CMD_SET_LIMITS:
+        if (len != 10) {
+            Host_Ack(type, HOST_ERR_LEN);
+            return;
+        }
+        for (i = 0; i < 5; i++)
+            v[i] = (int16_t)(p[2 * i] | (p[2 * i + 1] << 8));
+        if (v[0] > v[1] || v[2] > v[3] || v[4] < 0) {
+            Host_Ack(type, HOST_ERR_RANGE);
+            return;
+        }
+        limits.tx_r_min = v[0]; limits.tx_r_max = v[1];
+        limits.rx_r_min = v[2]; limits.rx_r_max = v[3];
+        limits.eps = v[4];
+        send_limits();
+        return;
+    case HOST_CMD_GET_CAL:
+        send_cal();
+        return;
+    case HOST_CMD_SET_CAL:
+        if (len != 16) {
+            Host_Ack(type, HOST_ERR_LEN);
+            return;
+        }
+        for (i = 0; i < 4; i++)
+            c[i] = (int32_t)((uint32_t)p[4 * i] | (uint32_t)p[4 * i + 1] << 8 |
+                             (uint32_t)p[4 * i + 2] << 16 | (uint32_t)p[4 * i + 3] << 24);
+        if (c[0] < 1000000 || c[0] > 5000000 || c[1] <= 0 || c[1] > 100000 ||
+            c[2] < -30000 || c[2] > 30000 || c[3] < 10 || c[3] > 100000) {
+            Host_Ack(type, HOST_ERR_RANGE);
+            return;
+        }
+        cal.vref_uv = c[0]; cal.r_centi_per_v = c[1];
+        cal.r_zero_centi = c[2]; cal.b_uv_per_centi = c[3];
+        cal_apply();
+        send_cal();
+        return;
+    case HOST_CMD_SAVE_CAL:
+        // 写 flash 期间 CPU 暂停取指，只在没有工位在测量时保存
+        if (any_measuring()) {
+            Host_Ack(type, HOST_ERR_BUSY);
+            return;
+        }
+        Host_Ack(type, Cal_Save(&cal, &limits) ? HOST_OK : HOST_ERR_FLASH);
+        return;
+    case HOST_CMD_GET_STATS:
+        Stats_Send();
+        return;
+    case HOST_CMD_RESET_STATS:
+        Stats_Reset();
+        if (ui_slot == UI_IDLE && idle_page) show_welcome();
+        Host_Ack(type, HOST_OK);
+        return;
+    case HOST_CMD_DUMP_LOG:
+        if (len != 0 && len != 4) {
+            Host_Ack(type, HOST_ERR_LEN);
+            return;
+        }
+        if (any_measuring()) {
+            Host_Ack(type, HOST_ERR_BUSY);
+            return;
+        }
+        Log_Flush();              // 排队的记录先写入，导出内容包含最近一次测试
+        Log_DumpStart(len ? (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24 : 0);
+        return;
+    case HOST_CMD_GET_PROF:
+        if (len > 1) {
+            Host_Ack(type, HOST_ERR_LEN);
+            return;
+        }
+        if (!Prof_Send()) {
+            Host_Ack(type, HOST_ERR_NODATA);   // 未编译剖析探针
+            return;
+        }
+        if (len && p[0]) Prof_Reset();
+        return;
+    case HOST_CMD_SET_STREAM:
+        if (len != 1) {
+            Host_Ack(type, HOST_ERR_LEN);
+            return;
+        }
+        Telemetry_SetSampleEvery(p[0]);
+        Host_Ack(type, HOST_OK);
+        return;
+    case HOST_CMD_SET_AUTO:
+        if (len != 1) {
+            Host_Ack(type, HOST_ERR_LEN);
+            return;
+        }
+        auto_mode = p[0] ? 1 : 0;
+        Host_Ack(type, HOST_OK);
+        return;
+    case HOST_CMD_SET_WAVE:
+        if (len != 1) {
+            Host_Ack(type, HOST_ERR_LEN);
+            return;
+        }
+        wave_upload = p[0] ? 1 : 0;
+        if (!wave_upload) Transient_UploadCancel();
+        Host_Ack(type, HOST_OK);
+        return;
+    default:
+        Host_Ack(type, HOST_ERR_UNKNOWN);
+        return;
+    }
+}
+
+/**
+  * @brief  上位机任务（SCHED_EVT_HOST 触发）：解析 USART3 收到的命令帧
+  */
+static void Task_Host(void) {
+    Host_Poll(host_on_cmd);
+}
+
+/**
+  * @brief  显示任务（周期）：有脏页且上一轮已发完时，启动新一轮 DMA 刷屏（立即返回）
+  */
+static void Task_Display(void) {
+    OLED_Flush();
+}
+
+/**
+  * @brief  波形上传任务（周期）：按遥测缓冲余量发送瞬态波形帧（没有待传波形时立即返回）
+  */
+static void Task_Wave(void) {
+    Transient_UploadPoll();
+}
+
+/**
+  * @brief  日志任务（周期）：没有工位在测量时把排队的结果写入 flash；导出进行中时按缓冲余量发送
+  */
+static void Task_Log(void) {
+    if (!any_measuring())
+        Log_Flush();
+    Log_DumpPoll();
+}
+
+// 任务表（按优先顺序）：测量、上位机命令由事件驱动，显示、波形上传、日志按周期运行
+static sched_task_t tasks[] = {
+    { .name = "measure", .run = Task_Measure, .events = SCHED_EVT_KEY | SCHED_EVT_ADC, .budget_us = TASK_MEASURE_BUDGET_US },
+    { .name = "host",    .run = Task_Host,    .events = SCHED_EVT_HOST,                .budget_us = TASK_HOST_BUDGET_US },
+    { .name = "display", .run = Task_Display, .period_ms = DISPLAY_PERIOD_MS,          .budget_us = TASK_DISPLAY_BUDGET_US },
+    { .name = "wave",    .run = Task_Wave,    .period_ms = WAVE_PERIOD_MS,             .budget_us = TASK_WAVE_BUDGET_US },
+    { .name = "log",     .run = Task_Log,     .period_ms = LOG_PERIOD_MS,              .budget_us = TASK_LOG_BUDGET_US },
+};
+
 /**
   * @brief  主函数
   */
 int main(void)
 {
+    uint8_t i;
+
     HAL_Init();
     SystemClock_Config();
     MX_GPIO_Init(); 
+		Key_Init();
 		MX_DMA_Init(); 
 		MX_ADC1_Init();
+		MX_ADC2_Init();
 		MX_I2C1_Init(); 
 		MX_USART3_UART_Init(); 
 		MX_TIM2_Init();
 
-    OLED_Init(); 
-		OLED_Clear();
-	
+    // 屏幕上电延时（OLED_POWERUP_MS，从复位算起）期间先完成 ADC 校准、启动采集和读 flash，
+    // OLED_Init 只等剩下的时间
     HAL_ADCEx_Calibration_Start(&hadc1);
-    HAL_ADC_Start_DMA(&hadc1, (uint32_t*)ADC_value, 4);
+    HAL_ADCEx_Calibration_Start(&hadc2);
+    ADC_Block_Start(&hadc1, &hadc2);          // 双 ADC 同步，DMA 循环写入 2 × ADC_BLOCK_SCANS 轮扫描的乒乓缓冲
+    HAL_TIM_PWM_Start(&htim2, TIM_CHANNEL_2); // 启动 TIM2，此后按 ADC_SCAN_RATE_HZ 定时触发 ADC 扫描
+    Host_Start();                             // USART3 DMA 循环接收上位机命令
+    Cal_Load(&cal, &limits);                  // flash 中有有效标定记录时替换编译期默认值
+    cal_apply();
+    Log_Init();                               // 扫描日志区，找到写入位置
+    Prof_Init();                              // PROF_ENABLE 时打开 DWT 周期计数器
 		
 		// 初始化控制继电器的GPIO引脚为低电平
     HAL_GPIO_WritePin(R_C_GPIO_Port, R_C_Pin, GPIO_PIN_RESET);
     HAL_GPIO_WritePin(T_C_GPIO_Port, T_C_Pin, GPIO_PIN_RESET);
+    HAL_GPIO_WritePin(R_C2_GPIO_Port, R_C2_Pin, GPIO_PIN_RESET);
+    HAL_GPIO_WritePin(T_C2_GPIO_Port, T_C2_Pin, GPIO_PIN_RESET);
+    for (i = 0; i < FIXTURE_SLOTS; i++)
+        slots[i].dut_armed = 1;               // 上电时夹具上已有的工件也自动测试
 
-    while (1)
-    {
-				// ------------- 状态: 空闲 (STATE_IDLE) -------------
-        // 等待用户按下按键开始测量
-        if (current_state == STATE_IDLE) {
-            if (show_welcome_flag) {
-                OLED_Clear();
-                OLED_ShowCHinese(16, 3, 10, 0); 
-								OLED_ShowCHinese(32, 3, 11, 0); 
-								OLED_ShowCHinese(48, 3, 12, 0);
-                OLED_ShowCHinese(64, 3, 13, 0);
-								OLED_ShowCHinese(80, 3, 14, 0); 
-								OLED_ShowCHinese(96, 3, 15, 0);
-                show_welcome_flag = 0;
-            }
-						
-						// 检测按键是否按下
-            if (HAL_GPIO_ReadPin(KEY_C_GPIO_Port, KEY_C_Pin) == GPIO_PIN_SET) {
-                HAL_Delay(20);
-                if (HAL_GPIO_ReadPin(KEY_C_GPIO_Port, KEY_C_Pin) == GPIO_PIN_SET) {
-                    OLED_Clear(); 
-										UI_Init();
-                    capture_tick = HAL_GetTick(); // 记录当前时间
-                    current_state = STATE_WAIT_FOR_2S; // 切换到等待状态
-                    while(HAL_GPIO_ReadPin(KEY_C_GPIO_Port, KEY_C_Pin) == GPIO_PIN_SET);
-                }
-            }
-        }
-				
-				// ------------- 状态: 完成 (STATE_DONE) -------------
-        // 等待用户按下按键返回空闲状态
-        if (current_state == STATE_DONE) {
-            if (HAL_GPIO_ReadPin(KEY_C_GPIO_Port, KEY_C_Pin) == GPIO_PIN_SET) {
-                HAL_Delay(20);
-                if (HAL_GPIO_ReadPin(KEY_C_GPIO_Port, KEY_C_Pin) == GPIO_PIN_SET) {
-                    current_state = STATE_IDLE;
-                    show_welcome_flag = 1;
-                    while(HAL_GPIO_ReadPin(KEY_C_GPIO_Port, KEY_C_Pin) == GPIO_PIN_SET);
-                }
-            }
-        }
-				
-				// 当ADC通过DMA完成一次4通道的转换后，adc_ready标志位会被置1
-        if (adc_ready) {
-            adc_ready = 0;
-						
-						// 1. 将ADC原始值转换为电压值
-            double v2 = ADC_value[0]*VREF/4095.0, v3 = ADC_value[1]*VREF/4095.0;
-            double v6 = ADC_value[2]*VREF/4095.0, v7 = ADC_value[3]*VREF/4095.0;
-	
-						// 2. 根据电路设计，将电压值转换为实际物理量（电阻和磁场强度），并进行滤波
-            double tx_R_f = filter_average((3.3-v2)*56.0/1.25, tx_R_buf, &tx_R_sum, &tx_R_idx); //2.6
-            double rx_R_f = filter_average((3.3-v3)*56.0/1.25, rx_R_buf, &rx_R_sum, &rx_R_idx); //2.45
-            double tx_B_f = filter_average((v7-1-.86)/0.013, tx_B_buf, &tx_B_sum, &tx_B_idx);
-            double rx_B_f = filter_average((v6-1.90)/0.013, rx_B_buf, &rx_B_sum, &rx_B_idx);
-					
-						tx_R_f -= 2;
-						rx_R_f -= 2;
-						
-						// ------------- 状态: 等待 (STATE_WAIT_FOR_2S) -------------
-            // 此阶段用于测量背景磁场值作为偏移量，并测量电阻值
-            if (current_state == STATE_WAIT_FOR_2S && HAL_GetTick() - capture_tick > 500) {
-								// 等待1.5秒后，数据稳定，此时捕获的值作为背景值和电阻值
-								tx_B_offset = tx_B_f;	// 捕获发送端磁场背景值
-                rx_B_offset = rx_B_f; // 捕获接收端磁场背景值
-                final_tx_R = tx_R_f;	// 捕获发送端电阻最终值
-                final_rx_R = rx_R_f;	// 捕获接收端电阻最终值
-
-								// 启动测量磁场的电路
-                HAL_GPIO_WritePin(R_C_GPIO_Port, R_C_Pin, GPIO_PIN_SET);
-                HAL_GPIO_WritePin(T_C_GPIO_Port, T_C_Pin, GPIO_PIN_SET);
-
-								// 在OLED上显示电阻值
-                OLED_ShowFloat(32, 2, final_tx_R, 2, 1, 16, 0);
-								OLED_ShowFloat(85, 2, final_rx_R, 2, 1, 16, 0);
-
-                capture_tick = HAL_GetTick();    // 重新计时
-                current_state = STATE_CAPTURE_R; // 切换到捕获状态
-            }
-						// ------------- 状态: 捕获 (STATE_CAPTURE_R) -------------
-            // 此阶段用于测量包含信号的磁场值
-            else if (current_state == STATE_CAPTURE_R && HAL_GetTick() - capture_tick > 1000) {
-								// 再等待3秒后，数据稳定，此时捕获的值为最终的磁场值
-                final_tx_B = tx_B_f - tx_B_offset;	// 最终磁场值 = 当前测量值 - 背景值
-                final_rx_B = rx_B_f - rx_B_offset;
-	
-								// 关闭测量磁场的电路
-                HAL_GPIO_WritePin(R_C_GPIO_Port, R_C_Pin, GPIO_PIN_RESET);
-                HAL_GPIO_WritePin(T_C_GPIO_Port, T_C_Pin, GPIO_PIN_RESET);
-
-								// 在OLED上显示磁场值
-                OLED_ShowFloat(32, 6, final_tx_B, 2, 1, 16, 0);
-								OLED_ShowFloat(85, 6, final_rx_B, 2, 1, 16, 0);
-							
-
-                // 3. 判定逻辑：检查所有四个测量值是否在预设的范围内
-                if (final_tx_R >= TX_R_MIN-EPS && final_tx_R <= TX_R_MAX+EPS &&
-                    final_rx_R >= RX_R_MIN-EPS && final_rx_R <= RX_R_MAX+EPS &&
-                    final_tx_B >= 0 &&
-                    final_rx_B >= 0)
-                {
-										// 如果所有值都在范围内，显示“测试合格”
-                    OLED_ShowCHinese(32, 4, 14, 0); OLED_ShowCHinese(48, 4, 15, 0);
-                    OLED_ShowCHinese(64, 4, 17, 0); OLED_ShowCHinese(80, 4, 18, 0);
-                } else {
-										// // 否则，显示“测试不合格”
-                    OLED_ShowCHinese(24, 4, 14, 0); OLED_ShowCHinese(40, 4, 15, 0);
-                    OLED_ShowCHinese(56, 4, 16, 0); OLED_ShowCHinese(72, 4, 17, 0);
-                    OLED_ShowCHinese(88, 4, 18, 0);
-                }
-
-                current_state = STATE_DONE; // 切换到完成状态
-            }
-        }
-    }
+    OLED_Init();
+    ui_templates_init();
+    show_welcome();
+    OLED_Refresh();                           // 欢迎界面整屏一次发送，之后的绘制都只写显存，由显示任务在后台发送
+    OLED_Display_On();                        // 显存内容就绪后再开显示，不闪出屏幕上电时的随机内容
+    Sched_Run(tasks, sizeof(tasks) / sizeof(tasks[0]));   // 不返回：按事件 / 周期运行任务，空闲时 __WFI 休眠
 }
 
 /**
@@ -278,12 +797,7 @@ void SystemClock_Config(void)
 }
 
 /* USER CODE BEGIN 4 */
-void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
-{
-    if (hadc->Instance == ADC1) {
-        adc_ready = 1;   // 一轮规则通道序列完成
-    }
-}
+// ADC 半满 / 全满回调见 icode/adc_block.c
 /* USER CODE END 4 */
 
 void Error_Handler(void)
@@ -0,0 +1,220 @@
+/*
+ * adc_block.c
+ *
+ *  ADC1 + ADC2 规则同步块采集：DMA 循环写入乒乓缓冲，半满 / 全满中断各交出一整块扫描。
+ *  双 ADC 模式下 ADC1->DR 低半字为 ADC1 结果、高半字为 ADC2 结果，DMA 按字搬运，
+ *  缓冲按半字看即为 ADC1 秩 1, ADC2 秩 1, ADC1 秩 2, ADC2 秩 2, ...，与 adc_sample_t 的通道顺序相同。
+ *  中断里只对刚写完的半个缓冲求和（此时 DMA 正在写另一半），累加满 2^ADC_OSR_LOG2 轮扫描后
+ *  右移输出并清零（累加-倾倒），主循环取最近的输出值，不再直接读 DMA 正在改写的数组。
+ *  全部为 32 位整数运算，没有历史缓冲，也不会因长时间运行累积舍入误差。
+ *  累加前每通道先过 3 点滑动中值（ADC_MEDIAN3），孤立的尖峰不进入累加和。
+ *  瞬态采集期间中断只把指定工位的磁场两路拷入 adc_burst_buf，不累加；采满后恢复 TIM2 原周期，投递 SCHED_EVT_ADC。
+ */
+#include "adc_block.h"
+#include "sched.h"
+#include "main.h"
+#include "prof.h"
+#include <string.h>
+
+#define ADC_DUMP_BLOCKS (1u << (ADC_OSR_LOG2 - ADC_BLOCK_SCANS_LOG2)) // 每个输出的块数
+#define ADC_DUMP_SHIFT  (ADC_OSR_LOG2 - (ADC_RES_BITS - 12))         // 倾倒时的右移位数
+
+static union {
+    uint32_t w[2 * ADC_BLOCK_SCANS * ADC_RANKS];    // DMA 写入单位：每字 = ADC2 << 16 | ADC1
+    uint16_t h[2 * ADC_BLOCK_SCANS * ADC_CHANNELS]; // 按通道读取
+} adc_dma_buf;                                      // 前半块 / 后半块
+static uint32_t adc_acc[ADC_CHANNELS]; // 当前输出的累加和（中断内使用）
+static uint16_t adc_acc_blocks;        // 已累加的块数
+static adc_sample_t adc_latest;        // 最近的输出（中断写，主循环关中断复制）
+static volatile uint8_t adc_fresh;     // 1 = adc_latest 尚未被取走
+static uint32_t adc_seq;               // 已输出的个数
+static ADC_HandleTypeDef *adc_master;  // ADC1 句柄（读 DMA 写入位置）
+#if ADC_MEDIAN3
+static uint16_t adc_med[ADC_CHANNELS][2]; // 各通道前两点原始值（中值窗口）
+static uint8_t adc_med_valid;             // 0 = 窗口需用下一块的首点重新填充（启动、瞬态采集之后）
+#endif
+
+// 瞬态采集
+enum { BURST_IDLE, BURST_ARMED, BURST_RUN, BURST_DONE };
+static uint16_t adc_burst_buf[ADC_BURST_SCANS * ADC_BURST_CHANNELS]; // 第 k 轮：[2k] = val[first]，[2k + 1] = val[first + 1]
+static volatile uint8_t burst_state;
+static uint8_t burst_first;            // 保存的第一路通道（val[] 下标）
+static TIM_HandleTypeDef *burst_tim;   // 触发 ADC 的定时器（TIM2）
+static uint32_t burst_arr, burst_ccr;  // 常速扫描的周期 / 比较值（采满后恢复）
+static uint8_t burst_half;             // 第 0 轮所在的半块
+static uint16_t burst_skip;            // 该半块中第 0 轮之前的扫描数
+static uint16_t burst_n;               // 已保存的扫描数
+
+/**
+  * @brief  启动 ADC1 + ADC2 规则同步 DMA 循环采集（两路均需已完成校准；TIM2 启动后开始按扫描频率出块）
+  * @param  master: ADC1 句柄（外部触发，DMA 所在）
+  * @param  slave: ADC2 句柄（跟随 ADC1 转换，须先使能）
+  */
+void ADC_Block_Start(ADC_HandleTypeDef *master, ADC_HandleTypeDef *slave)
+{
+    adc_master = master;
+    HAL_ADC_Start(slave);
+    HAL_ADCEx_MultiModeStart_DMA(master, adc_dma_buf.w, 2 * ADC_BLOCK_SCANS * ADC_RANKS);
+}
+
+/**
+  * @brief  取最近的抽取输出
+  * @param  out: 输出值
+  * @retval 1 有新输出；0 自上次调用以来没有新输出
+  */
+uint8_t ADC_Block_Get(adc_sample_t *out)
+{
+    uint32_t primask;
+    if (!adc_fresh) return 0;
+    primask = __get_PRIMASK();
+    __disable_irq();
+    *out = adc_latest;
+    adc_fresh = 0;
+    __set_PRIMASK(primask);
+    return 1;
+}
+
+/**
+  * @brief  启动一次瞬态采集：立即把扫描频率切到 ADC_BURST_RATE_HZ，保存其后 ADC_BURST_SCANS 轮的两路原始值
+  * @param  htim: 触发 ADC 的定时器（TIM2，CH2 比较事件触发）
+  * @param  first_ch: 保存的第一路（val[] 下标，与下一路构成一个工位的 tx_B / rx_B）
+  * @retval 1 已启动；0 上一次采集（可能属于另一个工位）尚未结束或尚未取走
+  * @note   上一次 ADC_Burst_Take 取得的数据随即被覆盖；正在累加的抽取输出作废，采满后重新开始累加
+  */
+uint8_t ADC_Burst_Arm(TIM_HandleTypeDef *htim, uint8_t first_ch)
+{
+    uint32_t primask, words, idx, arr;
+
+    if (first_ch + ADC_BURST_CHANNELS > ADC_CHANNELS) return 0;
+    primask = __get_PRIMASK();
+    __disable_irq();
+    if (burst_state != BURST_IDLE) {
+        __set_PRIMASK(primask);
+        return 0;
+    }
+    // DMA 已写入的字数 → 扫描序号；正在转换的一轮仍是常速扫描，必须跳过。
+    // CNDTR 停在扫描边界时无法区分“本轮已触发、第一个字未写入”与“等待下一次触发”，
+    // 因此总是多跳过一轮；多跳过的这一轮可能已是瞬态频率的扫描，采集起点最多晚一个瞬态扫描周期（1 / ADC_BURST_RATE_HZ）
+    words = 2 * ADC_BLOCK_SCANS * ADC_RANKS - __HAL_DMA_GET_COUNTER(adc_master->DMA_Handle);
+    idx = ((words + ADC_RANKS - 1) / ADC_RANKS + 1) % (2 * ADC_BLOCK_SCANS);
+    burst_half = (uint8_t)(idx / ADC_BLOCK_SCANS);
+    burst_skip = (uint16_t)(idx % ADC_BLOCK_SCANS);
+    burst_n = 0;
+    burst_first = first_ch;
+    memset(adc_acc, 0, sizeof(adc_acc));
+    adc_acc_blocks = 0;
+#if ADC_MEDIAN3
+    adc_med_valid = 0;
+#endif
+    burst_state = BURST_ARMED;
+
+    burst_tim = htim;
+    burst_arr = __HAL_TIM_GET_AUTORELOAD(htim);
+    burst_ccr = __HAL_TIM_GET_COMPARE(htim, TIM_CHANNEL_2);
+    arr = (burst_arr + 1) * ADC_SCAN_RATE_HZ / ADC_BURST_RATE_HZ;
+    __HAL_TIM_SET_AUTORELOAD(htim, arr - 1);
+    __HAL_TIM_SET_COMPARE(htim, TIM_CHANNEL_2, arr / 2);
+    HAL_TIM_GenerateEvent(htim, TIM_EVENTSOURCE_UPDATE); // 计数器清零并立即装入新周期（ARR / CCR2 均为预装载）
+    __set_PRIMASK(primask);
+    return 1;
+}
+
+/**
+  * @brief  取瞬态采集结果
+  * @param  first_ch: 返回该次采集的第一路通道（ADC_Burst_Arm 的 first_ch，调用者据此找到所属工位）
+  * @retval 采满时返回 adc_burst_buf（每次采集只返回一次，下次 ADC_Burst_Arm 之前有效）；否则 NULL
+  */
+const uint16_t *ADC_Burst_Take(uint8_t *first_ch)
+{
+    if (burst_state != BURST_DONE) return NULL;
+    *first_ch = burst_first;
+    burst_state = BURST_IDLE;
+    return adc_burst_buf;
+}
+
+/**
+  * @brief  瞬态采集：拷贝 n 轮扫描中 burst_first 起的两路，采满时恢复常速扫描（DMA 中断中调用）
+  */
+static void ADC_Burst_Copy(const uint16_t *p, uint16_t n)
+{
+    uint16_t *dst = &adc_burst_buf[burst_n * ADC_BURST_CHANNELS];
+    p += burst_first;
+    for (; n && burst_n < ADC_BURST_SCANS; n--, burst_n++, p += ADC_CHANNELS, dst += ADC_BURST_CHANNELS) {
+        dst[0] = p[0];
+        dst[1] = p[1];
+    }
+    if (burst_n < ADC_BURST_SCANS) return;
+
+    __HAL_TIM_SET_AUTORELOAD(burst_tim, burst_arr);          // 下一个更新事件起恢复原扫描频率
+    __HAL_TIM_SET_COMPARE(burst_tim, TIM_CHANNEL_2, burst_ccr);
+    burst_state = BURST_DONE;
+    Sched_Post(SCHED_EVT_ADC);
+}
+
+/**
+  * @brief  对半个缓冲（一块扫描）按通道累加，满 ADC_DUMP_BLOCKS 块时输出并清零（DMA 中断中调用）
+  * @param  p: 该块第一轮扫描的起始地址
+  * @param  half: 0 = 前半块，1 = 后半块
+  */
+static void ADC_Block_Process(const uint16_t *p, uint8_t half)
+{
+    uint16_t i, ch;
+    if (burst_state == BURST_ARMED && half == burst_half) {
+        burst_state = BURST_RUN;
+        ADC_Burst_Copy(p + burst_skip * ADC_CHANNELS, ADC_BLOCK_SCANS - burst_skip);
+        return;
+    }
+    if (burst_state == BURST_RUN) {
+        ADC_Burst_Copy(p, ADC_BLOCK_SCANS);
+        return;
+    }
+    if (burst_state == BURST_ARMED) return;   // 启动前的半块（常速 / 快速扫描混合），不累加
+
+#if ADC_MEDIAN3
+    if (!adc_med_valid) {
+        for (ch = 0; ch < ADC_CHANNELS; ch++)
+            adc_med[ch][0] = adc_med[ch][1] = p[ch];
+        adc_med_valid = 1;
+    }
+    for (i = 0; i < ADC_BLOCK_SCANS; i++, p += ADC_CHANNELS)
+        for (ch = 0; ch < ADC_CHANNELS; ch++) {
+            adc_acc[ch] += ADC_Median3(adc_med[ch][0], adc_med[ch][1], p[ch]);
+            adc_med[ch][0] = adc_med[ch][1];
+            adc_med[ch][1] = p[ch];
+        }
+#else
+    for (i = 0; i < ADC_BLOCK_SCANS; i++, p += ADC_CHANNELS)
+        for (ch = 0; ch < ADC_CHANNELS; ch++)
+            adc_acc[ch] += p[ch];
+#endif
+    if (++adc_acc_blocks < ADC_DUMP_BLOCKS) return;
+
+    adc_latest.seq = adc_seq++;
+    for (ch = 0; ch < ADC_CHANNELS; ch++) {
+        adc_latest.val[ch] = (uint16_t)(adc_acc[ch] >> ADC_DUMP_SHIFT);
+        adc_acc[ch] = 0;
+    }
+    adc_acc_blocks = 0;
+    adc_fresh = 1;
+    Sched_Post(SCHED_EVT_ADC);
+}
+
+// DMA 半满：前半块写完，DMA 转去写后半块
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc)
+{
+    if (hadc->Instance == ADC1) {
+        PROF_START(t0);
+        ADC_Block_Process(&adc_dma_buf.h[0], 0);
+        PROF_STOP(PROF_ADC_BLOCK, t0);
+    }
+}
+
+// DMA 全满：后半块写完，DMA 回到缓冲开头
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
+{
+    if (hadc->Instance == ADC1) {
+        PROF_START(t0);
+        ADC_Block_Process(&adc_dma_buf.h[ADC_BLOCK_SCANS * ADC_CHANNELS], 1);
+        PROF_STOP(PROF_ADC_BLOCK, t0);
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * adc_block.h
+ *
+ *  ADC1 + ADC2 规则同步块采集：DMA 以 32 位字循环写入乒乓缓冲，半满 / 全满中断各交出一整块扫描，
+ *  再由累加-倾倒抽取器（accumulate-and-dump）合并成低速率、高分辨率的输出值。
+ *  瞬态采集（ADC_Burst_Arm）：临时把扫描频率提到 ADC_BURST_RATE_HZ，把接下来 ADC_BURST_SCANS 轮扫描中
+ *  一个工位两路磁场的原始值逐点存入 RAM，期间抽取器暂停（所有工位都不出新值），采满后恢复原扫描频率。
+ */
+#ifndef ADC_BLOCK_H_
+#define ADC_BLOCK_H_
+
+#include "stm32f1xx_hal.h"
+
+#define ADC_SLOTS            2   // 夹具工位数（每个工位一对线圈，占 ADC_SLOT_CHANNELS 个通道，与 MX_ADC1_Init / MX_ADC2_Init 一致）
+#define ADC_SLOT_CHANNELS    4   // 每个工位的通道数：tx_R rx_R tx_B rx_B（顺序见 measure.h 的 CH_*）
+#define ADC_CHANNELS         (ADC_SLOTS * ADC_SLOT_CHANNELS) // 每轮扫描的通道数：工位 1 = 秩 1 ADC1 IN2 | ADC2 IN3、秩 2 ADC1 IN7 | ADC2 IN6，
+                                                             // 工位 2 = 秩 3 ADC1 IN10 | ADC2 IN11、秩 4 ADC1 IN12 | ADC2 IN13
+#define ADC_RANKS            (ADC_CHANNELS / 2) // 每个 ADC 的规则组长度（与 MX_ADC1_Init / MX_ADC2_Init 一致）
+#define ADC_BLOCK_SCANS_LOG2 5
+#define ADC_BLOCK_SCANS      (1u << ADC_BLOCK_SCANS_LOG2) // 每块扫描数（半个 DMA 缓冲；缓冲共 2 × 32 轮 × ADC_CHANNELS 通道）
+
+/*
+ * 抽取器配置：每个输出值累加 2^ADC_OSR_LOG2 轮扫描，右移后以 ADC_RES_BITS 位输出。
+ *   输出速率 = ADC_SCAN_RATE_HZ / 2^ADC_OSR_LOG2（默认 1 kHz / 64 = 15.6 Hz）；
+ *   白噪声下每 4 倍过采样多得 1 位有效分辨率，ADC_RES_BITS 超过 12 + ADC_OSR_LOG2 / 2 只是多保留噪声位。
+ */
+#define ADC_OSR_LOG2  6
+#define ADC_RES_BITS  15
+#define ADC_OUT_SCALE (1u << (ADC_RES_BITS - 12))   // 输出值 = 平均原始值 × ADC_OUT_SCALE（满量程 4095 × ADC_OUT_SCALE）
+
+/*
+ * 累加前的 3 点滑动中值（每通道每点 2~3 次比较）：单点尖峰（继电器触点抖动、ADC 毛刺）被相邻两点替换，
+ * 不会被平均进输出；阶跃只延后一轮扫描（1 ms）。0 = 直接累加原始值。
+ */
+#define ADC_MEDIAN3   1
+
+#if ADC_OSR_LOG2 < ADC_BLOCK_SCANS_LOG2 || ADC_OSR_LOG2 > 20
+#error "ADC_OSR_LOG2 must be 5..20 (whole blocks, 32-bit sums)"
+#endif
+#if ADC_RES_BITS < 12 || ADC_RES_BITS - 12 > ADC_OSR_LOG2 || ADC_RES_BITS > 16
+#error "ADC_RES_BITS must be 12..16 and at most 12 + ADC_OSR_LOG2"
+#endif
+
+/*
+ * 瞬态采集配置：只保存一个工位两路磁场（ADC_Burst_Arm 指定的 first_ch 及其下一路，即该工位的 tx_B / rx_B）
+ * 的 12 位原始值，交错存放。同一时刻只有一个工位能做瞬态采集（缓冲只有一份）。
+ *   第 k 轮扫描的时刻 = 启动后 ADC_BURST_T0_US + k × ADC_BURST_PERIOD_US（默认 10 kHz × 512 轮 = 51.2 ms，2 KB RAM）；
+ *   ADC_BURST_RATE_HZ 受扫描时间限制（四秩约 84 us），不应超过约 11 kHz。
+ */
+#define ADC_BURST_SCANS     512
+#define ADC_BURST_RATE_HZ   10000U
+#define ADC_BURST_CHANNELS  2
+#define ADC_BURST_PERIOD_US (1000000U / ADC_BURST_RATE_HZ)
+#define ADC_BURST_T0_US     (ADC_BURST_PERIOD_US * 3 / 2) // 启动时正在转换的一轮和其后一轮被丢弃，第 0 轮在半个周期处触发
+                                                          // （relay.c 在 TIM2 更新中断里同时切换继电器并启动，即从切换时刻算起）
+
+// 一个抽取输出（同一输出内各通道来自相同的扫描；val[2k]/val[2k + 1] 两两为同一时刻的采样）
+typedef struct {
+    uint32_t seq;                  // 输出序号（从 0 递增；与上次相差大于 1 说明主循环漏取了输出）
+    uint16_t val[ADC_CHANNELS];    // 各通道 ADC_RES_BITS 位输出值
+} adc_sample_t;
+
+// 三个数的中值
+static inline uint16_t ADC_Median3(uint16_t a, uint16_t b, uint16_t c)
+{
+    uint16_t t;
+    if (a > b) { t = a; a = b; b = t; }
+    return c <= a ? a : c >= b ? b : c;
+}
+
+void ADC_Block_Start(ADC_HandleTypeDef *master, ADC_HandleTypeDef *slave);
+uint8_t ADC_Block_Get(adc_sample_t *out);
+uint8_t ADC_Burst_Arm(TIM_HandleTypeDef *htim, uint8_t first_ch);
+const uint16_t *ADC_Burst_Take(uint8_t *first_ch);
+
+#endif /* ADC_BLOCK_H_ */
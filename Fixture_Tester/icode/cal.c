@@ -0,0 +1,106 @@
+/*
+ * cal.c
+ *
+ *  标定记录读写。写 flash 期间 CPU 取指暂停（擦页约 20 ms，写一条约 1 ms），
+ *  调用者只应在没有测量进行时保存（主程序在空闲 / 完成状态才接受 HOST_CMD_SAVE_CAL）。
+ */
+#include "cal.h"
+#include "telemetry.h"
+#include <stddef.h>
+#include <string.h>
+
+static uint32_t cal_seq;      // 当前记录的保存序号（0 = 尚未保存过）
+
+static const cal_record_t *cal_slot(uint32_t i)
+{
+    return (const cal_record_t *)(CAL_FLASH_ADDR + i * sizeof(cal_record_t));
+}
+
+static uint16_t cal_crc(const cal_record_t *r)
+{
+    return Telemetry_CRC16((const uint8_t *)r, (uint16_t)offsetof(cal_record_t, crc), 0xFFFF);
+}
+
+// 1 = 该格全部为擦除状态（可直接写入）
+static uint8_t cal_slot_blank(uint32_t i)
+{
+    const uint32_t *w = (const uint32_t *)cal_slot(i);
+    uint32_t k;
+    for (k = 0; k < sizeof(cal_record_t) / 4; k++)
+        if (w[k] != 0xFFFFFFFFu) return 0;
+    return 1;
+}
+
+/**
+  * @brief  读取 flash 中最新的有效标定记录
+  * @param  c: 换算常数（调用前填默认值；无有效记录时不修改）
+  * @param  l: 判定上下限（同上）
+  * @retval 1 已从 flash 载入；0 无有效记录，保持默认值
+  */
+uint8_t Cal_Load(cal_consts_t *c, cal_limits_t *l)
+{
+    const cal_record_t *r, *best = NULL;
+    uint32_t i;
+
+    for (i = 0; i < CAL_SLOTS; i++) {
+        r = cal_slot(i);
+        if (r->magic == 0xFFFFFFFFu) break;   // 之后的格尚未使用
+        if (r->magic != CAL_MAGIC || r->version != CAL_VERSION || r->size != sizeof(cal_record_t) ||
+            r->crc != cal_crc(r))
+            continue;                         // 写入中断电或旧版本的记录
+        if (!best || r->seq > best->seq) best = r;
+    }
+    if (!best) return 0;
+    *c = best->consts;
+    *l = best->limits;
+    cal_seq = best->seq;
+    return 1;
+}
+
+/**
+  * @brief  追加保存一条标定记录（页已写满时先擦除整页）
+  * @retval 1 已写入并校验通过；0 flash 操作失败
+  */
+uint8_t Cal_Save(const cal_consts_t *c, const cal_limits_t *l)
+{
+    cal_record_t rec;
+    FLASH_EraseInitTypeDef erase;
+    uint32_t i, k, addr, page_err;
+    const uint32_t *w = (const uint32_t *)&rec;
+    uint8_t ok = 1;
+
+    memset(&rec, 0xFF, sizeof(rec));
+    rec.magic = CAL_MAGIC;
+    rec.version = CAL_VERSION;
+    rec.size = sizeof(cal_record_t);
+    rec.seq = cal_seq + 1;
+    rec.consts = *c;
+    rec.limits = *l;
+    rec.crc = cal_crc(&rec);
+
+    for (i = 0; i < CAL_SLOTS && !cal_slot_blank(i); i++)
+        ;
+    HAL_FLASH_Unlock();
+    if (i == CAL_SLOTS) {
+        erase.TypeErase = FLASH_TYPEERASE_PAGES;
+        erase.Banks = FLASH_BANK_1;
+        erase.PageAddress = CAL_FLASH_ADDR;
+        erase.NbPages = 1;
+        ok = HAL_FLASHEx_Erase(&erase, &page_err) == HAL_OK;
+        i = 0;
+    }
+    addr = CAL_FLASH_ADDR + i * sizeof(cal_record_t);
+    for (k = 0; ok && k < sizeof(rec) / 4; k++, addr += 4)
+        ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr, w[k]) == HAL_OK;
+    HAL_FLASH_Lock();
+
+    if (!ok || memcmp(cal_slot(i), &rec, sizeof(rec)) != 0) return 0;
+    cal_seq = rec.seq;
+    return 1;
+}
+
+// 当前记录的保存序号（0 = 使用编译期默认值）
+uint32_t Cal_Seq(void)
+{
+    return cal_seq;
+}
@@ -0,0 +1,39 @@
+/*
+ * cal.h
+ *
+ *  标定常数与判定上下限的 flash 持久化：保留 flash 最后一页（不在 Keil IROM 范围内，重新下载程序不会擦除），
+ *  每次保存在页内追加一条带版本号和 CRC 的记录，上电时取序号最大的有效记录；页写满才整页擦除。
+ *  无有效记录（新板、版本不符、CRC 错）时保持调用者给的编译期默认值。
+ */
+#ifndef CAL_H_
+#define CAL_H_
+
+#include "stm32f1xx_hal.h"
+#include "measure.h"
+
+#define CAL_FLASH_ADDR  0x0803F800u   // STM32F103RC 最后一页（FLASH_PAGE_SIZE = 2 KB）
+#define CAL_MAGIC       0x4C414346u   // "FCAL"
+#define CAL_VERSION     1
+
+// 换算常数与判定上下限（定义见 measure.h，含义见其中同名的默认值宏）
+typedef meas_consts_t cal_consts_t;
+typedef meas_limits_t cal_limits_t;
+
+// flash 中的一条记录（40 字节，按字写入）
+typedef struct {
+    uint32_t magic;           // CAL_MAGIC
+    uint16_t version;         // CAL_VERSION
+    uint16_t size;            // sizeof(cal_record_t)
+    uint32_t seq;             // 保存序号（页内最大者为当前记录）
+    cal_consts_t consts;
+    cal_limits_t limits;
+    uint16_t crc;             // CRC-16/CCITT-FALSE，覆盖 magic 至 limits
+} cal_record_t;
+
+#define CAL_SLOTS (FLASH_PAGE_SIZE / sizeof(cal_record_t))
+
+uint8_t Cal_Load(cal_consts_t *c, cal_limits_t *l);
+uint8_t Cal_Save(const cal_consts_t *c, const cal_limits_t *l);
+uint32_t Cal_Seq(void);
+
+#endif /* CAL_H_ */
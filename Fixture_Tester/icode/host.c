@@ -0,0 +1,151 @@
+/*
+ * host.c
+ *
+ *  USART3 上位机命令接收：DMA 循环写 host_rx_buf，半满 / 全满 / 空闲线中断都只更新写入位置；
+ *  Host_Poll 从上次读到的位置逐字节喂给解帧状态机，整帧 CRC 正确才交给处理函数。
+ *  串口错误（噪声、帧错误、溢出）会让 HAL 停止接收，在错误回调里重新启动。
+ */
+#include "host.h"
+#include "telemetry.h"
+#include "sched.h"
+
+extern UART_HandleTypeDef huart3;
+
+static uint8_t host_rx_buf[HOST_RX_BUF_SIZE];
+static volatile uint16_t host_rx_wr;    // DMA 写入位置（中断更新）
+static uint16_t host_rx_rd;             // 已解析到的位置
+static volatile uint8_t host_rx_restart; // 1 = 接收已重新启动，Host_Poll 需从缓冲开头重新对齐
+static uint32_t host_bad_frames;        // CRC 错误或长度超限的帧数
+
+// 解帧状态
+enum { RX_SOF0, RX_SOF1, RX_TYPE, RX_SEQ, RX_LEN, RX_PAYLOAD, RX_CRC_LO, RX_CRC_HI };
+static uint8_t rx_state = RX_SOF0;
+static uint8_t rx_type, rx_len, rx_n;
+static uint8_t rx_payload[TLM_MAX_PAYLOAD];
+static uint16_t rx_crc;
+
+/**
+  * @brief  启动 DMA 循环接收（MX_USART3_UART_Init 之后调用）
+  */
+void Host_Start(void)
+{
+    host_rx_wr = host_rx_rd = 0;
+    HAL_UARTEx_ReceiveToIdle_DMA(&huart3, host_rx_buf, HOST_RX_BUF_SIZE);
+}
+
+// 半满 / 全满 / 空闲线：Size 为 DMA 当前写入位置
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+    if (huart->Instance != USART3) return;
+    host_rx_wr = Size < HOST_RX_BUF_SIZE ? Size : 0;
+    Sched_Post(SCHED_EVT_HOST);
+}
+
+// USART3 出错：发送部分交给遥测模块，接收被 HAL 终止时重新启动
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+    if (huart->Instance != USART3) return;
+    Telemetry_OnError(huart);
+    if (huart->RxState == HAL_UART_STATE_READY) {
+        host_rx_wr = 0;
+        host_rx_restart = 1;
+        HAL_UARTEx_ReceiveToIdle_DMA(&huart3, host_rx_buf, HOST_RX_BUF_SIZE);
+        Sched_Post(SCHED_EVT_HOST);
+    }
+}
+
+/**
+  * @brief  解帧状态机：喂入一个字节
+  * @retval 1 收到一帧完整且 CRC 正确的命令（rx_type / rx_payload / rx_len）
+  */
+static uint8_t host_feed(uint8_t b)
+{
+    switch (rx_state) {
+    case RX_SOF0:
+        if (b == TLM_SOF0) rx_state = RX_SOF1;
+        break;
+    case RX_SOF1:
+        rx_state = b == TLM_SOF1 ? RX_TYPE : (b == TLM_SOF0 ? RX_SOF1 : RX_SOF0);
+        break;
+    case RX_TYPE:
+        rx_type = b;
+        rx_crc = Telemetry_CRC16(&b, 1, 0xFFFF);
+        rx_state = RX_SEQ;
+        break;
+    case RX_SEQ:
+        rx_crc = Telemetry_CRC16(&b, 1, rx_crc);
+        rx_state = RX_LEN;
+        break;
+    case RX_LEN:
+        if (b > TLM_MAX_PAYLOAD) {
+            host_bad_frames++;
+            rx_state = RX_SOF0;
+            break;
+        }
+        rx_len = b;
+        rx_n = 0;
+        rx_crc = Telemetry_CRC16(&b, 1, rx_crc);
+        rx_state = rx_len ? RX_PAYLOAD : RX_CRC_LO;
+        break;
+    case RX_PAYLOAD:
+        rx_payload[rx_n++] = b;
+        rx_crc = Telemetry_CRC16(&b, 1, rx_crc);
+        if (rx_n == rx_len) rx_state = RX_CRC_LO;
+        break;
+    case RX_CRC_LO:
+        if (b != (uint8_t)rx_crc) {
+            host_bad_frames++;
+            rx_state = b == TLM_SOF0 ? RX_SOF1 : RX_SOF0;
+            break;
+        }
+        rx_state = RX_CRC_HI;
+        break;
+    case RX_CRC_HI:
+        rx_state = RX_SOF0;
+        if (b == (uint8_t)(rx_crc >> 8)) return 1;
+        host_bad_frames++;
+        if (b == TLM_SOF0) rx_state = RX_SOF1;
+        break;
+    }
+    return 0;
+}
+
+/**
+  * @brief  解析自上次调用以来收到的字节，每收到一条有效命令调用一次 handler（主循环中调用）
+  * @param  handler: 命令处理函数
+  */
+void Host_Poll(host_handler_t handler)
+{
+    uint16_t wr;
+    if (host_rx_restart) {              // 出错前的残帧作废
+        host_rx_restart = 0;
+        host_rx_rd = 0;
+        rx_state = RX_SOF0;
+    }
+    wr = host_rx_wr;
+    while (host_rx_rd != wr) {
+        uint8_t b = host_rx_buf[host_rx_rd];
+        host_rx_rd = (host_rx_rd + 1) % HOST_RX_BUF_SIZE;
+        if (host_feed(b))
+            handler(rx_type, rx_payload, rx_len);
+    }
+}
+
+/**
+  * @brief  回一帧应答
+  * @param  cmd: 命令类型
+  * @param  status: HOST_OK / HOST_ERR_*
+  */
+void Host_Ack(uint8_t cmd, uint8_t status)
+{
+    uint8_t buf[2];
+    buf[0] = cmd;
+    buf[1] = status;
+    Telemetry_Send(TLM_TYPE_ACK, buf, 2);
+}
+
+// CRC 错误或长度超限的帧数
+uint32_t Host_BadFrames(void)
+{
+    return host_bad_frames;
+}
@@ -0,0 +1,68 @@
+/*
+ * host.h
+ *
+ *  USART3 上位机命令：与遥测相同的帧格式（见 telemetry.h），上位机 → 测试仪方向。
+ *  RX 用 DMA 循环接收 + 空闲线检测（HAL_UARTEx_ReceiveToIdle_DMA），中断只记下 DMA 写入位置
+ *  并投递 SCHED_EVT_HOST；由主循环的 Host_Poll 解帧、校验 CRC，再交给命令处理函数。
+ *
+ *  命令（负载中多字节字段为小端）:
+ *    HOST_CMD_START       [u8 slot]     开始工位 slot（默认 0）的一次测试（该工位空闲或完成状态；测量中应答 BUSY，
+ *                                       工位不存在应答 RANGE）
+ *    HOST_CMD_ABORT       [u8 slot]     中止工位 slot 的测试（默认全部工位），断开继电器，回到空闲
+ *    HOST_CMD_GET_RESULT  无负载        重发最近一次完成的测试（任一工位）的 TLM_TYPE_RESULT 帧（尚无结果应答 NODATA）
+ *    HOST_CMD_GET_LIMITS  无负载        回 TLM_TYPE_LIMITS 帧
+ *    HOST_CMD_SET_LIMITS  5 × i16       tx_R_min tx_R_max rx_R_min rx_R_max eps（0.01 Ω），回 LIMITS 帧
+ *    HOST_CMD_SET_STREAM  u8 n          实时采样流：每 n 个抽取输出一帧，0 = 关闭
+ *    HOST_CMD_SET_AUTO    u8 on         自动模式：检测到工件放入即开始测试，取走后重新待命（1 = 开）
+ *    HOST_CMD_SET_WAVE    u8 on         每次测试后上传继电器切换瞬态波形（TLM_TYPE_WAVE，1 = 开）
+ *    HOST_CMD_GET_CAL     无负载        回 TLM_TYPE_CAL 帧
+ *    HOST_CMD_SET_CAL     4 × i32       vref_uv r_centi_per_v r_zero_centi b_uv_per_centi（见 cal.h），立即生效，回 CAL 帧
+ *    HOST_CMD_SAVE_CAL    无负载        把当前换算常数和判定上下限写入 flash（所有工位空闲或完成；写入失败应答 FLASH）
+ *    HOST_CMD_GET_STATS   无负载        回 4 帧 TLM_TYPE_STATS（本班统计）
+ *    HOST_CMD_RESET_STATS 无负载        清零统计，开始新的一班
+ *    HOST_CMD_DUMP_LOG    [u32 from]    导出 flash 结果日志中 seq >= from（默认 0 = 全部）的记录（所有工位空闲或完成），
+ *                                       成功时不回 ACK，以 TLM_TYPE_LOG 记录帧和结束帧（带丢弃记录数）作答
+ *    HOST_CMD_GET_PROF    [u8 reset]    回各剖析探针的 TLM_TYPE_PROF 帧，reset = 1 时发送后清零（未编译探针应答 NODATA）
+ *  除 GET_RESULT / GET_LIMITS / SET_LIMITS / GET_CAL / SET_CAL / GET_STATS / DUMP_LOG / GET_PROF 成功时回数据帧外，每条命令回一帧 TLM_TYPE_ACK:
+ *    u8 命令类型 | u8 状态（HOST_OK / HOST_ERR_*）
+ */
+#ifndef HOST_H_
+#define HOST_H_
+
+#include "stm32f1xx_hal.h"
+
+#define HOST_RX_BUF_SIZE     64     // DMA 循环接收缓冲（两次 Host_Poll 之间最多收这么多字节）
+
+#define HOST_CMD_START       0x81
+#define HOST_CMD_ABORT       0x82
+#define HOST_CMD_GET_RESULT  0x83
+#define HOST_CMD_GET_LIMITS  0x84
+#define HOST_CMD_SET_LIMITS  0x85
+#define HOST_CMD_SET_STREAM  0x86
+#define HOST_CMD_SET_AUTO    0x87
+#define HOST_CMD_SET_WAVE    0x88
+#define HOST_CMD_GET_CAL     0x89
+#define HOST_CMD_SET_CAL     0x8A
+#define HOST_CMD_SAVE_CAL    0x8B
+#define HOST_CMD_GET_STATS   0x8C
+#define HOST_CMD_RESET_STATS 0x8D
+#define HOST_CMD_DUMP_LOG    0x8E
+#define HOST_CMD_GET_PROF    0x8F
+
+#define HOST_OK              0
+#define HOST_ERR_BUSY        1      // 当前状态不能执行该命令
+#define HOST_ERR_LEN         2      // 负载长度不对
+#define HOST_ERR_UNKNOWN     3      // 未知命令
+#define HOST_ERR_NODATA      4      // 尚无数据
+#define HOST_ERR_RANGE       5      // 参数超出范围
+#define HOST_ERR_FLASH       6      // flash 擦写失败
+
+// 命令处理函数：type 为命令类型，payload / len 为已通过 CRC 校验的负载
+typedef void (*host_handler_t)(uint8_t type, const uint8_t *payload, uint8_t len);
+
+void Host_Start(void);
+void Host_Poll(host_handler_t handler);
+void Host_Ack(uint8_t cmd, uint8_t status);
+uint32_t Host_BadFrames(void);
+
+#endif /* HOST_H_ */
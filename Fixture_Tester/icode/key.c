@@ -0,0 +1,72 @@
+/*
+ * key.c
+ *
+ *  KEY_C 按键驱动：
+ *  EXTI 中断只记下边沿时刻并屏蔽该线；SysTick 每 1 ms 调 Key_Tick，边沿后 KEY_DEBOUNCE_MS
+ *  读一次电平，与上次稳定电平不同时投递 KEY_EVT_PRESS / KEY_EVT_RELEASE，再重新打开 EXTI。
+ *  抖动期间的边沿都被屏蔽，一次按下只产生一个事件；主循环用 Key_GetEvent 取事件，从不等待。
+ */
+#include "key.h"
+#include "sched.h"
+
+static volatile uint8_t key_wait;       // 1 = 已收到边沿，等待消抖到期（EXTI 已屏蔽）
+static volatile uint32_t key_edge_tick; // 边沿时刻（HAL_GetTick）
+static GPIO_PinState key_level;         // 上次消抖后的稳定电平（仅 SysTick 中断访问）
+
+static volatile uint8_t key_q[KEY_EVT_QUEUE]; // 事件队列：SysTick 中断写，主循环读
+static volatile uint8_t key_q_head, key_q_tail;
+
+/**
+  * @brief  记下当前电平作为初始稳定状态（在 MX_GPIO_Init 之后调用）
+  */
+void Key_Init(void)
+{
+    key_level = HAL_GPIO_ReadPin(KEY_C_GPIO_Port, KEY_C_Pin);
+}
+
+// EXTI：记下边沿时刻，屏蔽该线直到消抖结束
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+    if (GPIO_Pin != KEY_C_Pin) return;
+    EXTI->IMR &= ~(uint32_t)KEY_C_Pin;
+    key_edge_tick = HAL_GetTick();
+    key_wait = 1;
+}
+
+/**
+  * @brief  消抖定时（SysTick_Handler 中每 1 ms 调用）
+  */
+void Key_Tick(void)
+{
+    GPIO_PinState level;
+    uint8_t next;
+
+    if (!key_wait || HAL_GetTick() - key_edge_tick < KEY_DEBOUNCE_MS) return;
+    key_wait = 0;
+
+    // 先清挂起位并打开 EXTI，再读电平：读之后的变化会重新触发一次消抖
+    __HAL_GPIO_EXTI_CLEAR_IT(KEY_C_Pin);
+    EXTI->IMR |= KEY_C_Pin;
+    level = HAL_GPIO_ReadPin(KEY_C_GPIO_Port, KEY_C_Pin);
+    if (level == key_level) return;     // 抖动后回到原电平：不是一次有效按键
+    key_level = level;
+
+    next = (key_q_head + 1) & (KEY_EVT_QUEUE - 1);
+    if (next == key_q_tail) return;     // 队列满（主循环长时间未取）：丢弃新事件
+    key_q[key_q_head] = (level == KEY_PRESSED_LEVEL) ? KEY_EVT_PRESS : KEY_EVT_RELEASE;
+    key_q_head = next;
+    Sched_Post(SCHED_EVT_KEY);
+}
+
+/**
+  * @brief  取一个按键事件（不等待）
+  * @retval KEY_EVT_PRESS / KEY_EVT_RELEASE；没有事件时为 KEY_EVT_NONE
+  */
+key_event_t Key_GetEvent(void)
+{
+    key_event_t evt;
+    if (key_q_tail == key_q_head) return KEY_EVT_NONE;
+    evt = (key_event_t)key_q[key_q_tail];
+    key_q_tail = (key_q_tail + 1) & (KEY_EVT_QUEUE - 1);
+    return evt;
+}
@@ -0,0 +1,26 @@
+/*
+ * key.h
+ *
+ *  KEY_C 按键：EXTI 双边沿中断 + SysTick 定时消抖，按下 / 松开作为事件交给主循环，
+ *  主循环不再用 HAL_Delay 消抖，也不在按住期间死等松开。
+ */
+#ifndef KEY_H_
+#define KEY_H_
+
+#include "main.h"
+
+#define KEY_DEBOUNCE_MS  20             // 边沿后等待这么久再读电平（期间屏蔽该 EXTI 线）
+#define KEY_PRESSED_LEVEL GPIO_PIN_SET  // 按下时 KEY_C 的电平
+#define KEY_EVT_QUEUE    4              // 事件队列长度（2 的幂）
+
+typedef enum {
+    KEY_EVT_NONE = 0,
+    KEY_EVT_PRESS,      // 按下（消抖后）
+    KEY_EVT_RELEASE     // 松开（消抖后）
+} key_event_t;
+
+void Key_Init(void);
+void Key_Tick(void);
+key_event_t Key_GetEvent(void);
+
+#endif /* KEY_H_ */
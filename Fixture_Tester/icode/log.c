@@ -0,0 +1,187 @@
+/*
+ * log.c
+ *
+ *  上电时扫描整个日志区，序号最大的有效记录之后即为写入位置；断电时写了一半的格 CRC 不符，
+ *  读取时跳过，写入时也跳过（直到下一次擦到该页）。每条记录写 4 个字约 0.2 ms，
+ *  进入新的一页时先擦除该页（约 20 ms），都只发生在 Log_Flush 中。
+ */
+#include "log.h"
+#include <stddef.h>
+#include <string.h>
+
+static uint32_t log_head;              // 下一条记录写入的格
+static uint32_t log_seq;               // 最近写入（或排队）的记录序号
+static log_record_t log_queue[LOG_QUEUE];
+static uint8_t log_queued;
+static uint32_t log_dropped;           // 队列满丢弃的记录数
+
+static uint8_t dump_active;            // 1 = 正在导出
+static uint32_t dump_pos, dump_left;   // 下一个要检查的格、剩余格数
+static uint32_t dump_from;             // 只导出 seq >= dump_from 的记录
+
+static const log_record_t *log_slot(uint32_t i)
+{
+    return (const log_record_t *)(LOG_FLASH_ADDR + i * sizeof(log_record_t));
+}
+
+static uint8_t log_crc(const log_record_t *r)
+{
+    return (uint8_t)Telemetry_CRC16((const uint8_t *)r, (uint16_t)offsetof(log_record_t, crc), 0xFFFF);
+}
+
+static uint8_t log_valid(const log_record_t *r)
+{
+    return r->seq != 0xFFFFFFFFu && r->crc == log_crc(r);
+}
+
+static uint8_t log_blank(uint32_t i)
+{
+    const uint32_t *w = (const uint32_t *)log_slot(i);
+    return w[0] == 0xFFFFFFFFu && w[1] == 0xFFFFFFFFu && w[2] == 0xFFFFFFFFu && w[3] == 0xFFFFFFFFu;
+}
+
+/**
+  * @brief  扫描日志区，找到写入位置和最近的记录序号（上电时调用一次）
+  */
+void Log_Init(void)
+{
+    const log_record_t *r;
+    uint32_t i, last = LOG_SLOTS;
+
+    log_seq = 0;
+    for (i = 0; i < LOG_SLOTS; i++) {
+        r = log_slot(i);
+        if (log_valid(r) && r->seq >= log_seq) {
+            log_seq = r->seq;
+            last = i;
+        }
+    }
+    log_head = last == LOG_SLOTS ? 0 : (last + 1) % LOG_SLOTS;
+}
+
+static int16_t sat16(int32_t v) { return v > 32767 ? 32767 : v < -32768 ? -32768 : (int16_t)v; }
+
+/**
+  * @brief  记录一次测试结果（只放入 RAM 队列，不写 flash）
+  * @retval 1 已排队；0 队列已满（Log_Flush 太久没有运行），该记录丢弃
+  */
+uint8_t Log_Append(const tlm_result_t *r)
+{
+    log_record_t *e;
+    if (log_queued >= LOG_QUEUE) {
+        log_dropped++;
+        return 0;
+    }
+    e = &log_queue[log_queued++];
+    e->seq = ++log_seq;
+    e->tx_R = sat16(r->tx_R);
+    e->rx_R = sat16(r->rx_R);
+    e->tx_B = sat16(r->tx_B);
+    e->rx_B = sat16(r->rx_B);
+    e->cycle_ms = r->cycle_ms > 0xFFFF ? 0xFFFF : (uint16_t)r->cycle_ms;
+    e->flags = (uint8_t)((r->pass ? LOG_FLAG_PASS : 0) | r->slot << LOG_SLOT_SHIFT);
+    e->crc = log_crc(e);
+    return 1;
+}
+
+/**
+  * @brief  把 log_head 移到一个空白格：到达页首且该页有旧数据时擦除该页，页内非空白格（断电残留）跳过
+  * @retval HAL_OK 或擦除失败的状态
+  */
+static HAL_StatusTypeDef log_prepare_head(void)
+{
+    FLASH_EraseInitTypeDef erase;
+    uint32_t page_err;
+
+    while (!log_blank(log_head)) {
+        if (log_head % LOG_PER_PAGE == 0) {
+            erase.TypeErase = FLASH_TYPEERASE_PAGES;
+            erase.Banks = FLASH_BANK_1;
+            erase.PageAddress = LOG_FLASH_ADDR + log_head * sizeof(log_record_t);
+            erase.NbPages = 1;
+            if (HAL_FLASHEx_Erase(&erase, &page_err) != HAL_OK) return HAL_ERROR;
+        } else {
+            log_head = (log_head + 1) % LOG_SLOTS;
+        }
+    }
+    return HAL_OK;
+}
+
+/**
+  * @brief  把排队的记录成批写入 flash（会暂停 CPU 取指，只在没有测量进行时调用）
+  *         擦除或写入失败时停止，未写成的记录留在队列中下次重试（写失败的格跳过，换下一格重写）
+  */
+void Log_Flush(void)
+{
+    uint32_t addr, k;
+    uint8_t i;
+    const uint32_t *w;
+
+    if (!log_queued) return;
+    HAL_FLASH_Unlock();
+    for (i = 0; i < log_queued; i++) {
+        if (log_prepare_head() != HAL_OK) break;
+        w = (const uint32_t *)&log_queue[i];
+        addr = LOG_FLASH_ADDR + log_head * sizeof(log_record_t);
+        for (k = 0; k < sizeof(log_record_t) / 4; k++, addr += 4)
+            if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr, w[k]) != HAL_OK) break;
+        log_head = (log_head + 1) % LOG_SLOTS;   // 写失败的格 CRC 不符，读取时跳过
+        if (k < sizeof(log_record_t) / 4) break;
+    }
+    HAL_FLASH_Lock();
+    log_queued -= i;
+    memmove(log_queue, &log_queue[i], log_queued * sizeof(log_record_t));
+}
+
+/**
+  * @brief  开始导出日志（从最旧的页开始，只导出 seq >= from_seq 的有效记录），由 Log_DumpPoll 发送
+  */
+void Log_DumpStart(uint32_t from_seq)
+{
+    // 写入位置在页首时该页尚未擦除，就是最旧的一页；否则写入页之后的一页最旧
+    dump_pos = log_head % LOG_PER_PAGE == 0 ? log_head
+             : ((log_head / LOG_PER_PAGE + 1) % LOG_PAGES) * LOG_PER_PAGE;
+    dump_left = LOG_SLOTS;
+    dump_from = from_seq;
+    dump_active = 1;
+}
+
+/**
+  * @brief  按遥测缓冲余量发送 TLM_TYPE_LOG 帧，导出完毕后发一帧只含 u32 丢弃记录数的 TLM_TYPE_LOG 作为结束（周期任务中调用）
+  */
+void Log_DumpPoll(void)
+{
+    log_record_t buf[LOG_DUMP_RECS];
+    const log_record_t *r;
+    uint8_t n, end[4];
+
+    while (dump_active) {
+        if (Telemetry_Free() < TLM_FRAME_LEN(sizeof(buf)) + LOG_DUMP_RESERVE) return;
+        for (n = 0; n < LOG_DUMP_RECS && dump_left; dump_left--, dump_pos = (dump_pos + 1) % LOG_SLOTS) {
+            r = log_slot(dump_pos);
+            if (log_valid(r) && r->seq >= dump_from) buf[n++] = *r;
+        }
+        if (n) {
+            Telemetry_Send(TLM_TYPE_LOG, (const uint8_t *)buf, (uint8_t)(n * sizeof(log_record_t)));
+        } else if (!dump_left) {
+            end[0] = (uint8_t)log_dropped;
+            end[1] = (uint8_t)(log_dropped >> 8);
+            end[2] = (uint8_t)(log_dropped >> 16);
+            end[3] = (uint8_t)(log_dropped >> 24);
+            Telemetry_Send(TLM_TYPE_LOG, end, sizeof(end));
+            dump_active = 0;
+        }
+    }
+}
+
+// 最近一条记录的序号（0 = 日志为空）
+uint32_t Log_LastSeq(void)
+{
+    return log_seq;
+}
+
+// 队列满丢弃的记录数
+uint32_t Log_Dropped(void)
+{
+    return log_dropped;
+}
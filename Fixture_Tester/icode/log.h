@@ -0,0 +1,45 @@
+/*
+ * log.h
+ *
+ *  测试结果日志：每次测试一条 16 字节记录，只追加写入 flash 的 LOG_PAGES 页环形区（在标定页之前），
+ *  写满一圈后擦除最旧的一页继续写，各页轮流擦除（每页每 LOG_SLOTS 条记录擦一次）。
+ *  Log_Append 只把记录放入 RAM 队列，由 Log_Flush 在没有测量进行时成批写入，测量过程中从不写 flash；
+ *  擦写失败的记录留在队列中重试，队列满时才丢弃并计数（随导出结束帧上报）。
+ *  上位机 HOST_CMD_DUMP_LOG 按从旧到新的顺序经遥测导出（TLM_TYPE_LOG）。
+ */
+#ifndef LOG_H_
+#define LOG_H_
+
+#include "stm32f1xx_hal.h"
+#include "telemetry.h"
+
+#define LOG_FLASH_ADDR  0x0803B800u   // 日志区起始（紧接在 CAL_FLASH_ADDR 之前的 LOG_PAGES 页）
+#define LOG_PAGES       8
+#define LOG_QUEUE       (8 * ADC_SLOTS) // RAM 中待写入的记录数上限（只在所有工位都没有测量时写入）
+#define LOG_DUMP_RESERVE 64           // 导出时至少给其它遥测帧留的缓冲字节数
+
+// 一条记录（16 字节，按字写入；擦除状态 seq = 0xFFFFFFFF）
+typedef struct {
+    uint32_t seq;             // 记录序号（从 1 递增，擦页不复位，上位机据此增量导出）
+    int16_t tx_R, rx_R;       // 电阻（0.01 Ω，饱和到 16 位）
+    int16_t tx_B, rx_B;       // 磁场（0.01 单位）
+    uint16_t cycle_ms;        // 测试周期
+    uint8_t flags;            // bit0 = 合格，bit4~7 = 工位（旧版记录此字节为 0 / 1，读作工位 0）
+    uint8_t crc;              // CRC-16/CCITT-FALSE 低 8 位，覆盖前 15 字节
+} log_record_t;
+
+#define LOG_PER_PAGE (FLASH_PAGE_SIZE / sizeof(log_record_t))
+#define LOG_SLOTS    (LOG_PAGES * LOG_PER_PAGE)
+#define LOG_DUMP_RECS (TLM_MAX_PAYLOAD / sizeof(log_record_t))   // 每个 TLM_TYPE_LOG 帧的记录数
+#define LOG_FLAG_PASS  0x01
+#define LOG_SLOT_SHIFT 4
+
+void Log_Init(void);
+uint8_t Log_Append(const tlm_result_t *r);
+void Log_Flush(void);
+void Log_DumpStart(uint32_t from_seq);
+void Log_DumpPoll(void);
+uint32_t Log_LastSeq(void);
+uint32_t Log_Dropped(void);
+
+#endif /* LOG_H_ */
@@ -0,0 +1,132 @@
+/*
+ * measure.c
+ *
+ *  两阶段测量：MEAS_PHASE_R 中全部四路稳定（或超时）后捕获电阻和磁场背景值，
+ *  MEAS_PHASE_B 中两路磁场稳定（或超时）后捕获磁场值。稳定检测对每个通道只记一段
+ *  连续输出的最小 / 最大值和个数，每个输出 O(1)，不保留历史。
+ */
+#include "measure.h"
+#include <string.h>
+
+/**
+  * @brief  由换算常数计算定点换算系数（上电载入标定、上位机修改标定后调用）
+  * @param  full_counts: 满量程计数（4095 × ADC_OUT_SCALE）
+  * @note   R = (vref − v) × r_centi_per_v − r_zero，v = counts × vref / full_counts；B = Δv / b_uv_per_centi
+  */
+void Meas_ConvInit(meas_conv_t *c, const meas_consts_t *k, int32_t full_counts)
+{
+    const int64_t full = full_counts;
+    c->r_off_q16 = ((int64_t)k->vref_uv * k->r_centi_per_v * 65536) / 1000000 - ((int64_t)k->r_zero_centi << 16);
+    c->r_gain_q16 = ((int64_t)k->vref_uv * k->r_centi_per_v * 65536) / (full * 1000000);
+    c->b_gain_q16 = ((int64_t)k->vref_uv * 65536) / (full * k->b_uv_per_centi);
+}
+
+// 电阻通道：抽取输出原始值 → 电阻（0.01 Ω）
+int32_t Meas_R(const meas_conv_t *c, uint16_t counts)
+{
+    return (int32_t)((c->r_off_q16 - counts * c->r_gain_q16) / 65536);
+}
+
+// 磁场通道：相对背景的原始值之差 → 磁场（0.01 单位）
+int32_t Meas_B(const meas_conv_t *c, uint16_t counts, uint16_t offset)
+{
+    return (int32_t)(((int32_t)counts - offset) * c->b_gain_q16 / 65536);
+}
+
+// 开始新一段稳定检测（进入测量阶段、继电器切换后调用）
+static void settle_reset(meas_run_t *m)
+{
+    memset(m->settle, 0, sizeof(m->settle));
+    m->settle_skip = 1;
+}
+
+/**
+  * @brief  用一个抽取输出更新稳定检测
+  * @param  mask: 需要稳定的通道（位 ch 对应 val[ch]）
+  * @retval 1 mask 中所有通道都已连续 settle_count 个输出落在 settle_range 之内
+  * @note   新值使范围超出 settle_range 时从该值重新开始计数，缓慢漂移同样判为未稳定
+  */
+static uint8_t settle_update(meas_run_t *m, const meas_cfg_t *cfg, const uint16_t *val, uint8_t mask)
+{
+    uint8_t ch, stable = 1;
+    if (m->settle_skip) {
+        m->settle_skip--;
+        return 0;
+    }
+    for (ch = 0; ch < MEAS_CHANNELS; ch++) {
+        uint16_t v = val[ch];
+        uint16_t lo = m->settle[ch].lo < v ? m->settle[ch].lo : v;
+        uint16_t hi = m->settle[ch].hi > v ? m->settle[ch].hi : v;
+        if (m->settle[ch].n == 0 || hi - lo > cfg->settle_range) {
+            m->settle[ch].lo = m->settle[ch].hi = v;
+            m->settle[ch].n = 1;
+        } else {
+            m->settle[ch].lo = lo;
+            m->settle[ch].hi = hi;
+            if (m->settle[ch].n < 255) m->settle[ch].n++;
+        }
+        if ((mask & (1u << ch)) && m->settle[ch].n < cfg->settle_count) stable = 0;
+    }
+    return stable;
+}
+
+// 开始一次测试（now 同时作为测试周期的起点）
+void Meas_Begin(meas_run_t *m, uint32_t now)
+{
+    m->phase = MEAS_PHASE_R;
+    m->start_ms = now;
+    m->phase_ms = now;
+    settle_reset(m);
+}
+
+/**
+  * @brief  交给当前阶段一个抽取输出
+  * @param  val: MEAS_CHANNELS 路原始值（通道顺序同 CH_*）
+  * @param  now: 该输出的时刻（ms）
+  * @retval 本次输出结束了哪个阶段（MEAS_EV_NONE = 仍在等待）
+  */
+meas_ev_t Meas_Sample(meas_run_t *m, const meas_cfg_t *cfg, const meas_conv_t *c, const uint16_t *val, uint32_t now)
+{
+    uint8_t stable;
+
+    switch (m->phase) {
+    case MEAS_PHASE_R:
+        stable = settle_update(m, cfg, val, cfg->mask_wait);
+        if (!stable && now - m->phase_ms <= cfg->wait_timeout_ms) return MEAS_EV_NONE;
+        m->tx_B_offset = val[CH_TX_B];
+        m->rx_B_offset = val[CH_RX_B];
+        m->tx_R = Meas_R(c, val[CH_TX_R]);
+        m->rx_R = Meas_R(c, val[CH_RX_R]);
+        m->phase = MEAS_PHASE_B;
+        m->phase_ms = now;
+        settle_reset(m);          // 继电器即将切换，重新判断稳定
+        return MEAS_EV_R_DONE;
+    case MEAS_PHASE_B:
+        stable = settle_update(m, cfg, val, cfg->mask_capture);
+        if (!stable && now - m->phase_ms <= cfg->capture_timeout_ms) return MEAS_EV_NONE;
+        Meas_SetB(m, c, val[CH_TX_B], val[CH_RX_B]);
+        return MEAS_EV_B_DONE;
+    default:
+        return MEAS_EV_NONE;
+    }
+}
+
+// 由两路磁场原始值（抽取输出或瞬态末段平均）确定磁场值，结束测量
+void Meas_SetB(meas_run_t *m, const meas_conv_t *c, uint16_t tx_counts, uint16_t rx_counts)
+{
+    m->tx_B = Meas_B(c, tx_counts, m->tx_B_offset);   // 最终磁场值 = 当前测量值 - 背景值
+    m->rx_B = Meas_B(c, rx_counts, m->rx_B_offset);
+    m->phase = MEAS_PHASE_DONE;
+}
+
+/**
+  * @brief  判定：两路电阻在上下限（各放宽 eps）之内、两路磁场不为负
+  * @retval 1 合格
+  */
+uint8_t Meas_Judge(const meas_run_t *m, const meas_limits_t *l)
+{
+    return m->tx_R >= l->tx_r_min - l->eps && m->tx_R <= l->tx_r_max + l->eps &&
+           m->rx_R >= l->rx_r_min - l->eps && m->rx_R <= l->rx_r_max + l->eps &&
+           m->tx_B >= 0 &&
+           m->rx_B >= 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * measure.h
+ *
+ *  测量核心：抽取输出 → 电阻 / 磁场的定点换算、稳定检测、两阶段测量的时序和合格判定。
+ *  不依赖 HAL 和外设（只用 <stdint.h> / <string.h>），时间由调用者以毫秒传入：
+ *  固件传 HAL_GetTick()，上位机回放工具（sim/meas_replay.c）传记录数据中的时刻，两边走同一份代码。
+ *  显示、继电器、遥测等副作用由调用者按 Meas_Sample 返回的事件完成。
+ */
+#ifndef MEASURE_H_
+#define MEASURE_H_
+
+#include <stdint.h>
+
+#define MEAS_CHANNELS 4
+
+// 四路测量在ADC扫描序列（adc_smp.val[]）中的位置
+enum { CH_TX_R = 0, CH_RX_R = 1, CH_TX_B = 2, CH_RX_B = 3 };  // ADC1 IN2 / ADC2 IN3 同时采样，ADC1 IN7 / ADC2 IN6 同时采样
+
+// 测量值一律以 0.01 为单位的整数表示（电阻 0.01 Ω，磁场 0.01 单位），只在显示时换算成小数
+// 判定上下限与换算常数的默认值（固件运行时使用 flash 中的标定，可由上位机修改并保存，见 cal.h）
+#define TX_R_MIN  2800   // 发送端电阻最小值（28.00 Ω）
+#define TX_R_MAX  2900   // 发送端电阻最大值（29.00 Ω）
+#define RX_R_MIN  3800   // 接收端电阻最小值（38.00 Ω）
+#define RX_R_MAX  3900   // 接收端电阻最大值（39.00 Ω）
+#define EPS 5            // 允许的误差范围（0.05 Ω），用于放宽判定条件
+#define VREF_UV 3300000  // ADC的参考电压（uV）
+#define R_CENTI_PER_V 4480 // 电阻换算斜率：R = (3.3 V − v) × 56 / 1.25，即每伏 44.8 Ω = 4480 × 0.01 Ω
+#define R_ZERO_CENTI 200   // 电阻读数的固定偏差（2.00 Ω，引线与开关电阻）
+#define B_UV_PER_CENTI 130 // 磁场换算：0.013 V / 单位，即 130 uV / 0.01 单位（零点 1.86 / 1.90 V 在扣背景时抵消）
+
+// 测量阶段的稳定判据：读数稳定即提前结束，超时作为上限（未稳定也按时捕获）
+#define WAIT_TIMEOUT_MS    500   // 背景 / 电阻阶段最长时间
+#define CAPTURE_TIMEOUT_MS 1000  // 磁场阶段最长时间
+#define SETTLE_COUNT 4           // 连续这么多个抽取输出（4 × 64 ms）落在 SETTLE_RANGE 之内视为稳定
+#define SETTLE_RANGE 8           // 这段输出的最大值 − 最小值上限（ADC_RES_BITS 位计数；8 ≈ 一个 12 位 LSB ≈ 0.8 mV）
+#define SETTLE_MASK_WAIT    0x0F // 背景 / 电阻阶段需要稳定的通道（全部四路）
+#define SETTLE_MASK_CAPTURE ((1u << CH_TX_B) | (1u << CH_RX_B)) // 磁场阶段只看两路磁场
+
+// 换算常数
+typedef struct {
+    int32_t vref_uv;          // ADC 参考电压（uV）
+    int32_t r_centi_per_v;    // 电阻换算斜率（0.01 Ω / V）
+    int32_t r_zero_centi;     // 电阻读数固定偏差（0.01 Ω）
+    int32_t b_uv_per_centi;   // 磁场换算（uV / 0.01 单位）
+} meas_consts_t;
+
+// 判定上下限（0.01 Ω）
+typedef struct {
+    int16_t tx_r_min, tx_r_max;  // 发送端电阻范围
+    int16_t rx_r_min, rx_r_max;  // 接收端电阻范围
+    int16_t eps;                 // 判定时两端各放宽的量
+} meas_limits_t;
+
+// 由换算常数预先算好的定点系数（Q16，Meas_ConvInit 计算），测量时只做乘法和移位
+typedef struct {
+    int64_t r_off_q16, r_gain_q16;   // 电阻 = (r_off_q16 − counts × r_gain_q16) / 2^16
+    int64_t b_gain_q16;              // 磁场 = (counts − offset) × b_gain_q16 / 2^16（向零取整，与原浮点换算一致）
+} meas_conv_t;
+
+// 稳定判据与超时（固件用上面的默认值宏，回放工具可逐项修改）
+typedef struct {
+    uint16_t wait_timeout_ms;        // 背景 / 电阻阶段最长时间
+    uint16_t capture_timeout_ms;     // 磁场阶段最长时间
+    uint16_t settle_range;           // 稳定时连续输出的最大值 − 最小值上限
+    uint8_t settle_count;            // 连续这么多个输出落在范围内视为稳定
+    uint8_t mask_wait, mask_capture; // 两个阶段需要稳定的通道
+} meas_cfg_t;
+
+#define MEAS_CFG_DEFAULT { WAIT_TIMEOUT_MS, CAPTURE_TIMEOUT_MS, SETTLE_RANGE, SETTLE_COUNT, SETTLE_MASK_WAIT, SETTLE_MASK_CAPTURE }
+
+// 测量阶段
+typedef enum {
+    MEAS_PHASE_R = 0,     // 继电器断开：等稳定后捕获磁场背景值和电阻
+    MEAS_PHASE_B,         // 继电器接通：等两路磁场稳定后捕获磁场值
+    MEAS_PHASE_DONE       // 四个测量值已确定
+} meas_phase_t;
+
+// Meas_Sample 的返回值
+typedef enum {
+    MEAS_EV_NONE = 0,
+    MEAS_EV_R_DONE,       // 电阻和背景值已捕获，调用者接通继电器（已进入 MEAS_PHASE_B）
+    MEAS_EV_B_DONE        // 磁场值已捕获，调用者断开继电器并判定（已进入 MEAS_PHASE_DONE）
+} meas_ev_t;
+
+// 一次测试的过程与结果
+typedef struct {
+    uint8_t phase;                   // meas_phase_t
+    uint32_t start_ms;               // 测试开始时刻
+    uint32_t phase_ms;               // 当前阶段开始时刻
+    struct { uint16_t lo, hi; uint8_t n; } settle[MEAS_CHANNELS];  // 每个通道当前这段连续输出的范围和个数
+    uint8_t settle_skip;             // 进入新阶段后丢弃的输出个数（其抽取窗口可能跨过切换时刻）
+    uint16_t tx_B_offset, rx_B_offset;  // 磁场测量的背景值（抽取输出原始值）
+    int32_t tx_R, rx_R, tx_B, rx_B;     // 四个测量值（0.01 单位）
+} meas_run_t;
+
+void Meas_ConvInit(meas_conv_t *c, const meas_consts_t *k, int32_t full_counts);
+int32_t Meas_R(const meas_conv_t *c, uint16_t counts);
+int32_t Meas_B(const meas_conv_t *c, uint16_t counts, uint16_t offset);
+void Meas_Begin(meas_run_t *m, uint32_t now);
+meas_ev_t Meas_Sample(meas_run_t *m, const meas_cfg_t *cfg, const meas_conv_t *c, const uint16_t *val, uint32_t now);
+void Meas_SetB(meas_run_t *m, const meas_conv_t *c, uint16_t tx_counts, uint16_t rx_counts);
+uint8_t Meas_Judge(const meas_run_t *m, const meas_limits_t *l);
+
+#endif /* MEASURE_H_ */
@@ -5,56 +5,226 @@
  *      Author: Unicorn_Li
  */
 #include "oled.h"
+#include "prof.h"
 
 /**********************************************************
  * ʼ,оƬֲдϸͼԼע
+ *  0xAFʾд OLED_Display_On 
  ***********************************************************/
 uint8_t CMD_Data[]={
 0xAE, 0xD5, 0x80, 0xA8, 0x3F, 0xD3, 0x00, 0x40,0xA1, 0xC8, 0xDA,
 
-0x12, 0x81, 0xCF, 0xD9, 0xF1, 0xDB, 0x40, 0xA4, 0xA6,0x8D, 0x14,
+0x12, 0x81, 0xCF, 0xD9, 0xF1, 0xDB, 0x40, 0xA4, 0xA6,0x8D, 0x14};
 
-0xAF};
+/**********************************************************
+ * Դ棺12864 ҳţ8 ҳ  128 УÿֽΪһе 8 Уbit0 ϣ
+ * лƺֻдԴ沢ÿҳзΧ OLED_Flush ں̨ I2C DMA
+ * ҳĻƱռ
+ ***********************************************************/
+static uint8_t OLED_GRAM[OLED_PAGES][OLED_WIDTH];
+static uint8_t dirty_lo[OLED_PAGES];	//ÿҳ㣬dirty_lo > dirty_hi ʾҳ޸Ķѭʣ
+static uint8_t dirty_hi[OLED_PAGES];	//ÿҳյ㣨
+static uint8_t cur_x, cur_page;			//OLED_Set_Pos õдλ
+
+/**********************************************************
+ * DMA 䣺OLED_Flush ҳΧ xfer_lo/xfer_hi 
+ * ÿҳȷ 3 ֽڶλٷҳݣΪһ HAL_I2C_Mem_Write_DMA
+ * ɷжϽһΣֱֵҳ꣨жֻ xfer_*ѭֻ dirty_*
+ ***********************************************************/
+static uint8_t xfer_lo[OLED_PAGES], xfer_hi[OLED_PAGES];	//Ҫ͵зΧ
+static uint8_t xfer_mask;				//Ҫ͵ҳbit i =  i ҳ
+static uint8_t xfer_page;				//ڷ͵ҳ
+static uint8_t xfer_data;				//0 = һηλ1 = һη
+static uint8_t xfer_cmd[3];				//λDMA ڼ䲻ܷջϣ
+static volatile uint8_t xfer_busy;		//1 = 
+static volatile uint8_t xfer_error;		//1 = һִʧܣط
+
+static void OLED_MarkDirty(uint8_t page, uint8_t x0, uint8_t x1)
+{
+	if(dirty_lo[page] > dirty_hi[page])
+	{
+		dirty_lo[page] = x0;
+		dirty_hi[page] = x1;
+		return;
+	}
+	if(x0 < dirty_lo[page]) dirty_lo[page] = x0;
+	if(x1 > dirty_hi[page]) dirty_hi[page] = x1;
+}
+
+/**
+ * @function: static void OLED_Xfer_Next(void)
+ * @description: ֵһ DMA 䣻ѷʧʱ֣ѭ I2C жеã
+ * @return {*}
+ */
+static void OLED_Xfer_Next(void)
+{
+	HAL_StatusTypeDef st;
+	uint8_t lo;
+
+	if(!xfer_data)
+	{
+		while(xfer_page < OLED_PAGES && !(xfer_mask & (1u << xfer_page)))
+			xfer_page++;
+		if(xfer_page >= OLED_PAGES)
+		{
+			xfer_busy = 0;
+			return;
+		}
+		lo = xfer_lo[xfer_page];
+		xfer_cmd[0] = 0xb0 + xfer_page;			//ҳַ0~7
+		xfer_cmd[1] = ((lo&0xf0)>>4)|0x10;		//ʾλáиߵַ
+		xfer_cmd[2] = lo&0x0f;					//ʾλáе͵ַ
+		xfer_data = 1;
+		st = HAL_I2C_Mem_Write_DMA(&hi2c1 ,0x78,0x00,I2C_MEMADD_SIZE_8BIT,xfer_cmd,3);
+	}
+	else
+	{
+		lo = xfer_lo[xfer_page];
+		xfer_data = 0;
+		st = HAL_I2C_Mem_Write_DMA(&hi2c1 ,0x78,0x40,I2C_MEMADD_SIZE_8BIT,&OLED_GRAM[xfer_page][lo],xfer_hi[xfer_page]-lo+1);
+		xfer_page++;
+	}
+	if(st != HAL_OK)
+	{
+		xfer_error = 1;
+		xfer_busy = 0;
+	}
+}
+
+// I2C1 ɣŷһ
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	if(hi2c->Instance == I2C1 && xfer_busy)
+	{
+		PROF_START(t0);
+		OLED_Xfer_Next();
+		PROF_STOP(PROF_OLED_XFER, t0);
+	}
+}
+
+// I2C1 Ӧٲöʧȣ֣´ OLED_Flush ط
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	if(hi2c->Instance == I2C1 && xfer_busy)
+	{
+		xfer_error = 1;
+		xfer_busy = 0;
+	}
+}
+
+static void OLED_GRAM_Fill(uint8_t data)
+{
+	uint8_t i;
+	memset(OLED_GRAM, data, sizeof(OLED_GRAM));
+	for(i=0;i<OLED_PAGES;i++)
+		OLED_MarkDirty(i, 0, OLED_WIDTH-1);
+}
 
 
 
 /**
  * @function: void OLED_Init(void)
- * @description: OLEDʼ
+ * @description: OLEDʼȵϵ OLED_POWERUP_MS 󣬰ȫʼΪһ I2C ䷢
  * @return {*}
+ * @note ֽ 0x00Co = 0ֽ֮ڶһδͣ
+ *       ʱʾԹرգд OLED_Display_On
  */
 void OLED_Init(void)
 {
-	HAL_Delay(200);
+	while(HAL_GetTick() < OLED_POWERUP_MS);
 
-	uint8_t i = 0;
-	for(i=0; i<23; i++)
-	{
-		OLED_WR_CMD(CMD_Data[i]);
-	}
-	
+	HAL_I2C_Mem_Write(&hi2c1 ,0x78,0x00,I2C_MEMADD_SIZE_8BIT,CMD_Data,sizeof(CMD_Data),0x100);
+	memset(dirty_lo, 0xFF, sizeof(dirty_lo));	//ԴȫΪɾ
+	memset(dirty_hi, 0x00, sizeof(dirty_hi));
+	cur_x = 0;
+	cur_page = 0;
 }
 
 /**
  * @function: void OLED_WR_CMD(uint8_t cmd)
- * @description: 豸д
+ * @description: 豸дȵȺ̨ˢֻڳʼȵȲƵĲ
  * @param {uint8_t} cmd оƬֲ涨
  * @return {*}
  */
 void OLED_WR_CMD(uint8_t cmd)
 {
+	while(xfer_busy);
 	HAL_I2C_Mem_Write(&hi2c1 ,0x78,0x00,I2C_MEMADD_SIZE_8BIT,&cmd,1,0x100);
 }
 
 /**
  * @function: void OLED_WR_DATA(uint8_t data)
- * @description: 豸д
+ * @description:  OLED_Set_Pos õλдһݵԴ棬еַԶһβص 0 УͬĻҳѰַģʽ
  * @param {uint8_t} data 
  * @return {*}
  */
 void OLED_WR_DATA(uint8_t data)
 {
-	HAL_I2C_Mem_Write(&hi2c1 ,0x78,0x40,I2C_MEMADD_SIZE_8BIT,&data,1,0x100);
+	if(OLED_GRAM[cur_page][cur_x] != data)
+	{
+		OLED_GRAM[cur_page][cur_x] = data;
+		OLED_MarkDirty(cur_page, cur_x, cur_x);
+	}
+	cur_x = (cur_x + 1) & (OLED_WIDTH - 1);
+}
+
+/**
+ * @function: uint8_t OLED_Flush(void)
+ * @description: ں̨ DMA ҳ͵Ļ
+ * @return {uint8_t} 1 һִ䣻0 һδԴûиĶ
+ * @note ѭÿֵһΣ400 kHz  8 ҳԼ 25 msڼ CPU 룬
+ *       ٻƵĸĶΪµҳһַ
+ */
+uint8_t OLED_Flush(void)
+{
+	uint8_t i;
+
+	if(xfer_busy)
+		return 0;
+	PROF_START(t0);
+	if(xfer_error)	//һʧܣһֵҳҳط
+	{
+		xfer_error = 0;
+		for(i=0;i<OLED_PAGES;i++)
+			if(xfer_mask & (1u << i))
+				OLED_MarkDirty(i, xfer_lo[i], xfer_hi[i]);
+	}
+
+	xfer_mask = 0;
+	for(i=0;i<OLED_PAGES;i++)
+	{
+		if(dirty_lo[i] > dirty_hi[i])
+			continue;
+		xfer_lo[i] = dirty_lo[i];
+		xfer_hi[i] = dirty_hi[i];
+		xfer_mask |= (uint8_t)(1u << i);
+		dirty_lo[i] = 0xFF;	//Ϊɾ
+		dirty_hi[i] = 0x00;
+	}
+	if(!xfer_mask)
+	{
+		PROF_STOP(PROF_OLED_FLUSH, t0);
+		return 0;
+	}
+
+	xfer_page = 0;
+	xfer_data = 0;
+	xfer_busy = 1;
+	OLED_Xfer_Next();
+	PROF_STOP(PROF_OLED_FLUSH, t0);
+	return 1;
+}
+
+/**
+ * @function: void OLED_Refresh(void)
+ * @description: ҳ͵Ļȴ
+ * @return {*}
+ */
+void OLED_Refresh(void)
+{
+	while(xfer_busy);
+	OLED_Flush();
+	while(xfer_busy);
 }
 
 /**
@@ -65,15 +235,7 @@ void OLED_WR_DATA(uint8_t data)
  */
 void OLED_On(void)
 {
-	uint8_t i,n;
-	for(i=0;i<8;i++)
-	{
-		OLED_WR_CMD(0xb0+i);    //ҳַ0~7
-		OLED_WR_CMD(0x00);      //ʾλáе͵ַ
-		OLED_WR_CMD(0x10);      //ʾλáиߵַ
-		for(n=0;n<128;n++)
-			OLED_WR_DATA(1);
-	}
+	OLED_GRAM_Fill(1);
 }
 
 
@@ -84,15 +246,7 @@ void OLED_On(void)
  */
 void OLED_Clear(void)
 {
-	uint8_t i,n;
-	for(i=0;i<8;i++)
-	{
-		OLED_WR_CMD(0xb0+i);    //ҳַ0~7
-		OLED_WR_CMD(0x00);      //ʾλáе͵ַ
-		OLED_WR_CMD(0x10);      //ʾλáиߵַ
-		for(n=0;n<128;n++)
-			OLED_WR_DATA(0);
-	}
+	OLED_GRAM_Fill(0);
 }
 
 /**
@@ -122,15 +276,14 @@ void OLED_Display_Off(void)
 
 /**
  * @function: void OLED_Set_Pos(uint8_t x, uint8_t y)
- * @description: 
+ * @description: Դдλã x: 0~127ҳ y: 0~7
  * @param {uint8_t} x,y
  * @return {*}
  */
 void OLED_Set_Pos(uint8_t x, uint8_t y)
 {
-	OLED_WR_CMD(0xb0+y);	//ҳַ0~7
-	OLED_WR_CMD(((x&0xf0)>>4)|0x10); //ʾλáиߵַ
-	OLED_WR_CMD(x&0x0f);	//ʾλáе͵ַ
+	cur_x = x & (OLED_WIDTH - 1);
+	cur_page = y & (OLED_PAGES - 1);
 }
 
 
@@ -330,6 +483,7 @@ void OLED_Showdecimal(uint8_t x,uint8_t y,float num,uint8_t z_len,uint8_t f_len,
  */
 void OLED_ShowFloat(uint8_t x, uint8_t y, float num, uint8_t z_len, uint8_t f_len, uint8_t size2, uint8_t Color_Turn)
 {
+    PROF_START(t0);
     int i;
     int int_part = (int)num;                 // 
     int frac_part = (int)((num - int_part) * oled_pow(10, f_len)); // С
@@ -365,6 +519,7 @@ void OLED_ShowFloat(uint8_t x, uint8_t y, float num, uint8_t z_len, uint8_t f_le
                            size2, Color_Turn);
         }
     }
+    PROF_STOP(PROF_OLED_FLOAT, t0);
 }
 
 
@@ -401,6 +556,76 @@ void OLED_ShowCHinese(uint8_t x,uint8_t y,uint8_t no, uint8_t Color_Turn)
          }
 }
 
+/**
+ * @function: void OLED_ShowCHineseStr(uint8_t x, uint8_t y, const uint8_t *no, uint8_t n, uint8_t Color_Turn)
+ * @description: OLEDضλʾ n 16X16ּ֣ 16ÿҳοģֻһ
+ * @param {uint8_t} xʼ 0~112 127 еĲֲʾ OLED_ShowCHinese Ƶף
+ * @param {uint8_t} yʼ 0~6
+ * @param {const uint8_t} *noֱ
+ * @param {uint8_t} nָ
+ * @param {uint8_t} Color_TurnǷʾ(1ࡢ0)
+ * @return {*}
+ */
+void OLED_ShowCHineseStr(uint8_t x, uint8_t y, const uint8_t *no, uint8_t n, uint8_t Color_Turn)
+{
+	uint8_t i, t, half, w;
+	uint16_t col;
+	uint8_t *dst;
+
+	if(x >= OLED_WIDTH || y + 1 >= OLED_PAGES || n == 0)
+		return;
+	for(half=0;half<2;half++)
+	{
+		dst = OLED_GRAM[y+half];
+		col = x;
+		for(i=0;i<n && col<OLED_WIDTH;i++)
+		{
+			w = OLED_WIDTH - col < 16 ? (uint8_t)(OLED_WIDTH - col) : 16;
+			if(Color_Turn)
+				for(t=0;t<w;t++) dst[col+t] = (uint8_t)~Hzk[2*no[i]+half][t];
+			else
+				memcpy(&dst[col], Hzk[2*no[i]+half], w);
+			col += w;
+		}
+		OLED_MarkDirty(y+half, x, (uint8_t)(col-1));
+	}
+}
+
+/**
+ * @function: void OLED_SaveTemplate(uint8_t *tpl)
+ * @description: ѵǰԴ汣Ϊģ壨OLED_TPL_SIZE ֽڣ̶ıǩֻ軭һ
+ * @param {uint8_t} *tplģ建
+ * @return {*}
+ */
+void OLED_SaveTemplate(uint8_t *tpl)
+{
+	memcpy(tpl, OLED_GRAM, sizeof(OLED_GRAM));
+}
+
+/**
+ * @function: void OLED_LoadTemplate(const uint8_t *tpl)
+ * @description: ģ滻Դ棬ÿҳֻԴ治ͬжαΪࣨͬһظʱ䣩
+ * @param {const uint8_t} *tpl OLED_SaveTemplate ģ
+ * @return {*}
+ */
+void OLED_LoadTemplate(const uint8_t *tpl)
+{
+	uint8_t i;
+	int16_t lo, hi;
+	const uint8_t *src;
+
+	for(i=0;i<OLED_PAGES;i++)
+	{
+		src = tpl + i*OLED_WIDTH;
+		for(lo=0;lo<OLED_WIDTH && src[lo]==OLED_GRAM[i][lo];lo++);
+		if(lo == OLED_WIDTH)
+			continue;
+		for(hi=OLED_WIDTH-1;src[hi]==OLED_GRAM[i][hi];hi--);
+		memcpy(&OLED_GRAM[i][lo], &src[lo], hi-lo+1);
+		OLED_MarkDirty(i, (uint8_t)lo, (uint8_t)hi);
+	}
+}
+
 /**
  * @function: void OLED_DrawBMP(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t *  BMP,uint8_t Color_Turn)
  * @description: OLEDضʾBMPͼƬ
@@ -524,20 +749,89 @@ void OLED_IntensityControl(uint8_t intensity)
 	OLED_WR_CMD(intensity);
 }
 
-//  OLED ɫ 0 ʾɫ
+/**
+ * @function: void OLED_Fill(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t color)
+ * @description: Դ [x1,x2)  [y1,y2)ҳֽڴĩҳֻڵλ
+ * @param {uint8_t} x1,x2 ֹ꣨أx2 0~128
+ * @param {uint8_t} y1,y2 ֹ꣨أy2 0~64
+ * @param {uint8_t} color 1=0=
+ * @return {*}
+ */
 void OLED_Fill(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t color)
 {
-    for (uint8_t y = y1; y < y2; y++) {
-        for (uint8_t x = x1; x < x2; x++) {
-            OLED_DrawPoint(x, y, color);  // еصƺ
+    uint8_t page, last, mask, x;
+
+    if (x2 > OLED_WIDTH) x2 = OLED_WIDTH;
+    if (y2 > OLED_PAGES * 8) y2 = OLED_PAGES * 8;
+    if (x1 >= x2 || y1 >= y2) return;
+
+    last = (y2 - 1) / 8;
+    for (page = y1 / 8; page <= last; page++) {
+        mask = 0xFF;
+        if (page == y1 / 8) mask &= (uint8_t)(0xFF << (y1 % 8));        // ҳȥ y1 ϵ
+        if (page == last)   mask &= (uint8_t)(0xFF >> (7 - (y2 - 1) % 8)); // ĩҳȥ y2 µ
+        for (x = x1; x < x2; x++) {
+            if (color) OLED_GRAM[page][x] |= mask;
+            else       OLED_GRAM[page][x] &= (uint8_t)~mask;
         }
+        OLED_MarkDirty(page, x1, x2 - 1);
+    }
+}
+
+/**
+ * @function: void OLED_DrawLine(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t color)
+ * @description: Դл߶Σ˵㣩ˮƽ / ֱֽ߰䣬б Bresenham 㻭
+ * @param {uint8_t} x0,y0  x:0~127 y:0~63
+ * @param {uint8_t} x1,y1 յ
+ * @param {uint8_t} color 1=0=
+ * @return {*}
+ */
+void OLED_DrawLine(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t color)
+{
+    int16_t dx, dy, sx, sy, err, e2;
+    int16_t x = x0, y = y0;
+
+    if (y0 == y1 || x0 == x1) {
+        OLED_Fill(x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1,
+                  (x0 < x1 ? x1 : x0) + 1, (y0 < y1 ? y1 : y0) + 1, color);
+        return;
     }
+
+    dx = x1 > x0 ? x1 - x0 : x0 - x1;
+    dy = y1 > y0 ? y0 - y1 : y1 - y0;   // -|dy|
+    sx = x0 < x1 ? 1 : -1;
+    sy = y0 < y1 ? 1 : -1;
+    err = dx + dy;
+    for (;;) {
+        OLED_DrawPoint((uint8_t)x, (uint8_t)y, color);
+        if (x == x1 && y == y1) break;
+        e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x += sx; }
+        if (e2 <= dx) { err += dx; y += sy; }
+    }
+}
+
+/**
+ * @function: void OLED_DrawRect(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t color)
+ * @description: Դлα߿ OLED_Fill ͬ [x1,x2)  [y1,y2)߿ 1 
+ * @param {uint8_t} x1,x2 ֹ꣨x2 
+ * @param {uint8_t} y1,y2 ֹ꣨y2 
+ * @param {uint8_t} color 1=0=
+ * @return {*}
+ */
+void OLED_DrawRect(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t color)
+{
+    if (x1 >= x2 || y1 >= y2) return;
+    OLED_Fill(x1, y1, x2, y1 + 1, color);       // ϱ
+    OLED_Fill(x1, y2 - 1, x2, y2, color);       // ±
+    OLED_Fill(x1, y1, x1 + 1, y2, color);       // 
+    OLED_Fill(x2 - 1, y1, x2, y2, color);       // ұ
 }
 
 
 /**
  * @function: void OLED_DrawPoint(uint8_t x, uint8_t y, uint8_t color)
- * @description: ֱָλû㣨ǻcolor: 1=0=
+ * @description: Դָλû㣬ֻĸõڵһλcolor: 1=0=
  * @param x: 0~127
  * @param y: 0~63
  */
@@ -548,14 +842,13 @@ void OLED_DrawPoint(uint8_t x, uint8_t y, uint8_t color)
     // 귶Χ
     if (x >= 128 || y >= 64) return;
 
-    // λĿҳ
-    OLED_Set_Pos(x, y / 8);
+    // ԭֽλλSSD1306ÿҳ8Уbit 0 ϣ
+    data = OLED_GRAM[y / 8][x];
+    if (color)
+        data |= (uint8_t)(1 << (y % 8));
+    else
+        data &= (uint8_t)~(1 << (y % 8));
 
-    // ֽݣSSD1306ÿҳ8Уbit 0 £
-    data = (1 << (y % 8));
-    if (color) {
-        OLED_WR_DATA(data);  // 
-    } else {
-        OLED_WR_DATA(0x00);  // λã˷򵥵ܸ㣩
-    }
+    OLED_Set_Pos(x, y / 8);
+    OLED_WR_DATA(data);
 }
@@ -3,6 +3,12 @@
 
 #include "stm32f1xx_hal.h"
 #include "oledfont.h"
+#include <string.h>
+
+#define OLED_WIDTH	128	//列数
+#define OLED_PAGES	8	//页数（每页 8 行）
+#define OLED_POWERUP_MS	200	//上电到可以发送初始化命令的时间（从复位算起）
+#define OLED_TPL_SIZE	(OLED_PAGES*OLED_WIDTH)	//界面模板字节数（整屏显存）
 extern I2C_HandleTypeDef  hi2c1;
 
 void OLED_WR_CMD(uint8_t cmd);
@@ -13,12 +19,17 @@ void OLED_Display_On(void);
 void OLED_Display_Off(void);
 void OLED_Set_Pos(uint8_t x, uint8_t y);
 void OLED_On(void);
+uint8_t OLED_Flush(void);
+void OLED_Refresh(void);
 void OLED_ShowNum(uint8_t x,uint8_t y,unsigned int num,uint8_t len,uint8_t size2,uint8_t Color_Turn);
 void OLED_Showdecimal(uint8_t x,uint8_t y,float num,uint8_t z_len,uint8_t f_len,uint8_t size2, uint8_t Color_Turn);
 void OLED_ShowFloat(uint8_t x, uint8_t y, float num, uint8_t z_len, uint8_t f_len, uint8_t size2, uint8_t Color_Turn);
 void OLED_ShowChar(uint8_t x,uint8_t y,uint8_t chr,uint8_t Char_Size,uint8_t Color_Turn);
 void OLED_ShowString(uint8_t x,uint8_t y,char*chr,uint8_t Char_Size,uint8_t Color_Turn);
 void OLED_ShowCHinese(uint8_t x,uint8_t y,uint8_t no,uint8_t Color_Turn);
+void OLED_ShowCHineseStr(uint8_t x, uint8_t y, const uint8_t *no, uint8_t n, uint8_t Color_Turn);
+void OLED_SaveTemplate(uint8_t *tpl);
+void OLED_LoadTemplate(const uint8_t *tpl);
 void OLED_DrawBMP(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t *  BMP,uint8_t Color_Turn);
 void OLED_HorizontalShift(uint8_t direction);
 void OLED_Some_HorizontalShift(uint8_t direction,uint8_t start,uint8_t end);
@@ -27,6 +38,8 @@ void OLED_DisplayMode(uint8_t mode);
 void OLED_IntensityControl(uint8_t intensity);
 void OLED_Fill(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t color);
 void OLED_DrawPoint(uint8_t x, uint8_t y, uint8_t color);
+void OLED_DrawLine(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t color);
+void OLED_DrawRect(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t color);
 
 
 
@@ -0,0 +1,90 @@
+/*
+ * prof.c
+ *
+ *  探针统计在中断和主循环中都会更新（OLED 传输探针在 I2C 中断里），
+ *  更新时短暂关中断，避免主循环的读改写被打断后丢失一次记录。
+ */
+#include "prof.h"
+#include "telemetry.h"
+#include <string.h>
+
+typedef struct {
+    uint32_t count;
+    uint32_t min, max;
+    uint64_t sum;
+} prof_probe_t;
+
+static prof_probe_t probe[PROF_COUNT];
+
+/**
+  * @brief  打开 DWT 周期计数器并清零统计
+  * @note   CYCCNT 随内核时钟计数，72 MHz 下约 59 s 回绕一次，差值按无符号相减不受回绕影响
+  */
+void Prof_Init(void)
+{
+#if PROF_ENABLE
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    Prof_Reset();
+}
+
+void Prof_Record(uint8_t id, uint32_t cycles)
+{
+    prof_probe_t *s = &probe[id];
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (s->count == 0 || cycles < s->min) s->min = cycles;
+    if (cycles > s->max) s->max = cycles;
+    s->sum += cycles;
+    s->count++;
+    __set_PRIMASK(primask);
+}
+
+void Prof_Reset(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset(probe, 0, sizeof(probe));
+    __set_PRIMASK(primask);
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+/**
+  * @brief  把有记录的探针各发一帧 TLM_TYPE_PROF
+  * @retval 1 已发送；0 未编译探针（PROF_ENABLE = 0）
+  */
+uint8_t Prof_Send(void)
+{
+#if PROF_ENABLE
+    prof_probe_t s;
+    uint8_t buf[17], *p, i;
+    for (i = 0; i < PROF_COUNT; i++) {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        s = probe[i];
+        __set_PRIMASK(primask);
+        if (s.count == 0)
+            continue;
+        p = buf;
+        *p++ = i;
+        p = put_u32(p, s.count);
+        p = put_u32(p, s.min);
+        p = put_u32(p, (uint32_t)(s.sum / s.count));
+        p = put_u32(p, s.max);
+        Telemetry_Send(TLM_TYPE_PROF, buf, (uint8_t)(p - buf));
+    }
+    return 1;
+#else
+    return 0;
+#endif
+}
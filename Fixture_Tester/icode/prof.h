@@ -0,0 +1,47 @@
+/*
+ * prof.h
+ *
+ *  DWT 周期计数器剖析：在热点代码两端放 PROF_START / PROF_STOP，按探针累计调用次数和
+ *  最小 / 平均 / 最大周期数，上位机 HOST_CMD_GET_PROF 经遥测读出（TLM_TYPE_PROF）。
+ *  PROF_ENABLE 为 0 时宏展开为空，发布版本不带任何开销；读一次 CYCCNT 为单周期访问，
+ *  打开后每个探针约增加 20 个周期（72 MHz 下 0.3 us）。
+ */
+#ifndef PROF_H_
+#define PROF_H_
+
+#include "stm32f1xx_hal.h"
+
+#define PROF_ENABLE 0   // 1 = 编译剖析探针（调试用）
+
+// 探针编号（PROF_STATE_* 顺序同 MeasurementState）
+typedef enum {
+    PROF_ADC_BLOCK = 0,   // ADC_Block_Process：半块 DMA 数据的中值 / 抽取
+    PROF_CONVERT,         // Meas_Sample：稳定检测与原始值换算为电阻、磁场
+    PROF_TRANSIENT,       // Transient_Extract：一路瞬态特征提取
+    PROF_OLED_FLUSH,      // OLED_Flush：收集脏页并启动 DMA
+    PROF_OLED_XFER,       // I2C DMA 完成中断中启动下一段传输
+    PROF_OLED_FLOAT,      // OLED_ShowFloat：数值格式化与绘制
+    PROF_STATE_IDLE,      // 各状态的采样处理函数
+    PROF_STATE_WAIT,
+    PROF_STATE_CAPTURE,
+    PROF_STATE_DONE,
+    PROF_COUNT
+} prof_id_t;
+
+// PROF_CALL 在调用前求出 id，适合 id 随被调函数改变的场合（如按当前状态分派）
+#if PROF_ENABLE
+#define PROF_START(v)     uint32_t v = DWT->CYCCNT
+#define PROF_STOP(id, v)  Prof_Record((id), DWT->CYCCNT - (v))
+#define PROF_CALL(id, call) do { uint8_t prof_id_ = (uint8_t)(id); PROF_START(prof_t0_); call; PROF_STOP(prof_id_, prof_t0_); } while (0)
+#else
+#define PROF_START(v)
+#define PROF_STOP(id, v)
+#define PROF_CALL(id, call) do { call; } while (0)
+#endif
+
+void Prof_Init(void);
+void Prof_Record(uint8_t id, uint32_t cycles);
+void Prof_Reset(void);
+uint8_t Prof_Send(void);
+
+#endif /* PROF_H_ */
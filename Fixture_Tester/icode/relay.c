@@ -0,0 +1,83 @@
+/*
+ * relay.c
+ *
+ *  同步切换：更新中断只在有待切换请求时打开，切换完立即关闭，平时不增加中断负担。
+ *  工位 1 的 R_C（PB3）与 T_C（PA1）不在同一端口，只能连续写两个 BSRR（相隔 1 条存储指令，约 30 ns）；
+ *  工位 2 的 R_C2（PB4）/ T_C2（PB5）同在 GPIOB，relay_write 自动合并成一次 BSRR 写入。
+ *  各工位的请求互不覆盖，同一个更新事件里可以切换多个工位；瞬态采集缓冲只有一份，
+ *  已被其它工位占用时该工位不做瞬态采集，调用者收不到它的波形，照常按抽取输出判断稳定。
+ */
+#include "relay.h"
+#include "adc_block.h"
+#include "measure.h"
+
+extern TIM_HandleTypeDef htim2;
+
+// 各工位的继电器引脚（与 gpio.c / main.h 一致）
+static const struct {
+    GPIO_TypeDef *r_port, *t_port;
+    uint16_t r_pin, t_pin;
+} relay_pins[ADC_SLOTS] = {
+    { R_C_GPIO_Port,  T_C_GPIO_Port,  R_C_Pin,  T_C_Pin },
+    { R_C2_GPIO_Port, T_C2_GPIO_Port, R_C2_Pin, T_C2_Pin },
+};
+
+static volatile uint8_t relay_pending;  // bit i = 工位 i 等待下一个更新事件切换
+static uint8_t relay_on;                // bit i = 工位 i 请求的状态
+static uint8_t relay_burst;             // bit i = 工位 i 切换后立即启动瞬态采集
+
+// 一次（或同一端口时一次）BSRR 写入切换一个工位的两路：低 16 位置位，高 16 位复位
+static void relay_write(uint8_t slot, uint8_t on)
+{
+    uint32_t r = on ? relay_pins[slot].r_pin : (uint32_t)relay_pins[slot].r_pin << 16;
+    uint32_t t = on ? relay_pins[slot].t_pin : (uint32_t)relay_pins[slot].t_pin << 16;
+    if (relay_pins[slot].r_port == relay_pins[slot].t_port) {
+        relay_pins[slot].r_port->BSRR = r | t;
+    } else {
+        relay_pins[slot].r_port->BSRR = r;
+        relay_pins[slot].t_port->BSRR = t;
+    }
+}
+
+/**
+  * @brief  请求在 TIM2 下一个更新事件时切换一个工位的两路继电器（立即返回，最迟一个扫描周期后生效）
+  * @param  slot: 工位（0..ADC_SLOTS-1）
+  * @param  on: 1 = 接通（测量磁场），0 = 断开
+  * @param  burst: 1 = 切换后立即启动该工位的瞬态采集（ADC_Burst_Arm）
+  * @note   该工位前一个请求尚未执行时被新请求覆盖；其它工位的请求不受影响
+  */
+void Relay_Set(uint8_t slot, uint8_t on, uint8_t burst)
+{
+    uint8_t bit = (uint8_t)(1u << slot);
+    uint32_t primask;
+    if (slot >= ADC_SLOTS) return;
+    primask = __get_PRIMASK();
+    __disable_irq();
+    relay_on = on ? relay_on | bit : relay_on & ~bit;
+    relay_burst = burst ? relay_burst | bit : relay_burst & ~bit;
+    relay_pending |= bit;
+    __HAL_TIM_CLEAR_IT(&htim2, TIM_IT_UPDATE);   // 只响应请求之后的更新事件
+    __HAL_TIM_ENABLE_IT(&htim2, TIM_IT_UPDATE);
+    __set_PRIMASK(primask);
+}
+
+// 1 = 该工位还有未执行的切换请求
+uint8_t Relay_Pending(uint8_t slot)
+{
+    return (relay_pending >> slot) & 1u;
+}
+
+// TIM2 更新事件：执行所有工位的切换请求后关闭更新中断
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
+{
+    uint8_t slot, bit;
+    if (htim->Instance != TIM2) return;
+    __HAL_TIM_DISABLE_IT(htim, TIM_IT_UPDATE);
+    for (slot = 0; slot < ADC_SLOTS && relay_pending; slot++) {
+        bit = (uint8_t)(1u << slot);
+        if (!(relay_pending & bit)) continue;
+        relay_write(slot, relay_on & bit);
+        relay_pending &= ~bit;
+        if (relay_burst & bit) ADC_Burst_Arm(htim, (uint8_t)(slot * ADC_SLOT_CHANNELS + CH_TX_B));
+    }
+}
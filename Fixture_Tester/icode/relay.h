@@ -0,0 +1,16 @@
+/*
+ * relay.h
+ *
+ *  磁场测量继电器（每个工位一对 R_C / T_C）与 ADC 扫描同步切换：Relay_Set 只登记请求并打开 TIM2 更新中断，
+ *  在 TIM2 的下一个更新事件（两次 ADC 触发之间的固定位置）由中断写 BSRR 切换该工位两路继电器，
+ *  需要时在同一中断里启动瞬态采集，切换时刻与第一轮扫描之间的间隔固定（ADC_BURST_T0_US）。
+ */
+#ifndef RELAY_H_
+#define RELAY_H_
+
+#include "main.h"
+
+void Relay_Set(uint8_t slot, uint8_t on, uint8_t burst);
+uint8_t Relay_Pending(uint8_t slot);
+
+#endif /* RELAY_H_ */
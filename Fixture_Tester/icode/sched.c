@@ -0,0 +1,83 @@
+/*
+ * sched.c
+ *
+ *  协作式任务调度：事件位由中断置位、调度循环一次取走；任务按表中顺序检查，
+ *  事件命中或周期到期即运行。SysTick 每 1 ms 唤醒一次 __WFI，周期任务的分辨率为 1 ms。
+ */
+#include "sched.h"
+
+static volatile uint32_t sched_events; // 待处理事件（中断置位，调度循环取走）
+
+/**
+  * @brief  投递事件（中断或主循环中均可调用）
+  * @param  evt: SCHED_EVT_* 的组合
+  */
+void Sched_Post(uint32_t evt)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    sched_events |= evt;
+    __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  微秒时间（HAL_GetTick 毫秒数 + SysTick 当前计数），用于统计任务运行时间
+  * @note   约 71 分钟回绕一次，只用于求差
+  */
+uint32_t Sched_Micros(void)
+{
+    uint32_t ms, val;
+    do {
+        ms = HAL_GetTick();
+        val = SysTick->VAL;
+    } while (ms != HAL_GetTick());     // 读数期间发生了滴答中断：重读
+    return ms * 1000u + (SysTick->LOAD - val) / (SystemCoreClock / 1000000u);
+}
+
+/**
+  * @brief  调度循环（不返回）
+  * @param  tasks: 任务表（按优先顺序排列）
+  * @param  n: 任务数
+  */
+void Sched_Run(sched_task_t *tasks, uint8_t n)
+{
+    uint8_t i;
+    uint8_t due;
+    uint32_t ev, now, t0, dt;
+    sched_task_t *t;
+
+    now = HAL_GetTick();
+    for (i = 0; i < n; i++)
+        tasks[i].last_ms = now;
+
+    for (;;) {
+        __disable_irq();
+        ev = sched_events;
+        sched_events = 0;
+        __enable_irq();
+
+        for (i = 0; i < n; i++) {
+            t = &tasks[i];
+            now = HAL_GetTick();
+            due = (t->events & ev) != 0;
+            if (t->period_ms && now - t->last_ms >= t->period_ms) {
+                t->last_ms = now;
+                due = 1;
+            }
+            if (!due) continue;
+
+            t0 = Sched_Micros();
+            t->run();
+            dt = Sched_Micros() - t0;
+            t->runs++;
+            if (dt > t->max_us) t->max_us = dt;
+            if (t->budget_us && dt > t->budget_us) t->overruns++;
+        }
+
+        // 关中断检查后再休眠：检查之后到达的中断会挂起，__WFI 立即返回，不会漏掉事件
+        __disable_irq();
+        if (!sched_events)
+            __WFI();
+        __enable_irq();
+    }
+}
@@ -0,0 +1,35 @@
+/*
+ * sched.h
+ *
+ *  协作式任务调度：主循环只跑 Sched_Run，任务按事件（中断里 Sched_Post）或周期触发，
+ *  每个任务一次运行到底、不等待；没有任务可跑时 CPU 在 __WFI() 中休眠，由任意中断唤醒。
+ *  每个任务有单次运行时间预算，超出时计数，便于发现拖慢主循环的任务。
+ */
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include "stm32f1xx_hal.h"
+
+// 事件（位掩码，中断里用 Sched_Post 投递）
+#define SCHED_EVT_ADC  (1u << 0)   // 新的 ADC 抽取输出或瞬态采集完成（adc_block.c）
+#define SCHED_EVT_KEY  (1u << 1)   // 新的按键事件（key.c）
+#define SCHED_EVT_HOST (1u << 2)   // USART3 收到数据（host.c）
+
+typedef struct {
+    const char *name;           // 任务名（调试用）
+    void (*run)(void);          // 任务函数：一次处理完当前待办即返回
+    uint32_t events;            // 触发事件（SCHED_EVT_*），0 = 只按周期运行
+    uint16_t period_ms;         // 运行周期，0 = 只按事件运行
+    uint16_t budget_us;         // 单次运行时间预算，0 = 不检查
+    // 以下由调度器维护
+    uint32_t last_ms;           // 上次周期运行的时刻
+    uint32_t runs;              // 运行次数
+    uint32_t overruns;          // 超出预算的次数
+    uint32_t max_us;            // 最长单次运行时间
+} sched_task_t;
+
+void Sched_Post(uint32_t evt);
+uint32_t Sched_Micros(void);
+void Sched_Run(sched_task_t *tasks, uint8_t n);
+
+#endif /* SCHED_H_ */
@@ -0,0 +1,109 @@
+/*
+ * stats.c
+ *
+ *  Welford 在线算法：delta = x − mean，mean += delta / n，M2 += delta × (x − mean_new)。
+ *  均值以 Q16 保存，整数除法的舍入误差在 2^-16 量级，不随测试数累积；
+ *  乘积前两个因子各右移 8 位，测量值饱和到 ±32767 时也不会溢出 64 位。
+ */
+#include "stats.h"
+#include <string.h>
+
+static stats_t stats;
+
+// 开始新的一班：清零全部统计
+void Stats_Reset(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+static void stats_update(stats_qty_t *s, int32_t x, uint32_t n)
+{
+    int64_t xq = (int64_t)x * 65536;
+    int64_t d = xq - s->mean_q16;
+    s->mean_q16 += d / (int64_t)n;
+    s->m2_q16 += (d / 256) * ((xq - s->mean_q16) / 256);
+    if (n == 1 || x < s->min) s->min = x;
+    if (n == 1 || x > s->max) s->max = x;
+}
+
+/**
+  * @brief  加入一次测试的结果
+  */
+void Stats_Add(const tlm_result_t *r)
+{
+    const int32_t x[STATS_QTY] = { r->tx_R, r->rx_R, r->tx_B, r->rx_B };
+    uint8_t i;
+    stats.count++;
+    if (r->pass) stats.pass++;
+    for (i = 0; i < STATS_QTY; i++)
+        stats_update(&stats.q[i], x[i], stats.count);
+}
+
+const stats_t *Stats_Get(void)
+{
+    return &stats;
+}
+
+// 合格率（‰，尚无测试时为 0）
+uint16_t Stats_YieldPermille(void)
+{
+    return stats.count ? (uint16_t)((uint64_t)stats.pass * 1000 / stats.count) : 0;
+}
+
+// 均值（0.001 单位，即测量值单位的 1/10；四舍五入）
+int32_t Stats_Mean_x10(uint8_t i)
+{
+    int64_t m = stats.q[i].mean_q16 * 10;
+    return (int32_t)((m + (m < 0 ? -32768 : 32768)) / 65536);
+}
+
+// 64 位整数平方根（逐位求）
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t r = 0, bit = (uint64_t)1 << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+// 样本标准差（0.001 单位；少于两次测试时为 0）
+uint32_t Stats_Std_x10(uint8_t i)
+{
+    int64_t var_q16;
+    if (stats.count < 2 || stats.q[i].m2_q16 <= 0) return 0;
+    var_q16 = stats.q[i].m2_q16 / (int64_t)(stats.count - 1);
+    return isqrt64((uint64_t)var_q16 * 100 / 65536);   // sqrt(var × 10²)
+}
+
+/**
+  * @brief  发送 STATS_QTY 帧 TLM_TYPE_STATS（每个测量值一帧，格式见 telemetry.h）
+  */
+void Stats_Send(void)
+{
+    uint8_t buf[25], *p, i;
+    for (i = 0; i < STATS_QTY; i++) {
+        p = buf;
+        *p++ = i;
+        p = put_u32(p, stats.count);
+        p = put_u32(p, stats.pass);
+        p = put_u32(p, (uint32_t)Stats_Mean_x10(i));
+        p = put_u32(p, Stats_Std_x10(i));
+        p = put_u32(p, (uint32_t)stats.q[i].min);
+        p = put_u32(p, (uint32_t)stats.q[i].max);
+        Telemetry_Send(TLM_TYPE_STATS, buf, (uint8_t)(p - buf));
+    }
+}
@@ -0,0 +1,36 @@
+/*
+ * stats.h
+ *
+ *  本班生产统计：每次测试 O(1) 更新测试数、合格数，以及四个测量值的 Welford 均值 / 方差和最值，
+ *  全部为定点整数运算（均值、离差平方和为 Q16）。上位机 HOST_CMD_RESET_STATS 开始新的一班。
+ */
+#ifndef STATS_H_
+#define STATS_H_
+
+#include "stm32f1xx_hal.h"
+#include "telemetry.h"
+
+#define STATS_QTY 4   // 统计的测量值：tx_R, rx_R, tx_B, rx_B（顺序同 tlm_result_t，0.01 单位）
+
+// 一个测量值的统计
+typedef struct {
+    int64_t mean_q16;     // 均值 × 2^16
+    int64_t m2_q16;       // 离差平方和 Σ(x − mean)² × 2^16
+    int32_t min, max;
+} stats_qty_t;
+
+typedef struct {
+    uint32_t count;       // 测试数
+    uint32_t pass;        // 合格数
+    stats_qty_t q[STATS_QTY];
+} stats_t;
+
+void Stats_Reset(void);
+void Stats_Add(const tlm_result_t *r);
+const stats_t *Stats_Get(void);
+uint16_t Stats_YieldPermille(void);
+int32_t Stats_Mean_x10(uint8_t i);
+uint32_t Stats_Std_x10(uint8_t i);
+void Stats_Send(void);
+
+#endif /* STATS_H_ */
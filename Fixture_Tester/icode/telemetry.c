@@ -0,0 +1,223 @@
+/*
+ * telemetry.c
+ *
+ *  USART3 遥测发送：组帧后拷入环形缓冲，DMA 每次发送缓冲中一段连续的字节，
+ *  发送完成中断推进读指针并接着发下一段。写指针只由主循环改，读指针只由中断改。
+ */
+#include "telemetry.h"
+
+extern UART_HandleTypeDef huart3;
+
+static uint8_t tlm_ring[TLM_RING_SIZE];
+static volatile uint16_t tlm_head;      // 写指针（主循环）
+static volatile uint16_t tlm_tail;      // 读指针（发送完成中断）
+static volatile uint8_t tlm_busy;       // 1 = DMA 正在发送 [tlm_tail, tlm_tail + tlm_xfer_len)
+static uint16_t tlm_xfer_len;
+static uint8_t tlm_seq;                 // 帧序号
+static uint32_t tlm_dropped;            // 因缓冲满丢弃的帧数
+static uint8_t tlm_sample_every = TLM_SAMPLE_EVERY;
+static uint8_t tlm_sample_cnt;
+
+/**
+  * @brief  CRC-16/CCITT-FALSE（逐位计算，帧长只有几十字节）
+  * @param  crc: 初值（新帧用 0xFFFF，分段计算时传入上一段的结果）
+  */
+uint16_t Telemetry_CRC16(const uint8_t *p, uint16_t len, uint16_t crc)
+{
+    uint8_t i;
+    while (len--) {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+/**
+  * @brief  若 DMA 空闲且缓冲中有数据，启动发送一段连续字节（关中断后调用）
+  */
+static void tlm_kick(void)
+{
+    uint16_t head = tlm_head, tail = tlm_tail;
+    if (tlm_busy || head == tail) return;
+    tlm_xfer_len = head > tail ? head - tail : TLM_RING_SIZE - tail;   // 到写指针或缓冲末尾
+    tlm_busy = 1;
+    if (HAL_UART_Transmit_DMA(&huart3, &tlm_ring[tail], tlm_xfer_len) != HAL_OK)
+        tlm_busy = 0;   // 串口被占用：留到下次写入时再启动
+}
+
+// 发送完成：推进读指针，接着发下一段
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    if (huart->Instance != USART3 || !tlm_busy) return;
+    tlm_tail = (tlm_tail + tlm_xfer_len) & (TLM_RING_SIZE - 1);
+    tlm_busy = 0;
+    tlm_kick();
+}
+
+/**
+  * @brief  USART3 出错时调用（HAL_UART_ErrorCallback，见 host.c）：若发送段已被 HAL 终止，
+  *         丢弃该段继续发送后面的数据
+  */
+void Telemetry_OnError(UART_HandleTypeDef *huart)
+{
+    if (!tlm_busy || huart->gState != HAL_UART_STATE_READY) return;
+    tlm_tail = (tlm_tail + tlm_xfer_len) & (TLM_RING_SIZE - 1);
+    tlm_busy = 0;
+    tlm_kick();
+}
+
+static void tlm_put(uint16_t *pos, uint8_t b)
+{
+    tlm_ring[*pos] = b;
+    *pos = (*pos + 1) & (TLM_RING_SIZE - 1);
+}
+
+/**
+  * @brief  组成一帧写入发送缓冲（不等待）
+  * @param  type: 帧类型 TLM_TYPE_*
+  * @param  payload: 负载
+  * @param  len: 负载字节数（不超过 TLM_MAX_PAYLOAD）
+  * @retval 1 已写入；0 缓冲空间不足，该帧被丢弃
+  */
+uint8_t Telemetry_Send(uint8_t type, const uint8_t *payload, uint8_t len)
+{
+    uint8_t hdr[TLM_HEADER_LEN];
+    uint16_t pos, used, crc, i;
+    uint32_t primask;
+
+    if (len > TLM_MAX_PAYLOAD) return 0;
+    used = (tlm_head - tlm_tail) & (TLM_RING_SIZE - 1);
+    if (TLM_RING_SIZE - 1 - used < (uint16_t)TLM_FRAME_LEN(len)) {
+        tlm_dropped++;
+        return 0;
+    }
+
+    hdr[0] = TLM_SOF0;
+    hdr[1] = TLM_SOF1;
+    hdr[2] = type;
+    hdr[3] = tlm_seq++;
+    hdr[4] = len;
+    crc = Telemetry_CRC16(&hdr[2], 3, 0xFFFF);
+    crc = Telemetry_CRC16(payload, len, crc);
+
+    pos = tlm_head;
+    for (i = 0; i < TLM_HEADER_LEN; i++) tlm_put(&pos, hdr[i]);
+    for (i = 0; i < len; i++) tlm_put(&pos, payload[i]);
+    tlm_put(&pos, (uint8_t)crc);
+    tlm_put(&pos, (uint8_t)(crc >> 8));
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    tlm_head = pos;     // 整帧写完后才发布
+    tlm_kick();
+    __set_PRIMASK(primask);
+    return 1;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); return p + 2; }
+static uint8_t *put_u32(uint8_t *p, uint32_t v) { p = put_u16(p, (uint16_t)v); return put_u16(p, (uint16_t)(v >> 16)); }
+
+// 32 位测量值饱和到 16 位
+static int16_t sat16(int32_t v) { return v > 32767 ? 32767 : v < -32768 ? -32768 : (int16_t)v; }
+
+/**
+  * @brief  发送一次测试的结果帧
+  */
+void Telemetry_SendResult(const tlm_result_t *r)
+{
+    uint8_t buf[16], *p = buf;
+    p = put_u32(p, r->test_no);
+    p = put_u16(p, r->cycle_ms > 0xFFFF ? 0xFFFF : (uint16_t)r->cycle_ms);
+    p = put_u16(p, (uint16_t)sat16(r->tx_R));
+    p = put_u16(p, (uint16_t)sat16(r->rx_R));
+    p = put_u16(p, (uint16_t)sat16(r->tx_B));
+    p = put_u16(p, (uint16_t)sat16(r->rx_B));
+    *p++ = r->pass;
+    *p++ = r->slot;
+    Telemetry_Send(TLM_TYPE_RESULT, buf, (uint8_t)(p - buf));
+}
+
+/**
+  * @brief  发送继电器接通事件（在 Relay_Set 之后立即调用，缓冲为空时约 1 ms 内发出）
+  */
+void Telemetry_SendExcite(uint32_t test_no, uint8_t slot)
+{
+    uint8_t buf[5], *p = buf;
+    p = put_u32(p, test_no);
+    *p++ = slot;
+    Telemetry_Send(TLM_TYPE_EXCITE, buf, (uint8_t)(p - buf));
+}
+
+/**
+  * @brief  实时采样：每 tlm_sample_every 个抽取输出发送一帧（主循环每取到一个输出调用一次）
+  */
+void Telemetry_SendSample(const adc_sample_t *s)
+{
+    uint8_t buf[4 + 2 * ADC_CHANNELS], *p = buf, ch;
+    if (!tlm_sample_every || ++tlm_sample_cnt < tlm_sample_every) return;
+    tlm_sample_cnt = 0;
+    p = put_u32(p, s->seq);
+    for (ch = 0; ch < ADC_CHANNELS; ch++)
+        p = put_u16(p, s->val[ch]);
+    Telemetry_Send(TLM_TYPE_SAMPLE, buf, (uint8_t)(p - buf));
+}
+
+/**
+  * @brief  发送继电器切换瞬态特征帧（一个工位的两路磁场）
+  */
+void Telemetry_SendTransient(uint32_t test_no, uint8_t slot, const transient_feat_t *tx_B, const transient_feat_t *rx_B)
+{
+    const transient_feat_t *f[2] = { tx_B, rx_B };
+    uint8_t buf[25], *p = buf, i;
+    p = put_u32(p, test_no);
+    p = put_u16(p, ADC_BURST_PERIOD_US);
+    p = put_u16(p, ADC_BURST_SCANS);
+    for (i = 0; i < 2; i++) {
+        p = put_u16(p, (uint16_t)f[i]->step);
+        p = put_u16(p, (uint16_t)f[i]->peak);
+        p = put_u16(p, f[i]->rise_us);
+        p = put_u16(p, f[i]->settle_us);
+    }
+    *p++ = slot;
+    Telemetry_Send(TLM_TYPE_TRANSIENT, buf, (uint8_t)(p - buf));
+}
+
+/**
+  * @brief  发送一段瞬态波形
+  * @param  first: v[0] 所在的扫描序号
+  * @param  v: 交错的两路原始值（scans × ADC_BURST_CHANNELS 个）
+  * @param  scans: 扫描数（不超过 (TLM_MAX_PAYLOAD − 2) / 4）
+  * @retval 1 已写入；0 缓冲空间不足或过长
+  */
+uint8_t Telemetry_SendWave(uint16_t first, const uint16_t *v, uint8_t scans)
+{
+    uint8_t buf[TLM_MAX_PAYLOAD], *p = buf;
+    uint16_t i, n = (uint16_t)scans * ADC_BURST_CHANNELS;
+    if (2 + 2 * n > TLM_MAX_PAYLOAD) return 0;
+    p = put_u16(p, first);
+    for (i = 0; i < n; i++)
+        p = put_u16(p, v[i]);
+    return Telemetry_Send(TLM_TYPE_WAVE, buf, (uint8_t)(p - buf));
+}
+
+/**
+  * @brief  设置实时采样抽取比：每 n 个抽取输出发送一帧，0 = 关闭
+  */
+void Telemetry_SetSampleEvery(uint8_t n)
+{
+    tlm_sample_every = n;
+    tlm_sample_cnt = 0;
+}
+
+// 发送缓冲的剩余字节数（整帧长度 TLM_FRAME_LEN 不超过它才能写入）
+uint16_t Telemetry_Free(void)
+{
+    return (uint16_t)(TLM_RING_SIZE - 1 - ((tlm_head - tlm_tail) & (TLM_RING_SIZE - 1)));
+}
+
+// 因缓冲满丢弃的帧数
+uint32_t Telemetry_Dropped(void)
+{
+    return tlm_dropped;
+}
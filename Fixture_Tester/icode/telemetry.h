@@ -0,0 +1,81 @@
+/*
+ * telemetry.h
+ *
+ *  USART3 遥测：测试结果和（可选的）抽取后实时采样按二进制帧写入发送环形缓冲，
+ *  由 HAL_UART_Transmit_DMA 在后台发出。写入只做内存拷贝，缓冲满时丢弃新帧并计数，从不等待。
+ *
+ *  帧格式（多字节字段均为小端）:
+ *    0xA5 0x5A | type | seq | len | payload[len] | crc16
+ *    seq   帧序号（每帧加一，上位机据此发现丢帧）
+ *    crc16 CRC-16/CCITT-FALSE（多项式 0x1021，初值 0xFFFF），覆盖 type 至 payload 末尾
+ *
+ *  TLM_TYPE_RESULT（每次测试一帧，16 字节）:
+ *    u32 测试序号 | u16 测试周期 ms | i16 tx_R | i16 rx_R | i16 tx_B | i16 rx_B（0.01 单位）| u8 合格=1 | u8 工位（0 起）
+ *  TLM_TYPE_SAMPLE（每 N 个抽取输出一帧，4 + 2 × ADC_CHANNELS = 20 字节）:
+ *    u32 输出序号 | u16 val[ADC_CHANNELS]（ADC_RES_BITS 位原始值，通道顺序同 adc_sample_t，每工位 4 路）
+ *  TLM_TYPE_TRANSIENT（每次测试继电器切换后一帧，25 字节；瞬态采集缓冲被其它工位占用时该次测试没有这一帧）:
+ *    u32 测试序号 | u16 采样周期 us | u16 扫描数 | 两路磁场（tx_B, rx_B）各 i16 step | i16 peak | u16 rise_us | u16 settle_us
+ *    | u8 工位（step / peak 为 ADC_RES_BITS 位计数，见 transient.h）
+ *  TLM_TYPE_WAVE（瞬态波形分段，上位机开启上传时才发送，属于最近一帧 TLM_TYPE_TRANSIENT 的工位）:
+ *    u16 首个扫描序号 | n × (u16 tx_B, u16 rx_B)（12 位原始值，第 k 轮时刻见 ADC_BURST_T0_US）
+ *  TLM_TYPE_STATS（本班统计，每个测量值一帧，25 字节）:
+ *    u8 测量值序号（0..3 = tx_R rx_R tx_B rx_B）| u32 测试数 | u32 合格数 | i32 均值 | u32 标准差（0.001 单位）
+ *    | i32 最小值 | i32 最大值（0.01 单位）
+ *  TLM_TYPE_LOG（日志导出，HOST_CMD_DUMP_LOG 触发）:
+ *    至多 2 条 16 字节 log_record_t（见 log.h，按从旧到新）；只含 u32 丢弃记录数（上电以来 RAM 队列满未能写入的
+ *    记录数）的 4 字节一帧表示导出结束
+ *  TLM_TYPE_PROF（剖析探针，HOST_CMD_GET_PROF 触发，每个有记录的探针一帧，17 字节）:
+ *    u8 探针编号（prof_id_t，见 prof.h）| u32 次数 | u32 最小 | u32 平均 | u32 最大（DWT 周期数，72 MHz）
+ *  TLM_TYPE_EXCITE（每次测试继电器接通时一帧，5 字节；与继电器同一扫描周期内发出，上位机据此对齐外部采集）:
+ *    u32 测试序号 | u8 工位（0 起）
+ */
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include "stm32f1xx_hal.h"
+#include "adc_block.h"
+#include "transient.h"
+
+#define TLM_SOF0          0xA5
+#define TLM_SOF1          0x5A
+#define TLM_HEADER_LEN    5      // SOF0 SOF1 type seq len
+#define TLM_MAX_PAYLOAD   32
+#define TLM_FRAME_LEN(n)  (TLM_HEADER_LEN + (n) + 2)   // 负载 n 字节的整帧长度
+#define TLM_RING_SIZE     512    // 发送环形缓冲字节数（2 的幂；115200 bps 下约 45 ms 的数据）
+#define TLM_SAMPLE_EVERY  0      // 上电默认实时采样抽取比（0 = 不发送）
+
+#define TLM_TYPE_RESULT   0x01
+#define TLM_TYPE_SAMPLE   0x02
+#define TLM_TYPE_ACK      0x03   // 上位机命令的应答（见 host.h）
+#define TLM_TYPE_LIMITS   0x04   // 判定上下限（见 host.h）
+#define TLM_TYPE_TRANSIENT 0x05  // 继电器切换瞬态特征
+#define TLM_TYPE_WAVE     0x06   // 瞬态波形分段
+#define TLM_TYPE_CAL      0x07   // 换算常数（见 host.h）
+#define TLM_TYPE_STATS    0x08   // 本班统计（stats.c）
+#define TLM_TYPE_LOG      0x09   // 结果日志导出（log.c）
+#define TLM_TYPE_PROF     0x0A   // 剖析探针统计（prof.c）
+#define TLM_TYPE_EXCITE   0x0B   // 继电器接通（开始测量磁场）
+
+// 一次测试的结果（测量值为 0.01 单位的整数）
+typedef struct {
+    uint32_t test_no;       // 测试序号
+    uint32_t cycle_ms;      // 从开始测量到出结果的时间
+    int32_t tx_R, rx_R;     // 发送端 / 接收端电阻
+    int32_t tx_B, rx_B;     // 发送端 / 接收端磁场
+    uint8_t pass;           // 1 = 合格
+    uint8_t slot;           // 工位（0 起）
+} tlm_result_t;
+
+uint8_t Telemetry_Send(uint8_t type, const uint8_t *payload, uint8_t len);
+void Telemetry_SendResult(const tlm_result_t *r);
+void Telemetry_SendSample(const adc_sample_t *s);
+void Telemetry_SetSampleEvery(uint8_t n);
+void Telemetry_SendExcite(uint32_t test_no, uint8_t slot);
+void Telemetry_SendTransient(uint32_t test_no, uint8_t slot, const transient_feat_t *tx_B, const transient_feat_t *rx_B);
+uint8_t Telemetry_SendWave(uint16_t first, const uint16_t *v, uint8_t scans);
+uint16_t Telemetry_Free(void);
+uint32_t Telemetry_Dropped(void);
+uint16_t Telemetry_CRC16(const uint8_t *p, uint16_t len, uint16_t crc);
+void Telemetry_OnError(UART_HandleTypeDef *huart);
+
+#endif /* TELEMETRY_H_ */
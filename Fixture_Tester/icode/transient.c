@@ -0,0 +1,105 @@
+/*
+ * transient.c
+ *
+ *  瞬态特征提取：一次遍历求峰值和 10% / 90% 过阈时刻，再从末尾向前找最后一个稳定带外的点。
+ *  逐点先取相邻三点的中值（与抽取器相同的 ADC_Median3），单点尖峰不会被当成峰值或未稳定。
+ *  全部为整数运算，512 点两路约 0.2 ms。波形上传按遥测缓冲余量分帧发送，不阻塞主循环。
+ */
+#include "transient.h"
+#include "telemetry.h"
+#include "prof.h"
+
+static const uint16_t *wave_src;   // 正在上传的波形（NULL = 无）
+static uint16_t wave_next;         // 下一个要发送的扫描序号
+
+// 第 k 轮扫描的时刻（us，从继电器切换算起），饱和到 16 位
+static uint16_t scan_us(uint32_t k)
+{
+    uint32_t t = ADC_BURST_T0_US + k * ADC_BURST_PERIOD_US;
+    return t >= TRANSIENT_NA ? TRANSIENT_NA - 1 : (uint16_t)t;
+}
+
+// 第 k 点与其前后两点的中值（首尾点取原值），步长 ADC_BURST_CHANNELS
+static int32_t wave_at(const uint16_t *x, int32_t k)
+{
+    if (k == 0 || k == ADC_BURST_SCANS - 1) return x[k * ADC_BURST_CHANNELS];
+    return ADC_Median3(x[(k - 1) * ADC_BURST_CHANNELS], x[k * ADC_BURST_CHANNELS], x[(k + 1) * ADC_BURST_CHANNELS]);
+}
+
+/**
+  * @brief  提取一路的瞬态特征
+  * @param  wave: ADC_Burst_Take 返回的波形（ADC_BURST_SCANS 轮 × ADC_BURST_CHANNELS 路交错）
+  * @param  ch: 路序号（0 = 该工位的 tx_B，1 = rx_B）
+  * @param  baseline: 切换前的基线（ADC_RES_BITS 位，即切换前的抽取输出）
+  * @param  f: 特征输出
+  */
+void Transient_Extract(const uint16_t *wave, uint8_t ch, uint16_t baseline, transient_feat_t *f)
+{
+    const uint16_t *x = wave + ch;
+    const int32_t scale = ADC_OUT_SCALE, band_min = TRANSIENT_BAND_MIN, min_step = TRANSIENT_MIN_STEP;
+    int32_t sum = 0, final, step, mag, dev, peak = 0, band;
+    int32_t k, k10 = -1, k90 = -1;
+    int8_t dir;
+    PROF_START(t0);
+
+    for (k = ADC_BURST_SCANS - TRANSIENT_TAIL; k < ADC_BURST_SCANS; k++)
+        sum += wave_at(x, k);
+    final = sum * scale / TRANSIENT_TAIL;
+    step = final - baseline;
+    dir = step < 0 ? -1 : 1;
+    mag = step * dir;
+
+    for (k = 0; k < ADC_BURST_SCANS; k++) {
+        dev = (wave_at(x, k) * scale - baseline) * dir; // 阶跃方向上的偏移
+        if (dev > peak) peak = dev;
+        if (k10 < 0 && dev * 10 >= mag) k10 = k;
+        if (k90 < 0 && dev * 10 >= mag * 9) k90 = k;
+    }
+
+    band = mag * TRANSIENT_BAND_PCT / 100;
+    if (band < band_min) band = band_min;
+    for (k = ADC_BURST_SCANS - 1; k >= 0; k--) {
+        dev = wave_at(x, k) * scale - final;
+        if (dev > band || dev < -band) break;
+    }
+
+    f->final = (uint16_t)final;
+    f->step = (int16_t)step;
+    f->peak = (int16_t)(peak * dir);
+    f->rise_us = (mag >= min_step && k10 >= 0 && k90 >= 0)
+                 ? (uint16_t)((k90 - k10) * ADC_BURST_PERIOD_US) : TRANSIENT_NA;
+    // 末段本身还在稳定带外（或根本没离开过：切换前已在终值处）视为未稳定 / 立即稳定
+    f->settle_us = k >= ADC_BURST_SCANS - TRANSIENT_TAIL ? TRANSIENT_NA : k < 0 ? 0 : scan_us((uint32_t)k + 1);
+    PROF_STOP(PROF_TRANSIENT, t0);
+}
+
+/**
+  * @brief  开始上传一段波形（覆盖正在进行的上传）
+  * @param  wave: ADC_Burst_Take 返回的波形，上传结束前不得再次 ADC_Burst_Arm（或先 Transient_UploadCancel）
+  */
+void Transient_Upload(const uint16_t *wave)
+{
+    wave_src = wave;
+    wave_next = 0;
+}
+
+// 中止上传（重新启动瞬态采集之前调用）
+void Transient_UploadCancel(void)
+{
+    wave_src = NULL;
+}
+
+/**
+  * @brief  按遥测缓冲余量发送波形帧，至少保留 TRANSIENT_WAVE_RESERVE 字节（周期任务中调用）
+  */
+void Transient_UploadPoll(void)
+{
+    uint8_t n;
+    while (wave_src && wave_next < ADC_BURST_SCANS) {
+        n = ADC_BURST_SCANS - wave_next < TRANSIENT_WAVE_SCANS ? (uint8_t)(ADC_BURST_SCANS - wave_next) : TRANSIENT_WAVE_SCANS;
+        if (Telemetry_Free() < TLM_FRAME_LEN(2 + 2 * ADC_BURST_CHANNELS * n) + TRANSIENT_WAVE_RESERVE) return;
+        Telemetry_SendWave(wave_next, &wave_src[wave_next * ADC_BURST_CHANNELS], n);
+        wave_next += n;
+    }
+    wave_src = NULL;
+}
@@ -0,0 +1,36 @@
+/*
+ * transient.h
+ *
+ *  继电器切换瞬态分析：从 ADC_Burst_Take 取得的高速采集波形中提取特征（阶跃幅度、峰值、
+ *  上升时间、稳定时间），并可把整段波形分帧经遥测上传（TLM_TYPE_WAVE，由周期任务按缓冲余量发送）。
+ */
+#ifndef TRANSIENT_H_
+#define TRANSIENT_H_
+
+#include "stm32f1xx_hal.h"
+#include "adc_block.h"
+
+#define TRANSIENT_TAIL      64   // 末段平均的点数（与一个抽取输出的扫描数相同，噪声相当）
+#define TRANSIENT_BAND_PCT  5    // 稳定带：终值 ± 阶跃幅度的这个百分比
+#define TRANSIENT_BAND_MIN  (4 * ADC_OUT_SCALE)  // 稳定带下限（约 4 个 12 位 LSB，单点噪声）
+#define TRANSIENT_MIN_STEP  (8 * ADC_OUT_SCALE)  // 阶跃小于此值时不计算上升时间
+#define TRANSIENT_NA        0xFFFF               // 上升 / 稳定时间无效
+
+#define TRANSIENT_WAVE_SCANS   7   // 每个 TLM_TYPE_WAVE 帧的扫描数（2 + 7 × 4 = 30 字节负载）
+#define TRANSIENT_WAVE_RESERVE 64  // 上传时至少给其它遥测帧留的缓冲字节数
+
+// 一路的瞬态特征（计数均为 ADC_RES_BITS 位，与 adc_sample_t.val 同单位）
+typedef struct {
+    uint16_t final;       // 末 TRANSIENT_TAIL 点的平均值
+    int16_t step;         // 阶跃幅度 = final − 切换前基线
+    int16_t peak;         // 阶跃方向上相对基线的最大偏移（peak − step 为过冲）
+    uint16_t rise_us;     // 10% → 90% 上升时间（阶跃太小为 TRANSIENT_NA）
+    uint16_t settle_us;   // 从切换到最后一次离开稳定带的时间（采集窗口内未稳定为 TRANSIENT_NA）
+} transient_feat_t;
+
+void Transient_Extract(const uint16_t *wave, uint8_t ch, uint16_t baseline, transient_feat_t *f);
+void Transient_Upload(const uint16_t *wave);
+void Transient_UploadCancel(void);
+void Transient_UploadPoll(void);
+
+#endif /* TRANSIENT_H_ */
@@ -0,0 +1,245 @@
+/*
+ * meas_replay.c
+ *
+ *  测量核心（icode/measure.c）的上位机回放与评估工具：把录制的抽取输出逐个交给 Meas_Sample，
+ *  统计每次测试从开始到判定的时间和判定是否正确，用于离线调整稳定判据、超时和滤波深度。
+ *  与固件编译同一份 measure.c，时间取自记录数据，不需要 HAL。
+ *
+ *  记录文件（文本，每行一项，# 之后为注释，字段以空格或逗号分隔）:
+ *    test [pass|fail]          开始一次测试；可选给出该工件的已知结果，不给时以参考值判定
+ *    r t_ms v0 v1 v2 v3        继电器断开段的一个抽取输出（t_ms 从测试开始算起，v 顺序同 CH_*）
+ *    b t_ms v0 v1 v2 v3        继电器接通段的一个抽取输出（t_ms 从继电器接通算起）
+ *  v 为固件 TLM_TYPE_SAMPLE 帧中的原始值（ADC_RES_BITS 位）。每段应录得比超时更长，
+ *  回放时在 r 段判定后从 b 段开头接着送入，任何判据下都能取到对应时刻的输出。
+ *  参考值：r 段最后一个输出的电阻、b 段最后一个输出相对 r 段末背景的磁场（视为已完全稳定）。
+ *
+ *  用法:
+ *    meas_replay [-w wait_ms] [-c capture_ms] [-r range] [-n count] [-d depth] [-F full_counts] [-v] trace.txt
+ *    -d depth  在记录的输出上再做 depth 点块平均（等效 ADC_OSR_LOG2 + log2(depth)），默认 1
+ *    其余选项默认取 measure.h 中的宏；-v 逐个测试打印
+ *
+ *  编译:
+ *    gcc -O2 -std=c99 -Wall -I../icode meas_replay.c ../icode/measure.c -o meas_replay
+ */
+#define _POSIX_C_SOURCE 199309L
+#include "measure.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FULL_COUNTS_DEFAULT (4095 * 8)   // 满量程计数（4095 × ADC_OUT_SCALE，ADC_RES_BITS = 15）
+
+typedef struct {
+    uint32_t t_ms;
+    uint16_t v[MEAS_CHANNELS];
+} sample_t;
+
+typedef struct {
+    sample_t *s;
+    int n, cap;
+} seg_t;
+
+typedef struct {
+    seg_t r, b;
+    int expect;              // 1 合格，0 不合格，-1 未给出
+    int line;                // test 行号（报告用）
+} trace_test_t;
+
+static meas_cfg_t cfg = MEAS_CFG_DEFAULT;
+static const meas_limits_t limits = { TX_R_MIN, TX_R_MAX, RX_R_MIN, RX_R_MAX, EPS };
+static const meas_consts_t consts = { VREF_UV, R_CENTI_PER_V, R_ZERO_CENTI, B_UV_PER_CENTI };
+static meas_conv_t conv;
+static int depth = 1;
+static int verbose;
+
+// 统计
+static int n_tests, n_decided, n_correct, n_fp, n_fn;
+static double sum_cycle;
+static uint32_t max_cycle;
+static int32_t max_dr, max_db;
+static long long n_calls;
+static double call_ns;
+
+static void seg_push(seg_t *g, const sample_t *x)
+{
+    if (g->n == g->cap) {
+        g->cap = g->cap ? g->cap * 2 : 64;
+        g->s = (sample_t *)realloc(g->s, (size_t)g->cap * sizeof(sample_t));
+        if (!g->s) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    g->s[g->n++] = *x;
+}
+
+// 第 k 个（深度 depth 块平均后的）输出；k 超出时返回 0
+static int seg_get(const seg_t *g, int k, sample_t *out)
+{
+    int i, ch, base = k * depth;
+    uint32_t acc[MEAS_CHANNELS] = { 0 };
+    if (base + depth > g->n) return 0;
+    for (i = 0; i < depth; i++)
+        for (ch = 0; ch < MEAS_CHANNELS; ch++)
+            acc[ch] += g->s[base + i].v[ch];
+    for (ch = 0; ch < MEAS_CHANNELS; ch++)
+        out->v[ch] = (uint16_t)((acc[ch] + depth / 2) / depth);
+    out->t_ms = g->s[base + depth - 1].t_ms;
+    return 1;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static meas_ev_t feed(meas_run_t *m, const sample_t *x, uint32_t now)
+{
+    double t0 = now_ns();
+    meas_ev_t ev = Meas_Sample(m, &cfg, &conv, x->v, now);
+    call_ns += now_ns() - t0;
+    n_calls++;
+    return ev;
+}
+
+static int32_t iabs(int32_t x) { return x < 0 ? -x : x; }
+
+// 回放一次测试并累计统计
+static void run_test(const trace_test_t *t)
+{
+    meas_run_t m, ref;
+    sample_t x;
+    uint32_t t_r = 0, t_b = 0, cycle;
+    int k, pass, ref_pass, expect;
+
+    if (t->r.n == 0 || t->b.n == 0) {
+        fprintf(stderr, "line %d: test without r or b samples, skipped\n", t->line);
+        return;
+    }
+    n_tests++;
+
+    // 参考值：两段的最后一个原始输出
+    memset(&ref, 0, sizeof(ref));
+    ref.tx_B_offset = t->r.s[t->r.n - 1].v[CH_TX_B];
+    ref.rx_B_offset = t->r.s[t->r.n - 1].v[CH_RX_B];
+    ref.tx_R = Meas_R(&conv, t->r.s[t->r.n - 1].v[CH_TX_R]);
+    ref.rx_R = Meas_R(&conv, t->r.s[t->r.n - 1].v[CH_RX_R]);
+    Meas_SetB(&ref, &conv, t->b.s[t->b.n - 1].v[CH_TX_B], t->b.s[t->b.n - 1].v[CH_RX_B]);
+    ref_pass = Meas_Judge(&ref, &limits);
+    expect = t->expect >= 0 ? t->expect : ref_pass;
+
+    Meas_Begin(&m, 0);
+    for (k = 0; seg_get(&t->r, k, &x); k++)
+        if (feed(&m, &x, x.t_ms) == MEAS_EV_R_DONE) {
+            t_r = x.t_ms;
+            break;
+        }
+    if (m.phase == MEAS_PHASE_B) {
+        for (k = 0; seg_get(&t->b, k, &x); k++)
+            if (feed(&m, &x, t_r + x.t_ms) == MEAS_EV_B_DONE) {
+                t_b = x.t_ms;
+                break;
+            }
+    }
+    if (m.phase != MEAS_PHASE_DONE) {
+        printf("line %d: no decision, trace shorter than the timeouts\n", t->line);
+        return;
+    }
+
+    n_decided++;
+    cycle = t_r + t_b;
+    pass = Meas_Judge(&m, &limits);
+    sum_cycle += cycle;
+    if (cycle > max_cycle) max_cycle = cycle;
+    if (iabs(m.tx_R - ref.tx_R) > max_dr) max_dr = iabs(m.tx_R - ref.tx_R);
+    if (iabs(m.rx_R - ref.rx_R) > max_dr) max_dr = iabs(m.rx_R - ref.rx_R);
+    if (iabs(m.tx_B - ref.tx_B) > max_db) max_db = iabs(m.tx_B - ref.tx_B);
+    if (iabs(m.rx_B - ref.rx_B) > max_db) max_db = iabs(m.rx_B - ref.rx_B);
+    if (pass == expect) n_correct++;
+    else if (pass) n_fp++;
+    else n_fn++;
+
+    if (verbose)
+        printf("line %d: %4u ms (R %u + B %u)  R %d %d  B %d %d  %s%s\n", t->line, (unsigned)cycle,
+               (unsigned)t_r, (unsigned)t_b, (int)m.tx_R, (int)m.rx_R, (int)m.tx_B, (int)m.rx_B,
+               pass ? "pass" : "fail", pass == expect ? "" : "  << wrong");
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: meas_replay [-w wait_ms] [-c capture_ms] [-r range] [-n count] [-d depth] "
+                    "[-F full_counts] [-v] trace.txt\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *f;
+    char buf[256], *p, tag[8], res[8];
+    trace_test_t t;
+    sample_t x;
+    int i, line = 0, have = 0, full = FULL_COUNTS_DEFAULT;
+    unsigned tm, v[MEAS_CHANNELS];
+
+    for (i = 1; i < argc - 1; i++) {
+        if (!strcmp(argv[i], "-v")) { verbose = 1; continue; }
+        if (i + 1 >= argc - 1) usage();
+        if (!strcmp(argv[i], "-w")) cfg.wait_timeout_ms = (uint16_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-c")) cfg.capture_timeout_ms = (uint16_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-r")) cfg.settle_range = (uint16_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-n")) cfg.settle_count = (uint8_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-d")) depth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-F")) full = atoi(argv[++i]);
+        else usage();
+    }
+    if (i != argc - 1 || depth < 1 || full <= 0) usage();
+    if (!(f = fopen(argv[argc - 1], "r"))) {
+        perror(argv[argc - 1]);
+        return 1;
+    }
+    Meas_ConvInit(&conv, &consts, full);
+    memset(&t, 0, sizeof(t));
+
+    while (fgets(buf, sizeof(buf), f)) {
+        line++;
+        if ((p = strchr(buf, '#')) != NULL) *p = 0;
+        for (p = buf; *p; p++)
+            if (*p == ',') *p = ' ';
+        if (sscanf(buf, "%7s", tag) != 1) continue;
+        if (!strcmp(tag, "test")) {
+            if (have) run_test(&t);
+            t.r.n = t.b.n = 0;
+            t.line = line;
+            t.expect = -1;
+            if (sscanf(buf, "%*s %7s", res) == 1) t.expect = !strcmp(res, "pass");
+            have = 1;
+            continue;
+        }
+        if ((strcmp(tag, "r") && strcmp(tag, "b")) || !have ||
+            sscanf(buf, "%*s %u %u %u %u %u", &tm, &v[0], &v[1], &v[2], &v[3]) != 5) {
+            fprintf(stderr, "line %d: bad record\n", line);
+            return 1;
+        }
+        x.t_ms = tm;
+        for (i = 0; i < MEAS_CHANNELS; i++) x.v[i] = (uint16_t)v[i];
+        seg_push(tag[0] == 'r' ? &t.r : &t.b, &x);
+    }
+    if (have) run_test(&t);
+    fclose(f);
+
+    printf("settle range %u count %u, timeouts %u / %u ms, depth %d\n", (unsigned)cfg.settle_range,
+           (unsigned)cfg.settle_count, (unsigned)cfg.wait_timeout_ms, (unsigned)cfg.capture_timeout_ms, depth);
+    printf("tests %d, decided %d, correct %d (%.1f %%), false pass %d, false fail %d\n", n_tests, n_decided,
+           n_correct, n_decided ? 100.0 * n_correct / n_decided : 0.0, n_fp, n_fn);
+    if (n_decided)
+        printf("time to decision: mean %.0f ms, max %u ms (%.1f parts/min); max |dR| %d, |dB| %d (0.01)\n",
+               sum_cycle / n_decided, (unsigned)max_cycle, 60000.0 * n_decided / sum_cycle, (int)max_dr, (int)max_db);
+    if (n_calls)
+        printf("Meas_Sample: %lld calls, %.0f ns each on this host\n", n_calls, call_ns / n_calls);
+    free(t.r.s);
+    free(t.b.s);
+    return n_decided == n_tests ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+/*
+ * ================================================================
+ * 文件名: app_config.h
+ * 功能概述:
+ *   双摄显示 (dual_camera_capture_display)、双目瞳孔跟踪 (stereo_pupil_tracking)
+ *   与线圈触发抓拍 (coil_trigger_capture) 共用的运行时配置模块（仅头文件，C/C++ 通用）。
+ *
+ *   - 每个程序用一张 cfg_option 表登记可调参数（键名、类型、变量地址、说明），
+ *     变量的初值即编译期默认值（原来的 #define）；
+ *   - 先读 key=value 配置文件，再应用命令行 --key=value 覆盖，
+ *     调参只需改文件或命令行后重启程序，无需重新交叉编译；
+ *   - --help 按配置文件格式打印全部参数及当前值，可直接重定向生成模板。
+ *
+ * 配置文件格式:
+ *   # 注释行（# 之后到行尾均忽略）
+ *   cap_width = 1280
+ *   cam_left  = /dev/video21
+ *
+ * 命令行:
+ *   prog [-c FILE | --config=FILE] [--key=value | --key value ...] [-h | --help]
+ *   未指定 -c 时尝试读取程序给出的默认路径（文件不存在不算错误）；
+ *   键名中的 '-' 与 '_' 等价（--cap-width=1280）。
+ *
+ * 典型用法:
+ *   static int width = 640;
+ *   static char dev[CFG_STR_LEN] = "/dev/video21";
+ *   static const struct cfg_option opts[] = {
+ *       CFG_INT("width", &width, "采集宽度"),
+ *       CFG_STR("dev", dev, "摄像头节点"),
+ *   };
+ *   int rc = cfg_parse_args(opts, CFG_COUNT(opts), argc, argv, "/root/app.conf");
+ *   if (rc != 0) return rc > 0 ? 0 : 1;        // 1 = 已打印帮助，-1 = 参数错误
+ *
+ * 错误处理:
+ *   出错时向 stderr 打印来源（文件名:行号 或 命令行）与原因并返回 -1。
+ * ================================================================
+ */
+#ifndef APP_CONFIG_H
+#define APP_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+
+#define CFG_STR_LEN  128              // 字符串参数的缓冲长度（含结尾 '\0'）
+#define CFG_LINE_MAX 512              // 配置文件单行最大长度
+
+enum cfg_type {
+    CFG_TYPE_INT,                     // int
+    CFG_TYPE_FLOAT,                   // float
+    CFG_TYPE_STR                      // char[CFG_STR_LEN]
+};
+
+struct cfg_option {
+    const char *key;                  // 键名（小写 + 下划线）
+    enum cfg_type type;
+    void *ptr;                        // 变量地址
+    const char *help;                 // 说明（--help 输出）
+};
+
+#define CFG_INT(key, ptr, help)   { key, CFG_TYPE_INT, (void *)(ptr), help }
+#define CFG_FLOAT(key, ptr, help) { key, CFG_TYPE_FLOAT, (void *)(ptr), help }
+#define CFG_STR(key, buf, help)   { key, CFG_TYPE_STR, (void *)(buf), help }
+#define CFG_COUNT(opts)           ((int)(sizeof(opts) / sizeof((opts)[0])))
+
+// 键名比较：'-' 与 '_' 视为相同
+static inline int cfg_key_eq(const char *a, const char *b, size_t blen) {
+    size_t i = 0;
+    for (; i < blen && a[i]; i++) {
+        char x = a[i] == '-' ? '_' : a[i], y = b[i] == '-' ? '_' : b[i];
+        if (x != y) return 0;
+    }
+    return i == blen && a[i] == '\0';
+}
+
+static inline const struct cfg_option *cfg_find(const struct cfg_option *opts, int n,
+                                                const char *key, size_t len) {
+    for (int i = 0; i < n; i++)
+        if (cfg_key_eq(opts[i].key, key, len)) return &opts[i];
+    return NULL;
+}
+
+/**
+ * 函数名: cfg_set
+ * 功能描述: 按参数类型解析 value 并写入变量，origin 仅用于错误信息。
+ *
+ * 返回值:
+ *   0 成功，-1 键名未知或取值非法（变量保持原值）
+ */
+static inline int cfg_set(const struct cfg_option *opts, int n, const char *key, size_t key_len,
+                          const char *value, const char *origin) {
+    const struct cfg_option *o = cfg_find(opts, n, key, key_len);
+    if (!o) {
+        fprintf(stderr, "[CFG] %s: unknown key '%.*s'\n", origin, (int)key_len, key);
+        return -1;
+    }
+    char *end = NULL;
+    errno = 0;
+    switch (o->type) {
+    case CFG_TYPE_INT: {
+        long v = strtol(value, &end, 0);
+        if (end == value || *end != '\0' || errno == ERANGE || v != (long)(int)v) break;
+        *(int *)o->ptr = (int)v;
+        return 0;
+    }
+    case CFG_TYPE_FLOAT: {
+        float v = strtof(value, &end);
+        if (end == value || *end != '\0' || errno == ERANGE) break;
+        *(float *)o->ptr = v;
+        return 0;
+    }
+    case CFG_TYPE_STR:
+        if (strlen(value) >= CFG_STR_LEN) {
+            fprintf(stderr, "[CFG] %s: value of '%s' too long (max %d)\n", origin, o->key,
+                    CFG_STR_LEN - 1);
+            return -1;
+        }
+        strcpy((char *)o->ptr, value);
+        return 0;
+    }
+    fprintf(stderr, "[CFG] %s: invalid value '%s' for '%s'\n", origin, value, o->key);
+    return -1;
+}
+
+// 去掉首尾空白（原地修改），返回新的起始位置
+static inline char *cfg_trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *e = s + strlen(s);
+    while (e > s && isspace((unsigned char)e[-1])) *--e = '\0';
+    return s;
+}
+
+/**
+ * 函数名: cfg_load_file
+ * 功能描述:
+ *   读取 key=value 配置文件，逐行调用 cfg_set()。
+ *
+ * 输入参数:
+ *   required - 0 = 文件不存在时静默返回 0（默认路径），1 = 必须存在（-c 指定）
+ *
+ * 返回值:
+ *   0 成功，-1 文件打不开或任一行有错（已读入的有效行仍然生效）
+ */
+static inline int cfg_load_file(const struct cfg_option *opts, int n, const char *path, int required) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        if (!required && errno == ENOENT) return 0;
+        fprintf(stderr, "[CFG] %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    char line[CFG_LINE_MAX], origin[CFG_STR_LEN + 16];
+    int lineno = 0, rc = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        snprintf(origin, sizeof(origin), "%.*s:%d", CFG_STR_LEN, path, lineno);
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *s = cfg_trim(line);
+        if (*s == '\0') continue;
+        char *eq = strchr(s, '=');
+        if (!eq) {
+            fprintf(stderr, "[CFG] %s: expected key = value\n", origin);
+            rc = -1;
+            continue;
+        }
+        *eq = '\0';
+        char *key = cfg_trim(s), *value = cfg_trim(eq + 1);
+        if (cfg_set(opts, n, key, strlen(key), value, origin) != 0) rc = -1;
+    }
+    fclose(fp);
+    if (rc == 0) printf("[CFG] Loaded %s\n", path);
+    return rc;
+}
+
+/**
+ * 函数名: cfg_print
+ * 功能描述: 按配置文件格式打印全部参数的当前值（每项前一行为说明注释）。
+ */
+static inline void cfg_print(const struct cfg_option *opts, int n, FILE *out) {
+    for (int i = 0; i < n; i++) {
+        const struct cfg_option *o = &opts[i];
+        fprintf(out, "# %s\n", o->help);
+        switch (o->type) {
+        case CFG_TYPE_INT:   fprintf(out, "%s = %d\n", o->key, *(const int *)o->ptr); break;
+        case CFG_TYPE_FLOAT: fprintf(out, "%s = %g\n", o->key, *(const float *)o->ptr); break;
+        case CFG_TYPE_STR:   fprintf(out, "%s = %s\n", o->key, (const char *)o->ptr); break;
+        }
+    }
+}
+
+/**
+ * 函数名: cfg_parse_args
+ * 功能描述:
+ *   1. 在命令行中查找 -c FILE / --config=FILE，读取该文件；未指定时读取 default_path（可不存在）；
+ *   2. 依次应用其余的 --key=value / --key value，后出现的覆盖先出现的；
+ *   3. 出现 -h / --help 时打印用法与当前值（已包含文件与命令行的覆盖）。
+ *
+ * 返回值:
+ *   0 继续运行，1 已打印帮助（调用方正常退出），-1 参数错误
+ */
+static inline int cfg_parse_args(const struct cfg_option *opts, int n, int argc, char **argv,
+                                 const char *default_path) {
+    // ---------- 1. 配置文件 ----------
+    const char *path = NULL;
+    int help = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) path = argv[++i];
+        else if (strncmp(argv[i], "--config=", 9) == 0) path = argv[i] + 9;
+        else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) help = 1;
+    }
+    int rc = 0;
+    if (path) rc = cfg_load_file(opts, n, path, 1);
+    else if (default_path) rc = cfg_load_file(opts, n, default_path, 0);
+
+    // ---------- 2. 命令行覆盖 ----------
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "-c") == 0) { i++; continue; }
+        if (strncmp(a, "--config=", 9) == 0 || strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0)
+            continue;
+        if (strncmp(a, "--", 2) != 0) {
+            fprintf(stderr, "[CFG] command line: unexpected argument '%s'\n", a);
+            rc = -1;
+            continue;
+        }
+        a += 2;
+        const char *eq = strchr(a, '=');
+        if (eq) {
+            if (cfg_set(opts, n, a, (size_t)(eq - a), eq + 1, "command line") != 0) rc = -1;
+        } else if (i + 1 < argc) {
+            if (cfg_set(opts, n, a, strlen(a), argv[++i], "command line") != 0) rc = -1;
+        } else {
+            fprintf(stderr, "[CFG] command line: missing value for '--%s'\n", a);
+            rc = -1;
+        }
+    }
+
+    // ---------- 3. 帮助 ----------
+    if (help) {
+        printf("Usage: %s [-c FILE] [--key=value ...]\n", argv[0]);
+        printf("Default config file: %s\n\n", default_path ? default_path : "(none)");
+        cfg_print(opts, n, stdout);
+        return rc < 0 ? -1 : 1;
+    }
+    return rc;
+}
+
+#endif  // APP_CONFIG_H
@@ -1,17 +1,41 @@
 #include <stdio.h>      // 标准输入输出
 #include <stdlib.h>     // 标准库函数
+#include <stdint.h>     // 定长整数（归档索引格式）
 #include <unistd.h>     // UNIX 标准函数定义，如 read/write/usleep
 #include <fcntl.h>      // 文件控制定义 open()
 #include <sys/types.h>  // 系统数据类型
 #include <sys/wait.h>   // 进程等待 wait()
 #include <errno.h>      // 错误处理 errno
 #include <string.h>     // 字符串处理函数
+#include <limits.h>     // PATH_MAX（sysfs 路径缓冲）
 #include <time.h>       // 时间与延时
+#include <sys/time.h>   // gettimeofday()/struct timeval
 #include <sys/stat.h>   // 文件属性定义 mkdir/stat
 #include <arpa/inet.h>  // IP 地址转换
 #include <netinet/in.h> // 网络结构定义
 #include <sys/socket.h> // 套接字接口
 #include <dirent.h>     // 目录操作（opendir/readdir）
+#include <poll.h>       // poll() 等待摄像头帧就绪
+#include <sys/ioctl.h>  // ioctl() V4L2 控制
+#include <sys/mman.h>   // mmap() 映射摄像头缓冲区
+#include <sys/uio.h>    // writev() 分段写文件
+#include <linux/videodev2.h> // V4L2 接口定义
+#include <pthread.h>    // 后台采集线程
+#include <semaphore.h>  // 写盘队列的空/满计数
+#include <linux/gpio.h>  // GPIO 字符设备接口（/dev/gpiochipN 行请求）
+#include <sys/signalfd.h> // signalfd 在事件循环中接收 SIGUSR1（导出跟踪记录）
+#include <signal.h>     // sigprocmask
+#include <sys/timerfd.h> // timerfd 定时事件（采样周期、拍摄与线圈保持超时）
+#include <termios.h>    // 串口参数（测试仪遥测链路）
+#include <setjmp.h>     // libjpeg 出错时跳回（坏帧不终止进程）
+#include <jpeglib.h>    // 缩略图：DCT 缩放解码后重新编码（链接 -ljpeg）
+#include <sys/epoll.h>  // 内置图库 HTTP 服务的事件循环
+#include <sys/sendfile.h> // 图库服务零拷贝发送磁盘上的归档
+#include <sys/resource.h> // setpriority() 降低图库线程优先级
+#include <sys/syscall.h> // SYS_gettid
+#include <netinet/tcp.h> // TCP_NODELAY
+#include "app_config.h"  // 共享运行时配置（配置文件 + 命令行）
+#include "v4l2_camera.h" // 共享 V4L2 摄像头模块（V4L2 后端使用）
 
 // ----------------- 参数定义区 -----------------
 #define GPIO_A            33           // 控制线圈上电的 GPIO（GPIO33）
@@ -22,15 +46,372 @@
 #define HOLD_TIME_SEC     5            // 线圈保持通电时间（秒）
 #define SAMPLE_US         5000         // ADC 采样周期（微秒）
 
+// GPIO 驱动方式选择
+#define GPIO_BACKEND_SYSFS 0           // /sys/class/gpio/gpioN/value（value 文件常开复用）
+#define GPIO_BACKEND_CDEV  1           // /dev/gpiochipN 行请求，GPIO_A/GPIO_B 一次 ioctl 同时切换
+#define GPIO_BACKEND GPIO_BACKEND_CDEV
+#define GPIO_BANK_LINES    32          // 每个 gpiochip 的引脚数（GPIO33 → gpiochip1 第 1 脚）
+#define GPIO_CONSUMER      "coil_trigger" // 行请求的使用者标签（gpioinfo 中可见）
+
+// ADC 采集方式选择
+#define ADC_MODE_SYSFS    0            // 每 SAMPLE_US 读取一次 in_voltage1_raw（约 200 Hz）
+#define ADC_MODE_BUFFER   1            // IIO 缓冲：触发器定时采样，从 /dev/iio:device0 成块读取
+#define ADC_MODE ADC_MODE_BUFFER
+
+#define IIO_DEV_DIR       "/sys/bus/iio/devices/iio:device0" // ADC 设备 sysfs 目录
+#define IIO_DEV_NODE      "/dev/iio:device0"                 // ADC 缓冲数据字符设备
+#define IIO_CHANNEL       "voltage1"   // 监测的通道（对应 in_voltage1_*）
+#define IIO_TRIGGER_NAME  "coiltrig"   // hrtimer 触发器名称
+#define IIO_HRTIMER_DIR   "/sys/kernel/config/iio/triggers/hrtimer" // configfs 中创建 hrtimer 触发器的目录
+#define IIO_SAMPLE_HZ     2000         // 缓冲模式采样率（Hz）
+#define IIO_BLOCK_SAMPLES 64           // 每次读取的样本块大小（同时作为缓冲水位）
+#define IIO_BUFFER_LEN    1024         // 内核缓冲区长度（样本数）
+#define IIO_MAX_SCAN_BYTES 16          // 单次扫描最大字节数（电压 + 填充 + 64 位时间戳）
+#define ADC_REPORT_US     1000000      // 缓冲模式下电压概要的打印间隔（微秒）
+// 触发源：
+//   - ADC   ：监测 ADC 电压越过阈值（按 ADC_MODE 采样），触发时刻受采样周期与消抖次数影响
+//   - TESTER：接收工装测试仪 USART3 遥测（Fixture_Tester/icode/telemetry.h），继电器接通帧
+//             TLM_TYPE_EXCITE 到达即触发，随后的结果帧 TLM_TYPE_RESULT 附到同一次抓拍；
+//             串口打不开时回退到 ADC 触发
+#define TRIGGER_SOURCE_ADC    0
+#define TRIGGER_SOURCE_TESTER 1
+#define TRIGGER_SOURCE TRIGGER_SOURCE_TESTER
+
+#define TESTER_TTY        "/dev/ttyS3" // 接测试仪 USART3 的串口（只用 RX）
+#define TESTER_BAUD       B115200      // 与固件 huart3 一致
+#define TESTER_BAUD_BPS   115200
+#define TESTER_BYTE_US    (10 * 1000000LL / TESTER_BAUD_BPS) // 每字节传输时间（8N1，约 87 us）
+#define TESTER_REOPEN_MS  1000         // 串口断开（USB 串口拔出）后的重连间隔
+#define TESTER_BURSTS     8            // 记住最近几次触发的测试序号，用于把结果帧对应到抓拍
+
+// 缓冲模式的消抖样本数：保持与 sysfs 模式相同的消抖时长（TRIGGER_COUNT × SAMPLE_US）
+#define IIO_TRIGGER_COUNT ((long long)g_cfg.trigger_count * g_cfg.sample_us * g_cfg.iio_sample_hz / 1000000)
+
 #define MJPG_HOME  "/root/mjpg"        // mjpg_streamer 主目录
 #define WWW_DIR    "/root/mjpg/www"    // HTTP 输出目录
 #define CAPS_DIR   WWW_DIR              // 图像保存目录
 #define HTTP_PORT  8080                // HTTP 端口号
+#define INDEX_MANIFEST "frames.js"    // 追加式帧清单（由 index.html 加载）
+
+// 图像保存布局选择
+#define CAPS_LAYOUT_FLAT    0          // 每帧一个 CAPS_DIR/%03d.jpg（V4L2 浏览服务可实时推送新帧）
+#define CAPS_LAYOUT_ARCHIVE 1          // 每次触发一个打包归档 SESSION_DIR/bNNNNN.jpg（拼接 JPEG + 索引）
+#define CAPS_LAYOUT CAPS_LAYOUT_ARCHIVE
+#define SESSION_DIR_NAME "sessions"    // 归档目录名（相对 CAPS_DIR，网页中按此相对路径访问）
+#define SESSION_DIR  CAPS_DIR "/" SESSION_DIR_NAME
+#define THUMB_DIR_NAME "thumbs"        // 单帧文件布局的缩略图目录（相对 CAPS_DIR；归档布局写 SESSION_DIR/tNNNNN.jpg）
+#define THUMB_DIR    CAPS_DIR "/" THUMB_DIR_NAME
+#define THUMB_DENOM  4                 // 缩略图缩小倍数（libjpeg scale_denom：1/2/4/8，640×480 → 160×120；0 = 不生成）
+#define THUMB_QUALITY 70               // 缩略图 JPEG 质量
+#define ARCHIVE_MAGIC "CAPIDX01"       // 归档尾部标识（8 字节）
 
 #define TARGET_FPS 15                  // 每秒抓取帧数
-#define SNAPSHOT_INTERVAL_US (1000000 / TARGET_FPS) // 每帧间隔时间
+#define SNAPSHOT_INTERVAL_US (1000000 / g_cfg.target_fps) // 每帧间隔时间（随运行时配置）
+
+// 抓帧后端选择
+#define CAPTURE_BACKEND_SNAPSHOT 0     // 每帧一次 HTTP GET /?action=snapshot
+#define CAPTURE_BACKEND_STREAM   1     // mjpg_streamer 长连接 /?action=stream
+#define CAPTURE_BACKEND_V4L2     2     // 进程内直接从 /dev/video0 取 MJPEG（不经过 mjpg_streamer）
+#define CAPTURE_BACKEND CAPTURE_BACKEND_STREAM
+
+#define STREAM_PATH  "/?action=stream" // mjpg_streamer 的 multipart 推流路径
+#define STREAM_RECV_TIMEOUT_MS 1000    // 长连接读超时（毫秒），防止推流中断时永久阻塞
+
+#define V4L2_DEVICE      "/dev/video0" // V4L2 后端使用的摄像头节点
+#define V4L2_WIDTH       640           // 采集宽度
+#define V4L2_HEIGHT      480           // 采集高度
+#define V4L2_BUF_COUNT   CAM_MIN_BUFFERS // mmap 环形缓冲区数量
+#define V4L2_TIMEOUT_MS  1000          // 等待一帧的超时（毫秒）
+#define START_MJPG_VIEWER 1            // V4L2 后端下是否仍启动 mjpg_streamer 作为浏览用 HTTP 服务（gallery_port 为 0 时）
+
+#define PRETRIGGER_US    300000        // 触发前保留的预录时长（微秒）
+#define RING_FRAMES      32            // 内存环形缓冲帧数（需覆盖 预录 + 拍摄时长 内的全部帧）
+#define TRACE_ENABLE     1             // 是否记录时序跟踪事件（kill -USR1 <pid> 导出为 CSV）
+#define TRACE_RING_LEN   4096          // 跟踪环形缓冲事件数（需为 2 的幂）
+#define TRACE_CSV_PATH   "/tmp/coil_trace.csv" // 跟踪记录导出路径
+#define WRITE_QUEUE_LEN  64            // 写盘队列深度（帧），需不小于 RING_FRAMES + 1，保证一次触发的帧可全部入队
+
+// 内置图库 HTTP 服务（独立 epoll 线程，浏览本次运行的抓拍，不经过 mjpg_streamer）
+#define GALLERY_PORT      8081         // 监听端口（0 = 不启动）
+#define GALLERY_MAX_CONN  16           // 最大并发连接数（超出时新连接直接关闭）
+#define GALLERY_REQ_MAX   2048         // 请求头最大长度
+#define GALLERY_IDLE_MS   15000        // keep-alive 空闲连接超时
+#define GALLERY_CHUNK     65536        // 每轮每个连接 sendfile 的最大字节数（多个连接轮流发送）
+#define GALLERY_NICE      10           // 图库线程的 nice 值（低于采集、写盘与主循环）
+#define GALLERY_BUSY_POLL_US 20000     // 抓拍窗口内暂停服务，每隔这么久检查一次是否结束
+
+// mjpg_streamer 输入插件参数：
+//   - UVC   ："-d 设备 -r 宽x高 -f 帧率"，由配置项 v4l2_device / v4l2_width / v4l2_height / target_fps 在运行时拼出
+//   - VIEWER："-f CAPS_DIR" 监视保存目录，将新写入的帧推送给浏览器（摄像头由本进程占用）
+#define MJPG_INPUT_VIEWER "./input_file.so -f " CAPS_DIR
+
+static int g_total_saved = 0;          // 全局变量：记录已分配文件名的总帧数（由主循环维护）
+static int g_total_bursts = 0;         // 全局变量：记录触发次数（归档文件序号）
+
+// ----------------- 运行时配置 -----------------
+// 初值为上面的宏，启动时由配置文件 / 命令行覆盖（app_config.h），之后只读：
+//   coil_trigger_capture [-c FILE] [--key=value ...]，--help 列出全部参数与当前值。
+// 缓冲 / 队列长度、GPIO 编号、后端选择等仍为编译期常量。
+#define CONFIG_FILE "/root/coil_trigger.conf"   // 配置文件默认路径
+
+struct app_settings {
+    char  v4l2_device[CFG_STR_LEN];    // V4L2 后端 / UVC 插件使用的摄像头节点
+    int   v4l2_width, v4l2_height;     // 采集分辨率
+    int   target_fps;                  // 每秒抓取帧数
+    float voltage_thresh;              // 触发电压阈值（V）
+    int   trigger_count;               // 消抖次数
+    int   sample_us;                   // sysfs 模式采样周期
+    int   iio_sample_hz;               // 缓冲模式采样率
+    int   adc_report_us;               // 缓冲模式电压概要打印间隔
+    int   hold_time_us;                // 拍摄持续时间
+    int   hold_time_sec;               // 线圈保持通电时间
+    int   pretrigger_us;               // 预录时长
+    int   http_port;                   // mjpg_streamer HTTP 端口
+    char  tester_tty[CFG_STR_LEN];     // 测试仪遥测串口（TRIGGER_SOURCE_TESTER）
+    int   thumb_denom;                 // 缩略图缩小倍数
+    int   gallery_port;                // 内置图库 HTTP 端口
+};
+
+static app_settings g_cfg = {
+    V4L2_DEVICE, V4L2_WIDTH, V4L2_HEIGHT, TARGET_FPS,
+    VOLTAGE_THRESH, TRIGGER_COUNT, SAMPLE_US, IIO_SAMPLE_HZ, ADC_REPORT_US,
+    HOLD_TIME_US, HOLD_TIME_SEC, PRETRIGGER_US, HTTP_PORT, TESTER_TTY, THUMB_DENOM,
+    GALLERY_PORT,
+};
+
+static const cfg_option g_cfg_opts[] = {
+    CFG_STR("v4l2_device", g_cfg.v4l2_device, "摄像头节点"),
+    CFG_INT("v4l2_width", &g_cfg.v4l2_width, "采集宽度"),
+    CFG_INT("v4l2_height", &g_cfg.v4l2_height, "采集高度"),
+    CFG_INT("target_fps", &g_cfg.target_fps, "每秒抓取帧数"),
+    CFG_FLOAT("voltage_thresh", &g_cfg.voltage_thresh, "触发电压阈值（V）"),
+    CFG_INT("trigger_count", &g_cfg.trigger_count, "连续超过阈值的次数（sysfs 采样周期计）"),
+    CFG_INT("sample_us", &g_cfg.sample_us, "sysfs 模式 ADC 采样周期（us）"),
+    CFG_INT("iio_sample_hz", &g_cfg.iio_sample_hz, "IIO 缓冲模式采样率（Hz）"),
+    CFG_INT("adc_report_us", &g_cfg.adc_report_us, "缓冲模式电压概要打印间隔（us）"),
+    CFG_INT("hold_time_us", &g_cfg.hold_time_us, "触发后拍摄持续时间（us）"),
+    CFG_INT("hold_time_sec", &g_cfg.hold_time_sec, "线圈保持通电时间（s）"),
+    CFG_INT("pretrigger_us", &g_cfg.pretrigger_us, "触发前预录时长（us）"),
+    CFG_INT("http_port", &g_cfg.http_port, "mjpg_streamer HTTP 端口"),
+    CFG_STR("tester_tty", g_cfg.tester_tty, "测试仪遥测串口（继电器接通时触发抓拍）"),
+    CFG_INT("thumb_denom", &g_cfg.thumb_denom, "缩略图缩小倍数（1/2/4/8，0 = 不生成）"),
+    CFG_INT("gallery_port", &g_cfg.gallery_port, "内置图库 HTTP 端口（0 = 不启动）"),
+};
+
+static_assert((PRETRIGGER_US + HOLD_TIME_US) / (1000000 / TARGET_FPS) < RING_FRAMES,
+              "RING_FRAMES too small for PRETRIGGER_US + HOLD_TIME_US");
+static_assert(WRITE_QUEUE_LEN > RING_FRAMES, "WRITE_QUEUE_LEN must hold a full burst");
+static_assert((TRACE_RING_LEN & (TRACE_RING_LEN - 1)) == 0, "TRACE_RING_LEN must be a power of 2");
+
+/**
+ * @brief 内存中的一帧 JPEG（数据缓冲按需扩容并循环复用）
+ */
+typedef struct {
+    unsigned char *data;               // JPEG 数据
+    size_t         len;                // 有效长度
+    size_t         cap;                // 已分配容量
+    long long      ts_us;              // 采集时间戳（CLOCK_MONOTONIC，微秒）
+} cap_frame_t;
+
+/**
+ * @brief 预触发环形缓冲：后台线程持续写入最近 RING_FRAMES 帧，触发时取出时间窗口内的帧
+ */
+typedef struct {
+    cap_frame_t        slots[RING_FRAMES];
+    unsigned long long head;           // 已写入的总帧数（下一帧写入 slots[head % RING_FRAMES]）
+    pthread_mutex_t    lock;
+    pthread_cond_t     cond;           // 每写入一帧广播一次
+} frame_ring_t;
+
+static frame_ring_t g_ring;
+
+/**
+ * @brief 测试仪的一次测试结果（TLM_TYPE_RESULT 负载，测量值为 0.01 单位）
+ */
+typedef struct {
+    uint32_t test_no;                  // 测试序号
+    int      cycle_ms;                 // 测试周期（毫秒）
+    int      tx_R, rx_R;               // 发送端 / 接收端电阻
+    int      tx_B, rx_B;               // 发送端 / 接收端磁场
+    int      pass;                     // 1 = 合格
+    int      slot;                     // 工位（0 起）
+} tester_result_t;
+
+/**
+ * @brief 写盘任务：一帧待保存的图像，一次触发结束的标记，或一次触发对应的测试结果
+ */
+typedef struct {
+    cap_frame_t frame;                 // 图像数据（len == 0 表示仅为结束标记 / 测试结果）
+    int         index;                 // 文件序号（CAPS_DIR/%03d.jpg）；结束标记时为累计总帧数
+    int         burst_end;             // 1 = 本次触发的最后一项：追加帧清单并落盘同步
+    int         burst;                 // 触发序号（归档文件名 bNNNNN.jpg）
+    int         has_result;            // 1 = 仅携带 result：追加到帧清单，关联到第 burst 次触发
+    tester_result_t result;
+} write_job_t;
+
+/**
+ * @brief 归档文件格式（CAPS_LAYOUT_ARCHIVE，小端）
+ *
+ *   [JPEG 0][JPEG 1] ... [JPEG n-1]            —— 原样拼接，文件以第一帧开头
+ *   [archive_entry_t × n]                      —— 每帧的偏移、长度、时间戳
+ *   [archive_footer_t]                         —— 固定 16 字节，位于文件末尾
+ *
+ * 读取时先读末尾 16 字节，校验 magic 后按 index_offset 找到索引表。
+ */
+typedef struct {
+    uint32_t offset;                   // 帧在文件中的起始偏移
+    uint32_t length;                   // 帧长度
+    int64_t  ts_us;                    // 采集时间戳（CLOCK_MONOTONIC，微秒）
+} archive_entry_t;
+
+typedef struct {
+    char     magic[8];                 // ARCHIVE_MAGIC
+    uint32_t count;                    // 帧数
+    uint32_t index_offset;             // 索引表起始偏移
+} archive_footer_t;
+
+static_assert(sizeof(archive_entry_t) == 16 && sizeof(archive_footer_t) == 16,
+              "archive layout must be packed");
+
+/**
+ * @brief 有界单生产者/单消费者写盘队列
+ *
+ * 生产者为主循环（capture_snapshots），消费者为写盘线程。
+ * head 只由生产者修改，tail 只由消费者修改，两个信号量同时起到计数与内存屏障作用。
+ */
+typedef struct {
+    write_job_t  jobs[WRITE_QUEUE_LEN];
+    unsigned int head;                 // 下一个入队位置
+    unsigned int tail;                 // 下一个出队位置
+    sem_t        items;                // 可出队的任务数
+    sem_t        slots;                // 可入队的空位数
+} write_queue_t;
+
+static write_queue_t g_wq;
+
+/**
+ * @brief 帧清单 frames.js 的内存副本（写盘线程追加，图库线程直接从内存发送）
+ *
+ * 清单只追加不修改，长度即版本号，图库服务以 run_id + 长度作为 ETag。
+ */
+static struct {
+    pthread_mutex_t lock;
+    char           *data;
+    size_t          len;
+    size_t          cap;
+    long long       run_id;            // 本次运行的标识（启动时刻），区分不同运行的同名文件
+} g_manifest = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0 };
+
+static int g_capture_busy = 0;         // 1 = 抓拍窗口内（触发至取出帧），图库服务暂停发送
+
+/**
+ * @brief mjpg_streamer multipart 长连接的状态
+ *
+ * 整个程序只建立一次 TCP 连接并发送一次 GET /?action=stream，
+ * 之后服务端按 multipart/x-mixed-replace 格式持续推送 JPEG，
+ * 本结构保存套接字、分隔符以及尚未消费的接收数据。
+ */
+typedef struct {
+    int    sock;                       // 长连接套接字（-1 表示未连接）
+    char   boundary[96];               // multipart 分隔符（已带前导 "--"）
+    char   buf[16384];                 // 接收缓冲区
+    size_t len;                        // buf 中尚未消费的字节数
+} mjpg_stream_t;
+
+static mjpg_stream_t g_stream = { -1, "", "", 0 };
+
+/**
+ * @brief 测试仪遥测帧格式（与 Fixture_Tester/icode/telemetry.h 一致，多字节字段小端）
+ *
+ *   0xA5 0x5A | type | seq | len | payload[len] | crc16（CCITT-FALSE，覆盖 type 至 payload 末尾）
+ */
+#define TLM_SOF0          0xA5
+#define TLM_SOF1          0x5A
+#define TLM_HEADER_LEN    5
+#define TLM_MAX_PAYLOAD   32
+#define TLM_FRAME_LEN(n)  (TLM_HEADER_LEN + (n) + 2)
+#define TLM_TYPE_RESULT   0x01         // u32 测试序号 | u16 周期 ms | i16 tx_R rx_R tx_B rx_B | u8 合格 | u8 工位
+#define TLM_TYPE_EXCITE   0x0B         // u32 测试序号 | u8 工位（继电器接通）
+
+/**
+ * @brief 已解析的一帧遥测
+ */
+typedef struct {
+    int           type;
+    int           len;
+    unsigned char payload[TLM_MAX_PAYLOAD];
+    long long     t_start_us;          // 帧首字节开始传输的估计时刻（CLOCK_MONOTONIC 微秒）
+} tlm_frame_t;
+
+/**
+ * @brief 测试仪遥测串口的接收状态
+ *
+ * 测试仪还会发送采样、瞬态等其它帧，这里按帧头与长度整帧跳过，只处理 EXCITE / RESULT。
+ */
+typedef struct {
+    int           fd;                  // 串口描述符（-1 表示未打开）
+    unsigned char buf[512];            // 接收缓冲
+    size_t        len;                 // buf 中尚未解析的字节数
+    long long     t_rx_us;             // 最近一次 read() 返回的时刻（用于倒推帧的到达时刻）
+    int           seq;                 // 上一帧序号（-1 表示尚未收到）
+    unsigned      lost;                // 按序号推算的丢帧数
+    unsigned      crc_errors;          // CRC 错误次数
+} tester_link_t;
+
+static tester_link_t g_tester;         // fd 在 main() 开始时置 -1（未打开）
+
+/**
+ * @brief 测试仪触发的一次抓拍（测试序号 → 触发序号），结果帧到达时据此找到对应的抓拍
+ */
+typedef struct {
+    uint32_t test_no;
+    int      slot;
+    int      burst;                    // 触发序号
+} tester_burst_t;
+
+static tester_burst_t g_tester_bursts[TESTER_BURSTS];
+static int g_tester_burst_count = 0;   // 已记录的总次数（第 n 条位于 [n % TESTER_BURSTS]，循环覆盖最旧的）
+
+/**
+ * @brief 进程内 V4L2 MJPEG 采集状态（CAPTURE_BACKEND_V4L2 使用，fd = -1 表示未打开）
+ */
+static cam_device g_cam;               // fd 在 main() 开始时置 -1（未打开）
+
+/**
+ * @brief 线圈控制 GPIO（GPIO_A / GPIO_B）的句柄
+ *
+ * 字符设备方式下两个引脚在同一个行请求中，一次 ioctl 同时切换；
+ * sysfs 方式下缓存两个 value 文件描述符，避免每次切换都重新打开文件。
+ */
+typedef struct {
+    int req_fd;                        // GPIO_V2 行请求描述符（-1 表示未使用字符设备）
+    int fd_a;                          // sysfs 方式：GPIO_A 的 value 文件
+    int fd_b;                          // sysfs 方式：GPIO_B 的 value 文件
+} coil_gpio_t;
+
+static coil_gpio_t g_coil = { -1, -1, -1 };
+
+/**
+ * @brief IIO 缓冲模式的通道存储格式（来自 scan_elements/in_xxx_type）
+ */
+typedef struct {
+    int is_be;                         // 大端存储
+    int is_signed;                     // 有符号
+    int bits;                          // 有效位数
+    int bytes;                         // 存储字节数
+    int shift;                         // 右移位数
+} iio_chan_fmt_t;
 
-static int g_total_saved = 0;          // 全局变量：记录已保存的总帧数
+/**
+ * @brief IIO 缓冲采集状态（ADC_MODE_BUFFER 使用）
+ */
+typedef struct {
+    int            fd;                 // /dev/iio:deviceX 描述符（-1 表示未启用）
+    iio_chan_fmt_t fmt;                // 电压通道格式
+    int            scan_bytes;         // 每次扫描的字节数
+    int            ts_offset;          // 时间戳在扫描中的偏移（-1 表示无时间戳通道）
+    float          scale;              // ADC 单位比例因子（mV/bit）
+} iio_buf_t;
 
 // ----------------- 工具函数：目录与文件管理 -----------------
 
@@ -93,14 +474,14 @@ static int mkdir_p(const char *path, mode_t mode){
 }
 
 /**
- * @brief 删除 CAPS_DIR（通常为 /root/mjpg/www）目录下旧的 .jpg 文件和 index.html 文件
+ * @brief 删除 CAPS_DIR（通常为 /root/mjpg/www）目录下旧的 .jpg 文件、index.html 与 frames.js
  *
  * 功能：
  *   - 程序启动前执行，清空上次运行残留的截图文件
  *   - 保证新的拍摄内容不会混入旧数据
  *
  * 注意：
- *   - 仅删除指定类型文件（.jpg 与 index.html）
+ *   - 仅删除指定类型文件（.jpg、index.html 与 frames.js）
  *   - 不会删除其他文件或子目录，安全性较高
  *
  * @return int  始终返回 0（即使目录不存在也不会报错）
@@ -128,10 +509,11 @@ static int rm_caps_dir_contents(void) {
         // 判断文件是否是 ".jpg" 结尾（不区分大小写）
         int is_jpg = (L >= 4 && (strcasecmp(ent->d_name + L - 4, ".jpg") == 0));
 
-        // 判断文件是否为 "index.html"
-        int is_index = (strcasecmp(ent->d_name, "index.html") == 0);
+        // 判断文件是否为 "index.html" 或帧清单 "frames.js"
+        int is_index = (strcasecmp(ent->d_name, "index.html") == 0 ||
+                        strcasecmp(ent->d_name, INDEX_MANIFEST) == 0);
 
-        // 如果既不是 jpg，也不是 index.html，则跳过不删
+        // 如果既不是 jpg，也不是 index.html / frames.js，则跳过不删
         if (!(is_jpg || is_index))
             continue;
 
@@ -149,76 +531,220 @@ static int rm_caps_dir_contents(void) {
     return 0;
 }
 
+/**
+ * @brief 清理上次运行的归档 / 缩略图目录
+ *
+ * 功能：
+ *   - 将 dir（SESSION_DIR 或 THUMB_DIR）整体改名（一次 rename，立即生效），再新建空目录
+ *   - 改名后的旧目录由后台 `rm -rf` 孙进程删除，启动流程不等待
+ *   - 两次 fork：中间子进程立即退出并被回收，孙进程由 init 收养，不留僵尸进程
+ */
+static void rm_session_dir(const char *dir) {
+    char old[256];
+    snprintf(old, sizeof(old), "%s.old.%d", dir, (int)getpid());
+    if (rename(dir, old) == 0) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (fork() == 0) {
+                execlp("rm", "rm", "-rf", old, (char *)NULL);
+                _exit(127);
+            }
+            _exit(0);
+        }
+        if (pid > 0) waitpid(pid, NULL, 0);
+    }
+    mkdir_p(dir, 0755);
+}
+
 /**
  * @brief 自动生成一个简易网页 (index.html)，用于在浏览器中查看捕获到的图像帧
  *
  * 功能：
- *   - 生成 /root/mjpg/www/index.html 文件
- *   - 每个已保存的 jpg 图像自动在网页中以缩略图形式显示
- *   - 点击缩略图可放大查看原图
+ *   - 生成 /root/mjpg/www/index.html 文件（程序启动时写一次，之后不再改写）
+ *   - 页面先加载追加式清单 frames.js，再把清单中的每帧以缩略图显示（只下载采集时生成的
+ *     小图，缺少缩略图的帧回退为原图）
+ *   - 每次触发前显示一行标题；测试仪触发时附该次测试的结果（R[触发序号]）
+ *   - 点击缩略图在新窗口打开原图（归档布局下点击时才下载整个原图归档）
  *   - 页面支持自动排版（CSS Flex 布局）
  *
- * @param count 当前已有的帧数（用于决定生成多少个 <img> 标签）
+ * 说明：
+ *   - 每次触发只需向 frames.js 追加一行（见 append_index_manifest()），
+ *     开销与新增帧数成正比，与累计帧数无关
+ *   - 同时清空 frames.js，使清单与本次运行的图像目录一致
  */
-static void write_index_html(int count){
-    // ---------------- HTML 页面头部模板 ----------------
+static void write_index_html(void){
+    // ---------------- HTML 页面模板 ----------------
     // 包含页面标题、CSS 样式、图像布局和 JS 逻辑
-    const char *head =
+    const char *page =
             "<!doctype html><meta charset='utf-8'><title>Caps</title>"
             "<style>"
             "body{font-family:sans-serif;margin:20px}"           // 设置字体和边距
             "img{max-width:320px;margin:8px;border:1px solid #ddd;border-radius:8px}" // 图像样式（缩略图效果）
             ".wrap{display:flex;flex-wrap:wrap}"                 // 使用 Flex 布局使图片自动换行
+            ".cap{flex-basis:100%;margin:12px 8px 0}.fail{color:#c00}" // 每次触发的标题独占一行
             "</style>"
             "<h3>Captured Frames</h3><div class='wrap' id='g'></div>" // 页面标题与图片容器
+            "<script>const F=[],R={};</script>\n"               // 清单数组与测试结果表，由 frames.js 逐行填入
+            "<script src='" INDEX_MANIFEST "'></script>\n"
             "<script>\n"
-            "const g=document.getElementById('g');\n";           // JS 获取图片容器元素
-
-    // ---------------- HTML 页面尾部模板 ----------------
-    const char *tail = "</script>\n";
+            "const g=document.getElementById('g');\n"           // JS 获取图片容器元素
+            /**
+             * 每张图片都生成一个 <a><img></a> 元素：
+             *   - <a> 标签       ：点击图片后打开原图（新窗口）
+             *   - <img> 标签     ：显示缩略图 s；没有缩略图或加载失败时改为显示原图
+             *   - appendChild()  ：把图片插入到网页的 #g 容器中
+             *
+             * 原图 u 为 URL 字符串，或返回 Promise<URL> 的函数（归档中的帧，首次用到时才下载归档）
+             *
+             * 最终 HTML 效果：
+             *   <a href="000.jpg" target="_blank"><img src="thumbs/000.jpg"></a>
+             *   （归档中的帧使用 blob: URL）
+             */
+            "function add(u,s,n){"
+            "const a=document.createElement('a');"
+            "a.target='_blank';a.title=n;"
+            "const f=typeof u==='string'?()=>Promise.resolve(u):u;"
+            "if(typeof u==='string')a.href=u;"
+            "else a.onclick=ev=>{ev.preventDefault();const w=window.open('');f().then(x=>{w.location.href=x;});};"
+            "const img=new Image();img.alt=n;"
+            "img.onerror=()=>{img.onerror=null;f().then(x=>{img.src=x;});};"
+            "if(s)img.src=s;else img.onerror();"
+            "a.appendChild(img);"
+            "g.appendChild(a);}\n"
+            // 触发标题：触发序号，若有测试结果 {n:测试序号,s:工位,p:合格,c:周期ms,v:[tx_R,rx_R,tx_B,rx_B]×0.01}
+            "function cap(b){"
+            "const r=R[b],h=document.createElement('div');"
+            "h.className='cap'+(r&&!r.p?' fail':'');"
+            "h.textContent='#'+b+(r?' test '+r.n+' slot '+r.s+(r.p?' PASS':' FAIL')"
+            "+' tx_R='+r.v[0]/100+' rx_R='+r.v[1]/100+' tx_B='+r.v[2]/100+' rx_B='+r.v[3]/100"
+            "+' ('+r.c+' ms)':'');"
+            "g.appendChild(h);}\n"
+            // 清单项 {b:触发序号, j:[jpg,...], t:缩略图目录} 为单帧文件；
+            // {b:触发序号, a:归档, f:[[偏移,长度,相对毫秒],...], s:缩略图归档, t:[[偏移,长度],...]} 为归档，
+            // 缩略图归档整体请求一次再按索引切片，原图归档在点击（或缺缩略图）时才请求，且只请求一次
+            "const cut=(b,o,l)=>URL.createObjectURL(new Blob([b.slice(o,o+l)],{type:'image/jpeg'}));\n"
+            "(async()=>{for(const e of F){"
+            "cap(e.b);"
+            "if(e.j){for(const u of e.j)add(u,e.t?e.t+u:'',u);continue;}"
+            "let p;const full=()=>p||(p=fetch(e.a).then(r=>r.arrayBuffer()));"
+            "const tb=e.s?await(await fetch(e.s)).arrayBuffer():null;"
+            "e.f.forEach(([o,l,t],i)=>{"
+            "let q;const th=tb&&e.t[i][1]?cut(tb,e.t[i][0],e.t[i][1]):'';"
+            "add(()=>q||(q=full().then(b=>cut(b,o,l))),th,e.a+' +'+t+'ms');});"
+            "}})();\n"
+            "</script>\n";
 
     // 打开（或新建）index.html 文件，写入模式为覆盖写（O_TRUNC）
     int fd = open(CAPS_DIR "/index.html", O_WRONLY|O_CREAT|O_TRUNC, 0644);
     if(fd < 0) return; // 若创建失败则直接退出
+    write(fd, page, strlen(page));
+    close(fd);
+
+    // 清空清单文件及其内存副本，换一个运行标识（图库 ETag 不与上次运行混淆）
+    fd = open(CAPS_DIR "/" INDEX_MANIFEST, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if(fd >= 0) close(fd);
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    pthread_mutex_lock(&g_manifest.lock);
+    g_manifest.len = 0;
+    g_manifest.run_id = tv.tv_sec * 1000000LL + tv.tv_usec;
+    pthread_mutex_unlock(&g_manifest.lock);
+}
+
+/**
+ * @brief 以 O_APPEND 一次 write() 向清单 frames.js 追加一行
+ */
+static void append_manifest_line(const char *line, int n){
+    // 内存副本（图库服务使用）
+    pthread_mutex_lock(&g_manifest.lock);
+    if (g_manifest.len + n > g_manifest.cap) {
+        size_t cap = g_manifest.cap ? g_manifest.cap : 16 * 1024;
+        while (cap < g_manifest.len + n) cap *= 2;
+        char *p = (char *)realloc(g_manifest.data, cap);
+        if (p) {
+            g_manifest.data = p;
+            g_manifest.cap = cap;
+        }
+    }
+    if (g_manifest.len + n <= g_manifest.cap) {
+        memcpy(g_manifest.data + g_manifest.len, line, n);
+        g_manifest.len += n;
+    }
+    pthread_mutex_unlock(&g_manifest.lock);
 
-    // 写入页面头部 HTML 内容
-    write(fd, head, strlen(head));
-
-    // 临时缓冲区，用于存放每一行 JS 语句（生成单个 <img> 标签）
-    char line[256];
-
-    // ---------------- 动态生成图片展示区 ----------------
-    for(int i = 0; i < count; i++){
-        /**
-         * 每张图片都用一段 JS 代码生成一个 <a><img></a> 元素：
-         *   - n='%03d.jpg'   ：格式化文件名，如 000.jpg、001.jpg
-         *   - <a> 标签       ：点击图片后打开原图（新窗口）
-         *   - <img> 标签     ：显示缩略图
-         *   - appendChild()  ：把图片插入到网页的 #g 容器中
-         *
-         * 最终 HTML 效果：
-         *   <a href="000.jpg" target="_blank"><img src="000.jpg"></a>
-         */
-        int n = snprintf(line, sizeof(line),
-                         "(()=>{const n='%03d.jpg';"
-                         "const a=document.createElement('a');"
-                         "a.href=n;a.target='_blank';a.title=n;"
-                         "const img=new Image();"
-                         "img.src=n;img.alt=n;"
-                         "a.appendChild(img);"
-                         "g.appendChild(a);})();\n", i);
-
-        // 将生成的 JS 代码写入 HTML 文件
-        write(fd, line, n);
-    }
-
-    // 写入 HTML 尾部内容（结束 script 标签）
-    write(fd, tail, strlen(tail));
-
-    // 关闭文件句柄
+    int fd = open(CAPS_DIR "/" INDEX_MANIFEST, O_WRONLY|O_CREAT|O_APPEND, 0644);
+    if (fd < 0) return;
+    if (write(fd, line, n) != n)
+        perror("append manifest");
     close(fd);
 }
 
+/**
+ * @brief 向清单 frames.js 追加一次触发保存的帧
+ *
+ * 功能：
+ *   - 整次触发拼成一行，以 O_APPEND 一次 write() 写入
+ *       单帧文件：`F.push({b:3,j:['012.jpg','013.jpg',...],t:'thumbs/'});`
+ *       归档文件：`F.push({b:3,a:'sessions/b00003.jpg',f:[[0,31522,0],[31522,31610,66],...],
+ *                          s:'sessions/t00003.jpg',t:[[0,3310],[3310,3296],...]});`
+ *     （未生成缩略图时没有 t / s 字段）
+ *   - 之前的记录保持不变，网页刷新即可看到新帧
+ *
+ * @param burst   触发序号（与 append_result_manifest() 的结果对应）
+ * @param idx     本次成功保存的帧序号数组（单帧文件布局）
+ * @param entries 归档索引表（归档布局，为 NULL 时按单帧文件处理）
+ * @param count   帧数（为 0 时不写入）
+ * @param archive 归档文件名（相对 CAPS_DIR）
+ * @param thumb_entries 缩略图归档索引表（归档布局，为 NULL 时没有缩略图）
+ * @param thumb_archive 缩略图归档文件名（相对 CAPS_DIR）
+ */
+static void append_index_manifest(int burst, const int *idx, const archive_entry_t *entries,
+                                  int count, const char *archive,
+                                  const archive_entry_t *thumb_entries, const char *thumb_archive){
+    if (count <= 0) return;
+
+    char line[128 + WRITE_QUEUE_LEN * 64];
+    int n;
+    if (entries) {
+        n = snprintf(line, sizeof(line), "F.push({b:%d,a:'%s',f:[", burst, archive);
+        for (int i = 0; i < count && n < (int)sizeof(line) - 64; i++)
+            n += snprintf(line + n, sizeof(line) - n, "%s[%u,%u,%lld]", i ? "," : "",
+                          entries[i].offset, entries[i].length,
+                          (long long)(entries[i].ts_us - entries[0].ts_us) / 1000);
+        n += snprintf(line + n, sizeof(line) - n, "]");
+        if (thumb_entries) {
+            n += snprintf(line + n, sizeof(line) - n, ",s:'%s',t:[", thumb_archive);
+            for (int i = 0; i < count && n < (int)sizeof(line) - 32; i++)
+                n += snprintf(line + n, sizeof(line) - n, "%s[%u,%u]", i ? "," : "",
+                              thumb_entries[i].offset, thumb_entries[i].length);
+            n += snprintf(line + n, sizeof(line) - n, "]");
+        }
+        n += snprintf(line + n, sizeof(line) - n, "});\n");
+    } else {
+        n = snprintf(line, sizeof(line), "F.push({b:%d,j:[", burst);
+        for (int i = 0; i < count && n < (int)sizeof(line) - 32; i++)
+            n += snprintf(line + n, sizeof(line) - n, "%s'%03d.jpg'", i ? "," : "", idx[i]);
+        n += snprintf(line + n, sizeof(line) - n, "]%s});\n",
+                      g_cfg.thumb_denom > 0 ? ",t:'" THUMB_DIR_NAME "/'" : "");
+    }
+    append_manifest_line(line, n);
+}
+
+/**
+ * @brief 向清单 frames.js 追加第 burst 次触发对应的测试结果
+ *
+ *   `R[3]={n:1207,s:0,p:1,c:2315,v:[1250,1248,532,529]};`（测量值为 0.01 单位）
+ *
+ * 结果可能先于该次触发的帧写入清单，网页在整个清单加载完后才绘制，顺序不影响显示。
+ */
+static void append_result_manifest(int burst, const tester_result_t *r){
+    char line[160];
+    int n = snprintf(line, sizeof(line), "R[%d]={n:%u,s:%d,p:%d,c:%d,v:[%d,%d,%d,%d]};\n",
+                     burst, r->test_no, r->slot, r->pass, r->cycle_ms,
+                     r->tx_R, r->rx_R, r->tx_B, r->rx_B);
+    append_manifest_line(line, n);
+}
+
 // ----------------- GPIO 控制 -----------------
 
 /**
@@ -312,6 +838,118 @@ static void gpio_init_out(int pin, int init_val){
     gpio_write(pin, init_val);
 }
 
+#if GPIO_BACKEND == GPIO_BACKEND_CDEV
+/**
+ * @brief 通过 /dev/gpiochipN 一次性申请 GPIO_A 与 GPIO_B 两条输出线
+ *
+ * 说明：
+ *   - 两个引脚必须位于同一个 gpiochip（RV1106 上 GPIO32/33 均属 gpiochip1）
+ *   - 申请前先从 sysfs 取消导出，避免上次运行遗留的导出导致 EBUSY
+ *   - 初始电平在申请时一并设置，不会出现短暂的错误电平
+ *
+ * @return 0 成功，-1 失败（调用方回退到 sysfs）
+ */
+static int coil_gpio_open_cdev(coil_gpio_t *c, int init_a, int init_b) {
+    if (GPIO_A / GPIO_BANK_LINES != GPIO_B / GPIO_BANK_LINES) {
+        fprintf(stderr, "WARN: GPIO_A/GPIO_B on different chips, no bulk set\n");
+        return -1;
+    }
+
+    char path[32];
+    FILE *f = fopen("/sys/class/gpio/unexport", "w");
+    if (f) { fprintf(f, "%d", GPIO_A); fclose(f); }
+    f = fopen("/sys/class/gpio/unexport", "w");
+    if (f) { fprintf(f, "%d", GPIO_B); fclose(f); }
+
+    snprintf(path, sizeof(path), "/dev/gpiochip%d", GPIO_A / GPIO_BANK_LINES);
+    int chip = open(path, O_RDWR | O_CLOEXEC);
+    if (chip < 0) {
+        perror("open gpiochip");
+        return -1;
+    }
+
+    // 第 0 位对应 GPIO_A，第 1 位对应 GPIO_B
+    struct gpio_v2_line_request req;
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = GPIO_A % GPIO_BANK_LINES;
+    req.offsets[1] = GPIO_B % GPIO_BANK_LINES;
+    req.num_lines = 2;
+    snprintf(req.consumer, sizeof(req.consumer), "%s", GPIO_CONSUMER);
+    req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    req.config.num_attrs = 1;
+    req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    req.config.attrs[0].attr.values = (init_a ? 1u : 0u) | (init_b ? 2u : 0u);
+    req.config.attrs[0].mask = 3;
+
+    int ret = ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &req);
+    close(chip);
+    if (ret < 0) {
+        perror("GPIO_V2_GET_LINE_IOCTL");
+        return -1;
+    }
+    c->req_fd = req.fd;
+    return 0;
+}
+#endif
+
+/**
+ * @brief 初始化线圈控制 GPIO，并写入初始电平
+ *
+ * GPIO_BACKEND_CDEV 时优先使用字符设备；不可用时回退到 sysfs，
+ * 并保持 value 文件常开，后续切换只需一次 pwrite()。
+ */
+static void coil_gpio_open(coil_gpio_t *c, int init_a, int init_b) {
+    c->req_fd = c->fd_a = c->fd_b = -1;
+#if GPIO_BACKEND == GPIO_BACKEND_CDEV
+    if (coil_gpio_open_cdev(c, init_a, init_b) == 0)
+        return;
+    fprintf(stderr, "WARN: gpiochip unavailable, fallback to sysfs GPIO\n");
+#endif
+    gpio_init_out(GPIO_A, init_a);
+    gpio_init_out(GPIO_B, init_b);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", GPIO_A);
+    c->fd_a = open(path, O_WRONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", GPIO_B);
+    c->fd_b = open(path, O_WRONLY | O_CLOEXEC);
+    if (c->fd_a < 0 || c->fd_b < 0)
+        perror("open gpio value");
+}
+
+/**
+ * @brief 同时设置 GPIO_A、GPIO_B 的电平
+ *
+ * 字符设备方式：一次 GPIO_V2_LINE_SET_VALUES_IOCTL，两个引脚同时变化。
+ * sysfs 方式：先写变低的引脚、再写变高的引脚（先断后通），与原时序一致：
+ *   上电 (1,0) —— 先断开 GPIO_B，再上电 GPIO_A
+ *   断电 (0,1) —— 先断开 GPIO_A，再恢复 GPIO_B
+ */
+static void coil_gpio_set(coil_gpio_t *c, int a, int b) {
+    if (c->req_fd >= 0) {
+        struct gpio_v2_line_values v;
+        v.bits = (a ? 1u : 0u) | (b ? 2u : 0u);
+        v.mask = 3;
+        if (ioctl(c->req_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &v) < 0)
+            perror("GPIO_V2_LINE_SET_VALUES_IOCTL");
+        return;
+    }
+    int first = a ? c->fd_b : c->fd_a, second = a ? c->fd_a : c->fd_b;
+    int v1 = a ? b : a, v2 = a ? a : b;
+    if (pwrite(first, v1 ? "1" : "0", 1, 0) != 1 || pwrite(second, v2 ? "1" : "0", 1, 0) != 1)
+        perror("coil_gpio_set");
+}
+
+/**
+ * @brief 释放线圈控制 GPIO（字符设备方式下释放行请求，引脚保持最后电平）
+ */
+static void coil_gpio_close(coil_gpio_t *c) {
+    if (c->req_fd >= 0) close(c->req_fd);
+    if (c->fd_a >= 0) close(c->fd_a);
+    if (c->fd_b >= 0) close(c->fd_b);
+    c->req_fd = c->fd_a = c->fd_b = -1;
+}
+
 // ----------------- 启动 mjpg_streamer HTTP 服务 -----------------
 
 /**
@@ -391,7 +1029,7 @@ static int wait_http_ready(const char *host, int port, int timeout_ms) {
  *
  * 示例：
  *   kill_old_http();   // 清理旧的 mjpg_streamer 实例
- *   start_mjpg_streamer(); // 启动新的 HTTP 服务
+ *   start_mjpg_streamer(uvc_args);      // 启动新的 HTTP 服务
  */
 static void kill_old_http(void){
     // 调用 Linux shell 命令结束 mjpg_streamer 进程
@@ -403,10 +1041,13 @@ static void kill_old_http(void){
  * @brief 启动 mjpg_streamer 视频推流服务（基于 HTTP 输出）
  *
  * 功能：
- *   - 启动独立的 mjpg_streamer 进程，将 /dev/video0 摄像头采集的图像通过 HTTP 推流
+ *   - 启动独立的 mjpg_streamer 进程，将输入插件采集的图像通过 HTTP 推流
  *   - 典型推流地址为：http://<BOARD_IP>:8080/?action=stream
  *   - 启动后检测 HTTP 端口是否可用（最多等待 5 秒）
  *
+ * @param input_args 输入插件及参数：
+ *                   - UVC 参数（main 中按配置拼出）：由 mjpg_streamer 直接采集 v4l2_device
+ *                   - MJPG_INPUT_VIEWER：V4L2 后端占用摄像头时，仅把 CAPS_DIR 中新保存的帧推给浏览器
  * @return 子进程 PID（>0 表示成功），-1 表示 fork 失败
  *
  * 工作流程：
@@ -416,11 +1057,11 @@ static void kill_old_http(void){
  *   4️⃣ 父进程等待 HTTP 服务端口启动成功（通过 wait_http_ready() 检测）
  *
  * 示例：
- *   pid_t pid = start_mjpg_streamer();
+ *   pid_t pid = start_mjpg_streamer(uvc_args);
  *   if (pid > 0)
  *       printf("mjpg_streamer started, pid=%d\n", pid);
  */
-static pid_t start_mjpg_streamer(void) {
+static pid_t start_mjpg_streamer(const char *input_args) {
     // 1️⃣ 清理旧实例，防止端口（8080）被占用
     kill_old_http();
 
@@ -430,21 +1071,25 @@ static pid_t start_mjpg_streamer(void) {
     // ---------------- 子进程逻辑 ----------------
     if (pid == 0) {
         // 切换工作目录到 mjpg_streamer 主目录
-        // 该目录下应包含 input_uvc.so、output_http.so、www 文件夹
+        // 该目录下应包含 input_uvc.so / input_file.so、output_http.so、www 文件夹
         chdir(MJPG_HOME);
 
+        // 恢复主程序屏蔽的信号，避免被 mjpg_streamer 继承
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+
         // 调用 execl() 启动 mjpg_streamer
         // 参数说明：
-        //   - "-i" 指定输入插件（USB 摄像头采集模块）
-        //   - "-d /dev/video0" 表示使用主摄像头设备节点
-        //   - "-r 640x480" 设置分辨率
-        //   - "-f 15" 设置帧率（FPS）
+        //   - "-i" 指定输入插件（UVC 参数 / MJPG_INPUT_VIEWER）
         //   - "-o" 指定输出插件（HTTP 推流模块）
-        //   - "-p 8080" 设置 HTTP 服务端口号
+        //   - "-p <http_port>" 设置 HTTP 服务端口号
         //   - "-w ./www" 指定网页根目录（用于展示）
+        char output_args[64];
+        snprintf(output_args, sizeof(output_args), "./output_http.so -p %d -w ./www", g_cfg.http_port);
         execl("./mjpg_streamer", "./mjpg_streamer",
-              "-i", "./input_uvc.so -d /dev/video0 -r 640x480 -f 15", // 输入模块参数
-              "-o", "./output_http.so -p 8080 -w ./www",              // 输出模块参数
+              "-i", input_args,                                       // 输入模块参数
+              "-o", output_args,                                      // 输出模块参数
               (char*)NULL);
 
         // 若 execl 执行失败则打印错误并退出
@@ -460,40 +1105,339 @@ static pid_t start_mjpg_streamer(void) {
 
     // ---------------- 父进程逻辑 ----------------
     // 等待 HTTP 服务端口就绪（最多等待 5 秒）
-    if (wait_http_ready("127.0.0.1", HTTP_PORT, 5000) != 0) {
-        fprintf(stderr, "ERROR: http on 8080 not ready\n");
+    if (wait_http_ready("127.0.0.1", g_cfg.http_port, 5000) != 0) {
+        fprintf(stderr, "ERROR: http on %d not ready\n", g_cfg.http_port);
     } else {
-        printf("HTTP ready on 8080\n");
+        printf("HTTP ready on %d\n", g_cfg.http_port);
     }
 
     // 返回子进程 PID
     return pid;
 }
 
+// ----------------- 内存帧缓冲工具 -----------------
+
+/**
+ * @brief 读取单调时钟，返回微秒
+ */
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000LL;
+}
+
+/**
+ * @brief 确保帧缓冲至少还能容纳 extra 字节（按需扩容，扩容后的内存会被后续帧复用）
+ * @return 0 表示成功，-1 表示内存不足
+ */
+static int frame_reserve(cap_frame_t *f, size_t extra) {
+    if (f->len + extra <= f->cap) return 0;
+    size_t cap = f->cap ? f->cap : 64 * 1024;
+    while (cap < f->len + extra) cap *= 2;
+    unsigned char *p = (unsigned char *)realloc(f->data, cap);
+    if (!p) return -1;
+    f->data = p;
+    f->cap = cap;
+    return 0;
+}
+
+/**
+ * @brief 向帧缓冲末尾追加数据
+ * @return 0 表示成功，-1 表示内存不足
+ */
+static int frame_append(cap_frame_t *f, const void *src, size_t n) {
+    if (frame_reserve(f, n) != 0) return -1;
+    memcpy(f->data + f->len, src, n);
+    f->len += n;
+    return 0;
+}
+
+/**
+ * @brief 释放帧缓冲占用的内存
+ */
+static void frame_free(cap_frame_t *f) {
+    free(f->data);
+    memset(f, 0, sizeof(*f));
+}
+
+#if CAPS_LAYOUT == CAPS_LAYOUT_FLAT
+/**
+ * @brief 将内存中的一帧 JPEG 一次性写入文件
+ * @return 0 表示成功，-1 表示失败（不完整的文件会被删除）
+ */
+static int frame_save(const cap_frame_t *f, const char *out_path) {
+    int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    int ok = (write(fd, f->data, f->len) == (ssize_t)f->len);
+    close(fd);
+    if (!ok) unlink(out_path);
+    return ok ? 0 : -1;
+}
+#else
+/**
+ * @brief 将一次触发的多帧打包写入一个归档文件（格式见 archive_entry_t）
+ *
+ * 全部帧、索引表与尾部通过一次 writev() 写出，每次触发只创建一个文件。
+ *
+ * @param entries 输出：每帧的索引（容量至少 n）
+ * @return 0 表示成功，-1 表示失败（不完整的文件会被删除）
+ */
+static int archive_save(const cap_frame_t *frames, int n, const char *out_path,
+                        archive_entry_t *entries) {
+    struct iovec iov[WRITE_QUEUE_LEN + 2];
+    archive_footer_t footer;
+    uint32_t off = 0;
+    if (n > WRITE_QUEUE_LEN) n = WRITE_QUEUE_LEN;
+
+    for (int i = 0; i < n; i++) {
+        entries[i].offset = off;
+        entries[i].length = (uint32_t)frames[i].len;
+        entries[i].ts_us = frames[i].ts_us;
+        iov[i].iov_base = frames[i].data;
+        iov[i].iov_len = frames[i].len;
+        off += (uint32_t)frames[i].len;
+    }
+    memcpy(footer.magic, ARCHIVE_MAGIC, sizeof(footer.magic));
+    footer.count = (uint32_t)n;
+    footer.index_offset = off;
+    iov[n].iov_base = entries;
+    iov[n].iov_len = sizeof(archive_entry_t) * n;
+    iov[n + 1].iov_base = &footer;
+    iov[n + 1].iov_len = sizeof(footer);
+    size_t total = off + iov[n].iov_len + sizeof(footer);
+
+    int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    int ok = (writev(fd, iov, n + 2) == (ssize_t)total);
+    close(fd);
+    if (!ok) unlink(out_path);
+    return ok ? 0 : -1;
+}
+#endif
+
+// ----------------- 缩略图 -----------------
+
+/**
+ * @brief libjpeg 错误处理：出错时 longjmp 回 thumb_make()，不使用默认的 exit()
+ *
+ * 输出缓冲也放在这里，longjmp 之后仍能取到并释放。
+ */
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf               jb;
+    unsigned char        *out;         // jpeg_mem_dest 分配的输出缓冲
+    unsigned long         out_len;
+} thumb_jerr_t;
+
+static void thumb_error_exit(j_common_ptr c) {
+    longjmp(((thumb_jerr_t *)c->err)->jb, 1);
+}
+
+// 摄像头 MJPEG 常有「Corrupt JPEG data」一类警告，缩略图不必逐帧打印
+static void thumb_output_message(j_common_ptr c) {
+    (void)c;
+}
+
+/**
+ * @brief 由一帧 JPEG 生成缩略图 JPEG
+ *
+ * 功能：
+ *   - 解码时设 scale_denom = thumb_denom，由 IDCT 直接输出 1/2、1/4 或 1/8 尺寸，
+ *     不做完整尺寸解码与缩放，640×480 的 1/4 缩小在 Cortex-A7 上只需几毫秒
+ *   - 解码输出 YCbCr（灰度图为单通道），编码端原样输入，省去两次色彩转换
+ *   - 坏帧（解码出错）返回 -1，网页对该帧回退为显示原图
+ *
+ * @param src 原图
+ * @param dst 输出：缩略图（数据缓冲为新分配，用 frame_free() 释放；时间戳同原图）
+ * @return 0 表示成功，-1 表示失败（dst 为空帧）
+ */
+static int thumb_make(const cap_frame_t *src, cap_frame_t *dst) {
+    struct jpeg_decompress_struct din;
+    struct jpeg_compress_struct cout;
+    thumb_jerr_t jerr;
+
+    memset(dst, 0, sizeof(*dst));
+    din.err = jpeg_std_error(&jerr.pub);
+    cout.err = &jerr.pub;
+    jerr.pub.error_exit = thumb_error_exit;
+    jerr.pub.output_message = thumb_output_message;
+    jerr.out = NULL;
+    jerr.out_len = 0;
+    jpeg_create_decompress(&din);
+    jpeg_create_compress(&cout);
+    if (setjmp(jerr.jb)) {
+        jpeg_destroy_compress(&cout);
+        jpeg_destroy_decompress(&din);
+        free(jerr.out);
+        return -1;
+    }
+
+    // ① 缩放解码
+    jpeg_mem_src(&din, (unsigned char *)src->data, (unsigned long)src->len);
+    jpeg_read_header(&din, TRUE);
+    din.scale_num = 1;
+    din.scale_denom = g_cfg.thumb_denom;
+    din.dct_method = JDCT_IFAST;
+    din.do_fancy_upsampling = FALSE;
+    din.out_color_space = din.num_components == 1 ? JCS_GRAYSCALE : JCS_YCbCr;
+    jpeg_start_decompress(&din);
+
+    // ② 按解码输出尺寸编码到内存
+    jpeg_mem_dest(&cout, &jerr.out, &jerr.out_len);
+    cout.image_width = din.output_width;
+    cout.image_height = din.output_height;
+    cout.input_components = din.output_components;
+    cout.in_color_space = din.out_color_space;
+    jpeg_set_defaults(&cout);
+    jpeg_set_quality(&cout, THUMB_QUALITY, TRUE);
+    cout.dct_method = JDCT_IFAST;
+    jpeg_start_compress(&cout, TRUE);
+
+    // ③ 逐块扫描行从解码器直接交给编码器
+    JSAMPARRAY rows = (*din.mem->alloc_sarray)((j_common_ptr)&din, JPOOL_IMAGE,
+                                               din.output_width * din.output_components,
+                                               din.rec_outbuf_height);
+    while (din.output_scanline < din.output_height) {
+        JDIMENSION n = jpeg_read_scanlines(&din, rows, din.rec_outbuf_height);
+        jpeg_write_scanlines(&cout, rows, n);
+    }
+    jpeg_finish_compress(&cout);
+    jpeg_finish_decompress(&din);
+    jpeg_destroy_compress(&cout);
+    jpeg_destroy_decompress(&din);
+
+    // 直接接管 libjpeg 分配的缓冲（malloc），之后由 frame_free() 释放
+    dst->data = jerr.out;
+    dst->len = dst->cap = jerr.out_len;
+    dst->ts_us = src->ts_us;
+    return 0;
+}
+
+// ----------------- 时序跟踪 -----------------
+
+/**
+ * @brief 跟踪事件类型
+ *
+ * 用于定位「越过阈值 → 第一帧落盘」各环节的耗时与帧间抖动：
+ *   SAMPLE       —— 一次 ADC 读取（arg = 样本数）
+ *   CROSS        —— 本轮首次越过阈值（aux = 越过时刻）
+ *   TRIGGER      —— 消抖通过，进入拍摄（aux = 越过时刻）
+ *   REQ_SENT     —— HTTP 请求已发送（snapshot / stream 建连）
+ *   HDR_PARSED   —— HTTP 响应头或 multipart 部分头解析完成（arg = Content-Length）
+ *   FRAME        —— 一帧进入预触发环形缓冲（arg = 字节数，aux = 帧采集时刻）
+ *   BURST_QUEUED —— 触发窗口内的帧已交给写盘线程（arg = 帧数）
+ *   FILE_CLOSED  —— 图像 / 归档文件写完关闭（arg = 帧数）
+ *   GPIO         —— 线圈 GPIO 切换（arg = GPIO_A | GPIO_B << 1）
+ */
+typedef enum {
+    TRACE_SAMPLE = 0,
+    TRACE_CROSS,
+    TRACE_TRIGGER,
+    TRACE_REQ_SENT,
+    TRACE_HDR_PARSED,
+    TRACE_FRAME,
+    TRACE_BURST_QUEUED,
+    TRACE_FILE_CLOSED,
+    TRACE_GPIO,
+} trace_ev_t;
+
+static const char *const k_trace_names[] = {
+    "sample", "cross", "trigger", "req_sent", "hdr_parsed",
+    "frame", "burst_queued", "file_closed", "gpio",
+};
+
+/**
+ * @brief 一条跟踪记录（seq 最后写入，导出时用于识别被覆盖或未写完的槽位）
+ */
+typedef struct {
+    unsigned long long seq;            // 全局序号 + 1（0 表示空槽）
+    long long          ts_us;          // 记录时刻（CLOCK_MONOTONIC 微秒）
+    long long          aux;            // 附加时间戳或数值
+    int                ev;             // trace_ev_t
+    int                arg;            // 事件参数
+} trace_rec_t;
+
+static struct {
+    trace_rec_t        recs[TRACE_RING_LEN];
+    unsigned long long head;           // 已分配的记录总数（原子递增，多线程可同时写入）
+} g_trace;
+
+/**
+ * @brief 记录一个跟踪事件（无锁，约几十纳秒；TRACE_ENABLE 为 0 时为空操作）
+ */
+static inline void trace_event(int ev, int arg, long long aux) {
+#if TRACE_ENABLE
+    unsigned long long i = __atomic_fetch_add(&g_trace.head, 1, __ATOMIC_RELAXED);
+    trace_rec_t *r = &g_trace.recs[i & (TRACE_RING_LEN - 1)];
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    r->ts_us = now_us();
+    r->aux = aux;
+    r->ev = ev;
+    r->arg = arg;
+    __atomic_store_n(&r->seq, i + 1, __ATOMIC_RELEASE);
+#else
+    (void)ev; (void)arg; (void)aux;
+#endif
+}
+
+/**
+ * @brief 将环形缓冲中最近的跟踪记录按时间顺序导出为 CSV
+ *
+ * 列：seq,ts_us,event,arg,aux。正在被改写的槽位会被跳过。
+ *
+ * @return 导出的记录数，失败返回 -1
+ */
+static int trace_dump_csv(const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror("trace_dump_csv");
+        return -1;
+    }
+    fprintf(fp, "seq,ts_us,event,arg,aux\n");
+
+    unsigned long long head = __atomic_load_n(&g_trace.head, __ATOMIC_ACQUIRE);
+    unsigned long long first = head > TRACE_RING_LEN ? head - TRACE_RING_LEN : 0;
+    int n = 0;
+    for (unsigned long long i = first; i < head; i++) {
+        const trace_rec_t *r = &g_trace.recs[i & (TRACE_RING_LEN - 1)];
+        if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != i + 1) continue;
+        trace_rec_t c = *r;
+        if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != i + 1) continue;
+        const char *name = (c.ev >= 0 && c.ev <= TRACE_GPIO) ? k_trace_names[c.ev] : "?";
+        fprintf(fp, "%llu,%lld,%s,%d,%lld\n", i, c.ts_us, name, c.arg, c.aux);
+        n++;
+    }
+    fclose(fp);
+    return n;
+}
+
 // ----------------- HTTP 抓帧函数 -----------------
 
+#if CAPTURE_BACKEND != CAPTURE_BACKEND_V4L2
 /**
- * @brief 从 mjpg_streamer 的 HTTP 服务器抓取单帧图像并保存为 JPEG 文件
+ * @brief 从 mjpg_streamer 的 HTTP 服务器抓取单帧图像，读入内存帧缓冲
  *
  * 功能：
  *   - 通过 HTTP/1.0 协议发送 GET 请求，例如：
  *       GET /?action=snapshot HTTP/1.0
  *   - 读取返回的 HTTP 响应，解析响应头（Content-Length）
- *   - 将 JPEG 数据体保存为指定路径文件
+ *   - 将 JPEG 数据体读入 f，时间戳记为发起请求的时刻
  *
  * 典型用途：
- *   http_get_snapshot_save("127.0.0.1", 8080, "/?action=snapshot", "/root/mjpg/www/001.jpg");
+ *   http_get_snapshot_frame("127.0.0.1", 8080, "/?action=snapshot", &frame);
  *
  * @param host       HTTP 服务主机名（一般为 "127.0.0.1"）
  * @param port       HTTP 服务端口号（一般为 8080）
  * @param path       请求路径（例如 "/?action=snapshot"）
- * @param out_path   输出文件路径（例如 "/root/mjpg/www/001.jpg"）
+ * @param f          输出帧
  * @return           0 表示成功，-1 表示失败
  *
  * 调用关系：
- *   capture_snapshots() → http_get_snapshot_save()
+ *   capture_thread() → http_get_snapshot_frame()
  */
-static int http_get_snapshot_save(const char* host, int port, const char* path, const char* out_path) {
+static int http_get_snapshot_frame(const char* host, int port, const char* path, cap_frame_t *f) {
+    long long t_req = now_us();       // 请求时刻，作为该帧的时间戳
+
 
     // 1️⃣ 建立 TCP 套接字，用于连接 mjpg_streamer HTTP 服务
     int sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -526,6 +1470,7 @@ static int http_get_snapshot_save(const char* host, int port, const char* path,
         close(sock);
         return -1;
     }
+    trace_event(TRACE_REQ_SENT, 0, 0);
 
     // 5️⃣ 开始读取 HTTP 响应数据（包括头部与内容）
     char header[8192];        // 存放 HTTP 头部的缓冲区
@@ -558,20 +1503,20 @@ static int http_get_snapshot_save(const char* host, int port, const char* path,
                     content_length = (size_t)strtoull(p, NULL, 10);
                     have_len = 1;
                 }
+                trace_event(TRACE_HDR_PARSED, have_len ? (int)content_length : -1, 0);
 
                 // header_len: 头部长度；body0: 第一包中数据体的起始位置
                 size_t header_len = i + 1;
                 size_t body0 = hpos - header_len;
 
-                // 打开输出文件
-                FILE *fp = fopen(out_path, "wb");
-                if (!fp) { close(sock); return -1; }
+                // 清空输出帧，准备接收数据体
+                f->len = 0;
 
                 // 7️⃣ 写入第一包中可能包含的图像数据部分
                 if (body0) {
                     size_t w = body0;
                     if (have_len && w > content_length) w = content_length;
-                    fwrite(header + header_len, 1, w, fp);
+                    frame_append(f, header + header_len, w);
                     if (have_len) content_length -= w;
                 }
 
@@ -582,20 +1527,20 @@ static int http_get_snapshot_save(const char* host, int port, const char* path,
                         if (n <= 0) break;
                         size_t w = (size_t)n;
                         if (w > content_length) w = content_length;
-                        fwrite(buf, 1, w, fp);
+                        frame_append(f, buf, w);
                         content_length -= w;
                     }
                 }
                     // 若未提供 Content-Length，则一直读到 EOF
                 else {
                     while ((n = read(sock, buf, sizeof(buf))) > 0)
-                        fwrite(buf, 1, (size_t)n, fp);
+                        frame_append(f, buf, (size_t)n);
                 }
 
-                // 9️⃣ 完成写入与资源释放
-                fclose(fp);
+                // 9️⃣ 完成接收与资源释放
                 close(sock);
-                return 0; // 成功保存一帧
+                f->ts_us = t_req;
+                return f->len > 0 ? 0 : -1; // 成功取得一帧
             }
         }
 
@@ -610,177 +1555,1837 @@ static int http_get_snapshot_save(const char* host, int port, const char* path,
     close(sock);
     return -1;
 }
+#endif
+
+// ----------------- HTTP 长连接推流抓帧 -----------------
 
 /**
- * @brief 批量抓帧函数：在指定持续时间内连续从 HTTP 服务抓取图像帧
- *
- * 功能：
- *   - 在指定的时间段内（单位：微秒）循环调用 http_get_snapshot_save()
- *   - 按顺序保存为 /root/mjpg/www/000.jpg、001.jpg 等文件
- *   - 每帧之间按目标帧率（TARGET_FPS）间隔采样
- *   - 抓取结束后自动更新网页 index.html 文件
- *
- * 参数：
- *   @param duration_us —— 抓取时长（微秒），例如 500000 表示持续 0.5 秒
+ * @brief 关闭 mjpg_streamer 长连接
+ */
+static void mjpg_stream_close(mjpg_stream_t *s) {
+    if (s->sock >= 0) close(s->sock);
+    s->sock = -1;
+    s->len = 0;
+}
+
+#if CAPTURE_BACKEND == CAPTURE_BACKEND_STREAM
+/**
+ * @brief 从长连接中继续读取数据，追加到接收缓冲区末尾
  *
- * 返回：
- *   @return 成功抓取的帧数
+ * @param s  长连接状态
+ * @return   >0 为本次读取的字节数；0 表示对端关闭；-1 表示超时或出错
+ */
+static ssize_t mjpg_stream_fill(mjpg_stream_t *s) {
+    if (s->len >= sizeof(s->buf)) return -1; // 缓冲区已满（异常数据），由调用者处理
+    ssize_t n = read(s->sock, s->buf + s->len, sizeof(s->buf) - s->len);
+    if (n > 0) s->len += (size_t)n;
+    return n;
+}
+
+/**
+ * @brief 丢弃接收缓冲区前 n 个字节（剩余数据前移）
+ */
+static void mjpg_stream_consume(mjpg_stream_t *s, size_t n) {
+    if (n >= s->len) { s->len = 0; return; }
+    memmove(s->buf, s->buf + n, s->len - n);
+    s->len -= n;
+}
+
+/**
+ * @brief 建立到 mjpg_streamer 的 multipart 推流长连接
  *
- * 调用关系：
- *   main() → capture_snapshots() → http_get_snapshot_save()
+ * 功能：
+ *   - 连接 host:port 并发送一次 GET <path>（通常为 /?action=stream）
+ *   - 解析响应头，确认状态码 200，并从 Content-Type 中取出 boundary
+ *   - 响应头之后已收到的数据保留在 s->buf 中，供 mjpg_stream_read_frame() 继续解析
  *
- * 举例：
- *   capture_snapshots(500000);  // 连续抓取 0.5 秒的图像 (~7~8 帧)
+ * @return 0 表示连接成功；-1 表示失败（s->sock 复位为 -1）
  */
-static int capture_snapshots(useconds_t duration_us) {
-    int saved = 0;                      // 当前抓取帧数计数器
-    struct timespec ts0, ts1;           // 用于时间测量
-    clock_gettime(CLOCK_MONOTONIC, &ts0); // 获取抓取起始时间（单调时钟）
-
-    while (1) {
-        // ① 构造文件名，例如：000.jpg、001.jpg ...
-        char name[256];
-        snprintf(name, sizeof(name), CAPS_DIR "/%03d.jpg", g_total_saved);
+static int mjpg_stream_open(mjpg_stream_t *s, const char *host, int port, const char *path) {
+    mjpg_stream_close(s);
 
-        // ② 从 HTTP 抓取一帧图像并保存
-        if (http_get_snapshot_save("127.0.0.1", HTTP_PORT, "/?action=snapshot", name) == 0) {
-            ++saved;         // 成功抓取一帧
-            ++g_total_saved; // 全局计数器累加
-        }
+    // 1️⃣ 建立 TCP 连接
+    s->sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (s->sock < 0) return -1;
 
-        // ③ 计算当前时间与起始时间的差值（单位：微秒）
-        clock_gettime(CLOCK_MONOTONIC, &ts1);
-        long long el = (ts1.tv_sec - ts0.tv_sec) * 1000000LL +
-                       (ts1.tv_nsec - ts0.tv_nsec) / 1000LL;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1 ||
+        connect(s->sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        mjpg_stream_close(s);
+        return -1;
+    }
 
-        // 若已达到指定持续时间则退出循环
-        if (el >= (long long)duration_us)
-            break;
+    // 设置读超时：推流异常中断时 read() 不会永久阻塞
+    struct timeval tv = { STREAM_RECV_TIMEOUT_MS / 1000, (STREAM_RECV_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(s->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 
-        // ④ 控制帧率（休眠间隔）
-        // SNAPSHOT_INTERVAL_US = 1000000 / TARGET_FPS，例如 15fps → 间隔约 66ms
-        usleep(SNAPSHOT_INTERVAL_US);
+    // 2️⃣ 发送一次 GET 请求，之后服务端持续推送
+    char req[256];
+    int rl = snprintf(req, sizeof(req), "GET %s HTTP/1.0\r\nHost: %s\r\n\r\n", path, host);
+    if (write(s->sock, req, rl) != rl) {
+        mjpg_stream_close(s);
+        return -1;
     }
+    trace_event(TRACE_REQ_SENT, 1, 0);
 
-    // ⑤ 抓取完毕后更新 index.html，便于网页展示所有帧
-    write_index_html(g_total_saved);
+    // 3️⃣ 读取响应头直到 “\r\n\r\n”
+    char *end = NULL;
+    while (!(end = (char *)memmem(s->buf, s->len, "\r\n\r\n", 4))) {
+        if (mjpg_stream_fill(s) <= 0) {
+            mjpg_stream_close(s);
+            return -1;
+        }
+    }
+    size_t header_len = (size_t)(end - s->buf) + 4;
+
+    char header[1024];
+    size_t hl = header_len < sizeof(header) ? header_len : sizeof(header) - 1;
+    memcpy(header, s->buf, hl);
+    header[hl] = '\0';
+
+    // 4️⃣ 检查状态码并提取 boundary（例如 boundary=boundarydonotcross）
+    char *p = strcasestr(header, "boundary=");
+    if (strncmp(header, "HTTP/", 5) != 0 || !strstr(header, " 200") || !p) {
+        fprintf(stderr, "ERROR: unexpected stream response header\n");
+        mjpg_stream_close(s);
+        return -1;
+    }
+    p += 9;
+    if (*p == '"') ++p;
+    size_t bl = strcspn(p, "\"\r\n; ");
+    if (bl == 0 || bl + 2 >= sizeof(s->boundary)) {
+        mjpg_stream_close(s);
+        return -1;
+    }
+    snprintf(s->boundary, sizeof(s->boundary), "--%.*s", (int)bl, p);
 
-    // 返回本次抓取的帧数
-    return saved;
+    // 5️⃣ 丢弃响应头，保留其后的 multipart 数据
+    mjpg_stream_consume(s, header_len);
+    return 0;
 }
 
-// ----------------- 主程序入口 -----------------
 /**
- * @brief 程序主入口：基于 ADC 电压触发拍照与推流
+ * @brief 从长连接中切分出下一帧 JPEG，读入内存帧缓冲
  *
- * 功能概述：
- *   - 初始化目录与网页文件
- *   - 启动 mjpg_streamer 视频推流服务
- *   - 读取 ADC 电压信号，当电压超过阈值时触发自动拍照
- *   - 抓取多帧图像（连续截图）保存至 /root/mjpg/www 目录
- *   - 通过 GPIO 控制线圈通断，模拟打击或采样动作
- *   - 抓取结果可通过浏览器访问 mjpg_streamer 的 HTTP 端口查看
+ * 功能：
+ *   - 在接收数据中查找 boundary，随后解析该部分的头部（Content-Length、X-Timestamp）
+ *   - 按 Content-Length 将 JPEG 数据体读入 f
+ *   - 帧间节奏完全由推流本身决定（read 阻塞等待下一帧），无需 usleep
+ *
+ * @param s  长连接状态
+ * @param f  输出帧；ts_us 取 X-Timestamp（V4L2 缓冲时间戳，即单调时钟），缺失或不合理时取到达时间
+ * @return   0 表示成功读取一帧；-1 表示连接异常（需重连）
+ */
+static int mjpg_stream_read_frame(mjpg_stream_t *s, cap_frame_t *f) {
+    size_t bl = strlen(s->boundary);
+
+    // 1️⃣ 定位 boundary（丢弃其之前的所有数据，首次连接时依此同步）
+    char *b;
+    while (!(b = (char *)memmem(s->buf, s->len, s->boundary, bl))) {
+        if (s->len >= bl) mjpg_stream_consume(s, s->len - bl + 1);
+        if (mjpg_stream_fill(s) <= 0) return -1;
+    }
+    mjpg_stream_consume(s, (size_t)(b - s->buf) + bl);
+
+    // 2️⃣ 读取该部分的头部直到 “\r\n\r\n”
+    char *end;
+    while (!(end = (char *)memmem(s->buf, s->len, "\r\n\r\n", 4))) {
+        if (mjpg_stream_fill(s) <= 0) return -1;
+    }
+    size_t part_len = (size_t)(end - s->buf) + 4;
+
+    char part[512];
+    size_t pl = part_len < sizeof(part) ? part_len : sizeof(part) - 1;
+    memcpy(part, s->buf, pl);
+    part[pl] = '\0';
+    mjpg_stream_consume(s, part_len);
+
+    // 3️⃣ 解析 Content-Length（mjpg_streamer 每个部分都会给出）与 X-Timestamp
+    char *p = strcasestr(part, "Content-Length:");
+    if (!p) return -1;
+    size_t content_length = (size_t)strtoull(p + 15, NULL, 10);
+    trace_event(TRACE_HDR_PARSED, (int)content_length, 0);
+
+    f->len = 0;
+    f->ts_us = now_us();
+    p = strcasestr(part, "X-Timestamp:");
+    if (p) {
+        // X-Timestamp 取自 V4L2 缓冲时间戳（CLOCK_MONOTONIC，与 now_us() 同一时基），
+        // 可直接与 ADC 触发时刻比较；明显不合理（未来或 10 s 以前）时保留接收时刻
+        long long ts = (long long)(strtod(p + 12, NULL) * 1e6);
+        long long age_us = f->ts_us - ts;
+        if (age_us > 0 && age_us < 10000000LL) f->ts_us = ts;
+    }
+    if (frame_reserve(f, content_length) != 0) return -1;
+
+    // 4️⃣ 先取缓冲区中已有的数据体，再直接从套接字读取剩余部分
+    while (content_length > 0) {
+        if (s->len == 0 && mjpg_stream_fill(s) <= 0) return -1;
+        size_t w = s->len < content_length ? s->len : content_length;
+        frame_append(f, s->buf, w);
+        mjpg_stream_consume(s, w);
+        content_length -= w;
+    }
+    return 0;
+}
+#endif
+
+// ----------------- 进程内 V4L2 MJPEG 抓帧 -----------------
+
+#if CAPTURE_BACKEND == CAPTURE_BACKEND_V4L2
+/**
+ * @brief JPEG 标准 Huffman 表（DHT 段，ITU-T T.81 Annex K.3）
+ *
+ * 多数 UVC 摄像头输出的 MJPEG 帧省略 DHT 段，依赖解码端使用标准表。
+ * mjpg_streamer 的 input_uvc 会在保存前补上该段；直接写文件时由本程序补上，
+ * 保证浏览器与普通看图软件都能正常解码。
+ */
+static const unsigned char k_std_dht[420] = {
+    0xFF, 0xC4, 0x01, 0xA2, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A,
+    0x0B, 0x10, 0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00, 0x00,
+    0x01, 0x7D, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51,
+    0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52,
+    0xD1, 0xF0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26,
+    0x27, 0x28, 0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47,
+    0x48, 0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67,
+    0x68, 0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+    0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+    0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+    0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6,
+    0xF7, 0xF8, 0xF9, 0xFA, 0x01, 0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A,
+    0x0B, 0x11, 0x00, 0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04, 0x07, 0x05, 0x04, 0x04, 0x00, 0x01,
+    0x02, 0x77, 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07,
+    0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33,
+    0x52, 0xF0, 0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19,
+    0x1A, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46,
+    0x47, 0x48, 0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66,
+    0x67, 0x68, 0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85,
+    0x86, 0x87, 0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3,
+    0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA,
+    0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8,
+    0xD9, 0xDA, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6,
+    0xF7, 0xF8, 0xF9, 0xFA,
+};
+
+/**
+ * @brief 以 MJPEG 格式打开摄像头（共享模块 cam_open_ex）
+ *
+ * 功能：
+ *   - 格式按 MJPEG → JPEG 的顺序协商，分辨率接受驱动调整，帧率经 VIDIOC_S_PARM 设为 target_fps
+ *   - 申请 V4L2_BUF_COUNT 个 mmap 缓冲区并全部入队，非阻塞打开（等待由 poll 控制）
+ *   - STREAMON 后摄像头持续采集，DQBUF 得到的就是压缩好的 JPEG 数据
+ *
+ * @return 0 表示成功；-1 表示失败（已释放所有资源）
+ */
+static int mjpeg_cam_open(cam_device *c, const char *dev) {
+    static const unsigned int formats[] = { V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_JPEG, 0 };
+    cam_params p;
+    memset(&p, 0, sizeof(p));
+    p.width = g_cfg.v4l2_width;
+    p.height = g_cfg.v4l2_height;
+    p.formats = formats;
+    p.count = V4L2_BUF_COUNT;
+    p.fps = g_cfg.target_fps;
+    p.flags = CAM_NONBLOCK | CAM_NO_DMABUF;      // 只由 CPU 拷贝出 JPEG，不需要 DMABUF
+    return cam_open_ex(c, dev, &p);
+}
+
+/**
+ * @brief 取一帧 MJPEG 读入内存帧缓冲
+ *
+ * 功能：
+ *   - 最多等待 V4L2_TIMEOUT_MS 取出下一帧（cam_dequeue_timeout）
+ *   - 若帧中缺少 DHT 段，拷贝时在 SOS 之前插入标准 Huffman 表
+ *   - 拷贝完成立即释放帧（QBUF 归还缓冲区），驱动侧始终保持足够的空闲缓冲
+ *
+ * @param c  摄像头状态
+ * @param f  输出帧；ts_us 为共享模块给出的单调时钟时间戳（驱动时间戳非单调时为出队时刻）
+ * @return   0 表示成功读取一帧；-1 表示超时或出错
+ */
+static int mjpeg_cam_read_frame(cam_device *c, cap_frame_t *f) {
+    // 1️⃣ 等待帧就绪并出队
+    cam_frame *cf = cam_dequeue_timeout(c, V4L2_TIMEOUT_MS);
+    if (!cf) return -1;
+
+    // 2️⃣ 时间戳：即曝光/采集时刻（单调时钟）
+    f->ts_us = cf->ts_us;
+
+    const unsigned char *jpg = (const unsigned char *)cf->start;
+    size_t len = cf->bytesused;
+
+    // 3️⃣ 查找 DHT / SOS 段位置（只扫描段头，不扫描熵编码数据）
+    size_t sos = 0;
+    int has_dht = 0;
+    for (size_t i = 2; i + 4 <= len && jpg[i] == 0xFF; ) {
+        unsigned char m = jpg[i + 1];
+        if (m == 0xC4) has_dht = 1;
+        if (m == 0xDA) { sos = i; break; }
+        i += 2 + ((jpg[i + 2] << 8) | jpg[i + 3]);
+    }
+
+    // 4️⃣ 拷贝到帧缓冲：缺 DHT 时分三段拷贝（SOS 前 + 标准表 + SOS 及之后）
+    int ret = -1;
+    f->len = 0;
+    if (len > 0 && frame_reserve(f, len + sizeof(k_std_dht)) == 0) {
+        if (!has_dht && sos) {
+            frame_append(f, jpg, sos);
+            frame_append(f, k_std_dht, sizeof(k_std_dht));
+            frame_append(f, jpg + sos, len - sos);
+        } else {
+            frame_append(f, jpg, len);
+        }
+        ret = 0;
+    }
+
+    // 5️⃣ 归还缓冲区给驱动
+    cam_frame_release(cf);
+    return ret;
+}
+#endif
+
+// ----------------- 预触发环形缓冲与后台采集线程 -----------------
+
+/**
+ * @brief 初始化环形缓冲的互斥锁与条件变量（条件变量使用单调时钟超时）
+ */
+static void ring_init(frame_ring_t *r) {
+    memset(r->slots, 0, sizeof(r->slots));
+    r->head = 0;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&r->cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/**
+ * @brief 将一帧放入环形缓冲（与最旧的槽位交换内存，O(1) 且无数据拷贝）
+ *
+ * 调用后 *f 持有被替换出的旧槽位内存，供下一帧复用，
+ * 因此稳定运行时采集线程不会再分配内存。
+ */
+static void ring_push(frame_ring_t *r, cap_frame_t *f) {
+    pthread_mutex_lock(&r->lock);
+    cap_frame_t *slot = &r->slots[r->head % RING_FRAMES];
+    size_t slot_len = f->len;
+    long long slot_ts = f->ts_us;
+    cap_frame_t tmp = *slot;
+    *slot = *f;
+    *f = tmp;
+    r->head++;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    trace_event(TRACE_FRAME, (int)slot_len, slot_ts);
+}
+
+/**
+ * @brief 后台采集线程：持续从选定的抓帧后端取帧，放入预触发环形缓冲
+ *
+ * 说明：
+ *   - 空闲时帧只在内存中循环覆盖，不做任何磁盘写入
+ *   - 触发时由 capture_snapshots() 从环形缓冲中取出预录 + 后录的帧写盘
+ */
+static void *capture_thread(void *arg) {
+    (void)arg;
+    cap_frame_t cur;                   // 正在接收的帧（与环形缓冲槽位轮换使用）
+    memset(&cur, 0, sizeof(cur));
+
+    while (1) {
+        int ok;
+#if CAPTURE_BACKEND == CAPTURE_BACKEND_V4L2
+        // 摄像头未打开时 poll() 忽略负的 fd，按超时返回，不会空转
+        ok = (mjpeg_cam_read_frame(&g_cam, &cur) == 0);
+#else
+#if CAPTURE_BACKEND == CAPTURE_BACKEND_STREAM
+        if (g_stream.sock < 0)
+            mjpg_stream_open(&g_stream, "127.0.0.1", g_cfg.http_port, STREAM_PATH);
+        if (g_stream.sock >= 0) {
+            ok = (mjpg_stream_read_frame(&g_stream, &cur) == 0);
+            if (!ok) {
+                // 连接异常：关闭后下一轮立即重连
+                fprintf(stderr, "WARN: stream lost, reconnecting\n");
+                mjpg_stream_close(&g_stream);
+            }
+        } else
+#endif
+        {
+            // snapshot 模式（或长连接不可用时）按目标帧率间隔请求
+            ok = (http_get_snapshot_frame("127.0.0.1", g_cfg.http_port, "/?action=snapshot", &cur) == 0);
+            usleep(SNAPSHOT_INTERVAL_US);
+        }
+#endif
+        if (ok)
+            ring_push(&g_ring, &cur);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 初始化写盘队列
+ */
+static void write_queue_init(write_queue_t *q) {
+    memset(q->jobs, 0, sizeof(q->jobs));
+    q->head = q->tail = 0;
+    sem_init(&q->items, 0, 0);
+    sem_init(&q->slots, 0, WRITE_QUEUE_LEN);
+}
+
+/**
+ * @brief 入队一个写盘任务（队列满时等待写盘线程腾出空位）
+ *
+ * 入队后 job->frame 的数据缓冲归写盘线程所有，由其写完后释放。
+ */
+static void write_queue_push(write_queue_t *q, const write_job_t *job) {
+    while (sem_wait(&q->slots) != 0 && errno == EINTR) {}
+    q->jobs[q->head % WRITE_QUEUE_LEN] = *job;
+    q->head++;
+    sem_post(&q->items);
+}
+
+/**
+ * @brief 写盘线程：从队列取出帧写入 CAPS_DIR，每次触发结束时统一落盘
+ *
+ * 说明：
+ *   - CAPS_LAYOUT_FLAT   ：每帧写一个 %03d.jpg，同一次触发的帧连续写入
+ *   - 同时生成缩略图（thumb_make），单帧布局写 THUMB_DIR/%03d.jpg，归档布局打包为 tNNNNN.jpg
+ *   - CAPS_LAYOUT_ARCHIVE：帧先留在内存，结束标记到达时整体写成一个归档文件
+ *   - 遇到结束标记时向 frames.js 追加本次的帧，再对所在文件系统执行一次 syncfs()，不逐帧 fsync
+ *   - 测试结果任务（has_result）只向 frames.js 追加一行 R[触发序号]
+ *   - 采集与触发逻辑不再受 SD 卡写入速度影响
+ */
+static void *writer_thread(void *arg) {
+    write_queue_t *q = (write_queue_t *)arg;
+#if CAPS_LAYOUT == CAPS_LAYOUT_ARCHIVE
+    cap_frame_t burst[WRITE_QUEUE_LEN];          // 本次触发待打包的帧
+    archive_entry_t entries[WRITE_QUEUE_LEN];    // 打包后的索引
+    cap_frame_t thumbs[WRITE_QUEUE_LEN];         // 对应的缩略图（失败的帧为空帧）
+    archive_entry_t thumb_entries[WRITE_QUEUE_LEN];
+    int burst_n = 0;
+#else
+    int burst_idx[WRITE_QUEUE_LEN];    // 本次触发成功保存的帧序号（写入清单用）
+#endif
+    int burst_saved = 0;
+    long long t_burst = 0;
+
+    while (1) {
+        while (sem_wait(&q->items) != 0 && errno == EINTR) {}
+        write_job_t job = q->jobs[q->tail % WRITE_QUEUE_LEN];
+        q->tail++;
+        sem_post(&q->slots);
+
+        if (job.has_result) {
+            // 测试结果只追加一行清单，不打断正在打包的帧
+            append_result_manifest(job.burst, &job.result);
+            continue;
+        }
+
+        if (job.frame.len > 0) {
+#if CAPS_LAYOUT == CAPS_LAYOUT_ARCHIVE
+            if (burst_n == 0) t_burst = now_us();
+            if (burst_n < WRITE_QUEUE_LEN)
+                burst[burst_n++] = job.frame;
+            else
+                frame_free(&job.frame);
+#else
+            if (burst_saved == 0) t_burst = now_us();
+            char name[256];
+            snprintf(name, sizeof(name), CAPS_DIR "/%03d.jpg", job.index);
+            if (frame_save(&job.frame, name) == 0 && burst_saved < WRITE_QUEUE_LEN) {
+                burst_idx[burst_saved++] = job.index;
+                trace_event(TRACE_FILE_CLOSED, 1, job.frame.ts_us);
+            } else
+                fprintf(stderr, "WARN: write %s failed\n", name);
+            // 缩略图写到 THUMB_DIR 下同名文件；失败时网页回退为原图
+            cap_frame_t th;
+            if (g_cfg.thumb_denom > 0 && thumb_make(&job.frame, &th) == 0) {
+                snprintf(name, sizeof(name), THUMB_DIR "/%03d.jpg", job.index);
+                frame_save(&th, name);
+                frame_free(&th);
+            }
+            frame_free(&job.frame);
+#endif
+        }
+
+        if (job.burst_end) {
+            // 向清单追加本次的帧，便于网页展示，然后整体落盘
+#if CAPS_LAYOUT == CAPS_LAYOUT_ARCHIVE
+            if (burst_n > 0) {
+                char rel[64], name[256];
+                snprintf(rel, sizeof(rel), SESSION_DIR_NAME "/b%05d.jpg", job.burst);
+                snprintf(name, sizeof(name), CAPS_DIR "/%s", rel);
+                if (archive_save(burst, burst_n, name, entries) == 0) {
+                    burst_saved = burst_n;
+                    trace_event(TRACE_FILE_CLOSED, burst_n, burst[0].ts_us);
+                    // 缩略图同样打包成一个归档 tNNNNN.jpg（解码失败的帧长度为 0）
+                    char trel[64] = "";
+                    if (g_cfg.thumb_denom > 0) {
+                        for (int i = 0; i < burst_n; i++)
+                            thumb_make(&burst[i], &thumbs[i]);
+                        snprintf(trel, sizeof(trel), SESSION_DIR_NAME "/t%05d.jpg", job.burst);
+                        snprintf(name, sizeof(name), CAPS_DIR "/%s", trel);
+                        if (archive_save(thumbs, burst_n, name, thumb_entries) != 0) {
+                            fprintf(stderr, "WARN: write %s failed\n", name);
+                            trel[0] = '\0';
+                        }
+                        for (int i = 0; i < burst_n; i++)
+                            frame_free(&thumbs[i]);
+                    }
+                    append_index_manifest(job.burst, NULL, entries, burst_n, rel,
+                                          trel[0] ? thumb_entries : NULL, trel);
+                } else {
+                    fprintf(stderr, "WARN: write %s failed\n", name);
+                }
+            }
+            for (int i = 0; i < burst_n; i++)
+                frame_free(&burst[i]);
+            burst_n = 0;
+#else
+            append_index_manifest(job.burst, burst_idx, NULL, burst_saved, NULL, NULL, NULL);
+#endif
+            int dfd = open(CAPS_DIR, O_RDONLY | O_DIRECTORY);
+            if (dfd >= 0) {
+                syncfs(dfd);
+                close(dfd);
+            }
+            if (g_cfg.gallery_port > 0)
+                printf("Saved %d frames in %.1f ms. Total=%d. Browse: http://<BOARD_IP>:%d/\n",
+                       burst_saved, burst_saved ? (now_us() - t_burst) / 1e3 : 0.0,
+                       job.index, g_cfg.gallery_port);
+            else
+                printf("Saved %d frames in %.1f ms. Total=%d. "
+                       "Browse: http://<BOARD_IP>:%d/caps/index.html\n",
+                       burst_saved, burst_saved ? (now_us() - t_burst) / 1e3 : 0.0,
+                       job.index, g_cfg.http_port);
+            burst_saved = 0;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 触发抓拍：从环形缓冲中取出「触发前预录 + 触发后拍摄」时间窗口内的帧并交给写盘线程
+ *
+ * 功能：
+ *   - 时间窗口为 [t_trig_us - PRETRIGGER_US, t_trig_us + duration_us]
+ *   - 先等待后录完成（最新一帧的时间戳越过窗口终点），摄像头异常时最多再等 1 秒
+ *   - 持锁期间只交换指针取出窗口内的帧，不影响后台采集
+ *   - 取出的帧按顺序编号，交给写盘线程保存（单帧文件 000.jpg、001.jpg…… 或本次触发的归档
+ *     sessions/b00000.jpg），并追加到帧清单
+ *
+ * 参数：
+ *   @param t_trig_us   —— 触发时刻（CLOCK_MONOTONIC 微秒，通常为首次越过阈值的采样时刻）
+ *   @param duration_us —— 触发后的拍摄时长（微秒），例如 500000 表示持续 0.5 秒
+ *
+ * 返回：
+ *   @return 入队保存的帧数（实际写盘结果由写盘线程打印）
+ *
+ * 调用关系：
+ *   main() → capture_snapshots() → ring → write_queue_push() → writer_thread() → frame_save()
+ *
+ * 举例：
+ *   capture_snapshots(t_cross, 500000);  // 保存触发前 0.3 秒 + 触发后 0.5 秒的图像 (~12 帧)
+ */
+static int capture_snapshots(long long t_trig_us, useconds_t duration_us) {
+    long long t_begin = t_trig_us - g_cfg.pretrigger_us;
+    long long t_end = t_trig_us + (long long)duration_us;
+    cap_frame_t out[RING_FRAMES];
+    int n = 0;
+
+    // ① 等待后录完成
+    long long dl = t_end + 1000000LL;
+    struct timespec deadline = { (time_t)(dl / 1000000LL), (long)(dl % 1000000LL) * 1000L };
+
+    pthread_mutex_lock(&g_ring.lock);
+    while (!(g_ring.head > 0 &&
+             g_ring.slots[(g_ring.head - 1) % RING_FRAMES].ts_us >= t_end)) {
+        if (pthread_cond_timedwait(&g_ring.cond, &g_ring.lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+
+    // ② 按时间顺序取出窗口内的帧，原槽位置空（采集线程下次写入时重新分配）
+    unsigned long long first = g_ring.head > RING_FRAMES ? g_ring.head - RING_FRAMES : 0;
+    for (unsigned long long i = first; i < g_ring.head; i++) {
+        cap_frame_t *slot = &g_ring.slots[i % RING_FRAMES];
+        if (slot->len == 0 || slot->ts_us < t_begin || slot->ts_us > t_end)
+            continue;
+        out[n++] = *slot;
+        memset(slot, 0, sizeof(*slot));
+    }
+    pthread_mutex_unlock(&g_ring.lock);
+
+    // ③ 交给写盘线程（按顺序分配文件序号），最后附一个结束标记
+    write_job_t job;
+    memset(&job, 0, sizeof(job));
+    for (int i = 0; i < n; i++) {
+        job.frame = out[i];
+        job.index = g_total_saved++;
+        job.burst_end = 0;
+        job.burst = g_total_bursts;
+        write_queue_push(&g_wq, &job);
+    }
+    memset(&job, 0, sizeof(job));
+    job.index = g_total_saved;
+    job.burst_end = 1;
+    job.burst = g_total_bursts++;
+    write_queue_push(&g_wq, &job);
+    trace_event(TRACE_BURST_QUEUED, n, t_trig_us);
+
+    // 返回本次入队的帧数
+    return n;
+}
+
+// ----------------- 内置图库 HTTP 服务 -----------------
+
+/**
+ * @brief 图库服务的一个连接
+ *
+ * 每个连接同一时刻只处理一个请求：请求头收齐后生成响应，发送完毕再解析缓冲中的下一个请求
+ * （支持流水线请求，按顺序应答）。响应体为内存副本（body）或打开的文件（file_fd，sendfile 发送）。
+ */
+typedef struct {
+    int       fd;                      // 套接字（-1 表示空闲槽位）
+    char      req[GALLERY_REQ_MAX];    // 请求接收缓冲
+    size_t    req_len;
+    char      hdr[512];                // 响应头
+    size_t    hdr_len, hdr_off;
+    char     *body;                    // 内存响应体（malloc，发送完释放）
+    size_t    body_len, body_off;
+    int       file_fd;                 // 文件响应体（-1 表示无）
+    off_t     file_off;
+    size_t    file_left;
+    int       keep_alive;              // 本次响应后保持连接
+    long long t_active_us;             // 最近一次收发时刻（空闲超时用）
+} gallery_conn_t;
+
+static gallery_conn_t g_gallery_conns[GALLERY_MAX_CONN];
+
+/**
+ * @brief 按扩展名返回 Content-Type
+ */
+static const char *gallery_mime(const char *path) {
+    const char *dot = strrchr(path, '.');
+    if (!dot) return "application/octet-stream";
+    if (strcmp(dot, ".jpg") == 0) return "image/jpeg";
+    if (strcmp(dot, ".js") == 0) return "application/javascript";
+    if (strcmp(dot, ".html") == 0) return "text/html; charset=utf-8";
+    return "application/octet-stream";
+}
+
+/**
+ * @brief 释放连接当前响应占用的资源（内存体、文件描述符），保留套接字
+ */
+static void gallery_reset_response(gallery_conn_t *c) {
+    free(c->body);
+    c->body = NULL;
+    c->body_len = c->body_off = 0;
+    if (c->file_fd >= 0) close(c->file_fd);
+    c->file_fd = -1;
+    c->file_left = 0;
+    c->hdr_len = c->hdr_off = 0;
+}
+
+static void gallery_close(int ep, gallery_conn_t *c) {
+    epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    gallery_reset_response(c);
+    c->fd = -1;
+    c->req_len = 0;
+}
+
+/**
+ * @brief 组成响应头；etag 非空且与请求的 If-None-Match 相同时改为 304 且不带响应体
+ *
+ * @param body_len 响应体长度（HEAD / 304 时仍按此填写 Content-Length 或不发送）
+ * @return 1 = 需要发送响应体，0 = 只发送响应头
+ */
+static int gallery_header(gallery_conn_t *c, int status, const char *ctype, const char *etag,
+                          const char *if_none_match, size_t body_len, int head_only) {
+    const char *reason = status == 200 ? "OK" : status == 400 ? "Bad Request" :
+                         status == 404 ? "Not Found" : "Method Not Allowed";
+    if (etag && if_none_match && strstr(if_none_match, etag)) {
+        status = 304;
+        reason = "Not Modified";
+    }
+    int n = snprintf(c->hdr, sizeof(c->hdr), "HTTP/1.1 %d %s\r\n", status, reason);
+    if (status != 304)
+        n += snprintf(c->hdr + n, sizeof(c->hdr) - n, "Content-Type: %s\r\nContent-Length: %zu\r\n",
+                      ctype, body_len);
+    if (etag)
+        n += snprintf(c->hdr + n, sizeof(c->hdr) - n, "ETag: %s\r\nCache-Control: no-cache\r\n", etag);
+    n += snprintf(c->hdr + n, sizeof(c->hdr) - n, "Connection: %s\r\n\r\n",
+                  c->keep_alive ? "keep-alive" : "close");
+    c->hdr_len = (size_t)n;
+    c->hdr_off = 0;
+    return status != 304 && !head_only;
+}
+
+/**
+ * @brief 简单错误响应（文本体）
+ */
+static void gallery_error(gallery_conn_t *c, int status, int head_only) {
+    static const char msg[] = "error\n";
+    if (gallery_header(c, status, "text/plain", NULL, NULL, sizeof(msg) - 1, head_only)) {
+        c->body = (char *)malloc(sizeof(msg) - 1);
+        if (c->body) {
+            memcpy(c->body, msg, sizeof(msg) - 1);
+            c->body_len = sizeof(msg) - 1;
+        }
+    }
+}
+
+/**
+ * @brief 取请求头中某个字段的值（不区分大小写，返回指向值开头的指针，值以 \r 结束），没有返回 NULL
+ */
+static const char *gallery_req_field(const char *hdrs, const char *name) {
+    size_t nl = strlen(name);
+    for (const char *p = strstr(hdrs, "\r\n"); p; p = strstr(p, "\r\n")) {
+        p += 2;
+        if (strncasecmp(p, name, nl) == 0 && p[nl] == ':') {
+            p += nl + 1;
+            while (*p == ' ') p++;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 处理一个完整的请求头（已以 '\0' 结尾），生成响应
+ *
+ * 路由：
+ *   /、/index.html          —— 磁盘上的网页（sendfile）
+ *   /frames.js              —— 帧清单的内存副本，ETag = 运行标识 + 长度（只追加，长度即版本）
+ *   /latest.jpg             —— 预触发环形缓冲中最新的一帧（内存副本，不经过 mjpg_streamer）
+ *   其余 *.jpg              —— CAPS_DIR 下的单帧 / 缩略图 / 归档文件（sendfile），ETag = inode + 大小 + 修改时间
+ */
+static void gallery_handle_request(gallery_conn_t *c, char *req) {
+    char method[8], path[128];
+    int minor = 0;
+    if (sscanf(req, "%7s %127s HTTP/1.%d", method, path, &minor) != 3) {
+        c->keep_alive = 0;
+        gallery_error(c, 400, 0);
+        return;
+    }
+    const char *conn = gallery_req_field(req, "Connection");
+    c->keep_alive = conn ? strncasecmp(conn, "close", 5) != 0 && (minor >= 1 || strncasecmp(conn, "keep-alive", 10) == 0)
+                         : minor >= 1;
+    const char *inm = gallery_req_field(req, "If-None-Match");
+    char inm_buf[96] = "";
+    if (inm) {
+        size_t n = strcspn(inm, "\r");
+        if (n >= sizeof(inm_buf)) n = sizeof(inm_buf) - 1;
+        memcpy(inm_buf, inm, n);
+        inm_buf[n] = '\0';
+    }
+    int head_only = strcmp(method, "HEAD") == 0;
+    if (!head_only && strcmp(method, "GET") != 0) {
+        gallery_error(c, 405, 0);
+        return;
+    }
+    char *q = strchr(path, '?');
+    if (q) *q = '\0';
+    if (strcmp(path, "/") == 0) strcpy(path, "/index.html");
+
+    char etag[96];
+    if (strcmp(path, "/" INDEX_MANIFEST) == 0) {
+        // 帧清单：内存副本
+        pthread_mutex_lock(&g_manifest.lock);
+        size_t len = g_manifest.len;
+        snprintf(etag, sizeof(etag), "\"m%llx-%zx\"", g_manifest.run_id, len);
+        if (gallery_header(c, 200, gallery_mime(path), etag, inm ? inm_buf : NULL, len, head_only) && len > 0) {
+            c->body = (char *)malloc(len);
+            if (c->body) {
+                memcpy(c->body, g_manifest.data, len);
+                c->body_len = len;
+            } else {
+                c->keep_alive = 0;               // 内存不足：长度已声明，发完响应头即断开
+            }
+        }
+        pthread_mutex_unlock(&g_manifest.lock);
+        return;
+    }
+    if (strcmp(path, "/latest.jpg") == 0) {
+        // 最新一帧：持锁只做一次拷贝
+        pthread_mutex_lock(&g_ring.lock);
+        const cap_frame_t *f = g_ring.head > 0 ? &g_ring.slots[(g_ring.head - 1) % RING_FRAMES] : NULL;
+        if (f && f->len > 0) {
+            snprintf(etag, sizeof(etag), "\"r%llx-%llx\"", g_manifest.run_id, g_ring.head);
+            if (gallery_header(c, 200, "image/jpeg", etag, inm ? inm_buf : NULL, f->len, head_only)) {
+                c->body = (char *)malloc(f->len);
+                if (c->body) {
+                    memcpy(c->body, f->data, f->len);
+                    c->body_len = f->len;
+                } else {
+                    c->keep_alive = 0;
+                }
+            }
+            pthread_mutex_unlock(&g_ring.lock);
+        } else {
+            pthread_mutex_unlock(&g_ring.lock);
+            gallery_error(c, 404, head_only);
+        }
+        return;
+    }
+
+    // 磁盘文件：只允许 CAPS_DIR 下的简单相对路径（不含 ".."）
+    int ok = strstr(path, "..") == NULL;
+    for (const char *p = path; ok && *p; p++)
+        ok = ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') ||
+              *p == '/' || *p == '.' || *p == '_' || *p == '-');
+    char full[256];
+    snprintf(full, sizeof(full), CAPS_DIR "%s", path);
+    int fd = ok ? open(full, O_RDONLY | O_CLOEXEC) : -1;
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0) close(fd);
+        gallery_error(c, 404, head_only);
+        return;
+    }
+    snprintf(etag, sizeof(etag), "\"%lx-%llx-%lx\"", (unsigned long)st.st_ino,
+             (unsigned long long)st.st_size, (unsigned long)st.st_mtime);
+    if (gallery_header(c, 200, gallery_mime(path), etag, inm ? inm_buf : NULL, (size_t)st.st_size, head_only)) {
+        c->file_fd = fd;
+        c->file_off = 0;
+        c->file_left = (size_t)st.st_size;
+    } else {
+        close(fd);
+    }
+}
+
+/**
+ * @brief 发送当前响应
+ * @return 1 发送完毕，0 尚未发完（等待可写），-1 连接出错
+ *
+ * 文件体每次最多 sendfile GALLERY_CHUNK 字节后即返回 0，让出给其它连接。
+ */
+static int gallery_flush(gallery_conn_t *c) {
+    while (c->hdr_off < c->hdr_len) {
+        ssize_t n = send(c->fd, c->hdr + c->hdr_off, c->hdr_len - c->hdr_off, MSG_NOSIGNAL);
+        if (n < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        c->hdr_off += (size_t)n;
+    }
+    while (c->body_off < c->body_len) {
+        ssize_t n = send(c->fd, c->body + c->body_off, c->body_len - c->body_off, MSG_NOSIGNAL);
+        if (n < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        c->body_off += (size_t)n;
+    }
+    if (c->file_left > 0) {
+        size_t chunk = c->file_left < GALLERY_CHUNK ? c->file_left : GALLERY_CHUNK;
+        ssize_t n = sendfile(c->fd, c->file_fd, &c->file_off, chunk);
+        if (n < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        if (n == 0) return -1;                   // 文件被截短：已声明的长度发不完，只能断开
+        c->file_left -= (size_t)n;
+        if (c->file_left > 0) return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief 推进一个连接：发送响应；发完后解析缓冲中的下一个请求，直到需要等待收发
+ * @return 0 连接保持，-1 需要关闭
+ */
+static int gallery_advance(int ep, gallery_conn_t *c) {
+    while (1) {
+        if (c->hdr_len > 0) {
+            int r = gallery_flush(c);
+            if (r < 0) return -1;
+            if (r == 0) break;
+            gallery_reset_response(c);
+            if (!c->keep_alive) return -1;
+        }
+        // 取下一个完整的请求头
+        char *end = (char *)memmem(c->req, c->req_len, "\r\n\r\n", 4);
+        if (!end) {
+            if (c->req_len == sizeof(c->req)) {           // 请求头过长
+                c->keep_alive = 0;
+                gallery_error(c, 400, 0);
+                c->req_len = 0;
+                continue;
+            }
+            break;
+        }
+        end[2] = '\0';
+        size_t used = (size_t)(end + 4 - c->req);
+        gallery_handle_request(c, c->req);
+        memmove(c->req, c->req + used, c->req_len - used);
+        c->req_len -= used;
+    }
+    // 有待发数据时等可写，否则等下一个请求
+    struct epoll_event ev;
+    ev.events = c->hdr_len > 0 ? EPOLLOUT : EPOLLIN;
+    ev.data.u32 = (uint32_t)(c - g_gallery_conns);
+    epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+    return 0;
+}
+
+/**
+ * @brief 图库服务线程：单个 epoll 循环服务全部连接
+ *
+ * 功能：
+ *   - HTTP/1.1 keep-alive 与流水线请求，GET / HEAD，带 ETag 的条件请求回 304
+ *   - 帧清单与最新帧从内存发送，磁盘上的单帧 / 缩略图 / 归档用 sendfile 零拷贝发送
+ *   - 线程 nice 值为 GALLERY_NICE，抓拍窗口内（g_capture_busy）暂停服务，
+ *     浏览抓拍不与触发后的取帧争抢 CPU 与网络
+ *
+ * @param arg 监听套接字（intptr_t）
+ */
+static void *gallery_thread(void *arg) {
+    int lfd = (int)(intptr_t)arg;
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), GALLERY_NICE);
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) {
+        perror("epoll_create1");
+        close(lfd);
+        return NULL;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = GALLERY_MAX_CONN;              // 监听套接字
+    epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev);
+    for (int i = 0; i < GALLERY_MAX_CONN; i++) {
+        g_gallery_conns[i].fd = -1;
+        g_gallery_conns[i].file_fd = -1;
+    }
+
+    struct epoll_event evs[GALLERY_MAX_CONN + 1];
+    while (1) {
+        if (__atomic_load_n(&g_capture_busy, __ATOMIC_RELAXED)) {
+            usleep(GALLERY_BUSY_POLL_US);
+            continue;
+        }
+        int n = epoll_wait(ep, evs, GALLERY_MAX_CONN + 1, 1000);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        long long t_now = now_us();
+        for (int i = 0; i < n; i++) {
+            uint32_t id = evs[i].data.u32;
+            if (id == GALLERY_MAX_CONN) {
+                // 新连接：放入空闲槽位，没有空位时直接关闭
+                int cfd;
+                while ((cfd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    int k = 0;
+                    while (k < GALLERY_MAX_CONN && g_gallery_conns[k].fd >= 0) k++;
+                    if (k == GALLERY_MAX_CONN) {
+                        close(cfd);
+                        continue;
+                    }
+                    int one = 1;
+                    setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    gallery_conn_t *c = &g_gallery_conns[k];
+                    c->fd = cfd;
+                    c->req_len = 0;
+                    c->t_active_us = t_now;
+                    ev.events = EPOLLIN;
+                    ev.data.u32 = (uint32_t)k;
+                    epoll_ctl(ep, EPOLL_CTL_ADD, cfd, &ev);
+                }
+                continue;
+            }
+
+            gallery_conn_t *c = &g_gallery_conns[id];
+            if (c->fd < 0) continue;
+            int bad = (evs[i].events & EPOLLERR) != 0;
+            if (!bad && (evs[i].events & (EPOLLIN | EPOLLHUP))) {
+                ssize_t r = recv(c->fd, c->req + c->req_len, sizeof(c->req) - c->req_len, 0);
+                if (r > 0)
+                    c->req_len += (size_t)r;
+                else if (r == 0 || (errno != EAGAIN && errno != EINTR))
+                    bad = 1;                     // 对端关闭或出错
+            }
+            c->t_active_us = t_now;
+            if (bad || gallery_advance(ep, c) != 0)
+                gallery_close(ep, c);
+        }
+
+        // 关闭空闲超时的 keep-alive 连接
+        for (int k = 0; k < GALLERY_MAX_CONN; k++) {
+            gallery_conn_t *c = &g_gallery_conns[k];
+            if (c->fd >= 0 && t_now - c->t_active_us > GALLERY_IDLE_MS * 1000LL)
+                gallery_close(ep, c);
+        }
+    }
+    close(ep);
+    close(lfd);
+    return NULL;
+}
+
+/**
+ * @brief 监听 gallery_port 并启动图库服务线程
+ * @return 0 成功，-1 失败（已打印原因，不影响抓拍）
+ */
+static int gallery_start(int port) {
+    // sendfile 没有 MSG_NOSIGNAL，浏览器中途关闭连接时会产生 SIGPIPE，整个进程忽略该信号
+    signal(SIGPIPE, SIG_IGN);
+
+    int lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (lfd < 0) {
+        perror("gallery socket");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(lfd, GALLERY_MAX_CONN) != 0) {
+        perror("gallery bind/listen");
+        close(lfd);
+        return -1;
+    }
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, gallery_thread, (void *)(intptr_t)lfd) != 0) {
+        perror("pthread_create gallery");
+        close(lfd);
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+// ----------------- IIO 缓冲模式 ADC 采集 -----------------
+
+/**
+ * @brief 向 sysfs 属性文件写入字符串
+ * @return 0 成功，-1 失败
+ */
+static int sysfs_write(const char *path, const char *val) {
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) return -1;
+    ssize_t n = write(fd, val, strlen(val));
+    close(fd);
+    return n == (ssize_t)strlen(val) ? 0 : -1;
+}
+
+/**
+ * @brief 关闭 IIO 缓冲采集（停止缓冲并关闭设备节点）
+ */
+static void iio_buffer_close(iio_buf_t *b) {
+    if (b->fd >= 0) {
+        close(b->fd);
+        b->fd = -1;
+    }
+    sysfs_write(IIO_DEV_DIR "/buffer/enable", "0");
+}
+
+#if ADC_MODE == ADC_MODE_BUFFER
+/**
+ * @brief 读取 sysfs 属性文件内容（去掉末尾换行）
+ * @return 读取到的字节数，失败返回 -1
+ */
+static int sysfs_read(const char *path, char *buf, size_t size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0) return -1;
+    while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' ')) n--;
+    buf[n] = '\0';
+    return (int)n;
+}
+
+/**
+ * @brief 选择并配置 IIO 触发器（hrtimer 优先）
+ *
+ * 功能：
+ *   1️⃣ 通过 configfs 创建名为 IIO_TRIGGER_NAME 的 hrtimer 触发器（已存在则直接复用）
+ *   2️⃣ 在 /sys/bus/iio/devices/trigger* 中找到同名触发器，设置采样频率 IIO_SAMPLE_HZ
+ *   3️⃣ 写入 ADC 设备的 trigger/current_trigger
+ *
+ * 说明：内核需开启 CONFIG_IIO_HRTIMER_TRIGGER 且已挂载 configfs；
+ *       若板上没有 hrtimer，可事先准备同名的其他触发器（如 sysfs trigger）。
+ */
+static int iio_setup_trigger(void) {
+    if (mkdir(IIO_HRTIMER_DIR "/" IIO_TRIGGER_NAME, 0755) != 0 && errno != EEXIST)
+        fprintf(stderr, "WARN: create hrtimer trigger: %s\n", strerror(errno));
+
+    int found = 0;
+    DIR *d = opendir("/sys/bus/iio/devices");
+    if (!d) return -1;
+    struct dirent *e;
+    char path[PATH_MAX], name[64];
+    while ((e = readdir(d)) != NULL) {
+        if (strncmp(e->d_name, "trigger", 7) != 0) continue;
+        snprintf(path, sizeof(path), "/sys/bus/iio/devices/%s/name", e->d_name);
+        if (sysfs_read(path, name, sizeof(name)) <= 0 || strcmp(name, IIO_TRIGGER_NAME) != 0)
+            continue;
+        snprintf(path, sizeof(path), "/sys/bus/iio/devices/%s/sampling_frequency", e->d_name);
+        char freq[16];
+        snprintf(freq, sizeof(freq), "%d", g_cfg.iio_sample_hz);
+        if (sysfs_write(path, freq) != 0)
+            fprintf(stderr, "WARN: set trigger sampling_frequency failed\n");
+        found = 1;
+        break;
+    }
+    closedir(d);
+    if (!found) {
+        fprintf(stderr, "ERROR: IIO trigger '%s' not found\n", IIO_TRIGGER_NAME);
+        return -1;
+    }
+    return sysfs_write(IIO_DEV_DIR "/trigger/current_trigger", IIO_TRIGGER_NAME);
+}
+
+/**
+ * @brief 解析 scan_elements/in_xxx_type（格式如 "le:u12/16>>0"）
+ * @return 0 成功，-1 格式无法识别
+ */
+static int iio_parse_type(const char *path, iio_chan_fmt_t *fmt) {
+    char buf[32], endian[3] = "", sign = 'u';
+    int bits = 0, storage = 0, shift = 0;
+    if (sysfs_read(path, buf, sizeof(buf)) <= 0) return -1;
+    if (sscanf(buf, "%2[bl]e:%c%d/%d>>%d", endian, &sign, &bits, &storage, &shift) != 5)
+        return -1;
+    if (bits <= 0 || bits > 32 || (storage != 8 && storage != 16 && storage != 32))
+        return -1;
+    fmt->is_be     = (endian[0] == 'b');
+    fmt->is_signed = (sign == 's');
+    fmt->bits      = bits;
+    fmt->bytes     = storage / 8;
+    fmt->shift     = shift;
+    return 0;
+}
+
+/**
+ * @brief 打开 IIO 缓冲采集：只使能 IIO_CHANNEL（及时间戳）通道，启动缓冲
+ *
+ * 功能：
+ *   ① 关闭缓冲并清除其他已使能的扫描通道，使扫描布局固定为 [电压][填充][时间戳]
+ *   ② 解析电压通道存储格式；若支持时间戳通道则切换到单调时钟并使能
+ *   ③ 设置触发器、缓冲长度与水位（每次 read 返回的样本块大小），使能缓冲
+ *   ④ 以非阻塞方式打开 /dev/iio:deviceX，配合 poll() 读取
+ *
+ * @return 0 成功，-1 失败（调用方可回退到 sysfs 逐点读取）
+ */
+static int iio_buffer_open(iio_buf_t *b, float scale) {
+    char num[16];
+    memset(b, 0, sizeof(*b));
+    b->fd = -1;
+    b->ts_offset = -1;
+    b->scale = scale;
+
+    // ① 禁用缓冲并复位扫描通道
+    sysfs_write(IIO_DEV_DIR "/buffer/enable", "0");
+    DIR *d = opendir(IIO_DEV_DIR "/scan_elements");
+    if (!d) {
+        perror("open scan_elements");
+        return -1;
+    }
+    struct dirent *e;
+    char path[PATH_MAX];
+    while ((e = readdir(d)) != NULL) {
+        size_t n = strlen(e->d_name);
+        if (n > 3 && strcmp(e->d_name + n - 3, "_en") == 0) {
+            snprintf(path, sizeof(path), IIO_DEV_DIR "/scan_elements/%s", e->d_name);
+            sysfs_write(path, "0");
+        }
+    }
+    closedir(d);
+
+    // ② 电压通道 + 可选时间戳通道
+    if (iio_parse_type(IIO_DEV_DIR "/scan_elements/in_" IIO_CHANNEL "_type", &b->fmt) != 0 ||
+        sysfs_write(IIO_DEV_DIR "/scan_elements/in_" IIO_CHANNEL "_en", "1") != 0) {
+        fprintf(stderr, "ERROR: IIO channel %s not available for buffering\n", IIO_CHANNEL);
+        return -1;
+    }
+    b->scan_bytes = b->fmt.bytes;
+    if (sysfs_write(IIO_DEV_DIR "/current_timestamp_clock", "monotonic") == 0 &&
+        sysfs_write(IIO_DEV_DIR "/scan_elements/in_timestamp_en", "1") == 0) {
+        // 时间戳为 64 位，按 8 字节对齐
+        b->ts_offset = (b->scan_bytes + 7) & ~7;
+        b->scan_bytes = b->ts_offset + 8;
+    }
+
+    // ③ 触发器、缓冲长度、水位、使能
+    if (iio_setup_trigger() != 0)
+        return -1;
+    snprintf(num, sizeof(num), "%d", IIO_BUFFER_LEN);
+    sysfs_write(IIO_DEV_DIR "/buffer/length", num);
+    snprintf(num, sizeof(num), "%d", IIO_BLOCK_SAMPLES);
+    sysfs_write(IIO_DEV_DIR "/buffer/watermark", num); // 旧内核无此属性，可忽略
+    if (sysfs_write(IIO_DEV_DIR "/buffer/enable", "1") != 0) {
+        perror("enable IIO buffer");
+        return -1;
+    }
+
+    // ④ 打开字符设备
+    b->fd = open(IIO_DEV_NODE, O_RDONLY | O_NONBLOCK);
+    if (b->fd < 0) {
+        perror("open " IIO_DEV_NODE);
+        iio_buffer_close(b);
+        return -1;
+    }
+    printf("IIO buffer: %s @ %d Hz, %d-byte scan%s\n", IIO_CHANNEL, g_cfg.iio_sample_hz,
+           b->scan_bytes, b->ts_offset >= 0 ? " + timestamp" : "");
+    return 0;
+}
+#endif
+
+/**
+ * @brief 读取一块采样（等待至多 timeout_ms），转换为电压与单调时间戳
+ *
+ * 参数：
+ *   @param volts  —— 输出电压数组（V），容量至少 IIO_BLOCK_SAMPLES
+ *   @param ts_us  —— 输出每个样本的时间戳（CLOCK_MONOTONIC 微秒）
+ *
+ * 返回：
+ *   @return 本次得到的样本数（0 表示超时），-1 表示读取错误
+ *
+ * 说明：设备不提供时间戳通道时，按读取时刻与采样周期倒推每个样本的时间。
+ */
+static int iio_buffer_read_block(iio_buf_t *b, float *volts, long long *ts_us, int timeout_ms) {
+    unsigned char raw[IIO_BLOCK_SAMPLES * IIO_MAX_SCAN_BYTES];
+    struct pollfd pfd = { b->fd, POLLIN, 0 };
+    if (poll(&pfd, 1, timeout_ms) <= 0)
+        return 0;
+
+    ssize_t n = read(b->fd, raw, (size_t)IIO_BLOCK_SAMPLES * b->scan_bytes);
+    if (n < 0)
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    int cnt = (int)(n / b->scan_bytes);
+    long long t_read = now_us();
+
+    const iio_chan_fmt_t *fm = &b->fmt;
+    unsigned int mask = fm->bits >= 32 ? 0xffffffffu : ((1u << fm->bits) - 1u);
+    for (int i = 0; i < cnt; i++) {
+        const unsigned char *p = raw + (size_t)i * b->scan_bytes;
+
+        // 按存储字节序组装，再移位、截位、符号扩展
+        unsigned int v = 0;
+        for (int k = 0; k < fm->bytes; k++)
+            v |= (unsigned int)p[fm->is_be ? k : fm->bytes - 1 - k] << (8 * (fm->bytes - 1 - k));
+        v = (v >> fm->shift) & mask;
+        int val = (int)v;
+        if (fm->is_signed && fm->bits < 32 && (v & (1u << (fm->bits - 1))))
+            val = (int)(v | ~mask);
+        volts[i] = (val * b->scale) / 1000.0f;
+
+        if (b->ts_offset >= 0) {
+            long long ns;
+            memcpy(&ns, p + b->ts_offset, sizeof(ns));
+            ts_us[i] = ns / 1000;
+        } else {
+            ts_us[i] = t_read - (long long)(cnt - 1 - i) * 1000000LL / g_cfg.iio_sample_hz;
+        }
+    }
+    return cnt;
+}
+
+// ----------------- 测试仪遥测链路（TRIGGER_SOURCE_TESTER） -----------------
+
+/**
+ * @brief CRC-16/CCITT-FALSE（多项式 0x1021，初值 0xFFFF），与固件 Telemetry_CRC16 相同
+ */
+static uint16_t tlm_crc16(const unsigned char *p, size_t len) {
+    uint16_t crc = 0xFFFF;
+    while (len--) {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+/**
+ * @brief 以原始模式打开测试仪遥测串口（TESTER_BAUD 8N1，非阻塞，配合 poll() 读取）
+ *
+ * @return 0 成功，-1 失败（errno 为原因，不打印，便于断开后静默重连）
+ */
+static int tester_link_open(tester_link_t *l, const char *dev) {
+    int fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, TESTER_BAUD);
+    cfsetospeed(&tio, TESTER_BAUD);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    tcflush(fd, TCIFLUSH);             // 丢弃打开前积压的半帧数据
+    l->fd = fd;
+    l->len = 0;
+    l->seq = -1;
+    return 0;
+}
+
+static void tester_link_close(tester_link_t *l) {
+    if (l->fd >= 0) close(l->fd);
+    l->fd = -1;
+    l->len = 0;
+}
+
+/**
+ * @brief 读取串口已到达的数据（非阻塞）
+ * @return 读到的字节数（0 表示暂无数据），-1 表示串口出错或断开
+ */
+static ssize_t tester_link_fill(tester_link_t *l) {
+    if (l->len == sizeof(l->buf)) l->len = 0;   // 不可能出现的整缓冲无帧头：清空重新同步
+    ssize_t n = read(l->fd, l->buf + l->len, sizeof(l->buf) - l->len);
+    l->t_rx_us = now_us();
+    if (n > 0) {
+        l->len += (size_t)n;
+        return n;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return 0;
+    return -1;
+}
+
+/**
+ * @brief 从接收缓冲中取出下一帧
+ *
+ * 功能：
+ *   - 查找帧头 A5 5A，按长度字段等待整帧到齐后校验 CRC；CRC 错误或长度非法时丢弃一个字节重新同步
+ *   - 按帧序号统计丢帧数
+ *   - 以 read() 返回时刻倒推帧首字节的传输时刻（缓冲中该帧及其后的字节数 × TESTER_BYTE_US）
+ *
+ * @return 1 取到一帧（已从缓冲中移除），0 数据不足
+ */
+static int tester_link_next(tester_link_t *l, tlm_frame_t *f) {
+    size_t i = 0;
+    int got = 0;
+    while (l->len - i >= TLM_HEADER_LEN) {
+        const unsigned char *p = l->buf + i;
+        if (p[0] != TLM_SOF0 || p[1] != TLM_SOF1 || p[4] > TLM_MAX_PAYLOAD) {
+            i++;
+            continue;
+        }
+        size_t flen = TLM_FRAME_LEN(p[4]);
+        if (l->len - i < flen) break;                 // 半帧：等下次 read
+        uint16_t crc = tlm_crc16(p + 2, 3 + p[4]);
+        if ((uint16_t)(p[flen - 2] | p[flen - 1] << 8) != crc) {
+            l->crc_errors++;
+            i++;
+            continue;
+        }
+        if (l->seq >= 0)
+            l->lost += (unsigned char)(p[3] - l->seq - 1);
+        l->seq = p[3];
+        f->type = p[2];
+        f->len = p[4];
+        memcpy(f->payload, p + TLM_HEADER_LEN, f->len);
+        f->t_start_us = l->t_rx_us - (long long)(l->len - i) * TESTER_BYTE_US;
+        i += flen;
+        got = 1;
+        break;
+    }
+    memmove(l->buf, l->buf + i, l->len - i);
+    l->len -= i;
+    return got;
+}
+
+static uint32_t tlm_get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int tlm_get_i16(const unsigned char *p) {
+    return (int16_t)(p[0] | p[1] << 8);
+}
+
+/**
+ * @brief 解析 TLM_TYPE_RESULT 负载
+ * @return 0 成功，-1 长度不符
+ */
+static int tlm_parse_result(const tlm_frame_t *f, tester_result_t *r) {
+    if (f->len != 16) return -1;
+    const unsigned char *p = f->payload;
+    r->test_no  = tlm_get_u32(p);
+    r->cycle_ms = p[4] | p[5] << 8;
+    r->tx_R     = tlm_get_i16(p + 6);
+    r->rx_R     = tlm_get_i16(p + 8);
+    r->tx_B     = tlm_get_i16(p + 10);
+    r->rx_B     = tlm_get_i16(p + 12);
+    r->pass     = p[14];
+    r->slot     = p[15];
+    return 0;
+}
+
+/**
+ * @brief 记录一次由测试仪触发的抓拍（测试序号 → 触发序号）
+ */
+static void tester_burst_add(uint32_t test_no, int slot, int burst) {
+    tester_burst_t *b = &g_tester_bursts[g_tester_burst_count++ % TESTER_BURSTS];
+    b->test_no = test_no;
+    b->slot = slot;
+    b->burst = burst;
+}
+
+/**
+ * @brief 查找测试序号对应的触发序号
+ * @return 触发序号；该次测试没有触发抓拍（抓拍进行中被忽略，或记录已被覆盖）时返回 -1
+ */
+static int tester_burst_find(uint32_t test_no, int slot) {
+    int n = g_tester_burst_count < TESTER_BURSTS ? g_tester_burst_count : TESTER_BURSTS;
+    for (int i = 1; i <= n; i++) {
+        const tester_burst_t *b = &g_tester_bursts[(g_tester_burst_count - i) % TESTER_BURSTS];
+        if (b->test_no == test_no && b->slot == slot) return b->burst;
+    }
+    return -1;
+}
+
+/**
+ * @brief 测试结果到达：交给写盘线程追加到对应抓拍的清单项
+ */
+static void tester_on_result(const tester_result_t *r) {
+    int burst = tester_burst_find(r->test_no, r->slot);
+    printf("[Tester] test %u slot %d %s tx_R=%.2f rx_R=%.2f tx_B=%.2f rx_B=%.2f (%d ms)%s\n",
+           r->test_no, r->slot, r->pass ? "PASS" : "FAIL", r->tx_R / 100.0, r->rx_R / 100.0,
+           r->tx_B / 100.0, r->rx_B / 100.0, r->cycle_ms, burst < 0 ? ", no capture" : "");
+    if (burst < 0) return;
+
+    write_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.burst = burst;
+    job.has_result = 1;
+    job.result = *r;
+    write_queue_push(&g_wq, &job);
+}
+
+// ----------------- 事件循环：定时器与触发状态机 -----------------
+
+/**
+ * @brief 触发流程状态
+ *
+ *   IDLE      —— 监测电压，等待越过阈值
+ *   CAPTURING —— 已触发，等待后录时间窗口结束后保存图像
+ *   HOLDING   —— 线圈通电保持中，到时后断电并回到 IDLE
+ *
+ * 除 IDLE 外的状态只响应事件定时器，期间 ADC 仍按周期采样与打印，但不会再次触发。
+ */
+typedef enum {
+    COIL_IDLE = 0,
+    COIL_CAPTURING,
+    COIL_HOLDING,
+} coil_state_t;
+
+/**
+ * @brief 阈值消抖检测器
+ */
+typedef struct {
+    int       count;                   // 连续越过阈值的样本数
+    long long t_cross;                 // 本轮首次越过阈值的时刻（CLOCK_MONOTONIC 微秒）
+} trig_detect_t;
+
+/**
+ * @brief 输入一个样本，连续 need 个样本超过阈值时返回 1
+ */
+static int trig_detect_feed(trig_detect_t *d, float voltage, long long ts_us, long long need) {
+    if (voltage > g_cfg.voltage_thresh) {
+        if (d->count == 0) {
+            d->t_cross = ts_us;
+            trace_event(TRACE_CROSS, 0, ts_us);
+        }
+        if (++d->count >= need) {
+            d->count = 0;
+            return 1;
+        }
+    } else {
+        d->count = 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief 将 timerfd 设置为在单调时钟 t_us 时刻到期，period_us > 0 时此后周期触发
+ *
+ * 使用绝对时间，周期定时器的相位不会随处理耗时漂移。
+ */
+static int timerfd_arm_at(int tfd, long long t_us, long long period_us) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = (time_t)(t_us / 1000000LL);
+    its.it_value.tv_nsec = (long)(t_us % 1000000LL) * 1000L;
+    its.it_interval.tv_sec = (time_t)(period_us / 1000000LL);
+    its.it_interval.tv_nsec = (long)(period_us % 1000000LL) * 1000L;
+    return timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/**
+ * @brief 读取 timerfd 到期次数（非阻塞，未到期返回 0）
+ */
+static unsigned long long timerfd_consume(int tfd) {
+    unsigned long long expirations = 0;
+    if (read(tfd, &expirations, sizeof(expirations)) != (ssize_t)sizeof(expirations))
+        return 0;
+    return expirations;
+}
+
+/**
+ * @brief 触发事件：进入 CAPTURING，预约后录结束时刻的事件
+ *
+ * 多等一个帧间隔，保证窗口末尾的那一帧已进入环形缓冲。
+ */
+static void coil_on_trigger(coil_state_t *st, int tfd_event, long long t_cross) {
+    __atomic_store_n(&g_capture_busy, 1, __ATOMIC_RELAXED);   // 图库服务暂停到取出帧为止
+    printf("[Trigger] capture %.3fs (+%.3fs pre-roll) into %s ...\n",
+           g_cfg.hold_time_us / 1e6, g_cfg.pretrigger_us / 1e6, CAPS_DIR);
+    trace_event(TRACE_TRIGGER, 0, t_cross);
+    timerfd_arm_at(tfd_event, t_cross + g_cfg.hold_time_us + SNAPSHOT_INTERVAL_US, 0);
+    *st = COIL_CAPTURING;
+}
+
+/**
+ * @brief 事件定时器到期：推进触发状态机
+ *
+ *   CAPTURING → 保存窗口内图像，线圈上电，预约 HOLD_TIME_SEC 后的断电事件 → HOLDING
+ *               （drive_coil 为 0 时继电器由测试仪控制，保存后直接回到 IDLE）
+ *   HOLDING   → 线圈断电 → IDLE
+ */
+static void coil_on_event(coil_state_t *st, int tfd_event, long long t_cross, int drive_coil) {
+    if (*st == COIL_CAPTURING) {
+        // 从环形缓冲取出越过阈值前后的多帧图像
+        // （写盘在后台线程进行，这里不等待 SD 卡）
+        int queued = capture_snapshots(t_cross, g_cfg.hold_time_us);
+        __atomic_store_n(&g_capture_busy, 0, __ATOMIC_RELAXED);
+        printf("Captured %d frames, writing in background\n", queued);
+        if (!drive_coil) {
+            *st = COIL_IDLE;
+            return;
+        }
+
+        // 执行 GPIO 控制时序（线圈通断）：断开 GPIO_B、上电 GPIO_A
+        coil_gpio_set(&g_coil, 1, 0);
+        trace_event(TRACE_GPIO, 1, 0);
+        timerfd_arm_at(tfd_event, now_us() + g_cfg.hold_time_sec * 1000000LL, 0);
+        *st = COIL_HOLDING;
+    } else if (*st == COIL_HOLDING) {
+        // 保持时间到，断电
+        coil_gpio_set(&g_coil, 0, 1);
+        trace_event(TRACE_GPIO, 2, 0);
+        printf("[Coil] released after %ds\n", g_cfg.hold_time_sec);
+        *st = COIL_IDLE;
+    }
+}
+
+// ----------------- 主程序入口 -----------------
+/**
+ * @brief 程序主入口：基于测试仪继电器事件（或 ADC 电压）触发拍照与推流
+ *
+ * 功能概述：
+ *   - 初始化目录与网页文件
+ *   - 启动 mjpg_streamer 视频推流服务
+ *   - 接收测试仪遥测，继电器接通时触发自动拍照，测试结果附到该次抓拍
+ *     （TRIGGER_SOURCE_ADC 或串口不可用时：读取 ADC 电压信号，当电压超过阈值时触发）
+ *   - 抓取多帧图像（连续截图）保存至 /root/mjpg/www 目录
+ *   - 通过 GPIO 控制线圈通断，模拟打击或采样动作
+ *   - 抓取结果可通过浏览器访问 mjpg_streamer 的 HTTP 端口查看
  *
  * 核心逻辑：
- *   1️⃣ 系统初始化（目录、HTTP、ADC、GPIO）
- *   2️⃣ ADC 实时采样电压
- *   3️⃣ 达到电压门限 → 自动触发图像抓取
- *   4️⃣ GPIO 执行通断动作
+ *   1️⃣ 系统初始化（目录、HTTP、测试仪串口或 ADC、GPIO）
+ *   2️⃣ 接收测试仪事件 / ADC 实时采样电压
+ *   3️⃣ 继电器接通 / 达到电压门限 → 自动触发图像抓取
+ *   4️⃣ GPIO 执行通断动作（仅 ADC 触发；测试仪触发时继电器由测试仪控制）
  *   5️⃣ 抓取结果可网页实时预览
+ *   6️⃣ kill -USR1 <pid> 导出时序跟踪记录（TRACE_CSV_PATH），用于分析触发延迟与帧间抖动
  */
-int main(void) {
+int main(int argc, char **argv) {
+    g_tester.fd = -1;                  // 测试仪串口尚未打开
+    g_cam.fd = -1;                     // V4L2 摄像头尚未打开（退出时 cam_close 据此跳过）
+
+    // 读取配置文件与命令行覆盖（--help 打印全部参数后退出）
+    int cfg_rc = cfg_parse_args(g_cfg_opts, CFG_COUNT(g_cfg_opts), argc, argv, CONFIG_FILE);
+    if (cfg_rc != 0) return cfg_rc > 0 ? 0 : 1;
+    if (g_cfg.target_fps <= 0 || g_cfg.sample_us <= 0 || g_cfg.iio_sample_hz <= 0 ||
+        g_cfg.trigger_count <= 0 || g_cfg.hold_time_us < 0 || g_cfg.pretrigger_us < 0) {
+        fprintf(stderr, "ERROR: target_fps/sample_us/iio_sample_hz/trigger_count must be positive\n");
+        return 1;
+    }
+    if (g_cfg.thumb_denom != 0 && g_cfg.thumb_denom != 1 && g_cfg.thumb_denom != 2 &&
+        g_cfg.thumb_denom != 4 && g_cfg.thumb_denom != 8) {
+        fprintf(stderr, "ERROR: thumb_denom must be 0, 1, 2, 4 or 8\n");
+        return 1;
+    }
+    if ((g_cfg.pretrigger_us + g_cfg.hold_time_us) / SNAPSHOT_INTERVAL_US >= RING_FRAMES) {
+        fprintf(stderr, "ERROR: pretrigger_us + hold_time_us needs more than RING_FRAMES (%d) frames\n",
+                RING_FRAMES);
+        return 1;
+    }
+
+    // 屏蔽 SIGUSR1，使其后创建的线程都继承该屏蔽字，信号统一由主循环的 signalfd 读取
+    sigset_t blocked;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &blocked, NULL);
 
     // ----------------- 1️⃣ 准备工作目录 -----------------
     // 创建网页目录（/root/mjpg/www），并清空旧文件
     mkdir_p(CAPS_DIR, 0755);
     rm_caps_dir_contents();
+#if CAPS_LAYOUT == CAPS_LAYOUT_ARCHIVE
+    rm_session_dir(SESSION_DIR); // 旧归档目录整体改名后台删除
+#else
+    rm_session_dir(THUMB_DIR);   // 旧缩略图目录同样处理
+#endif
     g_total_saved = 0;
-    write_index_html(0); // 生成初始 index.html（空页面）
+    g_total_bursts = 0;
+    write_index_html(); // 生成 index.html 与空的帧清单
+
+    // 内置图库服务：浏览 http://<BOARD_IP>:<gallery_port>/（失败不影响抓拍）
+    if (g_cfg.gallery_port > 0 && gallery_start(g_cfg.gallery_port) == 0)
+        printf("Gallery: http://<BOARD_IP>:%d/\n", g_cfg.gallery_port);
 
     // ----------------- 2️⃣ 启动视频推流服务 -----------------
-    pid_t mjpg_pid = start_mjpg_streamer();
+#if CAPTURE_BACKEND == CAPTURE_BACKEND_V4L2
+    // 摄像头由本进程直接采集；mjpg_streamer 仅作为可选的浏览服务
+    if (mjpeg_cam_open(&g_cam, g_cfg.v4l2_device) != 0)
+        fprintf(stderr, "WARN: V4L2 capture unavailable, no frames will be saved\n");
+#if START_MJPG_VIEWER
+    // 内置图库已提供浏览（含 /latest.jpg 实时帧）时不再启动
+    if (g_cfg.gallery_port <= 0 && start_mjpg_streamer(MJPG_INPUT_VIEWER) < 0)
+        fprintf(stderr, "WARN: mjpg_streamer viewer start failed\n");
+#endif
+#else
+    char uvc_args[CFG_STR_LEN + 64];
+    snprintf(uvc_args, sizeof(uvc_args), "./input_uvc.so -d %s -r %dx%d -f %d",
+             g_cfg.v4l2_device, g_cfg.v4l2_width, g_cfg.v4l2_height, g_cfg.target_fps);
+    pid_t mjpg_pid = start_mjpg_streamer(uvc_args);
     if (mjpg_pid < 0)
         fprintf(stderr, "WARN: mjpg_streamer start failed\n");
-    // 成功后，HTTP 服务运行于 http://<BOARD_IP>:8080
+#endif
+    // 成功后，HTTP 服务运行于 http://<BOARD_IP>:<http_port>（默认 8080）
+
+#if CAPTURE_BACKEND == CAPTURE_BACKEND_STREAM
+    // 建立一次推流长连接，后续每次触发都复用该连接抓帧
+    if (mjpg_stream_open(&g_stream, "127.0.0.1", g_cfg.http_port, STREAM_PATH) == 0)
+        printf("Stream connected: %s\n", STREAM_PATH);
+    else
+        fprintf(stderr, "WARN: stream connect failed, fallback to snapshot\n");
+#endif
+
+    // 启动后台采集线程：持续把最新的帧放入预触发环形缓冲（空闲时不写盘）
+    ring_init(&g_ring);
+    pthread_t cap_tid;
+    if (pthread_create(&cap_tid, NULL, capture_thread, NULL) != 0) {
+        perror("pthread_create capture");
+        return -1;
+    }
 
-    // ----------------- 3️⃣ 打开 ADC 通道文件 -----------------
-    // /sys/bus/iio/devices/iio:device0/in_voltage1_raw   —— ADC 原始值
-    // /sys/bus/iio/devices/iio:device0/in_voltage_scale —— ADC 转换比例
-    int fd_raw = open("/sys/bus/iio/devices/iio:device0/in_voltage1_raw", O_RDONLY);
-    int fd_scale = open("/sys/bus/iio/devices/iio:device0/in_voltage_scale", O_RDONLY);
-    if (fd_raw < 0 || fd_scale < 0) {
-        perror("open ADC");
+    // 启动写盘线程：触发时取出的帧经有界队列交给它保存，主循环不阻塞在 SD 卡写入上
+    write_queue_init(&g_wq);
+    pthread_t wr_tid;
+    if (pthread_create(&wr_tid, NULL, writer_thread, &g_wq) != 0) {
+        perror("pthread_create writer");
         return -1;
     }
 
-    // ----------------- 4️⃣ 读取 ADC 电压转换比例 -----------------
+    // ----------------- 3️⃣ 打开测试仪遥测串口 -----------------
+    // 打开成功则以继电器接通事件触发，不再打开 ADC；串口之后断开时只重连，不切换触发源
+    int tester_mode = 0;
+#if TRIGGER_SOURCE == TRIGGER_SOURCE_TESTER
+    if (tester_link_open(&g_tester, g_cfg.tester_tty) == 0) {
+        tester_mode = 1;
+        printf("Tester link: %s @ %d bps, capture on relay excitation\n",
+               g_cfg.tester_tty, TESTER_BAUD_BPS);
+    } else {
+        fprintf(stderr, "WARN: tester link %s: %s, fallback to ADC trigger\n",
+                g_cfg.tester_tty, strerror(errno));
+    }
+#endif
+
+    // ----------------- 4️⃣ 打开 ADC 通道文件并读取电压转换比例（ADC 触发） -----------------
+    // /sys/bus/iio/devices/iio:device0/in_voltage1_raw   —— ADC 原始值
+    // /sys/bus/iio/devices/iio:device0/in_voltage_scale —— ADC 转换比例
+    int fd_raw = -1, fd_scale = -1;
     char buf[32];
     float scale = 1.0f; // ADC 单位比例因子（mV/bit）
-    lseek(fd_scale, 0, SEEK_SET);
-    int len = read(fd_scale, buf, sizeof(buf) - 1);
-    if (len > 0) {
-        buf[len] = '\0';
-        scale = strtof(buf, NULL); // 读取到的 scale 值通常为 0.732 等
-    } else {
-        perror("read scale");
+    if (!tester_mode) {
+        fd_raw = open("/sys/bus/iio/devices/iio:device0/in_voltage1_raw", O_RDONLY);
+        fd_scale = open("/sys/bus/iio/devices/iio:device0/in_voltage_scale", O_RDONLY);
+        if (fd_raw < 0 || fd_scale < 0) {
+            perror("open ADC");
+            return -1;
+        }
+        int len = read(fd_scale, buf, sizeof(buf) - 1);
+        if (len > 0) {
+            buf[len] = '\0';
+            scale = strtof(buf, NULL); // 读取到的 scale 值通常为 0.732 等
+        } else {
+            perror("read scale");
+        }
     }
 
     // ----------------- 5️⃣ 初始化 GPIO 输出 -----------------
     // GPIO_A = 33, GPIO_B = 32
     // 控制线圈上电与断电：A 控制正向上电，B 控制反向或关闭
-    gpio_init_out(GPIO_A, 0); // 初始为低电平（关）
-    gpio_init_out(GPIO_B, 1); // 初始为高电平（稳态）
+    // GPIO_A 初始为低电平（关），GPIO_B 初始为高电平（稳态）
+    coil_gpio_open(&g_coil, 0, 1);
+
+    // ----------------- 6️⃣ 主循环：触发源监测与触发逻辑 -----------------
+    // 单一 poll 循环：
+    //   - 测试仪串口：继电器接通帧触发抓拍，结果帧交给写盘线程附到抓拍（测试仪触发）
+    //   - 采样源：IIO 缓冲设备可读（缓冲模式），或固定周期的采样定时器（sysfs 模式）（ADC 触发）
+    //   - 事件定时器：后录结束、线圈保持超时
+    // 采样周期由 timerfd 绝对时间驱动，不随处理耗时漂移；线圈保持期间仍持续采样与打印。
+    coil_state_t state = COIL_IDLE;
+    trig_detect_t det = { 0, 0 };
+
+    int tfd_sample = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int tfd_event = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd_sample < 0 || tfd_event < 0) {
+        perror("timerfd_create");
+        return -1;
+    }
 
-    // ----------------- 6️⃣ 主循环：ADC 电压监测与触发逻辑 -----------------
-    int count = 0; // 连续检测计数器
+    iio_buf_t iio;
+    iio.fd = -1;
+#if ADC_MODE == ADC_MODE_BUFFER
+    // 缓冲模式：每块样本逐点做阈值/消抖判断，不再逐点打印；失败时回退到 sysfs 逐点读取
+    if (!tester_mode && iio_buffer_open(&iio, scale) != 0)
+        fprintf(stderr, "WARN: IIO buffer unavailable, fallback to sysfs polling\n");
+#endif
+    if (!tester_mode && iio.fd < 0)
+        timerfd_arm_at(tfd_sample, now_us() + g_cfg.sample_us, g_cfg.sample_us);
+
+    float volts[IIO_BLOCK_SAMPLES];
+    long long ts[IIO_BLOCK_SAMPLES];
+    long long t_report = now_us();
+    float v_max = -1e9f;
+
+    // SIGUSR1：导出跟踪记录（信号已在启动线程前屏蔽，只经 signalfd 在此处理）
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGUSR1);
+    int sfd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
 
     while (1) {
-        // ① 读取 ADC 原始值
-        lseek(fd_raw, 0, SEEK_SET);
-        int rlen = read(fd_raw, buf, sizeof(buf) - 1);
-        if (rlen > 0) {
-            buf[rlen] = '\0';
-            int raw = atoi(buf); // 转换为整数原始值
-            float voltage = (raw * scale) / 1000.0f; // 转换为电压值（V）
-            printf("Raw=%d Voltage=%.6f V\n", raw, voltage);
-
-            // ② 判断是否超过阈值
-            if (voltage > VOLTAGE_THRESH) {
-                if (++count >= TRIGGER_COUNT) {
-                    // 触发拍照逻辑
-                    printf("[Trigger] capture %.3fs into %s ...\n",
-                           HOLD_TIME_US / 1e6, CAPS_DIR);
-
-                    // 连续抓取多帧图像
-                    int saved = capture_snapshots(HOLD_TIME_US);
-                    printf("Captured %d frames. Total=%d. "
-                           "Browse: http://<BOARD_IP>:%d/caps/index.html\n",
-                           saved, g_total_saved, HTTP_PORT);
-
-                    // ③ 执行 GPIO 控制时序（线圈通断）
-                    // 先断开 GPIO_B，再上电 GPIO_A
-                    gpio_write(GPIO_B, 0);
-                    gpio_write(GPIO_A, 1);
-                    sleep(HOLD_TIME_SEC); // 保持上电一段时间
-                    gpio_write(GPIO_A, 0);
-                    gpio_write(GPIO_B, 1);
-
-                    count = 0; // 重置计数器
+        struct pollfd pfds[4] = {
+            { iio.fd >= 0 ? iio.fd : tfd_sample, POLLIN, 0 },
+            { tfd_event, POLLIN, 0 },
+            { sfd, POLLIN, 0 },
+            { g_tester.fd, POLLIN, 0 },    // 未打开（-1）时 poll 忽略该项
+        };
+        // 测试仪串口断开期间定时醒来重连
+        int timeout = tester_mode && g_tester.fd < 0 ? TESTER_REOPEN_MS : -1;
+        if (poll(pfds, 4, timeout) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        // ① 采样事件
+        if (pfds[0].revents & POLLIN) {
+            int n = 0;
+            if (iio.fd >= 0) {
+                n = iio_buffer_read_block(&iio, volts, ts, 0);
+                if (n < 0) {
+                    // 缓冲读取失败：回退到 sysfs 逐点读取
+                    perror("read IIO buffer");
+                    iio_buffer_close(&iio);
+                    timerfd_arm_at(tfd_sample, now_us() + g_cfg.sample_us, g_cfg.sample_us);
+                    n = 0;
+                }
+            } else if (timerfd_consume(tfd_sample) > 0) {
+                // 读取 ADC 原始值
+                lseek(fd_raw, 0, SEEK_SET);
+                int rlen = read(fd_raw, buf, sizeof(buf) - 1);
+                if (rlen > 0) {
+                    buf[rlen] = '\0';
+                    int raw = atoi(buf); // 转换为整数原始值
+                    volts[0] = (raw * scale) / 1000.0f; // 转换为电压值（V）
+                    ts[0] = now_us();
+                    printf("Raw=%d Voltage=%.6f V\n", raw, volts[0]);
+                    n = 1;
+                } else {
+                    perror("read raw");
                 }
-            } else {
-                count = 0; // 未触发则清零
             }
-        } else {
-            perror("read raw");
+            if (n > 0) trace_event(TRACE_SAMPLE, n, ts[n - 1]);
+
+            // ② 逐点阈值判断与消抖（仅 IDLE 状态下允许触发）
+            long long need = iio.fd >= 0 ? IIO_TRIGGER_COUNT : g_cfg.trigger_count;
+            for (int i = 0; i < n; i++) {
+                if (volts[i] > v_max) v_max = volts[i];
+                if (state == COIL_IDLE && trig_detect_feed(&det, volts[i], ts[i], need))
+                    coil_on_trigger(&state, tfd_event, det.t_cross);
+            }
         }
 
-        // ④ 控制 ADC 采样间隔（例如 5000us = 5ms）
-        usleep(SAMPLE_US);
+        // ③ 测试仪遥测：继电器接通 → 触发抓拍（空闲时）；测试结果 → 附到该次测试的抓拍
+        if (pfds[3].revents & (POLLIN | POLLERR | POLLHUP)) {
+            tlm_frame_t f;
+            tester_result_t r;
+            if (tester_link_fill(&g_tester) < 0) {
+                fprintf(stderr, "WARN: tester link %s lost (%u frames lost, %u CRC errors), reconnecting\n",
+                        g_cfg.tester_tty, g_tester.lost, g_tester.crc_errors);
+                tester_link_close(&g_tester);
+            }
+            while (g_tester.fd >= 0 && tester_link_next(&g_tester, &f)) {
+                if (f.type == TLM_TYPE_EXCITE && f.len == 5) {
+                    uint32_t test_no = tlm_get_u32(f.payload);
+                    if (state != COIL_IDLE) {
+                        printf("[Tester] test %u slot %d excited during capture, skipped\n",
+                               test_no, f.payload[4]);
+                        continue;
+                    }
+                    // 本次抓拍的触发序号即 capture_snapshots() 将分配的 g_total_bursts
+                    tester_burst_add(test_no, f.payload[4], g_total_bursts);
+                    det.t_cross = f.t_start_us;
+                    coil_on_trigger(&state, tfd_event, det.t_cross);
+                } else if (f.type == TLM_TYPE_RESULT && tlm_parse_result(&f, &r) == 0) {
+                    tester_on_result(&r);
+                }
+            }
+        }
+        if (tester_mode && g_tester.fd < 0 && tester_link_open(&g_tester, g_cfg.tester_tty) == 0)
+            printf("Tester link: %s reconnected\n", g_cfg.tester_tty);
+
+        // ④ 后录结束 / 线圈保持超时
+        if ((pfds[1].revents & POLLIN) && timerfd_consume(tfd_event) > 0) {
+            coil_on_event(&state, tfd_event, det.t_cross, !tester_mode);
+            if (state == COIL_IDLE) det.count = 0;
+        }
+
+        // ⑤ 导出跟踪记录：kill -USR1 <pid>
+        if (pfds[2].revents & POLLIN) {
+            struct signalfd_siginfo si;
+            while (read(sfd, &si, sizeof(si)) == (ssize_t)sizeof(si)) {}
+            int nrec = trace_dump_csv(TRACE_CSV_PATH);
+            if (nrec >= 0)
+                printf("Trace: %d events -> %s\n", nrec, TRACE_CSV_PATH);
+        }
+
+        // ⑥ 缓冲模式下定期打印电压概要
+        long long t_now = now_us();
+        if (iio.fd >= 0 && t_now - t_report >= g_cfg.adc_report_us) {
+            printf("ADC max=%.6f V over last %.1fs\n", v_max, (t_now - t_report) / 1e6);
+            v_max = -1e9f;
+            t_report = t_now;
+        }
     }
 
     // ----------------- 7️⃣ 程序收尾 -----------------
-    close(fd_raw);
-    close(fd_scale);
+    mjpg_stream_close(&g_stream);
+    cam_close(&g_cam);
+    iio_buffer_close(&iio);
+    coil_gpio_close(&g_coil);
+    tester_link_close(&g_tester);
+    if (sfd >= 0) close(sfd);
+    close(tfd_sample);
+    close(tfd_event);
+    if (fd_raw >= 0) close(fd_raw);
+    if (fd_scale >= 0) close(fd_scale);
     return 0;
 }
 
@@ -16,21 +16,39 @@
  *   ├── 右图保存路径 : /root/right/
  *
  * 编译命令:
- *   arm-rockchip830-linux-uclibcgnueabihf-gcc dual_camera_capture_display.c -o dual_camera_capture_display -lpthread -ljpeg
+ *   arm-rockchip830-linux-uclibcgnueabihf-gcc -O2 -mfpu=neon -I. dual_camera_capture_display.c -o dual_camera_capture_display -lpthread -ljpeg
+ *   （摄像头采集使用同目录下的共享模块 v4l2_camera.h，运行时配置使用 app_config.h）
+ *   （-mfpu=neon 启用 draw_on_lcd() 的 NEON 转换内核；未启用时自动使用标量实现）
+ *   启用 RGA 硬件预览：追加 -DUSE_RGA=1 -I<SDK>/media/rga/include -lrga
+ *   启用 TurboJPEG 编码：追加 -DUSE_TURBOJPEG=1 -lturbojpeg
+ *   启用 MPP 硬件 JPEG 编码：追加 -DUSE_MPP=1 -I<SDK>/media/mpp/include -lrockchip_mpp
+ *
+ * 运行参数:
+ *   dual_camera_capture_display [-c FILE] [--key=value ...]
+ *   未指定 -c 时读取 /root/dual_camera.conf（可不存在），--help 列出全部参数与当前值；
+ *   设备节点、采集分辨率、JPEG / 录像参数、预览区域等均可在运行时修改，宏只提供默认值。
  *
  * 运行说明:
  *   1. 程序启动后自动清空 /root/left 与 /root/right 下的旧照片；
  *   2. 两路摄像头画面实时显示于LCD左右两半；
  *   3. 按下按键（event1设备）时同时保存左右图像为 JPEG；
  *   4. 文件名自动编号，例如 /root/left/0.jpg、/root/right/0.jpg；
- *   5. 程序循环运行，可连续拍摄。
+ *   5. 程序循环运行，可连续拍摄；
+ *   6. 按下录像键（record_key，默认 KEY_RECORD，需 -DUSE_MPP=1）开始/停止双路硬件 H.264 录像，
+ *      保存到 /root/record/，.pts 文件逐帧记录时间戳，左右同一行即同一对帧；
+ *   7. 原始录制（raw_key 按键开关，或 raw_autostart=1 启动即录）把左右 YUYV 原始帧与驱动时间戳
+ *      不经转换写成 .sdump 序列（stereo_dump.h），供 stereo_pupil_tracking 的 replay 回放测试。
  *
  * ================================================================
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE                   // O_DIRECT、fallocate()
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <pthread.h>
@@ -43,114 +61,584 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <jpeglib.h>
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include <time.h>
+#include <signal.h>
+#include "v4l2_camera.h"
+#include "app_config.h"
+#include "stereo_dump.h"
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define USE_NEON 1                    // 编译器已启用 NEON（-mfpu=neon）
+#else
+#define USE_NEON 0
+#endif
+#ifndef USE_RGA
+#define USE_RGA 0                     // 1 = 使用 RGA 硬件完成预览的颜色转换与缩放（需 librga）
+#endif
+#if USE_RGA
+#include <im2d.h>
+#endif
+#ifndef USE_TURBOJPEG
+#define USE_TURBOJPEG 0               // 1 = 编译 libjpeg-turbo 的 TurboJPEG 编码后端
+#endif
+#if USE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+#ifndef USE_MPP
+#define USE_MPP 0                     // 1 = 编译 Rockchip MPP 硬件 JPEG 编码后端
+#endif
+#if USE_MPP
+#include <rockchip/rk_mpi.h>
+#endif
 
 // ======================== 宏定义区 ==============================
-#define WIDTH 640                     // 摄像头图像采集宽度
-#define HEIGHT 480                    // 摄像头图像采集高度
+#ifndef CAP_WIDTH
+#define CAP_WIDTH 640                 // 摄像头采集宽度（拍照分辨率，须为 16 的倍数）
+#endif
+#ifndef CAP_HEIGHT
+#define CAP_HEIGHT 480                // 摄像头采集高度
+#endif
 #define LEFT_FOLDER "/root/left"      // 左摄像头照片保存路径
 #define RIGHT_FOLDER "/root/right"    // 右摄像头照片保存路径
 #define INPUT_DEVICE "/dev/input/event1"  // 按键输入设备路径
 #define CAM_LEFT  "/dev/video21"      // 左摄像头设备节点
 #define CAM_RIGHT "/dev/video23"      // 右摄像头设备节点
+#ifndef CAM_BUFFERS
+#define CAM_BUFFERS 6                 // 每个摄像头的帧缓冲数量（4~8，可用 -DCAM_BUFFERS=N 覆盖）
+#endif
+#if CAM_BUFFERS < CAM_MIN_BUFFERS || CAM_BUFFERS > CAM_MAX_BUFFERS
+#error "CAM_BUFFERS must be within CAM_MIN_BUFFERS..CAM_MAX_BUFFERS"
+#endif
+#define STEREO_SYNC_US 16000          // 左右帧时间戳配对容差（约半个 30fps 帧周期）
+#define STEREO_WAIT_MS 1000           // 等待一对帧的超时
+#define CAM_FPS 0                     // 采集帧率（0 = 驱动默认，CAM_FPS_MAX = 最高）
+#define CAM_EXPOSURE (-1)             // 固定曝光（驱动单位，-1 = 自动）
+#define CAM_GAIN (-1)                 // 固定增益（驱动单位，-1 = 自动）
+#define ENCODE_QUEUE_LEN (CAM_BUFFERS - 3)  // 每路编码（拍照 + 录像）合计持有帧数上限（同步器待配对帧 + 最近显示帧之外，至少给驱动留 1 个空闲缓冲）
+
+// 连续录像（硬件 H.264/H.265，需 USE_MPP；按 RECORD_KEY 开始/停止）
+#define RECORD_FOLDER  "/root/record"  // 录像保存路径
+#ifndef RECORD_KEY
+#define RECORD_KEY     KEY_RECORD      // 录像开关键值（其它键仍为拍照）
+#endif
+#ifndef RECORD_CODEC
+#define RECORD_CODEC   MPP_VIDEO_CodingAVC   // H.264；H.265 用 MPP_VIDEO_CodingHEVC
+#endif
+#define RECORD_BITRATE 4000000         // 每路码率（bps）
+#define RECORD_FPS     30              // 标称帧率（码率控制用）
+#define RECORD_GOP     30              // I 帧间隔（每个 IDR 前重复 SPS/PPS）
+#define RECORD_QUEUE_LEN 2             // 每路录像队列深度（与拍照队列共用 ENCODE_QUEUE_LEN 的缓冲预算）
+
+// 原始双目序列录制（.sdump，YUYV 原样落盘，不需要编码器）
+#define RAW_KEY          0             // 原始录制开关键值（0 = 不用按键）
+#define RAW_AUTOSTART    0             // 1 = 程序启动即开始原始录制
+#define RAW_QUEUE_LEN    2             // 待写帧对队列深度（同样计入 ENCODE_QUEUE_LEN 的缓冲预算）
+#define RAW_BATCH        4             // 每次 write() 的记录数（640×480 时约 4.9 MB 一次顺序写）
+#define RAW_PREALLOC_MB  1024          // 每次 fallocate 预分配的空间（MB），写满后继续追加
+
+// JPEG 编码后端与参数
+#define JPEG_BACKEND_LIBJPEG 0        // libjpeg raw YCbCr（始终可用，也是失败时的兜底）
+#define JPEG_BACKEND_TURBO   1        // libjpeg-turbo TurboJPEG（SIMD，需 USE_TURBOJPEG）
+#define JPEG_BACKEND_MPP     2        // RV1106 硬件 JPEG 编码器（需 USE_MPP）
+#ifndef JPEG_BACKEND
+#if USE_MPP
+#define JPEG_BACKEND JPEG_BACKEND_MPP
+#elif USE_TURBOJPEG
+#define JPEG_BACKEND JPEG_BACKEND_TURBO
+#else
+#define JPEG_BACKEND JPEG_BACKEND_LIBJPEG
+#endif
+#endif
+#define JPEG_SUBSAMP_422 0            // 色度 4:2:2（与 YUYV 原生采样一致）
+#define JPEG_SUBSAMP_420 1            // 色度 4:2:0（文件更小）
+#ifndef JPEG_QUALITY
+#define JPEG_QUALITY 75               // JPEG 质量（1~100）
+#endif
+#ifndef JPEG_SUBSAMP
+#define JPEG_SUBSAMP JPEG_SUBSAMP_422
+#endif
+
+// 预览缩放质量
+#define PREVIEW_NEAREST  0            // 最近邻（NEON 加速，默认）
+#define PREVIEW_BILINEAR 1            // 双线性（亮度按像素、色度按宏像素插值，画面更平滑）
+#define PREVIEW_QUALITY  PREVIEW_NEAREST
+
+// 预览区域（采集帧中显示到半屏的矩形，W/H 为 0 表示整帧；X、W 须为偶数）
+// 预览只读取映射表指向的像素，开销取决于屏幕尺寸，与采集分辨率无关
+#define PREVIEW_ROI_X 0
+#define PREVIEW_ROI_Y 0
+#define PREVIEW_ROI_W 0
+#define PREVIEW_ROI_H 0
+
+// 运行时配置文件默认路径
+#define CONFIG_FILE "/root/dual_camera.conf"
+
+// 按键队列长度（2 的幂，连续快速按键时最多缓存的未处理按键数）
+#define PRESS_QUEUE_LEN 16
+// 按键事件通知（eventfd，由按键线程写入，主循环与摄像头 fd 一起 poll）
+int key_event_fd = -1;
+
+/*
+ * 运行时配置：初值为上面的编译期默认值，启动时由配置文件 / 命令行覆盖（app_config.h），
+ * 之后只读。数组尺寸相关的参数（CAM_BUFFERS、队列长度）仍为编译期常量。
+ */
+struct app_settings {
+    char cam_left[CFG_STR_LEN];       // 左摄像头设备节点
+    char cam_right[CFG_STR_LEN];      // 右摄像头设备节点
+    char input_device[CFG_STR_LEN];   // 按键输入设备
+    char left_folder[CFG_STR_LEN];    // 左图保存目录
+    char right_folder[CFG_STR_LEN];   // 右图保存目录
+    char record_folder[CFG_STR_LEN];  // 录像保存目录
+    char raw_path[CFG_STR_LEN];       // 原始录制输出（空 = record_folder 下按时间命名；可为 FIFO）
+    int cap_width, cap_height;        // 采集分辨率
+    int cam_fps;                      // 采集帧率（0 = 驱动默认，-1 = 最高）
+    int exposure, gain;               // 固定曝光 / 增益（-1 = 自动）
+    int stereo_sync_us;               // 左右帧配对容差
+    int stereo_wait_ms;               // 等待一对帧的超时
+    int jpeg_backend;                 // JPEG_BACKEND_*
+    int jpeg_quality;                 // 1~100
+    int jpeg_subsamp;                 // JPEG_SUBSAMP_*
+    int preview_quality;              // PREVIEW_NEAREST / PREVIEW_BILINEAR
+    int roi_x, roi_y, roi_w, roi_h;   // 预览区域
+    int record_key;                   // 录像开关键值
+    int record_bitrate;               // 每路码率（bps）
+    int record_fps;                   // 标称帧率
+    int record_gop;                   // I 帧间隔
+    int raw_key;                      // 原始录制开关键值（0 = 无）
+    int raw_autostart;                // 1 = 启动即录
+    int raw_prealloc_mb;              // 每次预分配的空间（MB）
+};
+
+static struct app_settings g_cfg = {
+    CAM_LEFT, CAM_RIGHT, INPUT_DEVICE, LEFT_FOLDER, RIGHT_FOLDER, RECORD_FOLDER, "",
+    CAP_WIDTH, CAP_HEIGHT, (int)CAM_FPS, CAM_EXPOSURE, CAM_GAIN, STEREO_SYNC_US, STEREO_WAIT_MS,
+    JPEG_BACKEND, JPEG_QUALITY, JPEG_SUBSAMP,
+    PREVIEW_QUALITY, PREVIEW_ROI_X, PREVIEW_ROI_Y, PREVIEW_ROI_W, PREVIEW_ROI_H,
+    RECORD_KEY, RECORD_BITRATE, RECORD_FPS, RECORD_GOP,
+    RAW_KEY, RAW_AUTOSTART, RAW_PREALLOC_MB,
+};
 
-// 拍照标志位（全局变量，由按键线程设置，主循环清零）
-volatile int photo_flag = 0;
+static const struct cfg_option g_cfg_opts[] = {
+    CFG_STR("cam_left", g_cfg.cam_left, "左摄像头设备节点"),
+    CFG_STR("cam_right", g_cfg.cam_right, "右摄像头设备节点"),
+    CFG_STR("input_device", g_cfg.input_device, "按键输入设备"),
+    CFG_STR("left_folder", g_cfg.left_folder, "左图保存目录（启动时清空其中的 .jpg）"),
+    CFG_STR("right_folder", g_cfg.right_folder, "右图保存目录（启动时清空其中的 .jpg）"),
+    CFG_STR("record_folder", g_cfg.record_folder, "录像保存目录"),
+    CFG_INT("cap_width", &g_cfg.cap_width, "采集宽度（拍照分辨率，16 的倍数）"),
+    CFG_INT("cap_height", &g_cfg.cap_height, "采集高度"),
+    CFG_INT("cam_fps", &g_cfg.cam_fps, "采集帧率（0 = 驱动默认，-1 = 驱动支持的最高帧率）"),
+    CFG_INT("exposure", &g_cfg.exposure, "固定曝光（驱动单位，-1 = 自动）"),
+    CFG_INT("gain", &g_cfg.gain, "固定增益（驱动单位，-1 = 自动）"),
+    CFG_INT("stereo_sync_us", &g_cfg.stereo_sync_us, "左右帧时间戳配对容差（us）"),
+    CFG_INT("stereo_wait_ms", &g_cfg.stereo_wait_ms, "等待一对帧的超时（ms）"),
+    CFG_INT("jpeg_backend", &g_cfg.jpeg_backend, "JPEG 编码后端：0 libjpeg，1 turbojpeg，2 mpp"),
+    CFG_INT("jpeg_quality", &g_cfg.jpeg_quality, "JPEG 质量（1~100）"),
+    CFG_INT("jpeg_subsamp", &g_cfg.jpeg_subsamp, "JPEG 色度采样：0 = 4:2:2，1 = 4:2:0"),
+    CFG_INT("preview_quality", &g_cfg.preview_quality, "预览缩放：0 最近邻，1 双线性"),
+    CFG_INT("preview_roi_x", &g_cfg.roi_x, "预览区域左上角 X（偶数）"),
+    CFG_INT("preview_roi_y", &g_cfg.roi_y, "预览区域左上角 Y"),
+    CFG_INT("preview_roi_w", &g_cfg.roi_w, "预览区域宽度（0 = 整帧）"),
+    CFG_INT("preview_roi_h", &g_cfg.roi_h, "预览区域高度（0 = 整帧）"),
+    CFG_INT("record_key", &g_cfg.record_key, "录像开关键值（linux/input-event-codes.h），其它键拍照"),
+    CFG_INT("record_bitrate", &g_cfg.record_bitrate, "录像每路码率（bps）"),
+    CFG_INT("record_fps", &g_cfg.record_fps, "录像标称帧率"),
+    CFG_INT("record_gop", &g_cfg.record_gop, "录像 I 帧间隔"),
+    CFG_STR("raw_path", g_cfg.raw_path, "原始录制输出文件（空 = record_folder/raw_时间.sdump；可为 FIFO / 管道）"),
+    CFG_INT("raw_key", &g_cfg.raw_key, "原始 YUYV 双目录制开关键值（0 = 不用按键）"),
+    CFG_INT("raw_autostart", &g_cfg.raw_autostart, "1 = 启动即开始原始录制"),
+    CFG_INT("raw_prealloc_mb", &g_cfg.raw_prealloc_mb, "原始录制每次 fallocate 预分配的空间（MB，0 = 不预分配）"),
+};
+
+/*
+ * 按键事件单生产者/单消费者无锁队列
+ *   - 生产者：event_listener 线程，只写 head；消费者：主循环，只写 tail；
+ *   - head/tail 单调递增，取模 PRESS_QUEUE_LEN 得槽位，head - tail 即积压数；
+ *   - 发布用 release、读取对方下标用 acquire，保证槽位内容先于下标可见；
+ *   - ts_us 为按键时间戳（CLOCK_MONOTONIC，与 V4L2 帧时间戳同一时钟）。
+ */
+struct key_press {
+    long long ts_us;                   // 按下时刻（微秒）
+    int code;                          // 键值
+};
+
+struct press_queue {
+    struct key_press ev[PRESS_QUEUE_LEN];
+    unsigned head;                     // 下一个写入位置（生产者）
+    unsigned tail;                     // 下一个读取位置（消费者）
+    unsigned dropped;                  // 队列满丢弃的按键数（仅生产者写）
+};
+
+// 按键队列（按键线程写入，主循环取出）
+struct press_queue g_press;
+
+// 生产者：入队，队列满返回 -1
+static int press_queue_push(struct press_queue *q, const struct key_press *k)
+{
+    unsigned head = q->head;
+    if (head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) >= PRESS_QUEUE_LEN)
+        return -1;
+    q->ev[head % PRESS_QUEUE_LEN] = *k;
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// 消费者：查看队首（不出队），队列空返回 NULL
+static const struct key_press *press_queue_peek(struct press_queue *q)
+{
+    unsigned tail = q->tail;
+    if (tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &q->ev[tail % PRESS_QUEUE_LEN];
+}
+
+// 消费者：丢弃队首（必须先 peek 成功）
+static void press_queue_pop(struct press_queue *q)
+{
+    __atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+}
 
 // ======================== 结构体定义 ==============================
-struct buffer {
-    void *start;                      // 映射内存起始地址
-    size_t length;                    // 映射内存长度
+/*
+ * 分屏预览几何映射（只与屏幕尺寸有关，获取屏幕参数后构建一次，左右半屏共用）
+ *   - 最近邻：row0[y] 源行，pair[x] 源宏像素序号（src_x / 2，已对齐偶数列）
+ *   - 双线性：row0/row1 + wy 纵向相邻两行及权重；
+ *             lx0/lx1 + wx 亮度列（像素）及权重，cx0/cx1 + cwx 色度列（宏像素）及权重
+ *   权重为 8 位定点（0~256，表示右/下侧样本所占比例）。
+ */
+struct preview_geom {
+    int dst_w, dst_h;                 // 每半屏目标尺寸
+    int quality;                      // PREVIEW_NEAREST / PREVIEW_BILINEAR
+    int src_stride;                   // 源帧行跨度（字节，取自驱动 bytesperline）
+    int roi_x, roi_y, roi_w, roi_h;   // 实际使用的源区域（已裁剪到帧内）
+    unsigned short *row0, *row1, *wy;
+    unsigned short *pair;
+    unsigned short *lx0, *lx1, *wx;
+    unsigned short *cx0, *cx1, *cwx;
+};
+
+/*
+ * LCD 预览呈现器：yres_virtual 设为 2 倍屏高时使用双页翻转，
+ * 每帧画到不可见的后台页，FBIOPAN_DISPLAY 切换后用 FBIO_WAITFORVSYNC 等待生效，
+ * 既无撕裂，又让预览节奏跟随屏幕刷新。驱动不支持时退化为单页直接绘制。
+ */
+struct fb_presenter {
+    int fd;                           // /dev/fb0
+    struct fb_var_screeninfo var;     // 可变参数（yoffset 记录当前显示页）
+    struct fb_fix_screeninfo fix;     // 固定参数（行长度、显存大小）
+    unsigned char *mem;               // 整块显存映射
+    int pages;                        // 1 = 单页，2 = 双页翻转
+    int back;                         // 下一帧绘制的页序号
+    int vsync;                        // 1 = FBIO_WAITFORVSYNC 可用
+};
+
+struct jpeg_encoder {
+    int backend;                      // 实际使用的 JPEG_BACKEND_*
+    int quality;                      // 1~100
+    int subsamp;                      // JPEG_SUBSAMP_*
+    int width, height;                // 图像尺寸
+    int stride;                       // 源帧行跨度（字节，取自驱动 bytesperline）
+#if USE_TURBOJPEG
+    tjhandle tj;                      // TurboJPEG 句柄
+    unsigned char *tj_planes;         // 整帧 Y/Cb/Cr 平面
+    unsigned char *tj_out;            // 输出缓冲（tjBufSize 预分配）
+    unsigned long tj_cap;
+#endif
+#if USE_MPP
+    MppCtx mpp_ctx;
+    MppApi *mpi;
+    MppBufferGroup mpp_grp;
+    MppBuffer mpp_pkt_buf;            // 输出码流缓冲
+    MppBuffer mpp_in[CAM_MAX_BUFFERS];  // 已导入的摄像头 DMABUF（按缓冲序号）
+#endif
+    unsigned char *mem;               // libjpeg 路径复用的码流缓冲
+    size_t mem_cap;
+};
+
+/*
+ * JPEG 编码工作线程（每路摄像头一个）
+ *   主循环把待保存的帧（额外持有 1 次引用）放入队列后立即返回，
+ *   工作线程编码写盘后释放该帧，缓冲随即回到驱动队列。
+ */
+struct encode_job {
+    struct cam_frame *frame;          // 待编码帧（队列持有 1 次引用）
+    int photo_idx;                    // 照片编号
+};
+
+struct jpeg_worker {
+    const char *name;                 // "Left" / "Right"（日志）
+    const char *folder;               // 保存目录
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct encode_job jobs[ENCODE_QUEUE_LEN];
+    int head, count;                  // 环形队列读位置与长度
+    int stop;                         // 1 = 处理完剩余任务后退出
+    struct jpeg_encoder enc;          // 本路独占的编码器
+};
+
+#if USE_MPP
+/*
+ * 双路连续录像（每路摄像头一个）
+ *   主循环把每一对帧同时投递给左右两路（两路都有空位才投递，否则两路一起丢弃），
+ *   工作线程把摄像头 DMABUF 直接送入硬件视频编码器，码流写成裸流（.h264/.h265），
+ *   同名 .pts 文本逐帧记录 "序号 驱动序列号 时间戳(us)"，左右同一序号即同一对帧。
+ */
+struct video_recorder {
+    const char *name;                 // "Left" / "Right"（日志）
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct cam_frame *jobs[RECORD_QUEUE_LEN];
+    int head, count;                  // 环形队列读位置与长度
+    int stop;                         // 1 = 处理完剩余帧后退出
+    int running;                      // 1 = 编码线程已启动
+    MppCtx ctx;
+    MppApi *mpi;
+    MppBuffer in[CAM_MAX_BUFFERS];    // 已导入的摄像头 DMABUF（按缓冲序号）
+    int width, height, stride;        // 帧尺寸与行跨度（字节）
+    int fd;                           // 码流文件
+    FILE *pts;                        // 时间戳文件
+    unsigned frames;                  // 已编码帧数
+    unsigned dropped;                 // 队列满丢弃的帧数（仅主循环写）
+};
+#endif
+
+/*
+ * 原始双目序列录制（一个工作线程同时写左右两路）
+ *   主循环投递每一对帧（有空位才投递，否则丢弃并计数，记录序号照常递增以便回放发现缺口），
+ *   工作线程把两帧原样拷入按 SDUMP_ALIGN 对齐的批量缓冲后立即释放帧，
+ *   攒满 RAW_BATCH 条记录做一次大块顺序写。普通文件用 O_DIRECT（绕过页缓存，
+ *   不与预览争内存带宽和缓存）并按 raw_prealloc_mb 分段 fallocate 预分配；FIFO / 管道直接写。
+ *   摄像头映射内存无法作为 O_DIRECT 的源（驱动页不能被 get_user_pages 固定），因此必须拷贝一次。
+ */
+struct raw_pair {
+    struct cam_frame *f[2];           // 左右帧（队列各持有 1 次引用）
+    unsigned seq;                     // 帧对序号
+};
+
+struct raw_recorder {
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct raw_pair jobs[RAW_QUEUE_LEN];
+    int head, count;                  // 环形队列读位置与长度
+    int stop;                         // 1 = 写完剩余帧后退出
+    int running;                      // 1 = 录制线程已启动
+    int fd;
+    int direct;                       // 1 = O_DIRECT 打开
+    int failed;                       // 1 = 写入出错，之后的帧只计数不写
+    struct sdump_header hdr;
+    unsigned char *buf;               // RAW_BATCH 条记录的对齐缓冲
+    int batched;                      // 缓冲中已填充的记录数
+    long long bytes;                  // 已写字节（含文件头）
+    long long prealloc;               // 已预分配到的文件偏移
+    long long t_start;                // 开始时刻（us）
+    unsigned offered;                 // 主循环投递过的帧对数（含丢弃，仅主循环写）
+    unsigned written;                 // 已写入的记录数
+    unsigned dropped;                 // 队列满丢弃的帧对数（仅主循环写）
+    char path[CFG_STR_LEN + 64];
 };
 
 // ======================== 函数声明区 ==============================
-void yuyv_to_jpeg(void *yuyv, int width, int height, const char *filename);
+size_t yuyv_to_jpeg(void *yuyv, int width, int height, int stride, int quality, int subsamp,
+                    unsigned char **out, size_t *cap);
+void jpeg_encoder_init(struct jpeg_encoder *e, int backend, int quality, int subsamp,
+                       const struct cam_device *cam);
+void jpeg_encoder_encode(struct jpeg_encoder *e, const struct cam_frame *f, const char *filename);
+void jpeg_encoder_close(struct jpeg_encoder *e);
+int jpeg_worker_start(struct jpeg_worker *w, const char *name, const char *folder,
+                      const struct cam_device *cam);
+int jpeg_worker_space(struct jpeg_worker *w);
+int jpeg_worker_submit(struct jpeg_worker *w, struct cam_frame *frame, int photo_idx);
+void jpeg_worker_stop(struct jpeg_worker *w);
 void clear_jpg_files(const char *folder);
-int init_camera(const char *dev, struct buffer *bufs, int *vfd);
-void draw_on_lcd(unsigned int *fb, int stride, int fb_w, int fb_h, void *yuyv, int x_offset);
+#if USE_MPP
+int video_recorder_start(struct video_recorder *r, const char *name, const struct cam_device *cam,
+                         const char *prefix);
+int video_recorder_space(struct video_recorder *r);
+int video_recorder_submit(struct video_recorder *r, struct cam_frame *frame);
+void video_recorder_stop(struct video_recorder *r);
+#endif
+int raw_recorder_start(struct raw_recorder *r, const struct cam_device *left,
+                       const struct cam_device *right, const char *path);
+int raw_recorder_space(struct raw_recorder *r);
+int raw_recorder_submit(struct raw_recorder *r, struct cam_frame *left, struct cam_frame *right,
+                        unsigned seq);
+void raw_recorder_stop(struct raw_recorder *r);
+int preview_geom_init(struct preview_geom *g, int fb_w, int fb_h, int quality,
+                      const struct cam_device *cam, int roi_x, int roi_y, int roi_w, int roi_h);
+void preview_geom_free(struct preview_geom *g);
+void draw_on_lcd(unsigned int *fb, int stride, const struct preview_geom *g, void *yuyv, int x_offset);
+int fb_presenter_init(struct fb_presenter *p, const char *dev);
+unsigned int *fb_presenter_page(const struct fb_presenter *p);
+void fb_presenter_flip(struct fb_presenter *p);
+void fb_presenter_close(struct fb_presenter *p);
 void *event_listener(void *arg);
 
 // ======================== 函数实现 ==============================
 
+/*
+ * 摄像头 YUYV 为 BT.601 有限范围（Y:16~235，UV:16~240），JPEG(JFIF) 的 YCbCr 为全范围，
+ * 编码前用查表做范围扩展，颜色与原先经 RGB 中转的结果一致。
+ */
+static unsigned char jpeg_y_lut[256], jpeg_c_lut[256];
+static pthread_once_t jpeg_lut_once = PTHREAD_ONCE_INIT;
+
+static void jpeg_lut_init(void) {
+    for (int i = 0; i < 256; i++) {
+        int y = ((i - 16) * 255 + 109) / 219;             // 1.164*(Y-16)，四舍五入
+        int c = ((i - 128) * 255) / 224 + 128;            // 1.138*(C-128)+128
+        jpeg_y_lut[i] = (unsigned char)(y > 255 ? 255 : (y < 0 ? 0 : y));
+        jpeg_c_lut[i] = (unsigned char)(c > 255 ? 255 : (c < 0 ? 0 : c));
+    }
+}
+
+/**
+ * 函数名称: yuyv_to_planes
+ * 功能描述:
+ *   把 YUYV 的第 y0 行起共 lines 行解交织为 Y / Cb / Cr 三个平面（含范围扩展），
+ *   供 libjpeg raw_data_in 与 TurboJPEG 共用。
+ *
+ * 输入参数:
+ *   src     - YUYV 帧首地址
+ *   width   - 图像宽度（像素）
+ *   height  - 图像高度（超出末行的行号重复末行补齐）
+ *   stride  - 源帧行跨度（字节，取自驱动 bytesperline）
+ *   y0      - 起始行
+ *   lines   - 亮度行数
+ *   vs      - 色度纵向下采样倍数：1 = 4:2:2（每行一行色度），2 = 4:2:0（两行平均为一行）
+ *   yp/up/vp - 输出平面，行跨度分别为 width、width/2、width/2
+ */
+static void yuyv_to_planes(const unsigned char *src, int width, int height, int stride, int y0,
+                           int lines, int vs, unsigned char *yp, unsigned char *up, unsigned char *vp) {
+    int cw = width / 2;
+    for (int r = 0; r < lines; r++) {
+        int sy = y0 + r < height ? y0 + r : height - 1;
+        const unsigned char *s = src + (size_t)sy * stride;
+        unsigned char *yr = yp + (size_t)r * width;
+        for (int x = 0; x < cw; x++, s += 4) {
+            yr[2 * x]     = jpeg_y_lut[s[0]];             // Y0
+            yr[2 * x + 1] = jpeg_y_lut[s[2]];             // Y1
+        }
+    }
+    for (int r = 0; r < lines / vs; r++) {
+        int s0 = y0 + r * vs, s1 = s0 + vs - 1;           // 参与平均的首末两行（4:2:2 时相同）
+        if (s0 >= height) s0 = height - 1;
+        if (s1 >= height) s1 = height - 1;
+        const unsigned char *a = src + (size_t)s0 * stride;
+        const unsigned char *b = src + (size_t)s1 * stride;
+        unsigned char *ur = up + (size_t)r * cw, *vr = vp + (size_t)r * cw;
+        for (int x = 0; x < cw; x++, a += 4, b += 4) {
+            ur[x] = (unsigned char)((jpeg_c_lut[a[1]] + jpeg_c_lut[b[1]] + 1) >> 1);   // U → Cb
+            vr[x] = (unsigned char)((jpeg_c_lut[a[3]] + jpeg_c_lut[b[3]] + 1) >> 1);   // V → Cr
+        }
+    }
+}
+
+/*
+ * libjpeg 内存输出目标：直接写入调用方的复用缓冲（*buf / *cap），
+ * 空间不足时按 2 倍扩容并把新缓冲交还调用方，之后的照片不再分配。
+ * 扩容失败时回绕到缓冲起点继续（丢弃本张），由 failed 标记告知调用方。
+ */
+struct jpeg_pool_dest {
+    struct jpeg_destination_mgr pub;
+    unsigned char **buf;
+    size_t *cap;
+    int failed;
+};
+
+static void pool_init_destination(j_compress_ptr cinfo) {
+    struct jpeg_pool_dest *d = (struct jpeg_pool_dest *)cinfo->dest;
+    d->pub.next_output_byte = *d->buf;
+    d->pub.free_in_buffer = *d->cap;
+}
+
+static boolean pool_empty_output_buffer(j_compress_ptr cinfo) {
+    struct jpeg_pool_dest *d = (struct jpeg_pool_dest *)cinfo->dest;
+    size_t used = *d->cap;                                // 调用时缓冲已全部写满
+    unsigned char *p = d->failed ? NULL : realloc(*d->buf, used * 2);
+    if (!p) {
+        d->failed = 1;
+        d->pub.next_output_byte = *d->buf;
+        d->pub.free_in_buffer = used;
+        return TRUE;
+    }
+    *d->buf = p;
+    *d->cap = used * 2;
+    d->pub.next_output_byte = p + used;
+    d->pub.free_in_buffer = used;
+    return TRUE;
+}
+
+static void pool_term_destination(j_compress_ptr cinfo) {
+    (void)cinfo;                                          // 长度由调用方根据 free_in_buffer 计算
+}
+
 /**
  * 函数名称: yuyv_to_jpeg
  * 功能描述:
- *   将摄像头采集到的 YUYV 格式原始帧数据转换为 JPEG 格式并保存至文件。
+ *   将摄像头采集到的 YUYV 格式原始帧数据直接按 YCbCr 编码为 JPEG，输出到内存
+ *   （libjpeg 后端，也是其它后端失败时的兜底实现）。
  *
  * 输入参数:
  *   yuyv     - 指向原始 YUYV 格式图像缓冲区的指针
- *   width    - 图像宽度（像素）
+ *   width    - 图像宽度（像素，需为 16 的倍数，raw_data_in 按整块 DCT 读取平面）
  *   height   - 图像高度（像素）
- *   filename - JPEG 文件保存路径（例如 "/root/left/0.jpg"）
+ *   stride   - 源帧行跨度（字节，取自驱动 bytesperline）
+ *   quality  - JPEG 质量（1~100）
+ *   subsamp  - JPEG_SUBSAMP_422 或 JPEG_SUBSAMP_420
+ *   out/cap  - 复用的输出缓冲及其容量（*out 为 NULL 时按半帧大小首次分配，不足时自动扩容）
+ *
+ * 返回值:
+ *   JPEG 数据长度（字节），失败返回 0
  *
  * 实现原理:
  *   1. 摄像头采集到的原始帧是 YUYV 格式（每两个像素共 4 字节）：
- *      字节序为：Y0 U Y1 V
- *      表示第1个像素(Y0,U,V)，第2个像素(Y1,U,V) 共用同一对U、V分量。
- *   2. 本函数将 YUYV 转换为 RGB 三通道数据（每像素3字节）。
- *   3. 使用 libjpeg 库进行压缩编码，并输出为 JPEG 文件。
- *   4. 最后释放动态内存并关闭文件。
+ *      字节序为：Y0 U Y1 V，两个像素共用同一对U、V分量，
+ *      正好是 JPEG 的 4:2:2 采样（Y 水平 2 倍、Cb/Cr 各 1 倍）；
+ *      4:2:0 时再把相邻两行色度平均为一行（Y 纵向也为 2 倍）。
+ *   2. 使用 libjpeg 的 raw_data_in 接口：每次把一个 MCU 行（8 或 16 行）解交织为
+ *      Y、Cb、Cr 三个平面（范围扩展查表），由 jpeg_write_raw_data() 直接进入 DCT，
+ *      省去 YUYV→RGB→YCbCr 的往返转换与整帧 RGB 缓冲。
+ *   3. 码流写入复用的内存缓冲，由调用方一次 write() 落盘或另作他用（如网络发送）。
  *
  * 注意事项:
  *   - JPEG 压缩库需链接 -ljpeg；
  *   - 输入缓冲必须完整且按帧对齐；
- *   - 函数内部使用 malloc 分配 RGB 临时缓存，处理后自动释放；
- *   - 适用于单帧静态图像保存。
+ *   - 仅分配一个 MCU 行的平面缓存（约 2×width×16 字节以内），不再分配整帧 RGB；
+ *   - 供左右编码线程并发调用（不使用可写全局状态）。
  */
-void yuyv_to_jpeg(void *yuyv, int width, int height, const char *filename) {
+size_t yuyv_to_jpeg(void *yuyv, int width, int height, int stride, int quality, int subsamp,
+                    unsigned char **out, size_t *cap) {
     // ----------- 输入有效性检查 -----------
-    if (!yuyv) return;                                    // 若输入为空指针，直接返回（防止段错误）
-
-    // ----------- 变量初始化与内存分配 -----------
-    unsigned char *p = (unsigned char *)yuyv;             // 指向输入的 YUYV 数据
-    unsigned char *rgb = malloc(width * height * 3);      // 分配 RGB 格式缓冲区 (3字节/像素)
-    if (!rgb) return;                                     // 若内存分配失败直接返回
-    unsigned char *out = rgb;                             // 输出指针，用于逐字节写入 RGB 数据
-
-    // ----------- YUYV 转 RGB -----------
-    // 每 4 个字节代表两个像素，遍历整个帧缓冲
-    for (int i = 0; i < width * height * 2; i += 4) {
-        int y0 = p[i];                                    // 第1像素亮度Y0
-        int u  = p[i+1];                                  // 共享色度分量U
-        int y1 = p[i+2];                                  // 第2像素亮度Y1
-        int v  = p[i+3];                                  // 共享色度分量V
-        int r, g, b;                                      // 临时存放RGB结果
-        int c, d, e;                                      // 色度计算中间变量
-
-        // ================= 第1个像素 =================
-        c = y0 - 16;                                      // 去除亮度偏移
-        d = u - 128;                                      // 去除蓝色色度偏移
-        e = v - 128;                                      // 去除红色色度偏移
-
-        // 按ITU-R BT.601标准公式计算RGB分量
-        r = (298 * c + 409 * e + 128) >> 8;               // R = 1.164*(Y-16) + 1.596*(V-128)
-        g = (298 * c - 100 * d - 208 * e + 128) >> 8;     // G = 1.164*(Y-16) - 0.392*(U-128) - 0.813*(V-128)
-        b = (298 * c + 516 * d + 128) >> 8;               // B = 1.164*(Y-16) + 2.017*(U-128)
-
-        // RGB分量裁剪到[0,255]范围，防止溢出
-        *out++ = (r > 255) ? 255 : (r < 0 ? 0 : r);
-        *out++ = (g > 255) ? 255 : (g < 0 ? 0 : g);
-        *out++ = (b > 255) ? 255 : (b < 0 ? 0 : b);
-
-        // ================= 第2个像素 =================
-        // 第2个像素共用相同的U、V分量，只更换Y1
-        c = y1 - 16;
-        r = (298 * c + 409 * e + 128) >> 8;
-        g = (298 * c - 100 * d - 208 * e + 128) >> 8;
-        b = (298 * c + 516 * d + 128) >> 8;
-
-        // 同样裁剪并存储RGB值
-        *out++ = (r > 255) ? 255 : (r < 0 ? 0 : r);
-        *out++ = (g > 255) ? 255 : (g < 0 ? 0 : g);
-        *out++ = (b > 255) ? 255 : (b < 0 ? 0 : b);
-    }
-
-    // ----------- 打开文件准备输出JPEG -----------
-    FILE *outf = fopen(filename, "wb");                   // 以二进制方式写入新文件
-    if (!outf) {                                          // 文件打开失败
-        perror("fopen");
-        free(rgb);
-        return;
+    if (!yuyv || (width & 15)) return 0;                  // 空指针或宽度不是 16 的倍数（Y/Cb/Cr 平面需整块），直接返回
+    if (!*out) {                                          // 首次使用：按半帧 YUYV 大小分配，足够常见质量
+        *cap = (size_t)width * height;
+        *out = malloc(*cap);
+        if (!*out) { *cap = 0; return 0; }
+    }
+
+    pthread_once(&jpeg_lut_once, jpeg_lut_init);
+
+    // ----------- MCU 行平面缓存：Y 为 width 列，Cb/Cr 各 width/2 列 -----------
+    const unsigned char *p = (const unsigned char *)yuyv; // 指向输入的 YUYV 数据
+    int vs = (subsamp == JPEG_SUBSAMP_420) ? 2 : 1;       // 亮度相对色度的纵向倍数
+    int lines = DCTSIZE * vs;                             // 每次写入的亮度行数（一个 MCU 行）
+    int cw = width / 2;
+    JSAMPLE *planes = malloc((size_t)lines * width + (size_t)2 * DCTSIZE * cw);
+    if (!planes) return 0;                                // 若内存分配失败直接返回
+    JSAMPLE *yp = planes, *up = planes + (size_t)lines * width, *vp = up + (size_t)DCTSIZE * cw;
+    JSAMPROW y_rows[2 * DCTSIZE], cb_rows[DCTSIZE], cr_rows[DCTSIZE];
+    for (int r = 0; r < lines; r++)
+        y_rows[r] = yp + r * width;
+    for (int r = 0; r < DCTSIZE; r++) {
+        cb_rows[r] = up + r * cw;
+        cr_rows[r] = vp + r * cw;
     }
+    JSAMPARRAY data[3] = { y_rows, cb_rows, cr_rows };
 
     // ----------- 初始化 JPEG 压缩结构体 -----------
     struct jpeg_compress_struct cinfo;                    // 主控制结构
@@ -158,32 +646,850 @@ void yuyv_to_jpeg(void *yuyv, int width, int height, const char *filename) {
     cinfo.err = jpeg_std_error(&jerr);                    // 初始化错误处理
     jpeg_create_compress(&cinfo);                         // 创建压缩对象
 
-    // ----------- 绑定输出目标文件 -----------
-    jpeg_stdio_dest(&cinfo, outf);                        // 指定输出文件为压缩目标
+    // ----------- 绑定内存输出目标 -----------
+    struct jpeg_pool_dest dest;
+    memset(&dest, 0, sizeof(dest));
+    dest.pub.init_destination = pool_init_destination;
+    dest.pub.empty_output_buffer = pool_empty_output_buffer;
+    dest.pub.term_destination = pool_term_destination;
+    dest.buf = out;
+    dest.cap = cap;
+    cinfo.dest = &dest.pub;                               // 编码结果写入复用缓冲
 
     // ----------- 设置JPEG图像参数 -----------
     cinfo.image_width = width;                            // 图像宽度
     cinfo.image_height = height;                          // 图像高度
-    cinfo.input_components = 3;                           // 每个像素3个通道（RGB）
-    cinfo.in_color_space = JCS_RGB;                       // 指定输入色彩空间
-    jpeg_set_defaults(&cinfo);                            // 使用默认压缩参数（质量约75%）
+    cinfo.input_components = 3;                           // Y、Cb、Cr 三个分量
+    cinfo.in_color_space = JCS_YCbCr;                     // 输入即 YCbCr，库内不再做颜色转换
+    jpeg_set_defaults(&cinfo);                            // 默认 Huffman / 量化表
+    jpeg_set_quality(&cinfo, quality, TRUE);              // 按配置缩放量化表
+    cinfo.raw_data_in = TRUE;                             // 直接提供已下采样的分量平面
+#if JPEG_LIB_VERSION >= 70
+    cinfo.do_fancy_downsampling = FALSE;
+#endif
+    cinfo.comp_info[0].h_samp_factor = 2;                 // Y：水平 2 倍
+    cinfo.comp_info[0].v_samp_factor = vs;                // 4:2:0 时纵向也为 2 倍
+    cinfo.comp_info[1].h_samp_factor = 1;                 // Cb
+    cinfo.comp_info[1].v_samp_factor = 1;
+    cinfo.comp_info[2].h_samp_factor = 1;                 // Cr
+    cinfo.comp_info[2].v_samp_factor = 1;
     jpeg_start_compress(&cinfo, TRUE);                    // 开始压缩过程
 
-    // ----------- 逐行写入RGB数据 -----------
-    // libjpeg按扫描线（行）方式写入，每次调用写入1行像素
-    JSAMPROW row_pointer[1];
-    while (cinfo.next_scanline < height) {
-        row_pointer[0] = &rgb[cinfo.next_scanline * width * 3];  // 定位当前行起始地址
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);             // 写入一行数据
+    // ----------- 每次解交织一个 MCU 行并写入 -----------
+    // 最后不足一个 MCU 行时重复末行补齐（jpeg_write_raw_data 要求整块 MCU 行）
+    while (cinfo.next_scanline < cinfo.image_height) {
+        yuyv_to_planes(p, width, height, stride, cinfo.next_scanline, lines, vs, yp, up, vp);
+        jpeg_write_raw_data(&cinfo, data, lines);         // 写入一个 MCU 行
     }
 
     // ----------- 压缩完成，清理资源 -----------
     jpeg_finish_compress(&cinfo);                       // 结束压缩流程
-    fclose(outf);                                       // 关闭文件流
+    size_t len = *cap - dest.pub.free_in_buffer;        // 已写入的码流长度
     jpeg_destroy_compress(&cinfo);                      // 释放JPEG结构体资源
-    free(rgb);                                          // 释放临时RGB缓冲区
+    free(planes);                                       // 释放平面缓存
+    if (dest.failed) {
+        fprintf(stderr, "[JPEG] out of memory for encoded frame\n");
+        return 0;
+    }
+
+    // 至此，一帧YUYV图像已编码为内存中的JPEG数据
+    return len;
+}
+
+/*
+ * 把 len 字节完整写入 fd（处理部分写入），0 成功，-1 失败（已打印原因）。
+ */
+static int write_all(int fd, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            perror("write");
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * 函数名称: save_buffer
+ * 功能描述: 把内存中已编码的 JPEG 数据一次 write() 写入文件（所有后端共用，
+ *           避免 stdio 在编码过程中对 SD 卡的大量小块写入）。
+ *
+ * 返回值:
+ *   0 成功，-1 失败
+ */
+static int save_buffer(const char *filename, const void *data, size_t len) {
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("open jpeg");
+        return -1;
+    }
+    int rc = write_all(fd, data, len);
+    close(fd);
+    return rc;
+}
+
+#if USE_TURBOJPEG
+/*
+ * TurboJPEG 后端：整帧解交织为平面后调用 tjCompressFromYUVPlanes（SIMD DCT / Huffman），
+ * 平面与输出缓冲在初始化时按最大尺寸分配一次。
+ */
+static int turbo_encoder_init(struct jpeg_encoder *e) {
+    int vs = e->subsamp == JPEG_SUBSAMP_420 ? 2 : 1;
+    int cw = e->width / 2, ch = (e->height + vs - 1) / vs; /* 与 turbo_encode 相同的向上取整，奇数高度不越界 */
+    e->tj = tjInitCompress();
+    if (!e->tj) return -1;
+    e->tj_planes = malloc((size_t)e->width * e->height + (size_t)2 * cw * ch);
+    e->tj_cap = tjBufSize(e->width, e->height, e->subsamp == JPEG_SUBSAMP_420 ? TJSAMP_420 : TJSAMP_422);
+    e->tj_out = tjAlloc((int)e->tj_cap);
+    if (!e->tj_planes || !e->tj_out) return -1;
+    return 0;
+}
+
+static int turbo_encode(struct jpeg_encoder *e, const struct cam_frame *f, const char *filename) {
+    int vs = e->subsamp == JPEG_SUBSAMP_420 ? 2 : 1;
+    int cw = e->width / 2, ch = (e->height + vs - 1) / vs;
+    unsigned char *yp = e->tj_planes, *up = yp + (size_t)e->width * e->height, *vp = up + (size_t)cw * ch;
+    yuyv_to_planes((const unsigned char *)f->start, e->width, e->height, e->stride, 0, ch * vs, vs,
+                   yp, up, vp);
+
+    const unsigned char *planes[3] = { yp, up, vp };
+    int strides[3] = { e->width, cw, cw };
+    unsigned char *out = e->tj_out;
+    unsigned long len = e->tj_cap;
+    if (tjCompressFromYUVPlanes(e->tj, planes, e->width, strides, e->height,
+                                vs == 2 ? TJSAMP_420 : TJSAMP_422, &out, &len,
+                                e->quality, TJFLAG_NOREALLOC) != 0) {
+        fprintf(stderr, "[JPEG] turbojpeg: %s\n", tjGetErrorStr());
+        return -1;
+    }
+    return save_buffer(filename, out, len);
+}
+#endif
+
+#if USE_MPP
+/*
+ * MPP 硬件后端：摄像头 DMABUF（cam_open 时 EXPBUF 导出）按缓冲序号导入一次，
+ * 之后每帧直接交给硬件 JPEG 编码器，CPU 不接触像素数据。
+ * 硬件输入格式为 YUYV，输出固定为 4:2:2。
+ */
+static int mpp_encoder_init(struct jpeg_encoder *e) {
+    if (mpp_create(&e->mpp_ctx, &e->mpi) != MPP_OK) return -1;
+    if (mpp_init(e->mpp_ctx, MPP_CTX_ENC, MPP_VIDEO_CodingMJPEG) != MPP_OK) return -1;
+
+    MppEncCfg cfg = NULL;
+    if (mpp_enc_cfg_init(&cfg) != MPP_OK) return -1;
+    e->mpi->control(e->mpp_ctx, MPP_ENC_GET_CFG, cfg);
+    mpp_enc_cfg_set_s32(cfg, "prep:width", e->width);
+    mpp_enc_cfg_set_s32(cfg, "prep:height", e->height);
+    mpp_enc_cfg_set_s32(cfg, "prep:hor_stride", e->stride);      // YUYV 行跨度（字节）
+    mpp_enc_cfg_set_s32(cfg, "prep:ver_stride", e->height);
+    mpp_enc_cfg_set_s32(cfg, "prep:format", MPP_FMT_YUV422_YUYV);
+    mpp_enc_cfg_set_s32(cfg, "rc:mode", MPP_ENC_RC_MODE_FIXQP);
+    mpp_enc_cfg_set_s32(cfg, "jpeg:q_factor", e->quality);
+    mpp_enc_cfg_set_s32(cfg, "jpeg:qf_max", e->quality);
+    mpp_enc_cfg_set_s32(cfg, "jpeg:qf_min", e->quality);
+    MPP_RET ret = e->mpi->control(e->mpp_ctx, MPP_ENC_SET_CFG, cfg);
+    mpp_enc_cfg_deinit(cfg);
+    if (ret != MPP_OK) return -1;
+
+    // 输出码流缓冲：整帧 YUYV 大小足以容纳任意质量的 JPEG
+    if (mpp_buffer_group_get_internal(&e->mpp_grp, MPP_BUFFER_TYPE_DRM) != MPP_OK ||
+        mpp_buffer_get(e->mpp_grp, &e->mpp_pkt_buf, (size_t)e->width * e->height * 2) != MPP_OK)
+        return -1;
+    if (e->subsamp != JPEG_SUBSAMP_422)
+        printf("[JPEG] MPP encodes YUYV input as 4:2:2\n");
+    return 0;
+}
+
+static int mpp_encode(struct jpeg_encoder *e, const struct cam_frame *f, const char *filename) {
+    if (f->dma_fd < 0) return -1;
+    MppBuffer in = e->mpp_in[f->index];
+    if (!in) {                                            // 首次遇到该缓冲：导入 DMABUF
+        MppBufferInfo info;
+        memset(&info, 0, sizeof(info));
+        info.type = MPP_BUFFER_TYPE_EXT_DMA;
+        info.fd = f->dma_fd;
+        info.size = f->length;
+        info.index = f->index;
+        if (mpp_buffer_import(&in, &info) != MPP_OK) return -1;
+        e->mpp_in[f->index] = in;
+    }
+
+    MppFrame frame = NULL;
+    MppPacket pkt = NULL, out = NULL;
+    int rc = -1;
+    if (mpp_frame_init(&frame) != MPP_OK) return -1;
+    mpp_frame_set_width(frame, e->width);
+    mpp_frame_set_height(frame, e->height);
+    mpp_frame_set_hor_stride(frame, e->stride);
+    mpp_frame_set_ver_stride(frame, e->height);
+    mpp_frame_set_fmt(frame, MPP_FMT_YUV422_YUYV);
+    mpp_frame_set_buffer(frame, in);
+
+    // 码流直接写入预分配的输出缓冲
+    mpp_packet_init_with_buffer(&pkt, e->mpp_pkt_buf);
+    mpp_packet_set_length(pkt, 0);
+    mpp_meta_set_packet(mpp_frame_get_meta(frame), KEY_OUTPUT_PACKET, pkt);
+
+    if (e->mpi->encode_put_frame(e->mpp_ctx, frame) == MPP_OK &&
+        e->mpi->encode_get_packet(e->mpp_ctx, &out) == MPP_OK && out) {
+        rc = save_buffer(filename, mpp_packet_get_pos(out), mpp_packet_get_length(out));
+    }
+    if (out) mpp_packet_deinit(&out);
+    mpp_frame_deinit(&frame);
+    return rc;
+}
+#endif
+
+/**
+ * 函数名称: jpeg_encoder_close
+ * 功能描述: 释放编码后端占用的全部资源。
+ */
+void jpeg_encoder_close(struct jpeg_encoder *e) {
+#if USE_TURBOJPEG
+    if (e->tj) tjDestroy(e->tj);
+    if (e->tj_out) tjFree(e->tj_out);
+    free(e->tj_planes);
+#endif
+#if USE_MPP
+    for (int i = 0; i < CAM_MAX_BUFFERS; i++)
+        if (e->mpp_in[i]) mpp_buffer_put(e->mpp_in[i]);
+    if (e->mpp_pkt_buf) mpp_buffer_put(e->mpp_pkt_buf);
+    if (e->mpp_grp) mpp_buffer_group_put(e->mpp_grp);
+    if (e->mpp_ctx) mpp_destroy(e->mpp_ctx);
+#endif
+    free(e->mem);
+    memset(e, 0, sizeof(*e));
+}
+
+/**
+ * 函数名称: jpeg_encoder_init
+ * 功能描述:
+ *   按配置初始化编码后端（每路摄像头一个实例，由对应的编码线程独占）。
+ *   所选后端未编译或初始化失败时回退到 libjpeg。
+ *
+ * 输入参数:
+ *   e       - 编码器对象
+ *   backend - JPEG_BACKEND_LIBJPEG / JPEG_BACKEND_TURBO / JPEG_BACKEND_MPP
+ *   quality - JPEG 质量（1~100）
+ *   subsamp - JPEG_SUBSAMP_422 或 JPEG_SUBSAMP_420
+ *   cam     - 已打开的摄像头（取协商后的宽高与行跨度）
+ */
+void jpeg_encoder_init(struct jpeg_encoder *e, int backend, int quality, int subsamp,
+                       const struct cam_device *cam) {
+    static const char *const names[] = { "libjpeg", "turbojpeg", "mpp" };
+    memset(e, 0, sizeof(*e));
+    e->quality = quality < 1 ? 1 : (quality > 100 ? 100 : quality);
+    e->subsamp = subsamp;
+    e->width = (int)cam->width;
+    e->height = (int)cam->height;
+    e->stride = (int)cam->bytesperline;
+    e->backend = JPEG_BACKEND_LIBJPEG;
+
+    int ok = 0;
+#if USE_TURBOJPEG
+    if (backend == JPEG_BACKEND_TURBO) ok = turbo_encoder_init(e) == 0;
+#endif
+#if USE_MPP
+    if (backend == JPEG_BACKEND_MPP) ok = mpp_encoder_init(e) == 0;
+#endif
+    if (ok) {
+        e->backend = backend;
+    } else if (backend != JPEG_BACKEND_LIBJPEG) {
+        fprintf(stderr, "[JPEG] %s backend unavailable, using libjpeg\n", names[backend]);
+        jpeg_encoder_close(e);
+        jpeg_encoder_init(e, JPEG_BACKEND_LIBJPEG, quality, subsamp, cam);
+        return;
+    }
+    printf("[INIT] JPEG encoder: %s, quality %d, %s\n", names[e->backend], e->quality,
+           e->subsamp == JPEG_SUBSAMP_420 ? "4:2:0" : "4:2:2");
+}
+
+/**
+ * 函数名称: jpeg_encoder_encode
+ * 功能描述:
+ *   编码一帧并保存到 filename。硬件 / SIMD 后端单帧失败时改用 libjpeg 重试，照片不丢。
+ *
+ * 注意事项:
+ *   libjpeg 路径出错时已打印原因。
+ */
+void jpeg_encoder_encode(struct jpeg_encoder *e, const struct cam_frame *f, const char *filename) {
+    int rc = -1;
+#if USE_MPP
+    if (e->backend == JPEG_BACKEND_MPP) rc = mpp_encode(e, f, filename);
+#endif
+#if USE_TURBOJPEG
+    if (e->backend == JPEG_BACKEND_TURBO) rc = turbo_encode(e, f, filename);
+#endif
+    if (rc != 0) {
+        size_t len = yuyv_to_jpeg(f->start, e->width, e->height, e->stride, e->quality, e->subsamp,
+                                  &e->mem, &e->mem_cap);
+        if (len) save_buffer(filename, e->mem, len);
+    }
+}
+
+/**
+ * 函数名称: jpeg_worker_thread
+ * 功能描述:
+ *   编码工作线程主体：等待队列中的帧，用本路编码器（jpeg_encoder_encode）保存后释放帧引用。
+ */
+static void *jpeg_worker_thread(void *arg) {
+    struct jpeg_worker *w = (struct jpeg_worker *)arg;
+    for (;;) {
+        // ----------- 取出一个任务（队列空时等待） -----------
+        pthread_mutex_lock(&w->lock);
+        while (w->count == 0 && !w->stop)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (w->count == 0) {                              // stop 且已无剩余任务
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+        struct encode_job job = w->jobs[w->head];
+        pthread_mutex_unlock(&w->lock);
+
+        // ----------- 编码并保存（不持锁，主循环可继续投递） -----------
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%d.jpg", w->folder, job.photo_idx);
+        jpeg_encoder_encode(&w->enc, job.frame, path);
+        printf("[SAVE] Photo %d %s: %s\n", job.photo_idx, w->name, path);
+
+        // ----------- 释放帧并出队（出队放在编码之后，count 即为仍被持有的帧数） -----------
+        cam_frame_release(job.frame);
+        pthread_mutex_lock(&w->lock);
+        w->head = (w->head + 1) % ENCODE_QUEUE_LEN;
+        w->count--;
+        pthread_mutex_unlock(&w->lock);
+    }
+    return NULL;
+}
+
+/**
+ * 函数名称: jpeg_worker_start
+ * 功能描述: 初始化队列与本路编码器（配置项 jpeg_backend / jpeg_quality / jpeg_subsamp），并启动编码工作线程。
+ *
+ * 输入参数:
+ *   cam - 本路摄像头（编码器按其协商后的宽高与行跨度读取帧）
+ *
+ * 返回值:
+ *   0 成功，-1 线程创建失败
+ */
+int jpeg_worker_start(struct jpeg_worker *w, const char *name, const char *folder,
+                      const struct cam_device *cam) {
+    memset(w, 0, sizeof(*w));
+    w->name = name;
+    w->folder = folder;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    jpeg_encoder_init(&w->enc, g_cfg.jpeg_backend, g_cfg.jpeg_quality, g_cfg.jpeg_subsamp, cam);
+    if (pthread_create(&w->tid, NULL, jpeg_worker_thread, w) != 0) {
+        perror("pthread_create jpeg worker");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * 函数名称: jpeg_worker_space
+ * 功能描述: 返回队列剩余空位数（主循环据此判断左右两路能否同时投递）。
+ */
+int jpeg_worker_space(struct jpeg_worker *w) {
+    pthread_mutex_lock(&w->lock);
+    int n = ENCODE_QUEUE_LEN - w->count;
+    pthread_mutex_unlock(&w->lock);
+    return n;
+}
+
+/**
+ * 函数名称: jpeg_worker_submit
+ * 功能描述:
+ *   投递一帧待保存图像。成功时队列额外持有该帧 1 次引用，
+ *   调用方自己的引用按原样释放即可。
+ *
+ * 返回值:
+ *   0 成功，-1 队列已满（帧未被持有）
+ */
+int jpeg_worker_submit(struct jpeg_worker *w, struct cam_frame *frame, int photo_idx) {
+    pthread_mutex_lock(&w->lock);
+    if (w->count >= ENCODE_QUEUE_LEN) {
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+    cam_frame_ref(frame);
+    struct encode_job *job = &w->jobs[(w->head + w->count) % ENCODE_QUEUE_LEN];
+    job->frame = frame;
+    job->photo_idx = photo_idx;
+    w->count++;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+/**
+ * 函数名称: jpeg_worker_stop
+ * 功能描述: 等待队列中剩余帧全部保存后结束工作线程。
+ */
+void jpeg_worker_stop(struct jpeg_worker *w) {
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->tid, NULL);
+    jpeg_encoder_close(&w->enc);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+}
+
+#if USE_MPP
+/*
+ * 编码一帧并把码流追加写入文件。编码器为同步模式，每送入一帧即取回对应的码流包。
+ */
+static int video_recorder_encode(struct video_recorder *r, const struct cam_frame *f) {
+    if (f->dma_fd < 0) return -1;
+    MppBuffer in = r->in[f->index];
+    if (!in) {                                            // 首次遇到该缓冲：导入 DMABUF
+        MppBufferInfo info;
+        memset(&info, 0, sizeof(info));
+        info.type = MPP_BUFFER_TYPE_EXT_DMA;
+        info.fd = f->dma_fd;
+        info.size = f->length;
+        info.index = f->index;
+        if (mpp_buffer_import(&in, &info) != MPP_OK) return -1;
+        r->in[f->index] = in;
+    }
+
+    MppFrame frame = NULL;
+    MppPacket out = NULL;
+    int rc = -1;
+    if (mpp_frame_init(&frame) != MPP_OK) return -1;
+    mpp_frame_set_width(frame, r->width);
+    mpp_frame_set_height(frame, r->height);
+    mpp_frame_set_hor_stride(frame, r->stride);
+    mpp_frame_set_ver_stride(frame, r->height);
+    mpp_frame_set_fmt(frame, MPP_FMT_YUV422_YUYV);
+    mpp_frame_set_buffer(frame, in);
+    mpp_frame_set_pts(frame, f->ts_us);
+
+    if (r->mpi->encode_put_frame(r->ctx, frame) == MPP_OK &&
+        r->mpi->encode_get_packet(r->ctx, &out) == MPP_OK && out) {
+        rc = write_all(r->fd, mpp_packet_get_pos(out), mpp_packet_get_length(out));
+    }
+    if (out) mpp_packet_deinit(&out);
+    mpp_frame_deinit(&frame);
+    return rc;
+}
+
+static void *video_recorder_thread(void *arg) {
+    struct video_recorder *r = (struct video_recorder *)arg;
+    while (1) {
+        pthread_mutex_lock(&r->lock);
+        while (r->count == 0 && !r->stop)
+            pthread_cond_wait(&r->cond, &r->lock);
+        if (r->count == 0) {                              // stop 且已无剩余帧
+            pthread_mutex_unlock(&r->lock);
+            break;
+        }
+        struct cam_frame *f = r->jobs[r->head];
+        pthread_mutex_unlock(&r->lock);
+
+        // 失败的帧也记一行时间戳（长度 -1），左右 .pts 行号保持对齐
+        int rc = video_recorder_encode(r, f);
+        fprintf(r->pts, "%u %u %lld%s\n", r->frames, f->sequence, f->ts_us, rc == 0 ? "" : " -1");
+        if (rc != 0)
+            fprintf(stderr, "[REC] %s: encode frame %u failed\n", r->name, r->frames);
+        r->frames++;
+
+        cam_frame_release(f);
+        pthread_mutex_lock(&r->lock);
+        r->head = (r->head + 1) % RECORD_QUEUE_LEN;
+        r->count--;
+        pthread_mutex_unlock(&r->lock);
+    }
+    return NULL;
+}
+
+/**
+ * 函数名称: video_recorder_start
+ * 功能描述:
+ *   创建硬件视频编码器（RECORD_CODEC 与配置项 record_bitrate / record_fps / record_gop，CBR），
+ *   打开 <prefix>.h264（或 .h265）与 <prefix>.pts，并启动编码线程。
+ *
+ * 输入参数:
+ *   cam    - 已打开的摄像头（取协商后的宽高与行跨度）
+ *   prefix - 输出文件路径前缀（不含扩展名）
+ *
+ * 返回值:
+ *   0 成功，-1 失败（已释放全部资源）
+ */
+int video_recorder_start(struct video_recorder *r, const char *name, const struct cam_device *cam,
+                         const char *prefix) {
+    memset(r, 0, sizeof(*r));
+    r->name = name;
+    r->fd = -1;
+    r->width = (int)cam->width;
+    r->height = (int)cam->height;
+    r->stride = (int)cam->bytesperline;
+
+    // ---------- 1. 编码器 ----------
+    MppEncCfg cfg = NULL;
+    if (mpp_create(&r->ctx, &r->mpi) != MPP_OK ||
+        mpp_init(r->ctx, MPP_CTX_ENC, RECORD_CODEC) != MPP_OK ||
+        mpp_enc_cfg_init(&cfg) != MPP_OK) {
+        fprintf(stderr, "[REC] %s: MPP encoder init failed\n", name);
+        goto fail;
+    }
+    r->mpi->control(r->ctx, MPP_ENC_GET_CFG, cfg);
+    mpp_enc_cfg_set_s32(cfg, "prep:width", r->width);
+    mpp_enc_cfg_set_s32(cfg, "prep:height", r->height);
+    mpp_enc_cfg_set_s32(cfg, "prep:hor_stride", r->stride);
+    mpp_enc_cfg_set_s32(cfg, "prep:ver_stride", r->height);
+    mpp_enc_cfg_set_s32(cfg, "prep:format", MPP_FMT_YUV422_YUYV);
+    mpp_enc_cfg_set_s32(cfg, "rc:mode", MPP_ENC_RC_MODE_CBR);
+    mpp_enc_cfg_set_s32(cfg, "rc:bps_target", g_cfg.record_bitrate);
+    mpp_enc_cfg_set_s32(cfg, "rc:bps_max", g_cfg.record_bitrate / 16 * 17);
+    mpp_enc_cfg_set_s32(cfg, "rc:bps_min", g_cfg.record_bitrate / 16 * 15);
+    mpp_enc_cfg_set_s32(cfg, "rc:fps_in_num", g_cfg.record_fps);
+    mpp_enc_cfg_set_s32(cfg, "rc:fps_in_denom", 1);
+    mpp_enc_cfg_set_s32(cfg, "rc:fps_out_num", g_cfg.record_fps);
+    mpp_enc_cfg_set_s32(cfg, "rc:fps_out_denom", 1);
+    mpp_enc_cfg_set_s32(cfg, "rc:gop", g_cfg.record_gop);
+    MPP_RET ret = r->mpi->control(r->ctx, MPP_ENC_SET_CFG, cfg);
+    mpp_enc_cfg_deinit(cfg);
+    MppEncHeaderMode hdr = MPP_ENC_HEADER_MODE_EACH_IDR;  // 裸流任意 IDR 处均可解码
+    if (ret != MPP_OK || r->mpi->control(r->ctx, MPP_ENC_SET_HEADER_MODE, &hdr) != MPP_OK) {
+        fprintf(stderr, "[REC] %s: MPP encoder config rejected\n", name);
+        goto fail;
+    }
+
+    // ---------- 2. 输出文件 ----------
+    char path[256];
+    snprintf(path, sizeof(path), "%s.%s", prefix, RECORD_CODEC == MPP_VIDEO_CodingHEVC ? "h265" : "h264");
+    r->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (r->fd < 0) {
+        perror(path);
+        goto fail;
+    }
+    snprintf(path, sizeof(path), "%s.pts", prefix);
+    r->pts = fopen(path, "w");
+    if (!r->pts) {
+        perror(path);
+        goto fail;
+    }
+
+    // ---------- 3. 编码线程 ----------
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (pthread_create(&r->tid, NULL, video_recorder_thread, r) != 0) {
+        perror("pthread_create recorder");
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->cond);
+        goto fail;
+    }
+    r->running = 1;
+    printf("[REC] %s: recording %dx%d to %s.*\n", name, r->width, r->height, prefix);
+    return 0;
+
+fail:
+    if (r->pts) fclose(r->pts);
+    if (r->fd >= 0) close(r->fd);
+    if (r->ctx) mpp_destroy(r->ctx);
+    memset(r, 0, sizeof(*r));
+    return -1;
+}
+
+/**
+ * 函数名称: video_recorder_space
+ * 功能描述: 返回录像队列剩余空位数。
+ */
+int video_recorder_space(struct video_recorder *r) {
+    pthread_mutex_lock(&r->lock);
+    int n = RECORD_QUEUE_LEN - r->count;
+    pthread_mutex_unlock(&r->lock);
+    return n;
+}
+
+/**
+ * 函数名称: video_recorder_submit
+ * 功能描述: 投递一帧待录制图像，成功时队列额外持有该帧 1 次引用。
+ *
+ * 返回值:
+ *   0 成功，-1 队列已满（帧未被持有）
+ */
+int video_recorder_submit(struct video_recorder *r, struct cam_frame *frame) {
+    pthread_mutex_lock(&r->lock);
+    if (r->count >= RECORD_QUEUE_LEN) {
+        pthread_mutex_unlock(&r->lock);
+        return -1;
+    }
+    cam_frame_ref(frame);
+    r->jobs[(r->head + r->count) % RECORD_QUEUE_LEN] = frame;
+    r->count++;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    return 0;
+}
+
+/**
+ * 函数名称: video_recorder_stop
+ * 功能描述: 编码完队列中剩余帧后结束线程，关闭文件并释放编码器。
+ */
+void video_recorder_stop(struct video_recorder *r) {
+    if (!r->running) return;
+    pthread_mutex_lock(&r->lock);
+    r->stop = 1;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->tid, NULL);
+    printf("[REC] %s: stopped, %u frames, %u dropped\n", r->name, r->frames, r->dropped);
+
+    for (int i = 0; i < CAM_MAX_BUFFERS; i++)
+        if (r->in[i]) mpp_buffer_put(r->in[i]);
+    mpp_destroy(r->ctx);
+    close(r->fd);
+    fclose(r->pts);
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+    memset(r, 0, sizeof(*r));
+}
+#endif
+
+/*
+ * 原始录制：把一对帧原样拷入批量缓冲的下一个记录槽（记录头 + 左右帧，槽内补齐部分保持为 0）。
+ */
+static void raw_recorder_fill(struct raw_recorder *r, const struct raw_pair *job) {
+    unsigned char *slot = r->buf + (size_t)r->batched * r->hdr.record_bytes;
+    struct sdump_record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.seq = job->seq;
+    for (int c = 0; c < 2; c++) {
+        const struct cam_frame *f = job->f[c];
+        unsigned char *dst = slot + SDUMP_ALIGN + (size_t)c * SDUMP_ALIGN_UP(r->hdr.frame_bytes);
+        size_t n = f->bytesused < r->hdr.frame_bytes ? f->bytesused : r->hdr.frame_bytes;
+        memcpy(dst, f->start, n);
+        memset(dst + n, 0, r->hdr.frame_bytes - n);       // 驱动给出的短帧补 0，记录长度固定
+        rec.ts_us[c] = f->ts_us;
+        rec.sequence[c] = f->sequence;
+    }
+    memcpy(slot, &rec, sizeof(rec));
+    r->batched++;
+}
+
+/*
+ * 原始录制：写出批量缓冲中的全部记录（一次大块顺序写）。
+ * 普通文件在写到预分配末尾前再 fallocate 一段（FALLOC_FL_KEEP_SIZE：文件长度只随实际写入增长，
+ * 录制被打断时不会留下全 0 的尾部）；文件系统不支持时不再尝试。
+ */
+static void raw_recorder_flush(struct raw_recorder *r) {
+    size_t len = (size_t)r->batched * r->hdr.record_bytes;
+    if (len == 0 || r->failed) {
+        r->batched = 0;
+        return;
+    }
+    long long chunk = (long long)g_cfg.raw_prealloc_mb << 20;
+    if (r->prealloc >= 0 && chunk > 0 && r->bytes + (long long)len > r->prealloc) {
+        if (fallocate(r->fd, FALLOC_FL_KEEP_SIZE, r->prealloc, chunk) == 0) {
+            r->prealloc += chunk;
+        } else {
+            perror("[RAW] fallocate");
+            r->prealloc = -1;
+        }
+    }
+    if (write_all(r->fd, r->buf, len) != 0) {
+        fprintf(stderr, "[RAW] %s: write failed at %lld bytes, recording stopped\n", r->path, r->bytes);
+        r->failed = 1;
+    } else {
+        r->bytes += (long long)len;
+        r->written += (unsigned)r->batched;
+    }
+    r->batched = 0;
+}
+
+static void *raw_recorder_thread(void *arg) {
+    struct raw_recorder *r = (struct raw_recorder *)arg;
+    while (1) {
+        pthread_mutex_lock(&r->lock);
+        while (r->count == 0 && !r->stop)
+            pthread_cond_wait(&r->cond, &r->lock);
+        if (r->count == 0) {                              // stop 且已无剩余帧
+            pthread_mutex_unlock(&r->lock);
+            break;
+        }
+        struct raw_pair job = r->jobs[r->head];
+        pthread_mutex_unlock(&r->lock);
+
+        // 拷贝后立即归还两帧，磁盘写入期间不占用摄像头缓冲
+        if (!r->failed) raw_recorder_fill(r, &job);
+        cam_frame_release(job.f[0]);
+        cam_frame_release(job.f[1]);
+        pthread_mutex_lock(&r->lock);
+        r->head = (r->head + 1) % RAW_QUEUE_LEN;
+        r->count--;
+        pthread_mutex_unlock(&r->lock);
+
+        if (r->batched == RAW_BATCH) raw_recorder_flush(r);
+    }
+    raw_recorder_flush(r);                                // 不足一批的剩余记录
+    return NULL;
+}
+
+/**
+ * 函数名称: raw_recorder_start
+ * 功能描述:
+ *   打开原始录制输出并启动写线程，先写入 .sdump 文件头。
+ *   普通文件：O_CREAT | O_TRUNC | O_DIRECT（文件系统不支持 O_DIRECT 时改用普通写），并预分配空间；
+ *   已存在的 FIFO / 字符设备：流式写入（不截断、不预分配、不用 O_DIRECT），
+ *   FIFO 必须已有读端（例如 "nc host port < fifo"），否则立即失败而不是阻塞主循环。
+ *
+ * 输入参数:
+ *   left / right - 已打开的摄像头（两路须为相同分辨率与行跨度的 YUYV）
+ *   path         - 输出路径
+ *
+ * 返回值:
+ *   0 成功，-1 失败（已释放全部资源）
+ */
+int raw_recorder_start(struct raw_recorder *r, const struct cam_device *left,
+                       const struct cam_device *right, const char *path) {
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    snprintf(r->path, sizeof(r->path), "%s", path);
+
+    // ---------- 1. 文件头与批量缓冲 ----------
+    if (left->pixelformat != V4L2_PIX_FMT_YUYV || right->pixelformat != left->pixelformat ||
+        right->width != left->width || right->height != left->height ||
+        right->bytesperline != left->bytesperline) {
+        fprintf(stderr, "[RAW] Both cameras must deliver YUYV with identical geometry\n");
+        return -1;
+    }
+    sdump_header_init(&r->hdr, left->width, left->height, left->pixelformat, left->bytesperline,
+                      left->fps_num, left->fps_den);
+    void *buf = NULL;
+    if (posix_memalign(&buf, SDUMP_ALIGN, (size_t)RAW_BATCH * r->hdr.record_bytes) != 0) {
+        fprintf(stderr, "[RAW] Out of memory for %d records\n", RAW_BATCH);
+        return -1;
+    }
+    r->buf = (unsigned char *)buf;
+    memset(r->buf, 0, (size_t)RAW_BATCH * r->hdr.record_bytes);
+
+    // ---------- 2. 输出 ----------
+    struct stat st;
+    int stream = stat(path, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode));
+    if (stream) {
+        r->fd = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (r->fd >= 0) fcntl(r->fd, F_SETFL, fcntl(r->fd, F_GETFL) & ~O_NONBLOCK);
+        r->prealloc = -1;
+        signal(SIGPIPE, SIG_IGN);                         // 读端退出时 write 返回 EPIPE 而不是杀死进程
+    } else {
+        r->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+        r->direct = r->fd >= 0;
+        if (r->fd < 0 && errno == EINVAL)
+            r->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (r->fd < 0) {
+        fprintf(stderr, "[RAW] %s: %s\n", path, errno == ENXIO ? "no reader on FIFO" : strerror(errno));
+        goto fail;
+    }
+    memcpy(r->buf, &r->hdr, sizeof(r->hdr));              // 文件头页（其余字节为 0）
+    ssize_t n = write(r->fd, r->buf, SDUMP_ALIGN);
+    if (n < 0 && errno == EINVAL && r->direct) {          // 打开成功但实际不支持直写
+        fcntl(r->fd, F_SETFL, fcntl(r->fd, F_GETFL) & ~O_DIRECT);
+        r->direct = 0;
+        n = write(r->fd, r->buf, SDUMP_ALIGN);
+    }
+    memset(r->buf, 0, sizeof(r->hdr));
+    if (n != SDUMP_ALIGN) {
+        fprintf(stderr, "[RAW] %s: header write failed\n", path);
+        goto fail;
+    }
+    r->bytes = SDUMP_ALIGN;
+
+    // ---------- 3. 写线程 ----------
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (pthread_create(&r->tid, NULL, raw_recorder_thread, r) != 0) {
+        perror("pthread_create raw recorder");
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->cond);
+        goto fail;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    r->t_start = (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    r->running = 1;
+    printf("[RAW] Recording %ux%u YUYV pairs to %s (%s, %u KB/record)\n", r->hdr.width, r->hdr.height,
+           path, stream ? "stream" : r->direct ? "O_DIRECT" : "buffered", r->hdr.record_bytes / 1024);
+    return 0;
+
+fail:
+    if (r->fd >= 0) close(r->fd);
+    free(r->buf);
+    memset(r, 0, sizeof(*r));
+    return -1;
+}
+
+/**
+ * 函数名称: raw_recorder_space
+ * 功能描述: 返回原始录制队列剩余空位数（帧对）。
+ */
+int raw_recorder_space(struct raw_recorder *r) {
+    pthread_mutex_lock(&r->lock);
+    int n = RAW_QUEUE_LEN - r->count;
+    pthread_mutex_unlock(&r->lock);
+    return n;
+}
 
-    // 至此，一帧YUYV图像已成功保存为JPEG文件
+/**
+ * 函数名称: raw_recorder_submit
+ * 功能描述: 投递一对待录制帧，成功时队列额外持有两帧各 1 次引用。
+ *
+ * 返回值:
+ *   0 成功，-1 队列已满（帧未被持有）
+ */
+int raw_recorder_submit(struct raw_recorder *r, struct cam_frame *left, struct cam_frame *right,
+                        unsigned seq) {
+    pthread_mutex_lock(&r->lock);
+    if (r->count >= RAW_QUEUE_LEN) {
+        pthread_mutex_unlock(&r->lock);
+        return -1;
+    }
+    cam_frame_ref(left);
+    cam_frame_ref(right);
+    struct raw_pair *job = &r->jobs[(r->head + r->count) % RAW_QUEUE_LEN];
+    job->f[0] = left;
+    job->f[1] = right;
+    job->seq = seq;
+    r->count++;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    return 0;
+}
+
+/**
+ * 函数名称: raw_recorder_stop
+ * 功能描述: 写完队列与批量缓冲中的剩余记录后结束线程，关闭输出并打印写入速率。
+ */
+void raw_recorder_stop(struct raw_recorder *r) {
+    if (!r->running) return;
+    pthread_mutex_lock(&r->lock);
+    r->stop = 1;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->tid, NULL);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double dt = ((long long)now.tv_sec * 1000000 + now.tv_nsec / 1000 - r->t_start) / 1e6;
+    double mb = r->bytes / 1048576.0;
+    printf("[RAW] Stopped %s: %u records, %u dropped, %.1f MB in %.1f s (%.1f MB/s)%s\n", r->path,
+           r->written, r->dropped, mb, dt, dt > 0 ? mb / dt : 0.0, r->failed ? ", WRITE FAILED" : "");
+    if (r->prealloc >= 0 && fdatasync(r->fd) != 0) perror("[RAW] fdatasync");
+    close(r->fd);
+    free(r->buf);
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+    memset(r, 0, sizeof(*r));
 }
 
 /**
@@ -270,127 +1576,174 @@ void clear_jpg_files(const char *folder) {
 }
 
 /**
- * 函数名称: init_camera
+ * 函数名: yuv_to_argb
  * 功能描述:
- *   初始化指定摄像头设备，包括：
- *     1. 打开 /dev/videoX 节点；
- *     2. 设置视频格式（分辨率、像素格式等）；
- *     3. 申请帧缓冲并进行内存映射；
- *     4. 启动视频流采集；
- *   最终返回缓冲区数量，并通过参数输出文件描述符。
- *
- * 输入参数:
- *   dev  - 摄像头设备节点路径，如 "/dev/video21" 或 "/dev/video23"
- *   bufs - 用户自定义 buffer 数组，用于存储 mmap 映射信息（起始地址 + 长度）
- *   vfd  - 指向整型变量的指针，用于返回打开的摄像头文件描述符
- *
- * 返回值:
- *   成功时返回缓冲区数量（通常为2），出错时程序退出。
- *
- * 依赖:
- *   <linux/videodev2.h>  —— V4L2 视频接口定义
- *   <sys/ioctl.h>        —— ioctl 系统调用
- *   <sys/mman.h>         —— mmap 内存映射函数
- *
- * 注意事项:
- *   - 摄像头必须支持 YUYV 格式，否则需调整 pixelformat；
- *   - 若 ioctl() 返回 -1，通常为驱动不支持或设备未连接；
- *   - 必须在 STREAMON 之后，才能从摄像头读取帧。
- */
-int init_camera(const char *dev, struct buffer *bufs, int *vfd) {
-    // ---------------------- 1. 打开摄像头设备 ----------------------
-    *vfd = open(dev, O_RDWR);                                // 以读写模式打开设备节点
-    if (*vfd < 0) {                                          // 若打开失败，输出错误并终止
-        perror("open camera");
-        exit(1);
-    }
-
-    // ---------------------- 2. 设置视频格式 ----------------------
-    // 定义 v4l2_format 结构体并指定视频捕获模式参数
-    struct v4l2_format fmt = {
-            .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,                 // 指定为视频捕获类型
-            .fmt.pix.width = WIDTH,                              // 图像宽度 (640)
-            .fmt.pix.height = HEIGHT,                            // 图像高度 (480)
-            .fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV,            // 像素格式：YUYV（常见于UVC摄像头）
-            .fmt.pix.field = V4L2_FIELD_NONE                     // 非交错扫描
-    };
-
-    // 向驱动发送 VIDIOC_S_FMT 命令，设置视频采集格式
-    if (ioctl(*vfd, VIDIOC_S_FMT, &fmt) < 0) {
-        perror("VIDIOC_S_FMT failed");                       // 例如设备不支持指定分辨率或格式
-        exit(1);
-    }
+ *   单个像素的 YUV→ARGB8888 转换（BT.601 整数公式），供标量路径与 NEON 尾部使用。
+ */
+static inline unsigned int yuv_to_argb(int y0, int u, int v) {
+    int c = y0 - 16;                         // 去除偏移 (标准YUV偏移)
+    int d = u - 128;
+    int e = v - 128;
+
+    int r = (298 * c + 409 * e + 128) >> 8;  // R = 1.164*(Y-16) + 1.596*(V-128)
+    int g = (298 * c - 100 * d - 208 * e + 128) >> 8;  // G = 1.164*(Y-16) - 0.392*(U-128) - 0.813*(V-128)
+    int b = (298 * c + 516 * d + 128) >> 8;  // B = 1.164*(Y-16) + 2.017*(U-128)
+
+    // 限幅操作，确保RGB在[0,255]范围内
+    r = (r > 255) ? 255 : (r < 0 ? 0 : r);
+    g = (g > 255) ? 255 : (g < 0 ? 0 : g);
+    b = (b > 255) ? 255 : (b < 0 ? 0 : b);
+
+    // LCD通常使用32位色深，每像素4字节: A(8) R(8) G(8) B(8)，Alpha=0xFF 表示不透明
+    return (0xFFu << 24) | (r << 16) | (g << 8) | b;
+}
 
-    // ---------------------- 3. 申请视频缓冲区 ----------------------
-    // 通常摄像头驱动使用环形缓冲机制（循环采集帧），此处申请2个缓冲区
-    struct v4l2_requestbuffers req = {
-            .count = 2,                                          // 请求分配2个缓冲区
-            .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,                 // 视频捕获类型
-            .memory = V4L2_MEMORY_MMAP                           // 使用内存映射模式（效率高）
-    };
+#if USE_NEON
+/**
+ * 函数名: neon_yuv_to_argb8
+ * 功能描述:
+ *   8 个像素一组的 YUV→ARGB8888 转换（NEON）。
+ *   src 为 8 个 YUYV 宏像素（每个 4 字节 Y0 U Y1 V），取每个宏像素的 Y0/U/V，
+ *   结果按 B,G,R,A 交织写入 dst（即小端 ARGB8888）。
+ *
+ * 实现要点:
+ *   - vld4_u8 一次解交织出 Y0/U/Y1/V 四个通道；
+ *   - 32 位整数乘加与标量公式逐位一致；
+ *   - vqmovun_s32 + vqmovn_u16 饱和收窄，代替三次分支限幅。
+ */
+static inline void neon_yuv_to_argb8(const uint8_t *src, uint32_t *dst) {
+    uint8x8x4_t yuyv = vld4_u8(src);
+    int16x8_t c = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(yuyv.val[0])), vdupq_n_s16(16));
+    int16x8_t d = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(yuyv.val[1])), vdupq_n_s16(128));
+    int16x8_t e = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(yuyv.val[3])), vdupq_n_s16(128));
+
+    int32x4_t c_lo = vmull_n_s16(vget_low_s16(c), 298), c_hi = vmull_n_s16(vget_high_s16(c), 298);
+    c_lo = vaddq_s32(c_lo, vdupq_n_s32(128));
+    c_hi = vaddq_s32(c_hi, vdupq_n_s32(128));
+
+    int32x4_t r_lo = vmlal_n_s16(c_lo, vget_low_s16(e), 409);
+    int32x4_t r_hi = vmlal_n_s16(c_hi, vget_high_s16(e), 409);
+    int32x4_t g_lo = vmlal_n_s16(vmlal_n_s16(c_lo, vget_low_s16(d), -100), vget_low_s16(e), -208);
+    int32x4_t g_hi = vmlal_n_s16(vmlal_n_s16(c_hi, vget_high_s16(d), -100), vget_high_s16(e), -208);
+    int32x4_t b_lo = vmlal_n_s16(c_lo, vget_low_s16(d), 516);
+    int32x4_t b_hi = vmlal_n_s16(c_hi, vget_high_s16(d), 516);
+
+    // >>8 后饱和收窄到 [0,255]
+    uint8x8x4_t argb;
+    argb.val[2] = vqmovn_u16(vcombine_u16(vqshrun_n_s32(r_lo, 8), vqshrun_n_s32(r_hi, 8)));
+    argb.val[1] = vqmovn_u16(vcombine_u16(vqshrun_n_s32(g_lo, 8), vqshrun_n_s32(g_hi, 8)));
+    argb.val[0] = vqmovn_u16(vcombine_u16(vqshrun_n_s32(b_lo, 8), vqshrun_n_s32(b_hi, 8)));
+    argb.val[3] = vdup_n_u8(0xFF);
+    vst4_u8((uint8_t *)dst, argb);
+}
+#endif
 
-    // VIDIOC_REQBUFS 命令申请缓冲区，驱动分配 DMA 内存供采集使用
-    if (ioctl(*vfd, VIDIOC_REQBUFS, &req) < 0) {
-        perror("VIDIOC_REQBUFS failed");
-        exit(1);
+/*
+ * 计算一维双线性映射：目标坐标 i（0~dst-1）按像素中心对齐映射到源坐标，
+ * 输出相邻两个源索引及右侧权重（0~256）。
+ */
+static void bilinear_axis(int dst, int src, unsigned short *i0, unsigned short *i1, unsigned short *w) {
+    for (int i = 0; i < dst; i++) {
+        // 16.16 定点：s = (i + 0.5) * src / dst - 0.5
+        long long s = ((2LL * i + 1) * src * 65536LL) / (2LL * dst) - 32768;
+        if (s < 0) s = 0;
+        int k = (int)(s >> 16);
+        if (k >= src - 1) { k = src - 1; s = (long long)k << 16; }
+        i0[i] = (unsigned short)k;
+        i1[i] = (unsigned short)(k + 1 < src ? k + 1 : k);
+        w[i]  = (unsigned short)((s & 0xFFFF) >> 8);
     }
+}
 
-    // ---------------------- 4. 映射缓冲区到用户空间 ----------------------
-    // 驱动将每个 buffer 映射到进程虚拟地址，使得应用程序可直接访问帧数据
-    for (int i = 0; i < 2; ++i) {
-        // 查询第 i 个缓冲区的偏移量与大小
-        struct v4l2_buffer buf = {
-                .type = req.type,
-                .memory = req.memory,
-                .index = i
-        };
-
-        if (ioctl(*vfd, VIDIOC_QUERYBUF, &buf) < 0) {        // 获取缓冲区属性
-            perror("VIDIOC_QUERYBUF failed");
-            exit(1);
-        }
-
-        // 记录缓冲区长度
-        bufs[i].length = buf.length;
-
-        // 建立内存映射（内核空间 → 用户空间）
-        bufs[i].start = mmap(
-                NULL,                                             // 让内核自动分配虚拟地址
-                buf.length,                                       // 映射长度
-                PROT_READ | PROT_WRITE,                           // 允许读写
-                MAP_SHARED,                                       // 与内核共享
-                *vfd,                                             // 设备文件描述符
-                buf.m.offset                                      // 内核提供的偏移地址
-        );
-
-        if (bufs[i].start == MAP_FAILED) {
-            perror("mmap failed");
-            exit(1);
+/**
+ * 函数名: preview_geom_init
+ * 功能描述:
+ *   根据屏幕尺寸与采集帧格式构建分屏预览的映射表（每个摄像头占半屏），之后每帧绘制只做查表。
+ *   映射表把每个屏幕像素直接指向源区域中的采样点，绘制时只读取被显示的像素，
+ *   因此提高采集分辨率（拍照更清晰）不会增加预览的计算量。
+ *
+ * 输入参数:
+ *   g       - 输出的映射表对象
+ *   fb_w    - LCD 屏幕宽度（例如 800）
+ *   fb_h    - LCD 屏幕高度（例如 480）
+ *   quality - PREVIEW_NEAREST 或 PREVIEW_BILINEAR
+ *   cam     - 已打开的摄像头（取协商后的宽高与行跨度，左右两路格式相同）
+ *   roi_*   - 预览源区域，roi_w/roi_h 为 0 表示整帧；超出帧的部分被裁掉，X/W 向下取偶
+ *
+ * 返回值:
+ *   0 成功，-1 内存不足
+ */
+int preview_geom_init(struct preview_geom *g, int fb_w, int fb_h, int quality,
+                      const struct cam_device *cam, int roi_x, int roi_y, int roi_w, int roi_h) {
+    memset(g, 0, sizeof(*g));
+    g->dst_w = fb_w / 2;                        // 每个摄像头占屏幕宽度的一半
+    g->dst_h = fb_h;                            // 全屏高度显示
+    g->quality = quality;
+    g->src_stride = (int)cam->bytesperline;
+
+    // ---------- 源区域：裁剪到帧内，宏像素对齐 ----------
+    int cw = (int)cam->width, ch = (int)cam->height;
+    if (roi_x < 0 || roi_x >= cw) roi_x = 0;
+    if (roi_y < 0 || roi_y >= ch) roi_y = 0;
+    if (roi_w <= 0 || roi_x + roi_w > cw) roi_w = cw - roi_x;
+    if (roi_h <= 0 || roi_y + roi_h > ch) roi_h = ch - roi_y;
+    g->roi_x = roi_x & ~1;
+    g->roi_w = (roi_w & ~1) < 2 ? 2 : (roi_w & ~1);
+    g->roi_y = roi_y;
+    g->roi_h = roi_h;
+    int sx = g->roi_x, sy = g->roi_y, sw = g->roi_w, sh = g->roi_h;
+
+    int w = g->dst_w, h = g->dst_h;
+    g->row0 = malloc(sizeof(unsigned short) * h);
+    g->pair = malloc(sizeof(unsigned short) * w);
+    if (!g->row0 || !g->pair) { preview_geom_free(g); return -1; }
+
+    // ---------- 最近邻：与原浮点映射一致 src = (int)(dst * 源尺寸 / 目标尺寸)，取偶数列 ----------
+    for (int x = 0; x < w; x++)
+        g->pair[x] = (unsigned short)((sx + x * sw / w) / 2);
+    for (int y = 0; y < h; y++)
+        g->row0[y] = (unsigned short)(sy + y * sh / h);
+
+    // ---------- 双线性：额外的相邻索引与权重 ----------
+    if (quality == PREVIEW_BILINEAR) {
+        g->row1 = malloc(sizeof(unsigned short) * h);
+        g->wy   = malloc(sizeof(unsigned short) * h);
+        g->lx0  = malloc(sizeof(unsigned short) * w);
+        g->lx1  = malloc(sizeof(unsigned short) * w);
+        g->wx   = malloc(sizeof(unsigned short) * w);
+        g->cx0  = malloc(sizeof(unsigned short) * w);
+        g->cx1  = malloc(sizeof(unsigned short) * w);
+        g->cwx  = malloc(sizeof(unsigned short) * w);
+        if (!g->row1 || !g->wy || !g->lx0 || !g->lx1 || !g->wx || !g->cx0 || !g->cx1 || !g->cwx) {
+            preview_geom_free(g);
+            return -1;
         }
-
-        // 将映射好的缓冲区重新放入输入队列，等待驱动采集数据填充
-        if (ioctl(*vfd, VIDIOC_QBUF, &buf) < 0) {
-            perror("VIDIOC_QBUF failed");
-            exit(1);
+        bilinear_axis(h, sh, g->row0, g->row1, g->wy);
+        bilinear_axis(w, sw, g->lx0, g->lx1, g->wx);
+        bilinear_axis(w, sw / 2, g->cx0, g->cx1, g->cwx);      // 色度为半水平分辨率
+        for (int y = 0; y < h; y++) { g->row0[y] += sy; g->row1[y] += sy; }
+        for (int x = 0; x < w; x++) {
+            g->lx0[x] += sx;     g->lx1[x] += sx;
+            g->cx0[x] += sx / 2; g->cx1[x] += sx / 2;
         }
     }
 
-    // ---------------------- 5. 启动视频流采集 ----------------------
-    enum v4l2_buf_type type = req.type;                      // 缓冲区类型
-    // VIDIOC_STREAMON 命令启动视频采集流
-    if (ioctl(*vfd, VIDIOC_STREAMON, &type) < 0) {
-        perror("VIDIOC_STREAMON failed");                    // 若失败，通常是驱动未准备好
-        exit(1);
-    }
-
-    // ---------------------- 6. 输出初始化结果 ----------------------
-    printf("[OK] Camera %s initialized (width=%d, height=%d, buffers=%d)\n",
-           dev, WIDTH, HEIGHT, req.count);
-
-    // 返回成功申请的缓冲区数量（通常为2）
-    return req.count;
+    printf("[INIT] Preview geometry %dx%d per half from %dx%d+%d+%d of %dx%d (%s)\n",
+           w, h, sw, sh, sx, sy, cw, ch, quality == PREVIEW_BILINEAR ? "bilinear" : "nearest");
+    return 0;
 }
 
+/**
+ * 函数名: preview_geom_free
+ * 功能描述: 释放映射表内存。
+ */
+void preview_geom_free(struct preview_geom *g) {
+    free(g->row0); free(g->row1); free(g->wy);
+    free(g->pair);
+    free(g->lx0); free(g->lx1); free(g->wx);
+    free(g->cx0); free(g->cx1); free(g->cwx);
+    memset(g, 0, sizeof(*g));
+}
 
 /**
  * 函数名: draw_on_lcd
@@ -400,83 +1753,411 @@ int init_camera(const char *dev, struct buffer *bufs, int *vfd) {
  *   支持左右分屏显示（左、右摄像头各占半屏）。
  *
  * 输入参数:
- *   fb        - LCD帧缓冲首地址（/dev/fb0 映射得到的内存起始地址）
- *   stride    - 每行字节跨度（等于 finfo.line_length）
- *   fb_w      - LCD 屏幕宽度（例如 800）
- *   fb_h      - LCD 屏幕高度（例如 480）
+ *   fb        - 目标页首地址（fb_presenter_page() 返回的后台页，单页时即显存起始地址）
+ *   stride    - 每行字节跨度（等于 fb_fix_screeninfo.line_length）
+ *   g         - 预先构建的分屏映射表（preview_geom_init）
  *   yuyv      - 摄像头采集的 YUYV 格式图像帧缓冲指针
  *   x_offset  - 横向偏移像素（用于分屏显示）
  *               例如: 左摄像头 x_offset = 0, 右摄像头 x_offset = fb_w / 2
  *
  * 工作原理:
  *   1. 每两个像素由4字节(Y0,U,Y1,V)组成，U/V分量共用；
- *   2. 函数计算目标显示尺寸(半屏)，并做比例缩放；
- *   3. 遍历每个目标像素点，根据映射位置取对应源像素；
- *   4. 按 YUV→RGB 标准公式转换；
- *   5. 拼装 ARGB8888 格式像素写入 framebuffer；
- *   6. LCD 控制器自动刷新显示。
+ *   2. 目标像素到源像素的映射全部来自映射表，内循环只做查表取数；
+ *   3. 只访问映射表指向的源像素（抽样），开销与屏幕尺寸成正比，与采集分辨率无关；
+ *      最近邻：按列表取出 YUYV 宏像素，NEON 每次转换 8 个像素，剩余像素走标量；
+ *      双线性：相邻两行、两列的亮度与色度按定点权重插值后再转换；
+ *   4. 按 YUV→RGB 标准公式转换，拼装 ARGB8888 格式像素写入 framebuffer；
+ *   5. LCD 控制器自动刷新显示。
  *
  * 注意事项:
  *   - framebuffer 通常是 32 位色深 (ARGB8888)，高字节为 Alpha 通道；
  *   - 左右分屏同时显示时，必须保证左右图像不会越界；
- *   - 若显示比例不一致，可调整 scale_x / scale_y；
  *   - LCD 的实际刷新频率由内核 framebuffer 驱动控制。
  */
-void draw_on_lcd(unsigned int *fb, int stride, int fb_w, int fb_h, void *yuyv, int x_offset) {
-    // ---------------------- 1. 计算目标显示尺寸 ----------------------
-    int target_w = fb_w / 2;                        // 每个摄像头占屏幕宽度的一半
-    int target_h = fb_h;                            // 全屏高度显示
-    float scale_x = (float)WIDTH / target_w;        // 横向缩放比例 (例如 640/400 = 1.6)
-    float scale_y = (float)HEIGHT / target_h;       // 纵向缩放比例 (例如 480/480 = 1.0)
-
-    // ---------------------- 2. YUYV 数据指针初始化 ----------------------
-    unsigned char *p = (unsigned char *)yuyv;       // 摄像头原始帧缓冲
-
-    // ---------------------- 3. 按行扫描绘制 ----------------------
-    for (int y = 0; y < target_h; y++) {
-        // 计算当前 LCD 行在 framebuffer 中的首地址
-        unsigned int *row = (unsigned int *)((unsigned char *)fb + y * stride);
-
-        for (int x = 0; x < target_w; x++) {
-            // ----------- 3.1 映射源像素坐标（带缩放） -----------
-            int src_x = (int)(x * scale_x);          // 映射后的原图像 X 坐标
-            int src_y = (int)(y * scale_y);          // 映射后的原图像 Y 坐标
-            if (src_x % 2 != 0) src_x--;             // 保证偶数列，U/V 对齐正确（每2像素共享U/V）
-            int idx = (src_y * WIDTH + src_x) * 2;   // 计算源图像中该像素的字节偏移量
-
-            // ----------- 3.2 提取YUV分量 -----------
-            int y0 = p[idx];                         // 当前像素亮度分量Y
-            int u  = p[idx + 1];                     // 蓝色色度分量U
-            int v  = p[idx + 3];                     // 红色色度分量V
-            int c = y0 - 16;                         // 去除偏移 (标准YUV偏移)
-            int d = u - 128;
-            int e = v - 128;
-
-            // ----------- 3.3 YUV→RGB颜色空间转换 (BT.601标准) -----------
-            int r = (298 * c + 409 * e + 128) >> 8;  // R = 1.164*(Y-16) + 1.596*(V-128)
-            int g = (298 * c - 100 * d - 208 * e + 128) >> 8;  // G = 1.164*(Y-16) - 0.392*(U-128) - 0.813*(V-128)
-            int b = (298 * c + 516 * d + 128) >> 8;  // B = 1.164*(Y-16) + 2.017*(U-128)
-
-            // ----------- 3.4 限幅操作，确保RGB在[0,255]范围内 -----------
-            r = (r > 255) ? 255 : (r < 0 ? 0 : r);
-            g = (g > 255) ? 255 : (g < 0 ? 0 : g);
-            b = (b > 255) ? 255 : (b < 0 ? 0 : b);
-
-            // ----------- 3.5 组装 ARGB8888 像素并写入帧缓冲 -----------
-            // LCD通常使用32位色深，每像素4字节: A(8) R(8) G(8) B(8)
-            // Alpha通道设为0xFF表示不透明。
-            row[x + x_offset] = (0xFF << 24) | (r << 16) | (g << 8) | b;
+void draw_on_lcd(unsigned int *fb, int stride, const struct preview_geom *g, void *yuyv, int x_offset) {
+    const unsigned char *p = (const unsigned char *)yuyv;   // 摄像头原始帧缓冲
+
+    for (int y = 0; y < g->dst_h; y++) {
+        // 当前 LCD 行在 framebuffer 中的首地址
+        unsigned int *row = (unsigned int *)((unsigned char *)fb + y * stride) + x_offset;
+        int x = 0;
+
+        if (g->quality == PREVIEW_BILINEAR) {
+            // ----------- 双线性：两行加权 -----------
+            const unsigned char *r0 = p + g->row0[y] * g->src_stride;
+            const unsigned char *r1 = p + g->row1[y] * g->src_stride;
+            int wy = g->wy[y], iy = 256 - wy;
+            for (; x < g->dst_w; x++) {
+                int l0 = g->lx0[x] * 2, l1 = g->lx1[x] * 2, wx = g->wx[x], ix = 256 - wx;
+                int c0 = g->cx0[x] * 4, c1 = g->cx1[x] * 4, cw = g->cwx[x], ic = 256 - cw;
+                int yy = ((r0[l0] * ix + r0[l1] * wx) * iy + (r1[l0] * ix + r1[l1] * wx) * wy + 32768) >> 16;
+                int uu = ((r0[c0 + 1] * ic + r0[c1 + 1] * cw) * iy + (r1[c0 + 1] * ic + r1[c1 + 1] * cw) * wy + 32768) >> 16;
+                int vv = ((r0[c0 + 3] * ic + r0[c1 + 3] * cw) * iy + (r1[c0 + 3] * ic + r1[c1 + 3] * cw) * wy + 32768) >> 16;
+                row[x] = yuv_to_argb(yy, uu, vv);
+            }
+            continue;
+        }
+
+        const uint32_t *line = (const uint32_t *)(p + g->row0[y] * g->src_stride);
+#if USE_NEON
+        // ----------- 最近邻 NEON：每次取 8 个宏像素并转换 -----------
+        uint32_t gather[8] __attribute__((aligned(16)));
+        for (; x + 8 <= g->dst_w; x += 8) {
+            for (int k = 0; k < 8; k++)
+                gather[k] = line[g->pair[x + k]];
+            neon_yuv_to_argb8((const uint8_t *)gather, row + x);
+        }
+#endif
+        // ----------- 最近邻标量：剩余像素（或未启用 NEON 时的全部像素） -----------
+        for (; x < g->dst_w; x++) {
+            const unsigned char *q = (const unsigned char *)&line[g->pair[x]];
+            row[x] = yuv_to_argb(q[0], q[1], q[3]);
         }
     }
 }
 
 
+/**
+ * 函数名: fb_presenter_init
+ * 功能描述:
+ *   打开 framebuffer，尝试把虚拟高度设为 2 倍屏高以启用双页翻转，
+ *   并探测 FBIO_WAITFORVSYNC 是否可用，最后映射整块显存。
+ *
+ * 返回值:
+ *   0 成功，-1 失败（设备打开 / 参数查询 / 映射失败）
+ */
+int fb_presenter_init(struct fb_presenter *p, const char *dev) {
+    memset(p, 0, sizeof(*p));
+    p->fd = open(dev, O_RDWR | O_CLOEXEC);
+    if (p->fd < 0) {
+        perror("open fb0");
+        return -1;
+    }
+    if (ioctl(p->fd, FBIOGET_VSCREENINFO, &p->var) < 0 ||
+        ioctl(p->fd, FBIOGET_FSCREENINFO, &p->fix) < 0) {
+        perror("FBIOGET_SCREENINFO");
+        close(p->fd);
+        return -1;
+    }
+
+    // ---------- 1. 尝试双页：显存足够且驱动接受 2 倍虚拟高度 ----------
+    p->pages = 1;
+    if (p->fix.smem_len >= (unsigned int)p->fix.line_length * p->var.yres * 2) {
+        struct fb_var_screeninfo v = p->var;
+        v.yres_virtual = v.yres * 2;
+        v.yoffset = 0;
+        if (ioctl(p->fd, FBIOPUT_VSCREENINFO, &v) == 0 &&
+            ioctl(p->fd, FBIOGET_VSCREENINFO, &v) == 0 && v.yres_virtual >= v.yres * 2) {
+            p->var = v;
+            p->pages = 2;
+            ioctl(p->fd, FBIOGET_FSCREENINFO, &p->fix);   // 行长度 / 显存大小可能随之变化
+        }
+    }
+    p->back = p->pages == 2 ? 1 : 0;                      // 当前显示第 0 页，先画第 1 页
+
+    // ---------- 2. 探测垂直同步等待 ----------
+    __u32 crtc = 0;
+    p->vsync = ioctl(p->fd, FBIO_WAITFORVSYNC, &crtc) == 0;
+
+    // ---------- 3. 映射显存 ----------
+    p->mem = mmap(NULL, p->fix.smem_len, PROT_READ | PROT_WRITE, MAP_SHARED, p->fd, 0);
+    if (p->mem == MAP_FAILED) {
+        perror("mmap fb");
+        close(p->fd);
+        return -1;
+    }
+    printf("[INIT] LCD framebuffer mapped. Resolution: %dx%d, %s, vsync %s\n",
+           p->var.xres, p->var.yres, p->pages == 2 ? "page flipping" : "single buffer",
+           p->vsync ? "on" : "off");
+    return 0;
+}
+
+/**
+ * 函数名: fb_presenter_page
+ * 功能描述: 返回下一帧应绘制的页（双页时为不可见的后台页）首地址。
+ */
+unsigned int *fb_presenter_page(const struct fb_presenter *p) {
+    return (unsigned int *)(p->mem + (size_t)p->back * p->var.yres * p->fix.line_length);
+}
+
+/**
+ * 函数名: fb_presenter_flip
+ * 功能描述:
+ *   呈现刚绘制完的页：双页时 FBIOPAN_DISPLAY 切换显示页，
+ *   再等待垂直同步，确保切换已生效、旧的前台页不再被扫描，之后才能在其上绘制下一帧。
+ *   单页时只等待垂直同步（用于节拍）。
+ */
+void fb_presenter_flip(struct fb_presenter *p) {
+    if (p->pages == 2) {
+        p->var.yoffset = p->back * p->var.yres;
+        if (ioctl(p->fd, FBIOPAN_DISPLAY, &p->var) < 0) {
+            perror("FBIOPAN_DISPLAY, falling back to single buffer");
+            p->pages = 1;
+            p->var.yoffset = 0;
+            ioctl(p->fd, FBIOPAN_DISPLAY, &p->var);
+            p->back = 0;
+            return;
+        }
+        p->back ^= 1;
+    }
+    if (p->vsync) {
+        __u32 crtc = 0;
+        if (ioctl(p->fd, FBIO_WAITFORVSYNC, &crtc) < 0) p->vsync = 0;
+    }
+}
+
+/**
+ * 函数名: fb_presenter_close
+ * 功能描述: 切回第 0 页并释放显存映射。
+ */
+void fb_presenter_close(struct fb_presenter *p) {
+    if (p->pages == 2) {
+        p->var.yoffset = 0;
+        ioctl(p->fd, FBIOPAN_DISPLAY, &p->var);
+    }
+    munmap(p->mem, p->fix.smem_len);
+    close(p->fd);
+    memset(p, 0, sizeof(*p));
+}
+
+
+#if USE_RGA
+/*
+ * RGA 预览状态：摄像头缓冲与 framebuffer 事先导入 RGA，
+ * 每帧只需一次 improcess() 完成 YUYV→BGRA（即小端 ARGB8888）转换与缩放，直接写入 LCD 对应半屏。
+ */
+struct rga_preview {
+    int ok;                                   // 1 = 全部缓冲导入成功，可使用 RGA
+    rga_buffer_handle_t fb;                   // framebuffer 句柄
+    int fb_wstride, fb_h;                     // framebuffer 行跨度（像素）与虚拟高度（含全部页）
+    int page_h;                               // 每页高度（屏高）
+    int src_w, src_h, src_wstride;            // 摄像头帧尺寸与行跨度（像素）
+    rga_buffer_handle_t cam[2][CAM_MAX_BUFFERS];  // [摄像头][缓冲序号]
+};
+
+/**
+ * 函数名: rga_preview_init
+ * 功能描述:
+ *   将 framebuffer（虚拟地址）与两路摄像头的全部 DMABUF 缓冲（cam_open 时 EXPBUF 导出）导入 RGA。
+ *   任一缓冲导入失败则 ok=0，调用方继续使用 CPU 绘制。
+ */
+static void rga_preview_init(struct rga_preview *r, const struct fb_presenter *fbp,
+                             struct cam_device *left, struct cam_device *right) {
+    memset(r, 0, sizeof(*r));
+    r->fb_wstride = fbp->fix.line_length / 4;
+    r->page_h = fbp->var.yres;
+    r->fb_h = fbp->var.yres * fbp->pages;
+    r->src_w = (int)left->width;
+    r->src_h = (int)left->height;
+    r->src_wstride = (int)left->bytesperline / 2;
+    r->fb = importbuffer_virtualaddr(fbp->mem, (int)fbp->fix.smem_len);
+    if (!r->fb) {
+        fprintf(stderr, "[RGA] import framebuffer failed, using CPU preview\n");
+        return;
+    }
+    struct cam_device *cams[2] = { left, right };
+    for (int c = 0; c < 2; c++) {
+        for (unsigned int i = 0; i < cams[c]->count; i++) {
+            const struct cam_frame *f = &cams[c]->frames[i];
+            if (f->dma_fd < 0 || !(r->cam[c][i] = importbuffer_fd(f->dma_fd, (int)f->length))) {
+                fprintf(stderr, "[RGA] import camera buffer failed, using CPU preview\n");
+                return;
+            }
+        }
+    }
+    r->ok = 1;
+    printf("[INIT] RGA preview enabled.\n");
+}
+
+/**
+ * 函数名: rga_preview_release
+ * 功能描述: 释放导入 RGA 的全部缓冲句柄。
+ */
+static void rga_preview_release(struct rga_preview *r) {
+    for (int c = 0; c < 2; c++)
+        for (int i = 0; i < CAM_MAX_BUFFERS; i++)
+            if (r->cam[c][i]) releasebuffer_handle(r->cam[c][i]);
+    if (r->fb) releasebuffer_handle(r->fb);
+    memset(r, 0, sizeof(*r));
+}
+
+/**
+ * 函数名: rga_draw_on_lcd
+ * 功能描述:
+ *   用 RGA 将第 cam 路摄像头的第 index 个缓冲转换并缩放到 LCD 第 page 页的 [x_offset, x_offset+dst_w) 区域。
+ *   颜色转换采用 BT.601 有限范围，与 CPU 路径公式一致。
+ *
+ * 返回值:
+ *   0 成功，-1 失败（调用方可改用 draw_on_lcd）
+ */
+static int rga_draw_on_lcd(const struct rga_preview *r, int cam, int index, int page,
+                           const struct preview_geom *g, int x_offset) {
+    rga_buffer_t src = wrapbuffer_handle_t(r->cam[cam][index], r->src_w, r->src_h,
+                                           r->src_wstride, r->src_h, RK_FORMAT_YUYV_422);
+    rga_buffer_t dst = wrapbuffer_handle_t(r->fb, r->fb_wstride, r->fb_h, r->fb_wstride, r->fb_h,
+                                           RK_FORMAT_BGRA_8888);
+    rga_buffer_t pat;
+    memset(&pat, 0, sizeof(pat));
+    im_rect srect = { g->roi_x, g->roi_y, g->roi_w, g->roi_h };
+    im_rect drect = { x_offset, page * r->page_h, g->dst_w, g->dst_h };
+    im_rect prect = { 0, 0, 0, 0 };
+    dst.color_space_mode = IM_YUV_TO_RGB_BT601_LIMIT;
+
+    IM_STATUS st = improcess(src, dst, pat, srect, drect, prect, IM_SYNC);
+    if (st != IM_STATUS_SUCCESS) {
+        fprintf(stderr, "[RGA] improcess: %s\n", imStrError(st));
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+
+// 一对帧的代表时刻：左右时间戳的中点
+static long long pair_ts(const struct cam_frame *a, const struct cam_frame *b)
+{
+    return (a->ts_us + b->ts_us) / 2;
+}
+
+#if USE_MPP
+static struct video_recorder g_rec[2];           // 左右录像（running=0 表示未在录像）
+#endif
+
+// 录像队列持有的帧数（左右取较大者）；未录像时为 0
+static int record_in_flight(void)
+{
+#if USE_MPP
+    if (!g_rec[0].running) return 0;
+    int a = RECORD_QUEUE_LEN - video_recorder_space(&g_rec[0]);
+    int b = RECORD_QUEUE_LEN - video_recorder_space(&g_rec[1]);
+    return a > b ? a : b;
+#else
+    return 0;
+#endif
+}
+
+static struct raw_recorder g_raw;                // 原始录制（running=0 表示未在录制）
+
+// 原始录制队列持有的帧对数；未录制时为 0
+static int raw_in_flight(void)
+{
+    return g_raw.running ? RAW_QUEUE_LEN - raw_recorder_space(&g_raw) : 0;
+}
+
+// 拍照、录像与原始录制队列合计持有的帧数，不超过 ENCODE_QUEUE_LEN 才能保证驱动始终有空闲缓冲
+static int encode_in_flight(struct jpeg_worker *l, struct jpeg_worker *r)
+{
+    int a = ENCODE_QUEUE_LEN - jpeg_worker_space(l);
+    int b = ENCODE_QUEUE_LEN - jpeg_worker_space(r);
+    return (a > b ? a : b) + record_in_flight() + raw_in_flight();
+}
+
+/**
+ * 函数名: record_toggle
+ * 功能描述:
+ *   开始或停止双路录像。开始时在配置项 record_folder 下按当前时间命名一组文件
+ *   （rec_YYYYmmdd_HHMMSS_left/right.h264 + .pts），任一路启动失败则两路都不录。
+ *   未启用 USE_MPP 时只打印提示。
+ */
+static void record_toggle(const struct cam_device *left, const struct cam_device *right)
+{
+#if USE_MPP
+    if (g_rec[0].running) {
+        video_recorder_stop(&g_rec[0]);
+        video_recorder_stop(&g_rec[1]);
+        return;
+    }
+    if (mkdir(g_cfg.record_folder, 0755) != 0 && errno != EEXIST) {
+        perror(g_cfg.record_folder);
+        return;
+    }
+    char stamp[32], prefix[2][256];
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(stamp, sizeof(stamp), "rec_%Y%m%d_%H%M%S", &tm);
+    snprintf(prefix[0], sizeof(prefix[0]), "%s/%s_left", g_cfg.record_folder, stamp);
+    snprintf(prefix[1], sizeof(prefix[1]), "%s/%s_right", g_cfg.record_folder, stamp);
+    if (video_recorder_start(&g_rec[0], "Left", left, prefix[0]) != 0 ||
+        video_recorder_start(&g_rec[1], "Right", right, prefix[1]) != 0) {
+        video_recorder_stop(&g_rec[0]);
+        video_recorder_stop(&g_rec[1]);
+    }
+#else
+    (void)left;
+    (void)right;
+    fprintf(stderr, "[REC] Recording needs a build with -DUSE_MPP=1\n");
+#endif
+}
+
+// 录像中：把新到的一对帧投递给左右编码器，两路都能接收才投递，否则两路同时丢弃
+static void record_feed(struct cam_frame *f1, struct cam_frame *f2,
+                        struct jpeg_worker *l, struct jpeg_worker *r)
+{
+#if USE_MPP
+    if (!g_rec[0].running) return;
+    if (video_recorder_space(&g_rec[0]) > 0 && video_recorder_space(&g_rec[1]) > 0 &&
+        encode_in_flight(l, r) < ENCODE_QUEUE_LEN) {
+        video_recorder_submit(&g_rec[0], f1);
+        video_recorder_submit(&g_rec[1], f2);
+    } else {
+        g_rec[0].dropped++;
+        g_rec[1].dropped++;
+    }
+#else
+    (void)f1; (void)f2; (void)l; (void)r;
+#endif
+}
+
+/**
+ * 函数名: raw_toggle
+ * 功能描述:
+ *   开始或停止原始录制。输出为配置项 raw_path；为空时在 record_folder 下按当前时间命名
+ *   （raw_YYYYmmdd_HHMMSS.sdump）。
+ */
+static void raw_toggle(const struct cam_device *left, const struct cam_device *right)
+{
+    if (g_raw.running) {
+        raw_recorder_stop(&g_raw);
+        return;
+    }
+    char path[CFG_STR_LEN + 64];
+    if (g_cfg.raw_path[0]) {
+        snprintf(path, sizeof(path), "%s", g_cfg.raw_path);
+    } else {
+        if (mkdir(g_cfg.record_folder, 0755) != 0 && errno != EEXIST) {
+            perror(g_cfg.record_folder);
+            return;
+        }
+        char stamp[32];
+        time_t now = time(NULL);
+        struct tm tm;
+        localtime_r(&now, &tm);
+        strftime(stamp, sizeof(stamp), "raw_%Y%m%d_%H%M%S", &tm);
+        snprintf(path, sizeof(path), "%s/%s.sdump", g_cfg.record_folder, stamp);
+    }
+    raw_recorder_start(&g_raw, left, right, path);
+}
+
+// 原始录制中：投递新到的一对帧；队列满或缓冲预算用尽时丢弃（记录序号仍递增，回放可见缺口）
+static void raw_feed(struct cam_frame *f1, struct cam_frame *f2,
+                     struct jpeg_worker *l, struct jpeg_worker *r)
+{
+    if (!g_raw.running) return;
+    unsigned seq = g_raw.offered++;
+    if (g_raw.failed || encode_in_flight(l, r) >= ENCODE_QUEUE_LEN ||
+        raw_recorder_submit(&g_raw, f1, f2, seq) != 0)
+        g_raw.dropped++;
+}
+
+
 /**
  * 函数名: event_listener
  * 功能描述:
  *   该函数运行于独立线程中，用于监听 Linux 输入事件设备（/dev/input/event1）。
- *   一旦检测到按键按下事件 (EV_KEY + value=1)，则将全局变量 photo_flag 置为 1，
- *   通知主线程执行拍照逻辑。
+ *   一旦检测到按键按下事件 (EV_KEY + value=1)，则把按键时间戳与键值
+ *   压入无锁队列 g_press，并写 key_event_fd 唤醒正在 poll 的主线程。
+ *   主线程按时间戳为每次按键挑选最接近按下时刻的一对帧。
  *
  * 工作原理:
  *   Linux 输入子系统会将所有键盘、按钮、触摸屏等输入设备统一抽象为 /dev/input/eventX。
@@ -496,7 +2177,9 @@ void draw_on_lcd(unsigned int *fb, int stride, int fb_w, int fb_h, void *yuyv, i
  *   - 该函数为常驻线程，不会主动退出；
  *   - 输入设备路径必须正确（常见为 /dev/input/event1）；
  *   - 若按键为 GPIO 键，需确认驱动已注册到 input 子系统；
- *   - photo_flag 为全局变量，应设为 volatile 以防编译优化错误；
+ *   - 事件时钟切换为 CLOCK_MONOTONIC（EVIOCSCLOCKID），与摄像头帧时间戳可直接比较；
+ *     内核不支持时退回 CLOCK_REALTIME，此时按键时刻以读取时的单调时间近似；
+ *   - 连续按键超过 PRESS_QUEUE_LEN 未处理时，多出的按键被丢弃并计数；
  *   - 若系统中有多个输入设备，可用 "cat /proc/bus/input/devices" 查看对应编号。
  */
 
@@ -504,12 +2187,18 @@ void *event_listener(void *arg) {
     // ---------------------- 1. 打开输入设备 ----------------------
     // O_RDONLY：只读模式打开输入事件文件，例如 /dev/input/event1。
     // 成功返回文件描述符，失败返回 -1。
-    int fd = open(INPUT_DEVICE, O_RDONLY);
+    int fd = open(g_cfg.input_device, O_RDONLY);
     if (fd < 0) {                                   // 打开失败则立即退出程序
         perror("open input device failed");
         exit(1);
     }
-    printf("[INIT] Listening for key events on %s ...\n", INPUT_DEVICE);
+    printf("[INIT] Listening for key events on %s ...\n", g_cfg.input_device);
+
+    // 事件时间戳改用单调时钟，与 V4L2 帧时间戳处于同一时间轴
+    int clk = CLOCK_MONOTONIC;
+    int mono = ioctl(fd, EVIOCSCLOCKID, &clk) == 0;
+    if (!mono)
+        perror("[WARN] EVIOCSCLOCKID");
 
     // ---------------------- 2. 定义输入事件结构 ----------------------
     // 每个 input_event 结构包含一个输入事件的信息：
@@ -526,7 +2215,24 @@ void *event_listener(void *arg) {
         if (ev.type == EV_KEY) {                    // 仅处理按键类事件
             // value == 1 表示“按下”；0 表示“释放”；2 表示“长按”
             if (ev.value == 1) {
-                photo_flag = 1;                     // 设置全局拍照标志位
+                struct key_press k;
+                if (mono) {
+                    k.ts_us = (long long)ev.time.tv_sec * 1000000 + ev.time.tv_usec;
+                } else {
+                    struct timespec now;
+                    clock_gettime(CLOCK_MONOTONIC, &now);
+                    k.ts_us = (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+                }
+                k.code = ev.code;
+                if (press_queue_push(&g_press, &k) != 0) {   // 主循环来不及处理
+                    g_press.dropped++;
+                    fprintf(stderr, "[KEY] Press queue full, press dropped (%u total)\n",
+                            g_press.dropped);
+                    continue;
+                }
+                uint64_t one = 1;
+                if (write(key_event_fd, &one, sizeof(one)) < 0)   // 唤醒主循环
+                    perror("write key eventfd");
                 printf("[KEY] Button pressed (code=%d, time=%ld.%06ld)\n",
                        ev.code, ev.time.tv_sec, ev.time.tv_usec);
             }
@@ -552,10 +2258,15 @@ void *event_listener(void *arg) {
  *   运行流程如下：
  *     1. 清空历史照片文件；
  *     2. 打开LCD帧缓冲设备并建立内存映射；
- *     3. 初始化左右摄像头（/dev/video21, /dev/video23）；
+ *     3. 初始化左右摄像头（/dev/video21, /dev/video23，共享模块 v4l2_camera.h）；
  *     4. 创建独立线程监听按键输入；
  *     5. 主循环中实时采集图像并显示；
- *     6. 检测到按键事件后执行双目同步拍照并保存JPEG文件。
+ *     6. 检测到按键事件后，把刚显示的同一对帧交给左右 JPEG 工作线程保存。
+ *
+ * 帧共享:
+ *   每对帧出队后由预览与拍照共同使用（引用计数），不额外拷贝或再次 DQBUF，
+ *   全部消费者释放后缓冲才回到驱动队列。编码在工作线程中进行，
+ *   预览不停顿；连续按键最多排队 ENCODE_QUEUE_LEN 对帧。
  *
  * 系统依赖:
  *   - LCD 显示设备: /dev/fb0 (分辨率800×480)
@@ -568,142 +2279,222 @@ void *event_listener(void *arg) {
  *
  * 注意事项:
  *   - 必须先加载摄像头驱动 (v4l2 模块)；
- *   - 摄像头与LCD分辨率不同，draw_on_lcd() 自动缩放；
- *   - 主循环采用 30ms 延时 (约33fps)，保持流畅预览；
- *   - 按键事件通过全局变量 photo_flag 进行线程间通信。
+ *   - 摄像头与LCD分辨率不同，draw_on_lcd() 按 preview_geom 映射表自动缩放（preview_quality 选择质量）；
+ *     采集分辨率（cap_width/cap_height，决定照片尺寸）与预览解耦，preview_roi_* 可只预览局部；
+ *   - 参数来自配置文件与命令行（见文件头"运行参数"），非法参数直接退出；
+ *   - 预览画到后台页后翻页并等待垂直同步（无撕裂，节奏跟随屏幕刷新）；
+ *     驱动不支持时退化为单页绘制；
+ *   - 按键事件（带时间戳）经无锁队列 g_press 传给主循环，eventfd 负责唤醒；
+ *     每次按键保存时间上最接近按下时刻的一对帧，连按不会合并；
+ *   - 主循环只阻塞在 poll()（两路摄像头 + 按键 eventfd），没有固定延时：
+ *     帧到达即显示，按键到达即拍照。
  */
 
-int main() {
+int main(int argc, char **argv) {
     // ============================================================
-    // 1. 初始化阶段：清空历史照片目录
+    // 1. 初始化阶段：读取配置，清空历史照片目录
     // ============================================================
-    clear_jpg_files(LEFT_FOLDER);                  // 清空 /root/left 下的旧 .jpg 文件
-    clear_jpg_files(RIGHT_FOLDER);                 // 清空 /root/right 下的旧 .jpg 文件
+    int cfg_rc = cfg_parse_args(g_cfg_opts, CFG_COUNT(g_cfg_opts), argc, argv, CONFIG_FILE);
+    if (cfg_rc != 0) return cfg_rc > 0 ? 0 : 1;
+    if (g_cfg.cap_width <= 0 || g_cfg.cap_width % 16 != 0 || g_cfg.cap_height <= 0) {
+        fprintf(stderr, "[CFG] cap_width must be a positive multiple of 16, cap_height positive\n");
+        return 1;
+    }
+    if (g_cfg.jpeg_backend < JPEG_BACKEND_LIBJPEG || g_cfg.jpeg_backend > JPEG_BACKEND_MPP)
+        g_cfg.jpeg_backend = JPEG_BACKEND_LIBJPEG;
+
+    clear_jpg_files(g_cfg.left_folder);            // 清空 /root/left 下的旧 .jpg 文件
+    clear_jpg_files(g_cfg.right_folder);           // 清空 /root/right 下的旧 .jpg 文件
     printf("[INIT] Old photos cleared. Press the button to take a photo.\n");
 
     // ============================================================
     // 2. 打开 LCD 帧缓冲设备 (/dev/fb0)
     // ============================================================
-    int fb_fd = open("/dev/fb0", O_RDWR);          // 以读写模式打开 LCD 设备
-    if (fb_fd < 0) {                               // 打开失败直接退出
-        perror("open fb0");
-        exit(1);
-    }
-
-    // 定义两个结构体用于获取 LCD 参数：
-    struct fb_var_screeninfo vinfo;                // 可变参数 (分辨率、颜色深度)
-    struct fb_fix_screeninfo finfo;                // 固定参数 (行长度、显存大小)
-    ioctl(fb_fd, FBIOGET_VSCREENINFO, &vinfo);     // 获取屏幕分辨率等信息
-    ioctl(fb_fd, FBIOGET_FSCREENINFO, &finfo);     // 获取帧缓冲长度与布局信息
+    // 呈现器负责映射显存、双页翻转与垂直同步（不支持时退化为单页）
+    struct fb_presenter fbp;
+    if (fb_presenter_init(&fbp, "/dev/fb0") != 0) exit(1);
+    const struct fb_var_screeninfo *vinfo = &fbp.var;   // 屏幕分辨率等信息
+    int line_length = fbp.fix.line_length;              // 每行字节跨度
 
-    // 使用 mmap() 将帧缓冲映射到用户空间，便于直接写入像素数据
-    unsigned int *fb_mem = (unsigned int *)mmap(
-            0, finfo.smem_len, PROT_READ | PROT_WRITE, MAP_SHARED, fb_fd, 0);
-    if (fb_mem == MAP_FAILED) { perror("mmap fb"); exit(1); }
-
-    printf("[INIT] LCD framebuffer mapped. Resolution: %dx%d\n", vinfo.xres, vinfo.yres);
 
     // ============================================================
     // 3. 初始化双摄像头设备 (/dev/video21 & /dev/video23)
     // ============================================================
-    struct buffer buf1[2], buf2[2];                // 每个摄像头分配两个缓冲区用于循环采集
-    int vfd1, vfd2;                                // 摄像头文件描述符
-    init_camera(CAM_LEFT, buf1, &vfd1);            // 初始化左摄像头
-    init_camera(CAM_RIGHT, buf2, &vfd2);           // 初始化右摄像头
+    struct cam_device cam1, cam2;                  // 左右摄像头（帧缓冲与 DMABUF 由共享模块管理）
+    static const unsigned int cam_formats[] = { V4L2_PIX_FMT_YUYV, 0 };
+    struct cam_params cp;
+    memset(&cp, 0, sizeof(cp));
+    cp.width = g_cfg.cap_width;
+    cp.height = g_cfg.cap_height;
+    cp.formats = cam_formats;
+    cp.count = CAM_BUFFERS;
+    cp.fps = g_cfg.cam_fps < 0 ? CAM_FPS_MAX : (unsigned int)g_cfg.cam_fps;
+    cp.flags = CAM_EXACT_SIZE;
+    if (cam_open_ex(&cam1, g_cfg.cam_left, &cp) != 0 || cam_open_ex(&cam2, g_cfg.cam_right, &cp) != 0)
+        exit(1);
+    // 固定曝光 / 增益（左右一致，避免自动曝光各自漂移、拖慢帧率）
+    if (g_cfg.exposure >= 0 || g_cfg.gain >= 0) {
+        cam_set_exposure(&cam1, NULL, g_cfg.exposure, g_cfg.gain);
+        cam_set_exposure(&cam2, NULL, g_cfg.exposure, g_cfg.gain);
+    }
     printf("[INIT] Both cameras initialized.\n");
 
+    // 构建分屏预览映射表（屏幕与采集格式固定，之后每帧只查表）
+    struct preview_geom geom;
+    if (preview_geom_init(&geom, vinfo->xres, vinfo->yres, g_cfg.preview_quality, &cam1,
+                          g_cfg.roi_x, g_cfg.roi_y, g_cfg.roi_w, g_cfg.roi_h) != 0) {
+        fprintf(stderr, "preview_geom_init: out of memory\n");
+        exit(1);
+    }
+
+#if USE_RGA
+    // 尝试启用 RGA 硬件预览（失败时自动回退到 CPU 绘制）
+    struct rga_preview rga;
+    rga_preview_init(&rga, &fbp, &cam1, &cam2);
+#endif
+
+    // 左右帧按驱动时间戳配对（两路由 poll 并行等待）
+    struct cam_stereo sync;
+    cam_stereo_init(&sync, &cam1, &cam2, g_cfg.stereo_sync_us);
+
     // ============================================================
     // 4. 创建独立线程监听按键事件 (/dev/input/event1)
     // ============================================================
+    key_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (key_event_fd < 0) {
+        perror("eventfd");
+        exit(1);
+    }
+    sync.wake_fd = key_event_fd;                   // 等帧的同时等待按键
     pthread_t tid;
     pthread_create(&tid, NULL, event_listener, NULL);
     printf("[INIT] Key listener thread started.\n");
 
+    // 左右 JPEG 编码工作线程
+    struct jpeg_worker enc_left, enc_right;
+    if (jpeg_worker_start(&enc_left, "Left", g_cfg.left_folder, &cam1) != 0 ||
+        jpeg_worker_start(&enc_right, "Right", g_cfg.right_folder, &cam2) != 0)
+        exit(1);
+    if (g_cfg.raw_autostart) raw_toggle(&cam1, &cam2);
+
     // ============================================================
     // 5. 进入主循环：实时显示 + 拍照逻辑
     // ============================================================
     int photo_idx = 0;                             // 拍照编号计数器
+    struct cam_frame *last1 = NULL, *last2 = NULL; // 最近显示的一对帧（拍照时直接使用）
     while (1) {
         // --------------------------------------------------------
-        // 5.1 从左右摄像头取出一帧视频数据
+        // 5.1 poll 等待：时间戳匹配的一对左右帧，或按键事件
+        //     两路同时排空，单路积压或无搭档的旧帧直接归还驱动
         // --------------------------------------------------------
-        struct v4l2_buffer b1 = {
-                .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
-                .memory = V4L2_MEMORY_MMAP
-        };
-        struct v4l2_buffer b2 = {
-                .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
-                .memory = V4L2_MEMORY_MMAP
-        };
-
-        // VIDIOC_DQBUF：从视频输入队列取出一个填充完成的缓冲区
-        if (ioctl(vfd1, VIDIOC_DQBUF, &b1) == 0 &&
-            ioctl(vfd2, VIDIOC_DQBUF, &b2) == 0) {
-
+        struct cam_frame *f1, *f2;
+        int ret = cam_stereo_next(&sync, &f1, &f2, g_cfg.stereo_wait_ms);
+        if (ret == 0) {
             // --------------------------------------------------------
-            // 5.2 将两路图像分别绘制到 LCD 左右半屏
+            // 5.2 将两路图像分别绘制到后台页的左右半屏
             // --------------------------------------------------------
-            draw_on_lcd(fb_mem, finfo.line_length, vinfo.xres, vinfo.yres,
-                        buf1[b1.index].start, 0);                      // 左半屏绘制左图
-            draw_on_lcd(fb_mem, finfo.line_length, vinfo.xres, vinfo.yres,
-                        buf2[b2.index].start, vinfo.xres / 2);         // 右半屏绘制右图
-
-            // 将缓冲重新放回采集队列以供下一帧使用
-            ioctl(vfd1, VIDIOC_QBUF, &b1);
-            ioctl(vfd2, VIDIOC_QBUF, &b2);
+            unsigned int *page = fb_presenter_page(&fbp);
+            int drawn = 0;
+#if USE_RGA
+            // RGA：直接从摄像头 DMABUF 转换缩放到 framebuffer，出错则本帧改用 CPU
+            drawn = rga.ok &&
+                    rga_draw_on_lcd(&rga, 0, f1->index, fbp.back, &geom, 0) == 0 &&
+                    rga_draw_on_lcd(&rga, 1, f2->index, fbp.back, &geom, vinfo->xres / 2) == 0;
+#endif
+            if (!drawn) {
+                draw_on_lcd(page, line_length, &geom, f1->start, 0);                // 左半屏绘制左图
+                draw_on_lcd(page, line_length, &geom, f2->start, vinfo->xres / 2);  // 右半屏绘制右图
+            }
+        } else if (ret == 1) {
+            uint64_t n;
+            if (read(key_event_fd, &n, sizeof(n)) < 0)    // 清除按键通知计数
+                perror("read key eventfd");
         }
 
         // --------------------------------------------------------
-        // 5.3 检测拍照标志位
+        // 5.3 处理按键队列：每次按键在"上一对 / 新到的一对"中选时间戳更接近的
+        //     按下时刻晚于新帧的按键留在队列里，等下一对帧到达后再决定；
+        //     超时（摄像头停顿）时直接使用最近一对，避免按键无限等待
         // --------------------------------------------------------
-        if (photo_flag) {
-            printf("[TRIGGER] Capture event detected.\n");
-
-            // 再次从摄像头队列取出当前帧作为保存帧
-            struct v4l2_buffer cap1 = {
-                    .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
-                    .memory = V4L2_MEMORY_MMAP
-            };
-            struct v4l2_buffer cap2 = {
-                    .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
-                    .memory = V4L2_MEMORY_MMAP
-            };
-            ioctl(vfd1, VIDIOC_DQBUF, &cap1);
-            ioctl(vfd2, VIDIOC_DQBUF, &cap2);
-
-            // 生成左右图像文件路径
-            char left_path[256], right_path[256];
-            snprintf(left_path, sizeof(left_path), LEFT_FOLDER"/%d.jpg", photo_idx);
-            snprintf(right_path, sizeof(right_path), RIGHT_FOLDER"/%d.jpg", photo_idx);
-
-            // 执行 YUYV→JPEG 转换并保存
-            yuyv_to_jpeg(buf1[cap1.index].start, WIDTH, HEIGHT, left_path);
-            yuyv_to_jpeg(buf2[cap2.index].start, WIDTH, HEIGHT, right_path);
-            printf("[SAVE] Photo %d saved:\n       Left: %s\n       Right: %s\n",
-                   photo_idx, left_path, right_path);
-
-            // 将采集缓冲重新入队
-            ioctl(vfd1, VIDIOC_QBUF, &cap1);
-            ioctl(vfd2, VIDIOC_QBUF, &cap2);
-
-            // 清除拍照标志，递增编号
-            photo_flag = 0;
-            photo_idx++;
+        struct cam_frame *n1 = ret == 0 ? f1 : NULL, *n2 = ret == 0 ? f2 : NULL;
+        const struct key_press *k;
+        while ((k = press_queue_peek(&g_press)) != NULL) {
+            if (k->code == g_cfg.record_key) {           // 录像开关键：与帧时刻无关，立即处理
+                record_toggle(&cam1, &cam2);
+                press_queue_pop(&g_press);
+                continue;
+            }
+            if (g_cfg.raw_key > 0 && k->code == g_cfg.raw_key) {   // 原始录制开关键
+                raw_toggle(&cam1, &cam2);
+                press_queue_pop(&g_press);
+                continue;
+            }
+            struct cam_frame *c1 = last1, *c2 = last2;
+            if (n1) {
+                long long t_new = pair_ts(n1, n2);
+                if (k->ts_us > t_new) break;
+                if (!c1 || llabs(k->ts_us - t_new) <= llabs(k->ts_us - pair_ts(c1, c2))) {
+                    c1 = n1;
+                    c2 = n2;
+                }
+            } else if (!c1 || (ret == 1 && k->ts_us > pair_ts(c1, c2))) {
+                break;
+            }
+
+            printf("[TRIGGER] Key %d, frame %+lld us from press.\n",
+                   k->code, pair_ts(c1, c2) - k->ts_us);
+
+            // 只有主循环投递，两路都有空位时投递必然成功，左右照片保持成对
+            if (encode_in_flight(&enc_left, &enc_right) < ENCODE_QUEUE_LEN) {
+                jpeg_worker_submit(&enc_left, c1, photo_idx);
+                jpeg_worker_submit(&enc_right, c2, photo_idx);
+                printf("[QUEUE] Photo %d queued (skew %lld us)\n",
+                       photo_idx, c1->ts_us - c2->ts_us);
+                photo_idx++;                      // 递增编号
+            } else {
+                fprintf(stderr, "[QUEUE] Encoder busy, photo %d skipped\n", photo_idx);
+            }
+            press_queue_pop(&g_press);
+        }
+
+        if (n1) {
+            record_feed(n1, n2, &enc_left, &enc_right);
+            raw_feed(n1, n2, &enc_left, &enc_right);
+
+            // 新的一对成为"最近显示帧"，上一对释放（最后一个消费者释放时缓冲自动重新入队）
+            cam_frame_release(last1);
+            cam_frame_release(last2);
+            last1 = n1;
+            last2 = n2;
         }
 
         // --------------------------------------------------------
-        // 5.4 控制刷新帧率 (约33fps)
+        // 5.4 呈现：翻页后等待垂直同步（节奏由帧到达与屏幕刷新决定，无固定延时）
         // --------------------------------------------------------
-        usleep(30000);                            // 延时30ms，防止CPU过载
+        if (ret == 0) fb_presenter_flip(&fbp);
     }
 
     // ============================================================
     // 6. 程序退出清理（一般不会执行到）
     // ============================================================
-    munmap(fb_mem, finfo.smem_len);               // 释放帧缓冲映射
-    close(fb_fd);
-    close(vfd1);
-    close(vfd2);
+#if USE_RGA
+    rga_preview_release(&rga);                    // 释放 RGA 缓冲句柄
+#endif
+    cam_frame_release(last1);                     // 归还最近显示的帧与未配对的帧
+    cam_frame_release(last2);
+    cam_stereo_release(&sync);
+    close(key_event_fd);
+#if USE_MPP
+    video_recorder_stop(&g_rec[0]);               // 写完排队中的录像帧
+    video_recorder_stop(&g_rec[1]);
+#endif
+    raw_recorder_stop(&g_raw);                    // 写完排队中的原始帧
+    jpeg_worker_stop(&enc_left);                  // 保存完排队中的照片后结束编码线程
+    jpeg_worker_stop(&enc_right);
+    preview_geom_free(&geom);                     // 释放预览映射表
+    fb_presenter_close(&fbp);                    // 切回第 0 页并释放帧缓冲映射
+    cam_close(&cam1);                             // 停止采集并释放摄像头缓冲
+    cam_close(&cam2);
     printf("[EXIT] Program terminated.\n");
 
     return 0;                                     // 正常结束
@@ -2,14 +2,20 @@
 % 文件名: export_stereo_params_to_cpp.m
 % 功能: 
 %   从 stereoParams.mat 文件中读取双目标定结果，
-%   自动提取左右相机的内参矩阵（K1, K2）和外参（R, T），
-%   并以 C++ (OpenCV) 格式打印输出，方便嵌入到 C++ 代码中。
+%   自动提取左右相机的内参矩阵（K1, K2）、畸变系数（D1, D2）和外参（R, T），
+%   写入 OpenCV FileStorage 可读的 YAML 标定文件 stereo_calib.yml，
+%   并以 C++ 格式打印 stereo_calib 初始化值（跟踪程序的内置标定）。
 %
 % 适用场景:
-%   - MATLAB 进行相机标定后，需将结果移植至 C++ 工程使用。
-%   - 输出格式直接可用于 OpenCV：
-%       cv::Matx33d R(...);
-%       cv::Vec3d  T(...);
+%   - MATLAB 进行相机标定后，把 stereo_calib.yml 拷到板子上
+%     （stereo_pupil_tracking 的 calib_file，默认 /root/stereo_calib.yml），
+%     重启程序或 kill -HUP <pid> 即生效，无需重新编译。
+%
+% 文件格式 (calib_version = 1):
+%   calib_version, image_width, image_height,
+%   K1, D1, K2, D2, R, T（与 cv::stereoCalibrate 输出同名的 !!opencv-matrix 节点）
+%   D = [k1 k2 p1 p2 k3]（OpenCV 顺序）；R、T 满足 X_L = R·X_R + T；
+%   主点已换算为 OpenCV 的 0 起点像素坐标（MATLAB 为 1 起点）。
 %
 % 作者: liu
 % 日期: 2025-10-27
@@ -21,6 +27,8 @@ function get_mat()
     % 根目录为你的项目文件夹（可根据实际修改）
     base_path = 'D:\Desktop\Proj\CameraDistance';       % 根目录路径
     mat_path = fullfile(base_path, 'stereoParams.mat'); % 拼接得到完整路径
+    out_path = fullfile(base_path, 'stereo_calib.yml'); % 导出的标定文件
+    calib_version = 1;                                  % 与跟踪程序 CALIB_VERSION 对应
 
     %% === 2. 检查文件是否存在 ===
     if exist(mat_path, 'file')
@@ -46,31 +54,48 @@ function get_mat()
         R = stereoParams.PoseCamera2.Rotation;          % 旋转矩阵 (3x3)
         T = stereoParams.PoseCamera2.Translation;       % 平移向量 (1x3)
 
-        %% === 6. 提取 fx, fy, cx, cy 四个关键内参参数 ===
+        %% === 6. 主点换算为 OpenCV 坐标，提取畸变系数 ===
+        % MATLAB 像素坐标以 1 起点，OpenCV 以 0 起点。
+        K1(1:2,3) = K1(1:2,3) - 1;
+        K2(1:2,3) = K2(1:2,3) - 1;
+        D1 = opencv_dist(stereoParams.CameraParameters1);
+        D2 = opencv_dist(stereoParams.CameraParameters2);
+        img_size = stereoParams.CameraParameters1.ImageSize;   % [行 列]，可能为空
+
         fx1 = K1(1,1); fy1 = K1(2,2); cx1 = K1(1,3); cy1 = K1(2,3);
         fx2 = K2(1,1); fy2 = K2(2,2); cx2 = K2(1,3); cy2 = K2(2,3);
 
-        %% === 7. 输出为 C++ 变量定义格式 ===
-        % 输出的格式可直接复制到 C++ 源代码中使用。
-        fprintf('\n===== 🎯 导出为 C++ 格式 =====\n\n');
-        
-        % 左右相机内参
-        fprintf('double fx1 = %.4f, fy1 = %.4f, cx1 = %.4f, cy1 = %.4f;\n', ...
-                fx1, fy1, cx1, cy1);
-        fprintf('double fx2 = %.4f, fy2 = %.4f, cx2 = %.4f, cy2 = %.4f;\n\n', ...
-                fx2, fy2, cx2, cy2);
-
-        % 旋转矩阵 R
-        fprintf('cv::Matx33d R(\n');
-        fprintf('    %.6f, %.6f, %.6f,\n', R(1,1), R(1,2), R(1,3));
-        fprintf('    %.6f, %.6f, %.6f,\n', R(2,1), R(2,2), R(2,3));
-        fprintf('    %.6f, %.6f, %.6f\n', R(3,1), R(3,2), R(3,3));
-        fprintf(');\n');
-
-        % 平移向量 T
-        fprintf('cv::Vec3d T(%.6f, %.6f, %.6f);\n\n', T(1), T(2), T(3));
+        %% === 7. 写出 YAML 标定文件 ===
+        fid = fopen(out_path, 'w');
+        if fid < 0
+            fprintf('⚠️ 无法写入: %s\n', out_path);
+            return;
+        end
+        fprintf(fid, '%%YAML:1.0\n---\n');
+        fprintf(fid, 'calib_version: %d\n', calib_version);
+        if numel(img_size) == 2
+            fprintf(fid, 'image_width: %d\nimage_height: %d\n', img_size(2), img_size(1));
+        end
+        write_opencv_matrix(fid, 'K1', K1);
+        write_opencv_matrix(fid, 'D1', D1);
+        write_opencv_matrix(fid, 'K2', K2);
+        write_opencv_matrix(fid, 'D2', D2);
+        write_opencv_matrix(fid, 'R', R);
+        write_opencv_matrix(fid, 'T', T(:));
+        fclose(fid);
+        fprintf('✅ 已写入标定文件: %s (calib_version %d)\n', out_path, calib_version);
 
-        fprintf('✅ 导出完成，请复制以上内容至 C++ 工程。\n');
+        %% === 8. 输出内置标定值（stereo_calib 初始化格式） ===
+        % 仅在需要更新程序内置的后备标定（无标定文件时使用）时复制。
+        fprintf('\n===== 🎯 stereo_calib 初始化值 =====\n\n');
+        fprintf('    { %.4f, %.4f }, { %.4f, %.4f },\n', fx1, fx2, fy1, fy2);
+        fprintf('    { %.4f, %.4f }, { %.4f, %.4f },\n', cx1, cx2, cy1, cy2);
+        fprintf('    { { %.6f, %.6f, %.6f, %.6f, %.6f },\n', D1);
+        fprintf('      { %.6f, %.6f, %.6f, %.6f, %.6f } },\n', D2);
+        fprintf('    { %9.6f, %9.6f, %9.6f,\n', R(1,1), R(1,2), R(1,3));
+        fprintf('      %9.6f, %9.6f, %9.6f,\n', R(2,1), R(2,2), R(2,3));
+        fprintf('      %9.6f, %9.6f, %9.6f },\n', R(3,1), R(3,2), R(3,3));
+        fprintf('    { %.6f, %.6f, %.6f },\n\n', T(1), T(2), T(3));
 
     else
         %% === 文件未找到处理 ===
@@ -78,3 +103,21 @@ function get_mat()
         fprintf('请确认路径或文件名是否正确。\n');
     end
 end
+
+%% === 辅助函数: MATLAB 畸变参数 → OpenCV 顺序 [k1 k2 p1 p2 k3] ===
+% RadialDistortion 为 2 或 3 个系数，TangentialDistortion 为 [p1 p2]（未估计时为 0）。
+function D = opencv_dist(cam)
+    k = zeros(1, 3);
+    k(1:numel(cam.RadialDistortion)) = cam.RadialDistortion;
+    p = cam.TangentialDistortion;
+    D = [k(1) k(2) p(1) p(2) k(3)];
+end
+
+%% === 辅助函数: 按 OpenCV FileStorage 格式写一个矩阵节点（双精度，行优先） ===
+function write_opencv_matrix(fid, name, M)
+    fprintf(fid, '%s: !!opencv-matrix\n', name);
+    fprintf(fid, '   rows: %d\n   cols: %d\n   dt: d\n', size(M, 1), size(M, 2));
+    v = reshape(M.', 1, []);                            % MATLAB 列优先 → 行优先
+    fprintf(fid, '   data: [ %s ]\n', strjoin(arrayfun(@(x) sprintf('%.10g', x), v, ...
+            'UniformOutput', false), ', '));
+end
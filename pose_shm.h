@@ -0,0 +1,169 @@
+/*
+ * ================================================================
+ * 文件名: pose_shm.h
+ * 功能概述:
+ *   三维瞳孔位置的共享内存环形缓冲（POSIX shm，仅头文件，C/C++ 通用）。
+ *   stereo_pupil_tracking 配置 shm_name 后每输出一个样本写入一格，同机的其它进程
+ *   （显示、记录、控制程序）只读映射即可取得与串口 / UDP 相同的样本，不经过任何系统调用，
+ *   写端也不会因读端慢而等待。
+ *
+ * 内存布局:
+ *   struct pose_shm：文件头 + POSE_SHM_SLOTS 个 struct pose_shm_slot。
+ *   head 为已写入的样本总数，第 n 个样本位于 slot[n % POSE_SHM_SLOTS]；
+ *   每格以 seq 作 seqlock：写入中为 2n+1，写完为 2n+2，读端前后两次读到 2n+2 才采用。
+ *   读端跟不上超过一圈时旧样本被覆盖（pose_shm_read 返回 -1），按 head 重新对齐即可。
+ *
+ * 典型用法（读端）:
+ *   struct pose_shm *s = pose_shm_open("/pupil_pose");
+ *   uint32_t next = pose_shm_head(s);
+ *   struct pose_shm_slot v;
+ *   for (;;) {
+ *       if (next == pose_shm_head(s)) { usleep(1000); continue; }
+ *       if (pose_shm_read(s, next, &v) == 0) use(v.xyz);
+ *       else next = pose_shm_head(s) - 1;           // 被覆盖：跳到最新
+ *       next++;
+ *   }
+ *
+ * 编译:
+ *   shm_open 在 uClibc / 旧 glibc 上需要 -lrt。
+ * ================================================================
+ */
+#ifndef POSE_SHM_H
+#define POSE_SHM_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define POSE_SHM_MAGIC   0x50534850u   // "PHSP"（小端内存中为 'P' 'H' 'S' 'P'）
+#define POSE_SHM_VERSION 1
+#define POSE_SHM_SLOTS   256           // 环形缓冲格数（2 的幂；30 fps 时约 8.5 s）
+
+#define POSE_SHM_FLAG_PREDICTED 0x1u   // 滤波外推值（本帧未检出）
+
+struct pose_shm_slot {
+    uint32_t seq;                      // seqlock：2n+1 写入中，2n+2 = 第 n 个样本已写完
+    uint32_t flags;                    // POSE_SHM_FLAG_*
+    int64_t ts_us;                     // 采集时间戳（CLOCK_MONOTONIC，us）
+    float xyz[3];                      // 三维位置（左相机坐标系，单位同标定 T，通常为 mm）
+    uint32_t reserved;
+};
+
+struct pose_shm {
+    uint32_t magic;                    // POSE_SHM_MAGIC
+    uint32_t version;                  // POSE_SHM_VERSION
+    uint32_t slots;                    // POSE_SHM_SLOTS
+    uint32_t slot_size;                // sizeof(struct pose_shm_slot)
+    uint32_t head;                     // 已写入的样本总数（写端 release 发布）
+    uint32_t writer_pid;               // 写端进程号（诊断用）
+    uint32_t reserved[2];
+    struct pose_shm_slot slot[POSE_SHM_SLOTS];
+};
+
+/**
+ * 函数名: pose_shm_create
+ * 功能: 写端创建（或重建）名为 name 的共享内存并初始化文件头，已存在的旧内容清零。
+ *
+ * 返回值:
+ *   映射地址；失败返回 NULL（已打印原因）
+ */
+static inline struct pose_shm *pose_shm_create(const char *name) {
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "[SHM] %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(struct pose_shm)) != 0) {
+        fprintf(stderr, "[SHM] %s: ftruncate: %s\n", name, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, sizeof(struct pose_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "[SHM] %s: mmap: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    struct pose_shm *s = (struct pose_shm *)p;
+    memset(s, 0, sizeof(*s));
+    s->version = POSE_SHM_VERSION;
+    s->slots = POSE_SHM_SLOTS;
+    s->slot_size = sizeof(struct pose_shm_slot);
+    s->writer_pid = (uint32_t)getpid();
+    __atomic_store_n(&s->magic, POSE_SHM_MAGIC, __ATOMIC_RELEASE);   // 最后置魔数，读端据此判断已初始化
+    return s;
+}
+
+// 写端：追加一个样本（单写者；不阻塞、不做系统调用）
+static inline void pose_shm_write(struct pose_shm *s, int64_t ts_us, const float xyz[3], uint32_t flags) {
+    uint32_t n = __atomic_load_n(&s->head, __ATOMIC_RELAXED);
+    struct pose_shm_slot *e = &s->slot[n % POSE_SHM_SLOTS];
+    __atomic_store_n(&e->seq, 2 * n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e->flags = flags;
+    e->ts_us = ts_us;
+    memcpy(e->xyz, xyz, sizeof(e->xyz));
+    __atomic_store_n(&e->seq, 2 * n + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&s->head, n + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * 函数名: pose_shm_open
+ * 功能: 读端只读映射名为 name 的共享内存并校验文件头。
+ *
+ * 返回值:
+ *   映射地址；不存在、尚未初始化或版本不符返回 NULL（已打印原因）
+ */
+static inline const struct pose_shm *pose_shm_open(const char *name) {
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "[SHM] %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    void *p = mmap(NULL, sizeof(struct pose_shm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "[SHM] %s: mmap: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    const struct pose_shm *s = (const struct pose_shm *)p;
+    if (__atomic_load_n(&s->magic, __ATOMIC_ACQUIRE) != POSE_SHM_MAGIC || s->version != POSE_SHM_VERSION ||
+        s->slots != POSE_SHM_SLOTS || s->slot_size != sizeof(struct pose_shm_slot)) {
+        fprintf(stderr, "[SHM] %s: not a version %d pose ring\n", name, POSE_SHM_VERSION);
+        munmap(p, sizeof(struct pose_shm));
+        return NULL;
+    }
+    return s;
+}
+
+// 读端：已写入的样本总数（下一个样本的编号）
+static inline uint32_t pose_shm_head(const struct pose_shm *s) {
+    return __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * 函数名: pose_shm_read
+ * 功能: 读取第 n 个样本。
+ *
+ * 返回值:
+ *   0 成功（写入 *out）；-1 尚未写入或已被覆盖
+ */
+static inline int pose_shm_read(const struct pose_shm *s, uint32_t n, struct pose_shm_slot *out) {
+    const struct pose_shm_slot *e = &s->slot[n % POSE_SHM_SLOTS];
+    uint32_t want = 2 * n + 2;
+    if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != want) return -1;
+    out->flags = e->flags;
+    out->ts_us = e->ts_us;
+    memcpy(out->xyz, e->xyz, sizeof(out->xyz));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != want) return -1;
+    out->seq = want;
+    out->reserved = 0;
+    return 0;
+}
+
+#endif  // POSE_SHM_H
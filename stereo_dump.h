@@ -0,0 +1,169 @@
+/*
+ * ================================================================
+ * 文件名: stereo_dump.h
+ * 功能概述:
+ *   双目原始帧序列文件（.sdump）的格式定义与读取接口（仅头文件，C/C++ 通用）。
+ *   用于离线回放：stereo_pupil_tracking 的 replay 模式读取录制的左右 YUYV 帧，
+ *   在没有摄像头的桌面或板子上复现检测 / 三角测量并测速。
+ *
+ * 文件布局（所有偏移与长度均为 SDUMP_ALIGN 的整数倍，便于 O_DIRECT 顺序写）:
+ *   [文件头 struct sdump_header，占 SDUMP_ALIGN 字节]
+ *   [记录 0][记录 1] ...，每条记录 record_bytes 字节:
+ *       +0                          记录头 struct sdump_record（占 SDUMP_ALIGN 字节）
+ *       +SDUMP_ALIGN                左帧原始数据（frame_bytes 字节，按 SDUMP_ALIGN 补齐）
+ *       +SDUMP_ALIGN + frame_slot   右帧原始数据
+ *   帧数据为驱动缓冲原样拷贝（YUYV，行跨度 bytesperline），不做任何转换；
+ *   多字节字段为本机字节序（录制与回放都在小端 ARM / x86 上）。
+ *
+ * 典型用法:
+ *   struct sdump_reader rd;
+ *   if (sdump_open(&rd, "/data/eyes.sdump") != 0) exit(1);
+ *   const struct sdump_record *rec;
+ *   while ((rec = sdump_next(&rd)) != NULL) {
+ *       const uint8_t *left = sdump_frame(&rd, 0), *right = sdump_frame(&rd, 1);
+ *       ...                                       // rec->ts_us[0/1] 为驱动时间戳
+ *   }
+ *   sdump_close(&rd);
+ *
+ * 错误处理:
+ *   函数向 stderr 打印原因并返回 -1 / NULL；文件末尾的不完整记录视为结束。
+ * ================================================================
+ */
+#ifndef STEREO_DUMP_H
+#define STEREO_DUMP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SDUMP_MAGIC   "STDUMP\r\n"     // 8 字节魔数（含 \r\n，文本方式误传输可被发现）
+#define SDUMP_VERSION 1
+#define SDUMP_ALIGN   4096             // 文件头、记录、帧槽的对齐粒度（O_DIRECT 要求）
+
+#define SDUMP_ALIGN_UP(n) (((n) + SDUMP_ALIGN - 1) / SDUMP_ALIGN * SDUMP_ALIGN)
+
+// 文件头（写在文件开头，其余字节填 0 至 SDUMP_ALIGN）
+struct sdump_header {
+    char magic[8];                     // SDUMP_MAGIC
+    uint32_t version;                  // SDUMP_VERSION
+    uint32_t width, height;            // 分辨率（两路相同）
+    uint32_t pixfmt;                   // V4L2 fourcc（V4L2_PIX_FMT_YUYV）
+    uint32_t bytesperline;             // 行跨度
+    uint32_t frame_bytes;              // 每帧有效字节数 = bytesperline × height
+    uint32_t record_bytes;             // 每条记录字节数 = SDUMP_ALIGN + 2 × SDUMP_ALIGN_UP(frame_bytes)
+    uint32_t fps_num, fps_den;         // 录制时的采集帧率（帧/秒 = fps_num / fps_den）
+};
+
+// 记录头（每条记录开头，其余字节填 0 至 SDUMP_ALIGN）
+struct sdump_record {
+    uint32_t seq;                      // 记录序号（从 0 递增，中间丢帧时不连续）
+    uint32_t flags;                    // 保留，写 0
+    int64_t ts_us[2];                  // 左 / 右帧驱动时间戳（CLOCK_MONOTONIC，us）
+    uint32_t sequence[2];              // 左 / 右帧驱动帧序号（v4l2_buffer.sequence）
+};
+
+// 按分辨率与行跨度填写文件头
+static inline void sdump_header_init(struct sdump_header *h, uint32_t width, uint32_t height, uint32_t pixfmt,
+                                     uint32_t bytesperline, uint32_t fps_num, uint32_t fps_den) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, SDUMP_MAGIC, 8);
+    h->version = SDUMP_VERSION;
+    h->width = width;
+    h->height = height;
+    h->pixfmt = pixfmt;
+    h->bytesperline = bytesperline;
+    h->frame_bytes = bytesperline * height;
+    h->record_bytes = SDUMP_ALIGN + 2 * SDUMP_ALIGN_UP(h->frame_bytes);
+    h->fps_num = fps_num;
+    h->fps_den = fps_den;
+}
+
+// 读取端
+struct sdump_reader {
+    int fd;
+    struct sdump_header hdr;
+    uint8_t *rec;                      // 当前记录（record_bytes 字节）
+    long long count;                   // 已读记录数
+};
+
+/**
+ * 函数名: sdump_open
+ * 功能: 打开序列文件并校验文件头，分配一条记录的读缓冲。
+ *
+ * 返回值:
+ *   0 成功；-1 打不开、不是 .sdump 文件或版本不支持
+ */
+static inline int sdump_open(struct sdump_reader *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0) {
+        fprintf(stderr, "[SDUMP] %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    uint8_t page[SDUMP_ALIGN];
+    if (read(r->fd, page, sizeof(page)) != (ssize_t)sizeof(page)) {
+        fprintf(stderr, "[SDUMP] %s: short header\n", path);
+        goto fail;
+    }
+    memcpy(&r->hdr, page, sizeof(r->hdr));
+    if (memcmp(r->hdr.magic, SDUMP_MAGIC, 8) != 0 || r->hdr.version != SDUMP_VERSION) {
+        fprintf(stderr, "[SDUMP] %s: not a version %d stereo dump\n", path, SDUMP_VERSION);
+        goto fail;
+    }
+    if (r->hdr.frame_bytes != r->hdr.bytesperline * r->hdr.height ||
+        r->hdr.record_bytes != SDUMP_ALIGN + 2 * SDUMP_ALIGN_UP(r->hdr.frame_bytes)) {
+        fprintf(stderr, "[SDUMP] %s: inconsistent header\n", path);
+        goto fail;
+    }
+    r->rec = (uint8_t *)malloc(r->hdr.record_bytes);
+    if (!r->rec) {
+        fprintf(stderr, "[SDUMP] %s: out of memory\n", path);
+        goto fail;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return 0;
+fail:
+    close(r->fd);
+    r->fd = -1;
+    return -1;
+}
+
+/**
+ * 函数名: sdump_next
+ * 功能: 读取下一条记录。
+ *
+ * 返回值:
+ *   记录头指针（在下次调用前有效）；文件结束或读错误返回 NULL
+ */
+static inline const struct sdump_record *sdump_next(struct sdump_reader *r) {
+    size_t got = 0;
+    while (got < r->hdr.record_bytes) {
+        ssize_t n = read(r->fd, r->rec + got, r->hdr.record_bytes - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) perror("[SDUMP] read");
+        if (n <= 0) return NULL;  // 末尾不完整的记录（录制被打断）忽略
+        got += (size_t)n;
+    }
+    r->count++;
+    return (const struct sdump_record *)r->rec;
+}
+
+// 当前记录中左 (cam = 0) / 右 (cam = 1) 帧数据
+static inline const uint8_t *sdump_frame(const struct sdump_reader *r, int cam) {
+    return r->rec + SDUMP_ALIGN + (size_t)cam * SDUMP_ALIGN_UP(r->hdr.frame_bytes);
+}
+
+static inline void sdump_close(struct sdump_reader *r) {
+    if (r->fd >= 0) close(r->fd);
+    free(r->rec);
+    r->fd = -1;
+    r->rec = NULL;
+}
+
+#endif  // STEREO_DUMP_H
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <termios.h>
@@ -10,27 +11,242 @@
 #include <sys/mman.h>
 #include <linux/input.h>
 #include <poll.h>
+#include <semaphore.h>
 #include <thread>
+#include <algorithm>
+#include <cmath>
+#include <climits>
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <sys/signalfd.h>
+#include <signal.h>
+/*
+ * HEADLESS = 1（-DHEADLESS=1）：无调试叠加的精简构建，不含 BGR 转换与绘制代码、不支持 JPEG 目录回放，
+ * 只需链接 -lopencv_imgproc -lopencv_core（无 imgcodecs / highgui 及其图像库依赖，体积更小、启动更快）。
+ */
+#ifndef HEADLESS
+#define HEADLESS 0
+#endif
+#if HEADLESS
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#else
 #include <opencv2/opencv.hpp>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define USE_NEON 1            // 编译器已启用 NEON（-mfpu=neon）
+#else
+#define USE_NEON 0
+#endif
+#include "v4l2_camera.h"      // 共享摄像头模块（DMABUF 导出 + 帧引用计数）
+#include "app_config.h"       // 共享运行时配置（配置文件 + 命令行）
+#include "stereo_dump.h"      // 双目原始帧序列文件（离线回放）
+#include "pose_shm.h"          // 三维位置共享内存环形缓冲（同机读端）
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netdb.h>
 
 /********************** 参数定义区 *************************/
 #define WIDTH 640             // 图像宽度
 #define HEIGHT 480            // 图像高度
-#define THRESH_MIN 0          // 阈值下限（备用）
-#define THRESH_MAX 40         // 阈值上限（用于二值化）
+#define THRESH_MIN 0          // 自适应阈值下限
+#define THRESH_MAX 40         // 初始 / 固定二值化阈值
+#define THRESH_LIMIT 100      // 自适应阈值上限
+#define THRESH_ADAPTIVE 1     // 1 = 按搜索区域直方图的暗峰谷底自适应阈值
 #define MIN_AREA 1500         // 最小瞳孔轮廓面积
-#define CENTER_X (WIDTH / 2)  // 图像中心X
-#define CENTER_Y (HEIGHT / 2) // 图像中心Y
+#define BLOB_CONTOURS 0       // 候选提取：findContours 轮廓
+#define BLOB_RLE 1            // 候选提取：单遍行程连通域（默认）
+#define BLOB_DETECTOR BLOB_RLE
+#define ELLIPSE_FIT 1         // 1 = 以边缘点椭圆拟合的中心代替质心（亚像素，抗眼睑遮挡）
+#define MAX_CANDIDATES 4      // 每路每帧最多保留的瞳孔候选数（candidates 的上限）
+#define CANDIDATES 1          // 每路保留的候选数（1 = 只取最接近参考点者；>1 时左右候选按极线关联）
+#define EPIPOLAR_MAX_PX 4.0f  // 左右候选关联时允许的极线距离（右图像素）
+#define EPIPOLAR_SEARCH 0     // 1 = 右相机重新捕获时只在左相机结果的极线带内搜索
+#define DEPTH_MIN 150         // 极线带对应的最近深度（左相机 Z，单位同 T，通常为 mm）
+#define DEPTH_MAX 1000        // 极线带对应的最远深度
+#define TRACK_ROI_SCALE 3     // 跟踪窗口半边长 = 瞳孔半径 × 此倍数
+#define TRACK_PRED_SCALE 2    // 有三维预测时窗口半边长 = 瞳孔半径 × 此倍数（比 TRACK_ROI_SCALE 更紧）
+#define TRACK_ROI_MIN 96      // 跟踪窗口最小边长（像素）
+#define PYRAMID_SCALE 4       // 重新捕获时粗搜索的降采样倍数（1 = 直接整帧检测）
+#define TRACK_MAX_MISSES 3    // 锁定后连续丢失超过此帧数回到整帧搜索（0 = 关闭跟踪）
+#define CAM_BUFFERS 6         // 每个摄像头申请的帧缓冲数量（4~8）
+#define DETECT_QUEUE_LEN 2    // 每路待检测帧队列长度（2 的幂）
+#define RESULT_QUEUE_LEN 8    // 每路检测结果队列长度（2 的幂）
+// 每路缓冲占用：待检测队列 + 检测中 1 帧 + 同步器待配对 1 帧，至少给驱动留 1 个空闲缓冲
+static_assert(DETECT_QUEUE_LEN + 3 <= CAM_BUFFERS, "CAM_BUFFERS too small for the detect pipeline");
+#define STEREO_SYNC_US 16000  // 左右帧时间戳配对容差（约半个 30fps 帧周期）
+#define STEREO_WAIT_MS 1000   // 等待一对帧的超时
+#define CAM_FPS 0             // 采集帧率（0 = 驱动支持的最高帧率）
+#define CAM_EXPOSURE (-1)     // 固定曝光（驱动单位，-1 = 自动；红外照明下建议固定）
+#define CAM_GAIN (-1)         // 固定增益（驱动单位，-1 = 自动）
+#define DEBUG_OVERLAY 0       // 1 = 额外生成 BGR 帧并绘制检测标记（调试用，增加一次整帧颜色转换）
+#define MAX_RATE 0            // 处理帧率上限（Hz，0 = 不限，随摄像头帧率运行；省电时设置）
+#define FILTER_ALPHA 0.5f     // α-β 滤波器位置增益（1 = 不平滑）
+#define FILTER_BETA 0.1f      // α-β 滤波器速度增益（0 = 不估计速度）
+#define FILTER_COAST_MS 100   // 缺测时外推输出的最长时间（0 = 缺测即不输出）
+#define SERIAL_BAUD 115200    // 串口波特率（最高 4000000，视串口控制器与线缆而定，如 921600 / 1500000）
+#define SERIAL_QUEUE_LEN 8    // 串口 / UDP 发送队列长度（2 的幂）
+#define SERIAL_MAX_AGE_MS 50  // 采集后超过此时间仍未发出的样本直接丢弃（0 = 不丢弃）
+#define SERIAL_ASCII 0        // 串口输出："X,Y,Z\n" 文本（默认，兼容旧下位机）
+#define SERIAL_BIN_F32 1      // 串口输出：二进制帧，float32 坐标
+#define SERIAL_BIN_I16 2      // 串口输出：二进制帧，int16 定点坐标（1/SERIAL_FIXED_SCALE mm）
+#define SERIAL_FORMAT SERIAL_ASCII
+#define SERIAL_FIXED_SCALE 20 // int16 定点坐标每 mm 的计数（0.05 mm 分辨率，量程 ±1638 mm）
+#define STATS_INTERVAL_MS 5000  // 周期打印各级延迟分布与帧率的间隔（0 = 只在 SIGUSR1 时打印）
+#define VERBOSE 1             // 控制台输出：0 = 静默，1 = 统计报告，2 = 另外逐帧打印位置
+#define CONFIG_FILE "/root/stereo_pupil.conf"  // 运行时配置文件默认路径
+#define CALIB_FILE "/root/stereo_calib.yml"    // 双目标定文件默认路径（不存在时用内置标定值）
+
+/*
+ * 运行时配置：初值为上面的宏，启动时由配置文件 / 命令行覆盖（app_config.h），之后只读。
+ *   stereo_pupil_tracking [-c FILE] [--key=value ...]，--help 列出全部参数与当前值。
+ */
+struct app_settings {
+    char cam_left[CFG_STR_LEN];       // 左相机设备节点
+    char cam_right[CFG_STR_LEN];      // 右相机设备节点
+    char input_device[CFG_STR_LEN];   // 退出按键输入设备
+    char serial_device[CFG_STR_LEN];  // 结果输出串口
+    char ctrl_left[CFG_STR_LEN];      // 左相机曝光/增益控件节点（空 = 视频节点本身）
+    char ctrl_right[CFG_STR_LEN];     // 右相机曝光/增益控件节点
+    char calib_file[CFG_STR_LEN];     // 双目标定文件
+    char replay[CFG_STR_LEN];         // 离线回放输入（.sdump 文件或含 left/ right/ 的 JPEG 目录，空 = 实时）
+    char replay_ref[CFG_STR_LEN];     // 回放参考结果 CSV（空 = 不评估精度）
+    char replay_out[CFG_STR_LEN];     // 回放逐帧结果 CSV（空 = 不输出）
+    char udp_dest[CFG_STR_LEN];       // UDP 输出目的地 host:port（空 = 不发送）
+    char shm_name[CFG_STR_LEN];       // 共享内存环形缓冲名（空 = 不创建）
+    int width, height;                // 采集分辨率
+    int fps;                          // 采集帧率（0 = 最高）
+    int exposure, gain;               // 固定曝光 / 增益（-1 = 自动）
+    int max_rate;                     // 处理帧率上限（0 = 不限）
+    int debug_overlay;                // 1 = 生成带检测标记的 BGR 帧
+    int thresh_max;                   // 瞳孔二值化阈值（自适应时为初值）
+    int thresh_adaptive;              // 1 = 自适应阈值
+    int thresh_min, thresh_limit;     // 自适应阈值范围
+    int min_area;                     // 最小瞳孔轮廓面积
+    int blob_detector;                // BLOB_CONTOURS / BLOB_RLE
+    int ellipse_fit;                  // 1 = 椭圆拟合中心
+    int candidates;                   // 每路候选数（1..MAX_CANDIDATES）
+    float epipolar_max_px;            // 候选关联的极线距离上限
+    int epipolar_search;              // 1 = 右相机按极线带搜索
+    int depth_min, depth_max;         // 极线带深度范围
+    int track_roi_min;                // 跟踪窗口最小边长
+    int track_max_misses;             // 丢失多少帧后回到整帧搜索（0 = 关闭跟踪）
+    int pyramid_scale;                // 粗搜索降采样倍数
+    int stereo_sync_us;               // 左右帧配对容差
+    int stereo_wait_ms;               // 等待一对帧的超时
+    float filter_alpha, filter_beta;  // α-β 滤波器增益
+    int filter_coast_ms;              // 缺测外推时长
+    int serial_format;                // SERIAL_ASCII / SERIAL_BIN_F32 / SERIAL_BIN_I16
+    int serial_baud;                  // 串口波特率
+    int serial_max_age_ms;            // 串口样本最大滞留时间
+    int stats_interval_ms;            // 统计报告间隔（0 = 仅 SIGUSR1）
+    int verbose;                      // 控制台输出级别
+};
+
+static app_settings g_cfg = {
+    "/dev/video21", "/dev/video23", "/dev/input/event1", "/dev/ttyS3", "", "", CALIB_FILE, "", "", "", "", "",
+    WIDTH, HEIGHT, CAM_FPS, CAM_EXPOSURE, CAM_GAIN, MAX_RATE, DEBUG_OVERLAY,
+    THRESH_MAX, THRESH_ADAPTIVE, THRESH_MIN, THRESH_LIMIT, MIN_AREA, BLOB_DETECTOR, ELLIPSE_FIT, CANDIDATES, EPIPOLAR_MAX_PX,
+    EPIPOLAR_SEARCH, DEPTH_MIN, DEPTH_MAX, TRACK_ROI_MIN, TRACK_MAX_MISSES, PYRAMID_SCALE,
+    STEREO_SYNC_US, STEREO_WAIT_MS, FILTER_ALPHA, FILTER_BETA, FILTER_COAST_MS,
+    SERIAL_FORMAT, SERIAL_BAUD, SERIAL_MAX_AGE_MS, STATS_INTERVAL_MS, VERBOSE,
+};
 
-/********************** 缓冲区结构体 ************************/
-struct buffer {
-    void *start;              // 映射到用户空间的内存地址
-    size_t length;            // 缓冲区大小
+static const cfg_option g_cfg_opts[] = {
+    CFG_STR("cam_left", g_cfg.cam_left, "左相机设备节点"),
+    CFG_STR("cam_right", g_cfg.cam_right, "右相机设备节点"),
+    CFG_STR("input_device", g_cfg.input_device, "退出按键输入设备"),
+    CFG_STR("serial_device", g_cfg.serial_device, "坐标输出串口（原始模式 8N1，波特率见 serial_baud）"),
+    CFG_INT("width", &g_cfg.width, "采集宽度"),
+    CFG_INT("height", &g_cfg.height, "采集高度"),
+    CFG_INT("fps", &g_cfg.fps, "采集帧率（0 = 驱动支持的最高帧率）"),
+    CFG_INT("exposure", &g_cfg.exposure, "固定曝光（驱动单位，-1 = 自动）"),
+    CFG_INT("gain", &g_cfg.gain, "固定增益（驱动单位，-1 = 自动）"),
+    CFG_INT("max_rate", &g_cfg.max_rate, "处理帧率上限（Hz，0 = 不限；多余的帧对不做检测直接释放）"),
+    CFG_INT("debug_overlay", &g_cfg.debug_overlay, "1 = 生成带检测标记的 BGR 调试帧（检测本身只用亮度；HEADLESS 构建无效）"),
+    CFG_STR("ctrl_left", g_cfg.ctrl_left, "左相机曝光/增益控件节点（如 /dev/v4l-subdev2，空 = 视频节点）"),
+    CFG_STR("ctrl_right", g_cfg.ctrl_right, "右相机曝光/增益控件节点（空 = 视频节点）"),
+    CFG_STR("calib_file", g_cfg.calib_file, "双目标定文件（OpenCV YAML：K1 D1 K2 D2 R T；不存在时用内置值）"),
+    CFG_STR("replay", g_cfg.replay, "离线回放：.sdump 序列文件，或含 left/N.jpg 与 right/N.jpg 的目录（空 = 实时跟踪）"),
+    CFG_STR("replay_ref", g_cfg.replay_ref, "回放参考 CSV（seq,lx,ly,rx,ry，未检出填 -1；空 = 只测速）"),
+    CFG_STR("replay_out", g_cfg.replay_out, "回放逐帧结果 CSV（格式同参考文件，另附 X,Y,Z；可作为下次的参考）"),
+    CFG_STR("udp_dest", g_cfg.udp_dest, "同时以 UDP 发送样本的目的地 host:port（每个数据报一个样本，内容同串口；空 = 不发送）"),
+    CFG_STR("shm_name", g_cfg.shm_name, "同时写入共享内存环形缓冲（如 /pupil_pose，格式见 pose_shm.h；空 = 不创建）"),
+    CFG_INT("thresh_max", &g_cfg.thresh_max, "瞳孔二值化阈值（灰度不高于此值视为瞳孔；自适应时为初值）"),
+    CFG_INT("thresh_adaptive", &g_cfg.thresh_adaptive, "1 = 按搜索区域直方图自适应阈值，0 = 固定 thresh_max"),
+    CFG_INT("thresh_min", &g_cfg.thresh_min, "自适应阈值下限"),
+    CFG_INT("thresh_limit", &g_cfg.thresh_limit, "自适应阈值上限"),
+    CFG_INT("min_area", &g_cfg.min_area, "最小瞳孔轮廓面积（像素）"),
+    CFG_INT("blob_detector", &g_cfg.blob_detector, "候选提取：0 = findContours，1 = 单遍行程连通域"),
+    CFG_INT("ellipse_fit", &g_cfg.ellipse_fit, "1 = 边缘点椭圆拟合求中心，0 = 亚像素质心"),
+    CFG_INT("candidates", &g_cfg.candidates, "每路每帧保留的候选数（1..4；>1 时按极线约束关联左右候选，适合双眼 / 反光点干扰）"),
+    CFG_FLOAT("epipolar_max_px", &g_cfg.epipolar_max_px, "候选关联允许的极线距离（右图像素，candidates > 1 时生效）"),
+    CFG_INT("epipolar_search", &g_cfg.epipolar_search, "1 = 右相机重新捕获时等待左相机结果，只在其极线带（depth_min..depth_max）内搜索"),
+    CFG_INT("depth_min", &g_cfg.depth_min, "极线带最近深度（左相机 Z，单位同标定 T）"),
+    CFG_INT("depth_max", &g_cfg.depth_max, "极线带最远深度"),
+    CFG_INT("track_roi_min", &g_cfg.track_roi_min, "跟踪窗口最小边长（像素）"),
+    CFG_INT("pyramid_scale", &g_cfg.pyramid_scale, "重新捕获时粗搜索的降采样倍数（1 = 直接整帧检测）"),
+    CFG_INT("track_max_misses", &g_cfg.track_max_misses, "锁定后连续丢失多少帧回到整帧搜索（0 = 每帧整帧检测）"),
+    CFG_INT("stereo_sync_us", &g_cfg.stereo_sync_us, "左右帧时间戳配对容差（us）"),
+    CFG_INT("stereo_wait_ms", &g_cfg.stereo_wait_ms, "等待一对帧的超时（ms）"),
+    CFG_FLOAT("filter_alpha", &g_cfg.filter_alpha, "三维 α-β 滤波器位置增益（1 = 不平滑）"),
+    CFG_FLOAT("filter_beta", &g_cfg.filter_beta, "三维 α-β 滤波器速度增益（0 = 不估计速度）"),
+    CFG_INT("filter_coast_ms", &g_cfg.filter_coast_ms, "缺测时按预测继续输出的最长时间（ms，0 = 不外推）"),
+    CFG_INT("serial_format", &g_cfg.serial_format, "串口输出格式：0 = 文本 X,Y,Z，1 = 二进制 float32，2 = 二进制 int16 定点"),
+    CFG_INT("serial_baud", &g_cfg.serial_baud, "串口波特率（115200 / 230400 / 460800 / 921600 / 1500000 ...）"),
+    CFG_INT("serial_max_age_ms", &g_cfg.serial_max_age_ms, "采集后超过此时间仍未发出的样本丢弃（ms，0 = 不丢弃）"),
+    CFG_INT("stats_interval_ms", &g_cfg.stats_interval_ms, "统计报告间隔（ms，0 = 只在 kill -USR1 时打印）"),
+    CFG_INT("verbose", &g_cfg.verbose, "控制台输出：0 = 静默，1 = 统计报告，2 = 另外逐帧打印三维位置"),
 };
 
 std::atomic<bool> g_running(true);  // 全局运行标志，用于控制主循环退出
 
+// 单调时钟（us），与驱动帧时间戳同一时基
+static long long now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/*
+ * 各级延迟直方图（单位 us，对数分桶：< 16 us 每 us 一桶，之后每个 2 的幂区间 8 桶，相对误差 ≤ 12.5%）
+ *   capture - 驱动时间戳 → 主循环拿到配对帧（DQBUF 与左右配对）
+ *   luma    - 提取亮度（及调试用 BGR 转换）
+ *   detect  - track_pupil：阈值、连通域 / 轮廓、椭圆拟合
+ *   fuse    - 三角测量 + 滤波 + 编码
+ *   serial  - write() 写出一个样本
+ *   total   - 驱动时间戳 → 样本写完（端到端）
+ *   各线程用 relaxed 原子累加；报告时逐桶 exchange(0)，即每个报告周期一份滚动分布。
+ */
+enum lat_stage { LAT_CAPTURE, LAT_LUMA, LAT_DETECT, LAT_FUSE, LAT_SERIAL, LAT_TOTAL, LAT_STAGES };
+static const char *const k_lat_names[LAT_STAGES] = { "capture", "luma", "detect", "fuse", "serial", "total" };
+#define LAT_BINS (16 + 26 * 8)        // 覆盖到 2^30 us
+
+static std::atomic<unsigned> g_lat[LAT_STAGES][LAT_BINS];
+
+static int lat_bin(long long us) {
+    if (us < 16) return us < 0 ? 0 : (int)us;
+    int e = 63 - __builtin_clzll((unsigned long long)us);     // us ∈ [2^e, 2^(e+1))
+    int b = 16 + (e - 4) * 8 + (int)((us >> (e - 3)) & 7);
+    return std::min(b, LAT_BINS - 1);
+}
+
+// 桶的上界（us），报告百分位时取上界，偏保守
+static long long lat_bin_upper(int b) {
+    if (b < 16) return b + 1;
+    int e = (b - 16) / 8 + 4, sub = (b - 16) % 8;
+    return (1LL << e) + ((long long)(sub + 1) << (e - 3));
+}
+
+static inline void lat_record(int stage, long long us) {
+    g_lat[stage][lat_bin(us)].fetch_add(1, std::memory_order_relaxed);
+}
+
+static std::atomic<unsigned> g_out_samples{0}, g_out_measured{0};  // 汇合线程输出的样本数 / 其中实测数
+
 /**
  * 函数名: monitor_key_event
  * 功能: 监听 Linux 输入事件设备 /dev/input/event1，
@@ -48,10 +264,10 @@ std::atomic<bool> g_running(true);  // 全局运行标志，用于控制主循
 void monitor_key_event() {
     // 打开输入事件设备文件（只读模式）
     // Linux 中所有输入事件（按键、触摸屏、鼠标等）都以 event 设备节点形式存在于 /dev/input 目录下。
-    int evfd = open("/dev/input/event1", O_RDONLY);
+    int evfd = open(g_cfg.input_device, O_RDONLY);
     if (evfd < 0) {
         // 若打开失败（文件不存在或权限不足），输出错误信息并返回。
-        perror("open /dev/input/event1 failed");
+        perror(g_cfg.input_device);
         return;
     }
 
@@ -82,32 +298,297 @@ void monitor_key_event() {
     close(evfd);
 }
 
+/**
+ * 函数名: extract_luma
+ * 功能: 从 YUYV 帧（Y0 U Y1 V）中取出 Y 通道，写入复用的单通道亮度图。
+ *
+ * 参数:
+ *   src    - YUYV 数据（可直接为驱动映射内存）
+ *   stride - 源行跨度（字节）
+ *   w/h    - 图像尺寸
+ *   gray   - 输出 CV_8UC1；尺寸不变时复用已有内存，不再分配
+ *
+ * 实现要点:
+ *   NEON 下 vld2q_u8 每次解交织 16 个像素的 Y 与 U/V，只保存 Y；行尾不足 16 像素时标量处理。
+ */
+static void extract_luma(const uint8_t *src, size_t stride, int w, int h, cv::Mat &gray) {
+    gray.create(h, w, CV_8UC1);
+    for (int y = 0; y < h; y++) {
+        const uint8_t *s = src + (size_t)y * stride;
+        uint8_t *d = gray.ptr<uint8_t>(y);
+        int x = 0;
+#if USE_NEON
+        for (; x + 16 <= w; x += 16) {
+            uint8x16x2_t yc = vld2q_u8(s + 2 * x);
+            vst1q_u8(d + x, yc.val[0]);
+        }
+#endif
+        for (; x < w; x++) d[x] = s[2 * x];
+    }
+}
+
+// 行程（同一行内连续的瞳孔像素 [x0, x1]）
+struct blob_run {
+    int x0, x1, y;
+    int parent;                       // 并查集父节点（行程下标）
+    int overlap;                      // 与上一行相连行程的重叠列数（用于周长）
+};
+
+// 连通域统计量（按根行程累加）
+struct blob_stats {
+    long long area;                   // 像素数
+    long long edges;                  // 4 邻域边界边数（裂缝周长）
+    double sx, sy;                    // 一阶矩 Σx, Σy
+    double sxx, syy, sxy;             // 二阶矩 Σx², Σy², Σxy
+    int x0, y0, x1, y1;               // 外接矩形
+};
+
+// 瞳孔候选（检测器输出，按与参考点的距离升序，第一个即 detect_pupil 的返回值）
+struct pupil_candidate {
+    cv::Point2f pt;                   // 中心亚像素坐标
+    float radius;                     // 等效半径 sqrt(面积/π)
+};
+
+/*
+ * 检测器暂存区（每个检测线程一份，跨帧复用）
+ *   binary 按出现过的最大尺寸分配一次，每次检测只使用其左上角与输入同尺寸的子区域
+ *   （子区域只是矩阵头，不分配）；contours 的外层与内层 vector 保留容量，
+ *   稳态下每帧不再有堆分配（uClibc 上的分配抖动会直接表现为延迟尖峰）。
+ */
+struct pupil_detector {
+    std::vector<pupil_candidate> cands;               // 本次检出的候选（最多 candidates 个）
+    cv::Mat binary;                                   // 二值化缓冲（轮廓检测器）
+    std::vector<std::vector<cv::Point>> contours;    // 轮廓存储（轮廓检测器）
+    std::vector<blob_run> runs;                       // 行程表（行程检测器）
+    std::vector<blob_stats> stats;                    // 连通域统计（行程检测器）
+    std::vector<cv::Point2f> edge;                    // 边缘点（椭圆拟合）
+    int thresh = -1;                                  // 当前二值化阈值（-1 = 尚未初始化）
+};
+
+/**
+ * 函数名: ellipse_center
+ * 功能: 椭圆拟合结果的合理性检查：轴长为正、短长轴比不小于 0.3、中心落在候选外接矩形内。
+ *
+ * 返回值:
+ *   true 时 *c 为椭圆中心；false 表示拟合不可信（调用方保留质心）
+ */
+static bool ellipse_center(const cv::RotatedRect &e, float x0, float y0, float x1, float y1,
+                           cv::Point2f *c) {
+    float a = std::max(e.size.width, e.size.height), b = std::min(e.size.width, e.size.height);
+    if (!(b > 0) || b < 0.3f * a) return false;
+    if (e.center.x < x0 || e.center.x > x1 || e.center.y < y0 || e.center.y > y1) return false;
+    *c = e.center;
+    return true;
+}
+
+// 候选排序槽：筛选过程中按距离平方保持升序的前 K 个
+struct cand_slot {
+    double dist2, area;
+    cv::Point2f center;
+    int idx;                          // 连通域根行程 / 轮廓下标
+};
+
+// 插入一个候选，只保留距离最小的 k 个（k 很小，直接插入排序）
+static void cand_insert(cand_slot *top, int *n, int k, const cand_slot &c) {
+    if (*n == k && c.dist2 >= top[k - 1].dist2) return;
+    int i = *n < k ? (*n)++ : k - 1;
+    while (i > 0 && top[i - 1].dist2 > c.dist2) {
+        top[i] = top[i - 1];
+        i--;
+    }
+    top[i] = c;
+}
+
+// 并查集查找（路径减半）
+static int blob_find(std::vector<blob_run> &runs, int i) {
+    while (runs[i].parent != i) {
+        runs[i].parent = runs[runs[i].parent].parent;
+        i = runs[i].parent;
+    }
+    return i;
+}
+
+// 合并两个行程所在的连通域（根取较小下标，即最早出现的行程）
+static void blob_union(std::vector<blob_run> &runs, int a, int b) {
+    a = blob_find(runs, a);
+    b = blob_find(runs, b);
+    if (a < b) runs[b].parent = a;
+    else if (b < a) runs[a].parent = b;
+}
+
+/**
+ * 函数名: detect_pupil_rle
+ * 功能:
+ *   单遍行程编码连通域标记，代替 findContours + contourArea + arcLength + moments
+ *   对每个轮廓的多次遍历：
+ *   1. 逐行扫描亮度图，灰度 <= 当前阈值（d.thresh）的连续像素记为一个行程（不生成二值图）；
+ *   2. 与上一行在 8 邻域意义下相接的行程用并查集合并，同时记录列重叠数；
+ *   3. 每个行程的面积、一阶 / 二阶矩、外接矩形按闭式公式累加到根；
+ *      4 邻域边界边数 = Σ(2 + 2·长度) − 2·Σ重叠，周长估计 = 边数 × π/4
+ *      （凸形的裂缝周长等于外接矩形周长，对圆为 4/π 倍真实周长）；
+ *   4. 按与 detect_pupil 相同的面积、圆度、参考点距离规则选出前 candidates 个候选，中心取亚像素质心；
+ *   5. ellipse_fit 打开时，取每个候选连通域各行程两端的阈值穿越点（按相邻像素灰度
+ *      线性插值到亚像素）拟合椭圆，以椭圆中心代替质心。
+ *
+ * 参数 / 返回值: 同 detect_pupil
+ */
+static cv::Point2f detect_pupil_rle(pupil_detector &d, const cv::Mat &gray, cv::Point ref,
+                                    double min_area, cv::Mat *overlay, float *radius) {
+    std::vector<blob_run> &runs = d.runs;
+    const int thr = d.thresh;
+    runs.clear();
+
+    // ---------- 1~2. 行程提取与连通合并 ----------
+    size_t prev_begin = 0, prev_end = 0;   // 上一行的行程区间 [prev_begin, prev_end)
+    for (int y = 0; y < gray.rows; y++) {
+        const uint8_t *row = gray.ptr<uint8_t>(y);
+        size_t cur_begin = runs.size();
+        for (int x = 0; x < gray.cols;) {
+            while (x < gray.cols && row[x] > thr) x++;
+            if (x >= gray.cols) break;
+            blob_run r;
+            r.x0 = x;
+            while (x < gray.cols && row[x] <= thr) x++;
+            r.x1 = x - 1;
+            r.y = y;
+            r.parent = static_cast<int>(runs.size());
+            r.overlap = 0;
+            runs.push_back(r);
+        }
+        size_t j = prev_begin;
+        for (size_t i = cur_begin; i < runs.size(); i++) {
+            blob_run &c = runs[i];
+            while (j < prev_end && runs[j].x1 < c.x0 - 1) j++;
+            for (size_t k = j; k < prev_end && runs[k].x0 <= c.x1 + 1; k++) {
+                blob_union(runs, static_cast<int>(i), static_cast<int>(k));
+                int ov = std::min(c.x1, runs[k].x1) - std::max(c.x0, runs[k].x0) + 1;
+                if (ov > 0) c.overlap += ov;
+            }
+        }
+        prev_begin = cur_begin;
+        prev_end = runs.size();
+    }
+
+    // ---------- 3. 统计量累加到根 ----------
+    std::vector<blob_stats> &st = d.stats;
+    st.resize(runs.size());
+    for (size_t i = 0; i < runs.size(); i++) {
+        const blob_run &r = runs[i];
+        blob_stats &b = st[blob_find(runs, static_cast<int>(i))];
+        if (runs[i].parent == static_cast<int>(i)) {
+            memset(&b, 0, sizeof(b));
+            b.x0 = r.x0; b.x1 = r.x1; b.y0 = b.y1 = r.y;
+        }
+        double n = r.x1 - r.x0 + 1;
+        double s1 = n * (r.x0 + r.x1) / 2;       // Σx
+        double s2 = (double)r.x1 * (r.x1 + 1) * (2.0 * r.x1 + 1) / 6 -
+                    (double)(r.x0 - 1) * r.x0 * (2.0 * r.x0 - 1) / 6;   // Σx²
+        b.area += (long long)n;
+        b.edges += 2 + 2 * (long long)n - 2 * r.overlap;
+        b.sx += s1;
+        b.sy += n * r.y;
+        b.sxx += s2;
+        b.syy += n * r.y * r.y;
+        b.sxy += s1 * r.y;
+        b.x0 = std::min(b.x0, r.x0);
+        b.x1 = std::max(b.x1, r.x1);
+        b.y1 = r.y;                              // 行按顺序扫描，最后一个行程所在行即下边界
+    }
+
+    // ---------- 4. 筛选 ----------
+    cand_slot top[MAX_CANDIDATES];
+    int ntop = 0, k = std::min(std::max(g_cfg.candidates, 1), MAX_CANDIDATES);
+    d.cands.clear();
+    for (size_t i = 0; i < runs.size(); i++) {
+        if (runs[i].parent != static_cast<int>(i)) continue;   // 只看根
+        const blob_stats &b = st[i];
+        double area = static_cast<double>(b.area);
+        if (area < min_area) continue;
+        double perimeter = b.edges * (CV_PI / 4);
+        double circularity = 4 * CV_PI * area / (perimeter * perimeter);
+        if (circularity < 0.7) continue;
+        double cx = b.sx / area, cy = b.sy / area;
+        double ox = cx - ref.x, oy = cy - ref.y;
+        cand_slot c = { ox * ox + oy * oy, area,
+                        cv::Point2f(static_cast<float>(cx), static_cast<float>(cy)), static_cast<int>(i) };
+        cand_insert(top, &ntop, k, c);
+    }
+    if (ntop == 0) return cv::Point2f(-1, -1);
+
+    // ---------- 5. 亚像素边缘椭圆拟合（可选） ----------
+    for (int j = 0; j < ntop && g_cfg.ellipse_fit; j++) {
+        const int best = top[j].idx;
+        std::vector<cv::Point2f> &edge = d.edge;
+        edge.clear();
+        for (size_t i = best; i < runs.size(); i++) {    // 根是该连通域最早的行程
+            const blob_run &r = runs[i];
+            if (blob_find(runs, static_cast<int>(i)) != best) continue;
+            const uint8_t *row = gray.ptr<uint8_t>(r.y);
+            float xl = r.x0 - 0.5f, xr = r.x1 + 0.5f;
+            if (r.x0 > 0) xl = (r.x0 - 1) + (float)(row[r.x0 - 1] - thr) / (row[r.x0 - 1] - row[r.x0]);
+            if (r.x1 + 1 < gray.cols) xr = r.x1 + (float)(thr - row[r.x1]) / (row[r.x1 + 1] - row[r.x1]);
+            edge.push_back(cv::Point2f(xl, static_cast<float>(r.y)));
+            edge.push_back(cv::Point2f(xr, static_cast<float>(r.y)));
+        }
+        const blob_stats &b = st[best];
+        if (edge.size() >= 5)
+            ellipse_center(cv::fitEllipse(edge), b.x0 - 1.0f, b.y0 - 1.0f, b.x1 + 1.0f, b.y1 + 1.0f,
+                           &top[j].center);
+    }
+    for (int j = 0; j < ntop; j++)
+        d.cands.push_back({ top[j].center, static_cast<float>(std::sqrt(top[j].area / CV_PI)) });
+
+    cv::Point2f best_center = top[0].center;
+    float r = d.cands[0].radius;
+    if (radius) *radius = r;
+#if !HEADLESS
+    if (overlay) {
+        cv::drawMarker(*overlay, cv::Point(cvRound(best_center.x), cvRound(best_center.y)),
+                       cv::Scalar(0, 255, 0), cv::MARKER_CROSS, 10, 2);
+        cv::circle(*overlay, best_center, static_cast<int>(r), cv::Scalar(0, 0, 255), 2);
+    }
+#else
+    (void)overlay;
+#endif
+    return best_center;
+}
+
 /**
  * 函数名: detect_pupil
- * 功能: 从单帧图像中检测瞳孔的中心点位置（像素坐标）。
+ * 功能: 从单帧亮度图中检测瞳孔的中心点位置（像素坐标）。
  *
  * 算法流程:
- *   1. 将输入图像转为灰度；
+ *   1. 输入即摄像头 YUYV 的 Y 通道（extract_luma），无需颜色转换；
  *   2. 通过阈值分割反转得到黑色瞳孔区域；
  *   3. 提取所有轮廓并计算面积、圆度；
- *   4. 筛选出最接近中心且近似圆形的轮廓；
- *   5. 计算该轮廓的几何中心并返回。
+ *   4. 筛选出最接近参考点且近似圆形的轮廓（candidates > 1 时同一遍内保留最接近的前 K 个）；
+ *   5. 计算各候选的亚像素质心（ellipse_fit 打开时改用轮廓点拟合的椭圆中心），返回最接近者。
  *
  * 参数:
- *   img - 输入帧 (OpenCV BGR 格式图像)
+ *   d       - 检测器暂存区（二值图与轮廓存储）
+ *   gray    - 输入亮度图 (CV_8UC1，可以是整帧中的 ROI)
+ *   ref     - 参考点（gray 坐标系）：整帧搜索为图像中心，跟踪时为上一帧位置
+ *   min_area - 最小轮廓面积（gray 分辨率下的像素数）
+ *   overlay - 调试叠加图 (BGR，与 gray 同尺寸)；非空时在其上绘制检测标记
+ *   radius  - 非空时输出等效半径 sqrt(面积/π)（像素）
  *
  * 返回值:
- *   cv::Point(x, y) - 瞳孔中心坐标；若检测失败则返回 (-1, -1)
+ *   cv::Point2f(x, y) - 瞳孔中心亚像素坐标（gray 坐标系）；若检测失败则返回 (-1, -1)
+ *   全部候选（含返回值）按距离升序写入 d.cands（gray 坐标系，未检出时为空）
  */
-cv::Point detect_pupil(cv::Mat &img) {
-    cv::Mat gray, binary;
+cv::Point2f detect_pupil(pupil_detector &d, const cv::Mat &gray, cv::Point ref, double min_area,
+                       cv::Mat *overlay = nullptr, float *radius = nullptr) {
+    if (g_cfg.blob_detector == BLOB_RLE) return detect_pupil_rle(d, gray, ref, min_area, overlay, radius);
+
+    if (d.binary.rows < gray.rows || d.binary.cols < gray.cols)
+        d.binary.create(std::max(d.binary.rows, gray.rows), std::max(d.binary.cols, gray.cols), CV_8UC1);
+    cv::Mat binary = d.binary(cv::Rect(0, 0, gray.cols, gray.rows));
 
     /************************************************************
-     * Step 1: 转灰度图像
-     * 原图为 BGR 彩色帧，瞳孔检测只关心亮度信息；
-     * 因此通过 cvtColor() 转换为单通道灰度图。
+     * Step 1: 亮度图
+     * 瞳孔检测只关心亮度信息，摄像头输出的 Y 通道即灰度图，
+     * 由调用方从 YUYV 帧中直接提取（见 extract_luma）。
      ************************************************************/
-    cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
 
     /************************************************************
      * Step 2: 阈值分割 (二值化)
@@ -115,38 +596,41 @@ cv::Point detect_pupil(cv::Mat &img) {
      * 转换为白色 (255)，背景变为黑色 (0)，方便后续轮廓提取。
      *
      * 参数解释:
-     *   THRESH_MAX = 40 → 灰度值小于40的像素视为瞳孔
+     *   d.thresh（初值 thresh_max，自适应时逐帧更新）→ 灰度值不高于该值的像素视为瞳孔
      *   255 → 白色输出值
      ************************************************************/
-    cv::threshold(gray, binary, THRESH_MAX, 255, cv::THRESH_BINARY_INV);
+    cv::threshold(gray, binary, d.thresh, 255, cv::THRESH_BINARY_INV);
 
     /************************************************************
      * Step 3: 提取所有轮廓
      * 使用 cv::findContours() 提取外轮廓，忽略内层结构。
-     * 结果为一个二维 vector，每个轮廓由一系列点构成。
+     * 结果为一个二维 vector，每个轮廓由一系列点构成（复用 d.contours 的容量）。
      ************************************************************/
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    std::vector<std::vector<cv::Point>> &contours = d.contours;
+    // 椭圆拟合需要完整的边界点，不压缩
+    cv::findContours(binary, contours, cv::RETR_EXTERNAL,
+                     g_cfg.ellipse_fit ? cv::CHAIN_APPROX_NONE : cv::CHAIN_APPROX_SIMPLE);
 
     /************************************************************
-     * Step 4: 初始化最优瞳孔参数
-     *   best_center → 最优瞳孔的中心坐标
-     *   min_dist2 → 当前最接近图像中心的瞳孔距离平方
+     * Step 4: 初始化候选表
+     *   top[0..ntop) → 按与参考点距离平方升序的前 k 个候选
+     *   idx → 候选轮廓的下标（只记下标，不复制轮廓）
      ************************************************************/
-    cv::Point best_center(-1, -1);
-    double min_dist2 = DBL_MAX;
-    std::vector<cv::Point> best_contour;
+    cand_slot top[MAX_CANDIDATES];
+    int ntop = 0, k = std::min(std::max(g_cfg.candidates, 1), MAX_CANDIDATES);
+    d.cands.clear();
 
     /************************************************************
      * Step 5: 遍历所有轮廓，筛选出最符合条件的瞳孔
      ************************************************************/
-    for (const auto &cnt : contours) {
+    for (size_t i = 0; i < contours.size(); i++) {
+        const std::vector<cv::Point> &cnt = contours[i];
         /******************* (1) 面积筛选 *******************
          * 忽略过小的区域（如噪声点、反光点等）
-         * MIN_AREA 在宏定义中设置为 1500 像素
+         * min_area 默认为 MIN_AREA = 1500 像素，可在配置中调整
          ************************************************************/
         double area = cv::contourArea(cnt);
-        if (area < MIN_AREA) continue;
+        if (area < min_area) continue;
 
         /******************* (2) 周长计算 *******************
          * arcLength() 返回闭合轮廓的长度；
@@ -169,39 +653,58 @@ cv::Point detect_pupil(cv::Mat &img) {
          ************************************************************/
         cv::Moments M = cv::moments(cnt);
         if (M.m00 == 0) continue;
-        int cx = static_cast<int>(M.m10 / M.m00);
-        int cy = static_cast<int>(M.m01 / M.m00);
+        double cx = M.m10 / M.m00;
+        double cy = M.m01 / M.m00;
 
         /******************* (5) 中心偏移度判断 *******************
-         * 计算该轮廓中心与图像中心的欧式距离平方；
-         * 取距离最小者作为最终瞳孔区域。
+         * 计算该轮廓中心与参考点的欧式距离平方；
+         * 距离最小者作为最终瞳孔区域，其后 k − 1 个作为备选候选。
          ************************************************************/
-        double dist2 = (cx - CENTER_X) * (cx - CENTER_X) + (cy - CENTER_Y) * (cy - CENTER_Y);
-
-        if (dist2 < min_dist2) {
-            min_dist2 = dist2;
-            best_center = cv::Point(cx, cy);
-            best_contour = cnt;
-        }
+        double ox = cx - ref.x, oy = cy - ref.y;   // 相对参考点
+        cand_slot c = { ox * ox + oy * oy, area,
+                        cv::Point2f(static_cast<float>(cx), static_cast<float>(cy)), static_cast<int>(i) };
+        cand_insert(top, &ntop, k, c);
     }
 
     /************************************************************
-     * Step 6: 若检测到有效瞳孔，绘制辅助标记
+     * Step 6: 若检测到有效瞳孔，可选椭圆拟合，并绘制辅助标记（仅调试叠加）
      ************************************************************/
-    if (!best_contour.empty()) {
-        float radius;
-        cv::Point2f enclosing_center;
-
-        // 用最小外接圆包围该轮廓，估计瞳孔边界半径
-        cv::minEnclosingCircle(best_contour, enclosing_center, radius);
-
-        // 绘制十字中心标记 (绿色)
-        cv::drawMarker(img, best_center, cv::Scalar(0, 255, 0),
-                       cv::MARKER_CROSS, 10, 2);
-
-        // 绘制圆形边界线 (红色)
-        cv::circle(img, enclosing_center,
-                   static_cast<int>(radius), cv::Scalar(0, 0, 255), 2);
+    if (ntop > 0) {
+        for (int j = 0; j < ntop; j++) {
+            const std::vector<cv::Point> &cnt = contours[top[j].idx];
+            if (g_cfg.ellipse_fit && cnt.size() >= 5) {
+                int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+                for (const cv::Point &q : cnt) {
+                    x0 = std::min(x0, q.x); x1 = std::max(x1, q.x);
+                    y0 = std::min(y0, q.y); y1 = std::max(y1, q.y);
+                }
+                ellipse_center(cv::fitEllipse(cnt), (float)x0, (float)y0, (float)x1, (float)y1,
+                               &top[j].center);
+            }
+            d.cands.push_back({ top[j].center, static_cast<float>(std::sqrt(top[j].area / CV_PI)) });
+        }
+        cv::Point2f best_center = top[0].center;
+        if (radius) *radius = d.cands[0].radius;
+#if !HEADLESS
+        const int best = top[0].idx;
+        if (overlay) {
+            float r;
+            cv::Point2f enclosing_center;
+
+            // 用最小外接圆包围该轮廓，估计瞳孔边界半径
+            cv::minEnclosingCircle(contours[best], enclosing_center, r);
+
+            // 绘制十字中心标记 (绿色)
+            cv::drawMarker(*overlay, cv::Point(cvRound(best_center.x), cvRound(best_center.y)),
+                           cv::Scalar(0, 255, 0), cv::MARKER_CROSS, 10, 2);
+
+            // 绘制圆形边界线 (红色)
+            cv::circle(*overlay, enclosing_center,
+                       static_cast<int>(r), cv::Scalar(0, 0, 255), 2);
+        }
+#else
+        (void)overlay;
+#endif
 
         // 返回检测到的瞳孔中心坐标
         return best_center;
@@ -210,7 +713,628 @@ cv::Point detect_pupil(cv::Mat &img) {
     /************************************************************
      * Step 7: 若未检测到瞳孔，返回无效坐标 (-1, -1)
      ************************************************************/
-    return cv::Point(-1, -1);
+    return cv::Point2f(-1, -1);
+}
+
+/*
+ * 单路瞳孔跟踪状态（每个检测线程一份）
+ *   锁定时只在上一帧位置周围的方形窗口内检测；丢失时窗口加倍，
+ *   连续丢失超过 track_max_misses 帧后解锁，回到整帧搜索。
+ */
+struct pupil_tracker {
+    bool locked = false;
+    cv::Point center;                 // 上一次检出的位置（整帧坐标）
+    int half = 0;                     // 当前搜索窗口半边长（像素）
+    float radius = 0;                 // 上一次检出的等效半径
+    int misses = 0;                   // 锁定后连续未检出的帧数
+    cv::Mat coarse;                   // 粗搜索用的降采样亮度图（复用）
+    pupil_detector det;               // 检测暂存区
+    unsigned hist[256];               // 自适应阈值直方图
+};
+
+/**
+ * 函数名: update_threshold
+ * 功能:
+ *   在即将检测的区域上统计 256 级灰度直方图，取暗峰（瞳孔）之后的谷底作为新阈值，
+ *   并以 1/4 权重平滑到当前阈值，适应红外照明变化而不逐帧跳变：
+ *   1. 按 step 抽样统计直方图（已锁定时区域只是跟踪窗口，开销很小）；
+ *   2. 在 [thresh_min, thresh_limit] 内自暗向亮，5 点滑动和首次达到 min_pixels / 16 后
+ *      爬升到的局部极大为暗峰（面积更大的虹膜峰不会被误选）；
+ *   3. 自暗峰向亮处找最小值（平坦谷底取中点），回升到谷底两倍以上即停止（已进入虹膜 / 皮肤峰）；
+ *   4. 谷底以下的抽样像素不足半个瞳孔面积时认为区域内没有瞳孔，阈值不变。
+ *
+ * 参数:
+ *   region     - 即将检测的亮度图区域
+ *   step       - 抽样间隔（行列相同）
+ *   min_pixels - 区域内一个最小瞳孔对应的抽样像素数
+ */
+static void update_threshold(pupil_tracker &t, const cv::Mat &region, int step, double min_pixels) {
+    pupil_detector &d = t.det;
+    if (d.thresh < 0 || !g_cfg.thresh_adaptive) d.thresh = g_cfg.thresh_max;
+    if (!g_cfg.thresh_adaptive) return;
+
+    // ---------- 1. 直方图 ----------
+    unsigned *h = t.hist;
+    memset(t.hist, 0, sizeof(t.hist));
+    for (int y = 0; y < region.rows; y += step) {
+        const uint8_t *row = region.ptr<uint8_t>(y);
+        for (int x = 0; x < region.cols; x += step) h[row[x]]++;
+    }
+    auto smooth = [h](int v) {
+        unsigned sum = 0;
+        for (int i = std::max(v - 2, 0); i <= std::min(v + 2, 255); i++) sum += h[i];
+        return sum;
+    };
+
+    // ---------- 2. 暗峰 ----------
+    int lo = std::max(g_cfg.thresh_min, 0), hi = std::min(g_cfg.thresh_limit, 254);
+    unsigned peak_min = static_cast<unsigned>(min_pixels / 16) + 1;
+    int peak = lo;
+    while (peak <= hi && smooth(peak) < peak_min) peak++;
+    if (peak > hi) return;                               // 范围内没有足够暗的像素
+    while (peak < hi && smooth(peak + 1) >= smooth(peak)) peak++;
+    unsigned peak_n = smooth(peak);
+
+    // ---------- 3. 谷底 ----------
+    int vs = peak, ve = peak;                            // 谷底平台 [vs, ve]，取中点
+    unsigned valley_n = peak_n;
+    for (int v = peak + 1; v <= hi; v++) {
+        unsigned n = smooth(v);
+        if (n < valley_n) { valley_n = n; vs = ve = v; }
+        else if (n == valley_n && ve == v - 1) ve = v;
+        else if (n > 2 * valley_n + 4) break;
+    }
+    int valley = (vs + ve) / 2;
+
+    // ---------- 4. 采纳 ----------
+    double below = 0;
+    for (int v = 0; v <= valley; v++) below += h[v];
+    if (below < min_pixels / 2) return;
+    d.thresh = (3 * d.thresh + valley + 2) / 4;
+}
+
+/**
+ * 函数名: detect_in_rect
+ * 功能: 只在 roi（须已与图像求交）内检测，center 为整帧坐标的参考点，返回整帧坐标（候选同样换算）。
+ */
+static cv::Point2f detect_in_rect(pupil_detector &d, const cv::Mat &gray, const cv::Rect &roi, cv::Point center,
+                                  cv::Mat *overlay, float *radius) {
+    cv::Mat sub = gray(roi), sub_overlay;
+    if (overlay) sub_overlay = (*overlay)(roi);
+    cv::Point2f pt = detect_pupil(d, sub, cv::Point(center.x - roi.x, center.y - roi.y), g_cfg.min_area,
+                                overlay ? &sub_overlay : nullptr, radius);
+    if (pt.x >= 0) pt = cv::Point2f(pt.x + roi.x, pt.y + roi.y);
+    for (pupil_candidate &c : d.cands) c.pt = cv::Point2f(c.pt.x + roi.x, c.pt.y + roi.y);
+    return pt;
+}
+
+/**
+ * 函数名: detect_in_window
+ * 功能: 只在 center ± half 的窗口（与图像求交）内检测，返回整帧坐标。
+ */
+static cv::Point2f detect_in_window(pupil_detector &d, const cv::Mat &gray, cv::Point center, int half,
+                                  cv::Mat *overlay, float *radius) {
+    cv::Rect roi(center.x - half, center.y - half, 2 * half, 2 * half);
+    roi = roi & cv::Rect(0, 0, gray.cols, gray.rows);
+    return detect_in_rect(d, gray, roi, center, overlay, radius);
+}
+
+// 检出后窗口半边长：半径 × TRACK_ROI_SCALE，且不小于 track_roi_min / 2
+static int track_half(float radius) {
+    return std::max(static_cast<int>(radius * TRACK_ROI_SCALE), g_cfg.track_roi_min / 2);
+}
+
+/**
+ * 函数名: acquire_pupil
+ * 功能: 无先验位置时的由粗到精搜索。
+ *
+ * 流程:
+ *   1. 亮度图按 pyramid_scale 降采样（INTER_AREA 块平均，640×480 → 160×120），
+ *      以面积下限 min_area / scale² 整帧检测出候选；
+ *   2. 只在候选位置周围（换算回原分辨率）的窗口内用原图精确定位，保持全分辨率精度；
+ *      candidates > 1 时粗图的每个候选各精定位一次，结果按粗图顺序汇总到 t.det.cands。
+ *   pyramid_scale <= 1 时直接整帧检测。
+ *
+ * 返回值:
+ *   瞳孔中心（整帧亚像素坐标，即第一个精定位成功的候选）；未检出为 (-1, -1)
+ */
+static cv::Point2f acquire_pupil(pupil_tracker &t, const cv::Mat &gray, cv::Mat *overlay,
+                               float *radius) {
+    int k = g_cfg.pyramid_scale;
+    if (k <= 1) {
+        update_threshold(t, gray, 2, g_cfg.min_area / 4.0);
+        return detect_pupil(t.det, gray, cv::Point(gray.cols / 2, gray.rows / 2), g_cfg.min_area,
+                            overlay, radius);
+    }
+
+    // ---------- 1. 粗搜索 ----------
+    cv::resize(gray, t.coarse, cv::Size(gray.cols / k, gray.rows / k), 0, 0, cv::INTER_AREA);
+    update_threshold(t, t.coarse, 1, (double)g_cfg.min_area / (k * k));
+    cv::Point2f c = detect_pupil(t.det, t.coarse, cv::Point(t.coarse.cols / 2, t.coarse.rows / 2),
+                               (double)g_cfg.min_area / (k * k), nullptr, nullptr);
+    if (c.x < 0) return c;
+
+    // ---------- 2. 原分辨率精定位 ----------
+    // 粗图像素 i 覆盖原图 [i·k, i·k + k - 1]，中心为 i·k + (k - 1) / 2
+    pupil_candidate coarse[MAX_CANDIDATES], fine[MAX_CANDIDATES];
+    int nc = 0, nf = 0;
+    for (const pupil_candidate &q : t.det.cands) coarse[nc++] = q;
+    for (int i = 0; i < nc; i++) {
+        cv::Point center(cvRound(coarse[i].pt.x * k + (k - 1) * 0.5f),
+                         cvRound(coarse[i].pt.y * k + (k - 1) * 0.5f));
+        if (detect_in_window(t.det, gray, center, track_half(coarse[i].radius * k), overlay, nullptr).x >= 0)
+            fine[nf++] = t.det.cands[0];
+    }
+    t.det.cands.assign(fine, fine + nf);
+    if (nf == 0) return cv::Point2f(-1, -1);
+    if (radius) *radius = fine[0].radius;
+    return fine[0].pt;
+}
+
+/**
+ * 函数名: acquire_in_bands
+ * 功能: 已知另一相机的结果时的重新捕获：只在给定的极线带 bands（整帧坐标，见 epipolar_bands）内
+ *       检测，每个带按自身直方图更新阈值，各带候选依次汇总到 t.det.cands（最多 MAX_CANDIDATES 个）。
+ *       n = 0（另一相机未检出）时不做任何搜索。
+ *
+ * 返回值:
+ *   第一个检出的候选中心（整帧坐标）；未检出为 (-1, -1)
+ */
+static cv::Point2f acquire_in_bands(pupil_tracker &t, const cv::Mat &gray, const cv::Rect *bands, int n,
+                                    cv::Mat *overlay, float *radius) {
+    pupil_candidate found[MAX_CANDIDATES];
+    int nf = 0;
+    for (int i = 0; i < n && nf < MAX_CANDIDATES; i++) {
+        const cv::Rect &b = bands[i];
+        update_threshold(t, gray(b), 1, g_cfg.min_area);
+        cv::Point ref(b.x + b.width / 2, b.y + b.height / 2);
+        if (detect_in_rect(t.det, gray, b, ref, overlay, nullptr).x < 0) continue;
+        for (const pupil_candidate &c : t.det.cands)
+            if (nf < MAX_CANDIDATES) found[nf++] = c;
+    }
+    t.det.cands.assign(found, found + nf);
+    if (nf == 0) return cv::Point2f(-1, -1);
+    if (radius) *radius = found[0].radius;
+    return found[0].pt;
+}
+
+// 本帧 track_pupil 是否会重新捕获（整帧或极线带搜索），而不是在跟踪窗口内检测
+static bool track_needs_acquire(const pupil_tracker &t, bool has_pred) {
+    return g_cfg.track_max_misses <= 0 || (!t.locked && !has_pred);
+}
+
+/**
+ * 函数名: track_pupil
+ * 功能: 带 ROI 跟踪的瞳孔检测。
+ *
+ * 流程:
+ *   1. 未锁定且没有预测（或 track_max_misses = 0 关闭跟踪）：由粗到精搜索（acquire_pupil），
+ *      给出极线带时改为只在带内搜索（acquire_in_bands）；
+ *   2. 窗口中心：有三维滤波器的预测时取预测位置，否则取上次位置；
+ *      有预测且上一帧检出时窗口收紧为 半径 × TRACK_PRED_SCALE，否则为 half；
+ *   3. 检出：锁定并更新位置，half = track_half(半径)，清零丢失计数；
+ *      未检出：窗口加倍，连续丢失过多时解锁（未锁定时只等待预测失效后重新捕获）。
+ *
+ * 参数:
+ *   t       - 本路跟踪状态
+ *   gray    - 整帧亮度图
+ *   pred    - 本帧的预测位置（整帧坐标，可为空）
+ *   overlay - 调试叠加图（可为空）
+ *   bands   - 重新捕获时的搜索区域（整帧坐标，可为空 = 整帧由粗到精），nbands 为个数
+ *
+ * 返回值:
+ *   瞳孔中心（整帧坐标）；未检出为 (-1, -1)
+ *   全部候选（整帧坐标，第一个即返回值）留在 t.det.cands 中
+ */
+cv::Point2f track_pupil(pupil_tracker &t, const cv::Mat &gray, const cv::Point2f *pred,
+                        cv::Mat *overlay, const cv::Rect *bands = nullptr, int nbands = 0) {
+    float radius = 0;
+    bool tracking = g_cfg.track_max_misses > 0;
+
+    // ---------- 1. 重新捕获 ----------
+    if (track_needs_acquire(t, pred != nullptr)) {
+        cv::Point2f pt = bands ? acquire_in_bands(t, gray, bands, nbands, overlay, &radius)
+                               : acquire_pupil(t, gray, overlay, &radius);
+        if (pt.x >= 0 && tracking) {
+            t.locked = true;
+            t.center = cv::Point(cvRound(pt.x), cvRound(pt.y));
+            t.radius = radius;
+            t.half = track_half(radius);
+            t.misses = 0;
+        }
+        return pt;
+    }
+
+    // ---------- 2. 窗口内检测（阈值按窗口直方图更新） ----------
+    cv::Point center = pred ? cv::Point(cvRound(pred->x), cvRound(pred->y)) : t.center;
+    int half = t.half;
+    if (pred && t.locked && t.misses == 0)
+        half = std::max(static_cast<int>(t.radius * TRACK_PRED_SCALE), g_cfg.track_roi_min / 2);
+    cv::Rect win = cv::Rect(center.x - half, center.y - half, 2 * half, 2 * half) &
+                   cv::Rect(0, 0, gray.cols, gray.rows);
+    update_threshold(t, gray(win), 1, g_cfg.min_area);
+    cv::Point2f pt = detect_in_window(t.det, gray, center, half, overlay, &radius);
+
+    // ---------- 3. 更新跟踪状态 ----------
+    if (pt.x >= 0) {
+        t.locked = true;
+        t.center = cv::Point(cvRound(pt.x), cvRound(pt.y));
+        t.radius = radius;
+        t.half = track_half(radius);
+        t.misses = 0;
+    } else if (t.locked && ++t.misses > g_cfg.track_max_misses) {
+        t.locked = false;
+    } else if (t.locked) {
+        t.half = half * 2;
+    }
+    return pt;
+}
+
+/*
+ * 双目标定参数（Matlab 双目标定 stereoParams.mat，左相机坐标系为世界坐标系）
+ *   右相机坐标系中的点 X_R 与左相机坐标的关系：X_L = R·X_R + T
+ *   启动时由 calib_file 载入（load_calibration），文件缺失时使用下面的内置值（无畸变）；
+ *   运行中 kill -HUP <pid> 重新载入（calib_reload）。
+ *   文件由 export_stereo_params_to_cpp.m 生成，格式版本不高于 CALIB_VERSION 才接受。
+ */
+#define CALIB_VERSION 1       // 标定文件格式版本（calib_version 节点）
+
+struct stereo_calib {
+    double fx[2], fy[2];              // 左 / 右相机焦距（像素）
+    double cx[2], cy[2];              // 左 / 右相机主点
+    double dist[2][5];                // 左 / 右相机畸变系数（OpenCV 顺序 k1, k2, p1, p2, k3）
+    double R[9];                      // 右相机相对左相机的旋转（行优先）
+    double T[3];                      // 右相机相对左相机的平移（单位同标定板，通常为 mm）
+};
+
+static const stereo_calib k_builtin_calib = {
+    { 475.8266, 483.0534 }, { 477.8292, 484.4886 },
+    { 356.0519, 375.5120 }, { 272.4657, 276.3651 },
+    { { 0, 0, 0, 0, 0 }, { 0, 0, 0, 0, 0 } },
+    {  0.999313,  0.036906, -0.003363,
+      -0.036555,  0.996563,  0.074340,
+       0.006095, -0.074166,  0.997227 },
+    { -0.074773, -12.877214, -0.31784 },
+};
+
+// 从 FileStorage 读取一个矩阵节点的全部元素（按行展开），返回元素个数，节点缺失或超过 max_n 时返回 -1；
+// rows 非 0 时还要求矩阵恰为 rows 行（列数 = 元素个数 / rows）
+static int read_calib_node(const cv::FileStorage &fs, const char *name, double *out, int max_n, int rows = 0) {
+    cv::Mat m;
+    fs[name] >> m;
+    if (m.empty() || (int)m.total() > max_n || (rows && m.rows != rows)) return -1;
+    m.convertTo(m, CV_64F);
+    const double *p = m.ptr<double>();
+    for (int i = 0; i < (int)m.total(); i++) out[i] = p[i];
+    return (int)m.total();
+}
+
+/**
+ * 函数名: load_calibration
+ * 功能: 从 OpenCV YAML/XML 文件载入双目标定参数。
+ *
+ * 文件节点（与 cv::stereoCalibrate 的输出同名）:
+ *   calib_version             - 格式版本（可省略 = 版本 0，直接保存的 cv::stereoCalibrate 结果）
+ *   image_width, image_height - 标定图像分辨率（可省略；给出时须与采集分辨率一致）
+ *   K1, K2 - 3×3 内参矩阵
+ *   D1, D2 - 畸变系数 k1, k2, p1, p2[, k3]（4 或 5 个，可省略 = 无畸变）
+ *   R      - 3×3 旋转，T - 3×1 平移：
+ *              版本 ≥ 1（export_stereo_params_to_cpp.m 写出）满足 X_L = R·X_R + T，原样使用；
+ *              版本 0 为 stereoCalibrate 的约定 X_R = R·X_L + T，载入时换算为 R' = Rᵀ、T' = −Rᵀ·T
+ *
+ * 返回值:
+ *   0 成功（写入 *out）；-1 文件不存在；-2 文件格式错误或与当前分辨率不符（*out 不变）
+ */
+static int load_calibration(const char *path, stereo_calib *out) {
+    if (access(path, R_OK) != 0) return -1;
+    cv::FileStorage fs;
+    if (!fs.open(path, cv::FileStorage::READ)) {
+        fprintf(stderr, "[CALIB] %s: not an OpenCV YAML/XML file\n", path);
+        return -2;
+    }
+
+    // ---------- 1. 版本与分辨率 ----------
+    int version = fs["calib_version"].isNone() ? 0 : (int)fs["calib_version"];
+    if (version < 0 || version > CALIB_VERSION) {
+        fprintf(stderr, "[CALIB] %s: unsupported calib_version %d (max %d)\n", path, version, CALIB_VERSION);
+        return -2;
+    }
+    if (!fs["image_width"].isNone() &&
+        ((int)fs["image_width"] != g_cfg.width || (int)fs["image_height"] != g_cfg.height)) {
+        fprintf(stderr, "[CALIB] %s: calibrated at %dx%d, capture is %dx%d\n", path,
+                (int)fs["image_width"], (int)fs["image_height"], g_cfg.width, g_cfg.height);
+        return -2;
+    }
+
+    // ---------- 2. 内参、畸变、外参 ----------
+    stereo_calib c = {};
+    bool ok = read_calib_node(fs, "R", c.R, 9, 3) == 9 && read_calib_node(fs, "T", c.T, 3) == 3;
+    for (int cam = 0; ok && cam < 2; cam++) {
+        double K[9];
+        ok = read_calib_node(fs, cam == 0 ? "K1" : "K2", K, 9, 3) == 9 && K[0] > 0 && K[4] > 0;
+        if (!ok) break;
+        c.fx[cam] = K[0];
+        c.fy[cam] = K[4];
+        c.cx[cam] = K[2];
+        c.cy[cam] = K[5];
+        int nd = read_calib_node(fs, cam == 0 ? "D1" : "D2", c.dist[cam], 5);
+        if (nd >= 0 && nd < 4) ok = false;
+        if (nd < 0) memset(c.dist[cam], 0, sizeof(c.dist[cam]));
+    }
+    if (!ok) {
+        fprintf(stderr, "[CALIB] %s: missing or malformed K1/D1/K2/D2/R/T\n", path);
+        return -2;
+    }
+
+    // ---------- 3. 版本 0：stereoCalibrate 的左→右变换取逆，统一为 X_L = R·X_R + T ----------
+    if (version == 0) {
+        double R[9], T[3];
+        memcpy(R, c.R, sizeof(R));
+        memcpy(T, c.T, sizeof(T));
+        for (int i = 0; i < 3; i++) {
+            c.T[i] = 0;
+            for (int j = 0; j < 3; j++) {
+                c.R[i * 3 + j] = R[j * 3 + i];
+                c.T[i] -= R[j * 3 + i] * T[j];
+            }
+        }
+    }
+
+    *out = c;
+    printf("[CALIB] Loaded %s (v%d, D1 k1=%.4f, D2 k1=%.4f, |T|=%.2f)\n", path, version, c.dist[0][0],
+           c.dist[1][0], std::sqrt(c.T[0] * c.T[0] + c.T[1] * c.T[1] + c.T[2] * c.T[2]));
+    return 0;
+}
+
+// 对归一化坐标 (x, y) 施加镜头畸变（Brown-Conrady 模型，与 OpenCV 一致）
+static void distort_normalized(const double k[5], double x, double y, double *xd, double *yd) {
+    double r2 = x * x + y * y;
+    double radial = 1 + r2 * (k[0] + r2 * (k[1] + r2 * k[4]));
+    *xd = x * radial + 2 * k[2] * x * y + k[3] * (r2 + 2 * x * x);
+    *yd = y * radial + k[2] * (r2 + 2 * y * y) + 2 * k[3] * x * y;
+}
+
+/**
+ * 函数名: undistort_pixel
+ * 功能: 像素坐标 → 去畸变后的归一化坐标（不动点迭代，与 cv::undistortPoints 相同的方法）。
+ *       只在启动时建查找表用，逐帧路径只做查表插值。
+ */
+static void undistort_pixel(const stereo_calib &C, int cam, double u, double v, double *x, double *y) {
+    const double *k = C.dist[cam];
+    double xd = (u - C.cx[cam]) / C.fx[cam], yd = (v - C.cy[cam]) / C.fy[cam];
+    double xu = xd, yu = yd;
+    for (int it = 0; it < 10; it++) {
+        double xe, ye;
+        distort_normalized(k, xu, yu, &xe, &ye);
+        xu += xd - xe;
+        yu += yd - ye;
+    }
+    *x = xu;
+    *y = yu;
+}
+
+/*
+ * 视线查找表（每个相机一张）
+ *   在 RAY_LUT_STEP 像素间隔的网格上预先存放该像素视线的方向（左相机坐标系，未单位化）：
+ *     左相机  r = (x, y, 1)
+ *     右相机  r = R·(x, y, 1)
+ *   (x, y) 为去畸变归一化坐标。方向是 (x, y) 的线性函数，在网格间双线性插值即可，
+ *   三角测量时不再做除法、畸变迭代与矩阵乘法。
+ */
+#define RAY_LUT_STEP 4        // 查找表网格间隔（像素）；畸变场平滑，插值误差远小于检测误差
+
+struct ray_lut {
+    int gw = 0, gh = 0;               // 网格点数（列 / 行）
+    std::vector<float> ray;           // gw × gh × 3
+};
+
+/*
+ * 标定集：标定参数 + 两台相机的视线查找表，生成后只读。
+ *   检测 / 汇合线程每次使用前经 calib_current() 取一份引用，SIGHUP 重载时主线程整体替换指针，
+ *   旧的标定集在最后一个使用者放手后释放，读侧无锁等待。
+ */
+struct calib_set {
+    stereo_calib cal;
+    ray_lut rays[2];
+};
+
+static std::shared_ptr<const calib_set> g_calib_set;
+
+static std::shared_ptr<const calib_set> calib_current() {
+    return std::atomic_load(&g_calib_set);
+}
+
+/**
+ * 函数名: build_ray_lut
+ * 功能: 按 C 为指定相机生成 w×h 图像的视线查找表（启动时 / 标定重载时调用）。
+ */
+static void build_ray_lut(const stereo_calib &C, int cam, int w, int h, ray_lut &L) {
+    L.gw = (w + RAY_LUT_STEP - 1) / RAY_LUT_STEP + 1;
+    L.gh = (h + RAY_LUT_STEP - 1) / RAY_LUT_STEP + 1;
+    L.ray.resize((size_t)L.gw * L.gh * 3);
+    float *p = L.ray.data();
+    for (int gy = 0; gy < L.gh; gy++) {
+        for (int gx = 0; gx < L.gw; gx++, p += 3) {
+            double x, y;
+            undistort_pixel(C, cam, gx * RAY_LUT_STEP, gy * RAY_LUT_STEP, &x, &y);
+            double r[3] = { x, y, 1.0 };
+            if (cam == 1) {
+                for (int i = 0; i < 3; i++)
+                    r[i] = C.R[i * 3 + 0] * x + C.R[i * 3 + 1] * y + C.R[i * 3 + 2];
+            }
+            for (int i = 0; i < 3; i++) p[i] = static_cast<float>(r[i]);
+        }
+    }
+}
+
+// 查表得到像素 pt 的视线方向（双线性插值，超出图像的坐标夹到边缘）
+static void lookup_ray(const ray_lut &L, const cv::Point2f &pt, float r[3]) {
+    float fx = std::min(std::max(pt.x / RAY_LUT_STEP, 0.0f), (float)(L.gw - 1) - 1e-3f);
+    float fy = std::min(std::max(pt.y / RAY_LUT_STEP, 0.0f), (float)(L.gh - 1) - 1e-3f);
+    int gx = (int)fx, gy = (int)fy;
+    float ax = fx - gx, ay = fy - gy;
+    const float *p00 = &L.ray[((size_t)gy * L.gw + gx) * 3];
+    const float *p10 = p00 + 3, *p01 = p00 + (size_t)L.gw * 3, *p11 = p01 + 3;
+    for (int i = 0; i < 3; i++) {
+        float top = p00[i] + ax * (p10[i] - p00[i]);
+        float bottom = p01[i] + ax * (p11[i] - p01[i]);
+        r[i] = top + ay * (bottom - top);
+    }
+}
+
+/**
+ * 函数名: calib_reload
+ * 功能: 载入标定文件、生成新的标定集并整体替换 g_calib_set（启动时与收到 SIGHUP 时调用）。
+ *
+ * 返回值:
+ *   0 已换用文件中的标定；-1 文件不存在（首次调用时换用内置标定，之后保持当前标定）；
+ *   -2 文件有误（保持当前标定）
+ */
+static int calib_reload(const char *path) {
+    auto cs = std::make_shared<calib_set>();
+    int rc = load_calibration(path, &cs->cal);
+    if (rc == -2) return rc;
+    if (rc == -1) {
+        if (calib_current()) {
+            printf("[CALIB] %s not found, keeping current calibration\n", path);
+            return rc;
+        }
+        printf("[CALIB] %s not found, using built-in calibration (no distortion)\n", path);
+        cs->cal = k_builtin_calib;
+    }
+    for (int cam = 0; cam < 2; cam++)
+        build_ray_lut(cs->cal, cam, g_cfg.width, g_cfg.height, cs->rays[cam]);
+    std::atomic_store(&g_calib_set, std::shared_ptr<const calib_set>(std::move(cs)));
+    return rc;
+}
+
+/**
+ * 函数名: project_point
+ * 功能: 把左相机坐标系中的三维点投影到指定相机的像素坐标（triangulate 的逆过程，含畸变）。
+ *
+ * 参数:
+ *   C   - 标定参数
+ *   cam - 0 = 左相机，1 = 右相机（X_R = Rᵀ·(X_L − T)）
+ *   X   - 三维点（左相机坐标系）
+ *   uv  - 输出像素坐标
+ *
+ * 返回值:
+ *   true 成功；false 点在相机后方
+ */
+static bool project_point(const stereo_calib &C, int cam, const double X[3], cv::Point2f *uv) {
+    double p[3] = { X[0], X[1], X[2] };
+    if (cam == 1) {
+        double d[3] = { X[0] - C.T[0], X[1] - C.T[1], X[2] - C.T[2] };
+        for (int i = 0; i < 3; i++)
+            p[i] = C.R[0 * 3 + i] * d[0] + C.R[1 * 3 + i] * d[1] + C.R[2 * 3 + i] * d[2];
+    }
+    if (p[2] <= 0) return false;
+    double xd, yd;
+    distort_normalized(C.dist[cam], p[0] / p[2], p[1] / p[2], &xd, &yd);
+    uv->x = static_cast<float>(C.fx[cam] * xd + C.cx[cam]);
+    uv->y = static_cast<float>(C.fy[cam] * yd + C.cy[cam]);
+    return true;
+}
+
+/*
+ * 一组视线（SoA 布局：x / y / z 各自连续，按 4 路补齐，NEON 一次处理 4 条）
+ *   由 lookup_rays 查表填充，补齐的尾部为 0。
+ */
+#define RAY_SET_CAP ((MAX_CANDIDATES + 3) & ~3)
+
+struct ray_set {
+    int n = 0;
+    alignas(16) float x[RAY_SET_CAP];
+    alignas(16) float y[RAY_SET_CAP];
+    alignas(16) float z[RAY_SET_CAP];
+};
+
+// 两组视线所有配对的三角测量结果：第 i 条左视线与第 j 条右视线
+struct ray_pairs {
+    alignas(16) float s[RAY_SET_CAP][RAY_SET_CAP];    // 左视线参数：三维点 = s · a_i
+    alignas(16) float err[RAY_SET_CAP][RAY_SET_CAP];  // 极线距离（右图像素）；无效配对为 FLT_MAX
+};
+
+// 查表得到 n 个像素（n ≤ MAX_CANDIDATES）的视线方向
+static void lookup_rays(const ray_lut &L, const cv::Point2f *pt, int n, ray_set *out) {
+    out->n = n;
+    for (int i = 0; i < RAY_SET_CAP; i++) {
+        float r[3] = { 0.0f, 0.0f, 0.0f };
+        if (i < n) lookup_ray(L, pt[i], r);
+        out->x[i] = r[0];
+        out->y[i] = r[1];
+        out->z[i] = r[2];
+    }
+}
+
+/**
+ * 函数名: triangulate_rays
+ * 功能: 对左右两组视线的全部 na × nb 个配对同时求射线最近点参数与极线距离（float32）。
+ *
+ * 数学模型:
+ *   左相机射线:  L1(s) = s · a，右相机射线:  L2(t) = t · b + T（a、b 无需单位化）
+ *   令 |L1(s) − L2(t)| 最小，由拉格朗日恒等式:
+ *      s = ((T × b)·(a × b)) / |a × b|²
+ *   与展开式 ((T·a)(b·b) − (a·b)(T·b)) / ((a·a)(b·b) − (a·b)²) 等价，
+ *   但分母直接取叉积的模方，视线接近平行（远处目标）时不会在 float 下相减抵消。
+ *   极线距离：两相机中心 0、T 与左视线 a 张成极平面，法向 n = a × T；
+ *      err = fx_R · |n·b| / (|n||b|)（视场中心附近准确，边缘略偏小，足够用于候选关联）
+ *
+ * 实现要点:
+ *   每条左视线的 n 只算一次；右视线按 4 条一组，NEON 下除法与开方用倒数估计 + 两次牛顿迭代
+ *   （相对误差约 1e-7，与 float 精度相当），未启用 NEON 时逐个标量计算。
+ */
+static void triangulate_rays(const float T[3], float fx, const ray_set &A, const ray_set &B, ray_pairs *out) {
+    for (int i = 0; i < A.n; i++) {
+        const float ax = A.x[i], ay = A.y[i], az = A.z[i];
+        const float nx = ay * T[2] - az * T[1], ny = az * T[0] - ax * T[2], nz = ax * T[1] - ay * T[0];
+        const float nn = nx * nx + ny * ny + nz * nz;
+        int j = 0;
+#if USE_NEON
+        for (; j < B.n; j += 4) {
+            float32x4_t bx = vld1q_f32(B.x + j), by = vld1q_f32(B.y + j), bz = vld1q_f32(B.z + j);
+            // c = a × b，d = T × b
+            float32x4_t cx = vmlsq_n_f32(vmulq_n_f32(bz, ay), by, az);
+            float32x4_t cy = vmlsq_n_f32(vmulq_n_f32(bx, az), bz, ax);
+            float32x4_t cz = vmlsq_n_f32(vmulq_n_f32(by, ax), bx, ay);
+            float32x4_t dx = vmlsq_n_f32(vmulq_n_f32(bz, T[1]), by, T[2]);
+            float32x4_t dy = vmlsq_n_f32(vmulq_n_f32(bx, T[2]), bz, T[0]);
+            float32x4_t dz = vmlsq_n_f32(vmulq_n_f32(by, T[0]), bx, T[1]);
+            float32x4_t den = vmlaq_f32(vmlaq_f32(vmulq_f32(cx, cx), cy, cy), cz, cz);
+            float32x4_t num = vmlaq_f32(vmlaq_f32(vmulq_f32(dx, cx), dy, cy), dz, cz);
+            float32x4_t inv = vrecpeq_f32(den);
+            inv = vmulq_f32(inv, vrecpsq_f32(den, inv));
+            inv = vmulq_f32(inv, vrecpsq_f32(den, inv));
+            // 视线平行（den = 0）时倒数为 inf，与标量路径一样置 s = 0、err = FLT_MAX
+            uint32x4_t ok = vcgtq_f32(den, vdupq_n_f32(0.0f));
+            vst1q_f32(out->s[i] + j, vbslq_f32(ok, vmulq_f32(num, inv), vdupq_n_f32(0.0f)));
+
+            float32x4_t nb = vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(bx, nx), by, ny), bz, nz);
+            float32x4_t q = vmulq_n_f32(vmlaq_f32(vmlaq_f32(vmulq_f32(bx, bx), by, by), bz, bz), nn);
+            float32x4_t rs = vrsqrteq_f32(q);
+            rs = vmulq_f32(rs, vrsqrtsq_f32(vmulq_f32(q, rs), rs));
+            rs = vmulq_f32(rs, vrsqrtsq_f32(vmulq_f32(q, rs), rs));
+            ok = vandq_u32(ok, vcgtq_f32(q, vdupq_n_f32(0.0f)));
+            vst1q_f32(out->err[i] + j, vbslq_f32(ok, vmulq_f32(vmulq_n_f32(vabsq_f32(nb), fx), rs),
+                                                 vdupq_n_f32(FLT_MAX)));
+        }
+#endif
+        for (; j < B.n; j++) {
+            const float bx = B.x[j], by = B.y[j], bz = B.z[j];
+            const float cx = ay * bz - az * by, cy = az * bx - ax * bz, cz = ax * by - ay * bx;
+            const float dx = T[1] * bz - T[2] * by, dy = T[2] * bx - T[0] * bz, dz = T[0] * by - T[1] * bx;
+            const float den = cx * cx + cy * cy + cz * cz;
+            const float q = nn * (bx * bx + by * by + bz * bz);
+            out->s[i][j] = den > 0 ? (dx * cx + dy * cy + dz * cz) / den : 0.0f;
+            out->err[i][j] = den > 0 && q > 0 ? fx * std::fabs(nx * bx + ny * by + nz * bz) / std::sqrt(q) : FLT_MAX;
+        }
+    }
+}
+
+// 三角测量用的标定量（float32）：平移向量 T 与右相机焦距
+static void calib_float(const calib_set &cs, float T[3], float *fx) {
+    for (int i = 0; i < 3; i++) T[i] = static_cast<float>(cs.cal.T[i]);
+    *fx = static_cast<float>(cs.cal.fx[1]);
 }
 
 /**
@@ -219,299 +1343,696 @@ cv::Point detect_pupil(cv::Mat &img) {
  *
  * 算法原理:
  *   - 基于双目视觉几何模型（立体三角测量）；
- *   - 已知两台摄像机的内参 (K1, K2) 和相对位姿 (R, T)；
- *   - 将像素坐标 (u1,v1)、(u2,v2) 转换为归一化坐标 (x1,y1)、(x2,y2)；
- *   - 计算两条视线（射线）的最近点，作为空间点的估计位置。
- *
- * 数学模型:
- *   左相机射线:  L1(s) = s * r1
- *   右相机射线:  L2(t) = R * (t * r2) + T
- *   其中:
- *      - r1, r2 为两相机的单位方向向量
- *      - R, T 为右相机相对于左相机的旋转矩阵和平移向量
- *   通过最小化两条射线的距离，求得最佳交点近似位置。
+ *   - 去畸变、内参归一化与右相机旋转已预先算进视线查找表 (build_ray_lut)；
+ *   - 计算两条视线（射线）的最近点，作为空间点的估计位置（triangulate_rays，float32）。
+ *   多候选时由 match_candidates 一次算出全部配对，本函数为单对的便捷形式。
  *
  * 参数:
+ *   cs  - 标定集（calib_current()）
  *   pt1 - 左相机图像中的瞳孔中心坐标 (像素坐标)
  *   pt2 - 右相机图像中的瞳孔中心坐标 (像素坐标)
  *
  * 返回值:
  *   cv::Point3f(X, Y, Z) - 瞳孔的三维坐标（以左相机为世界坐标系原点）
  */
-cv::Point3f triangulate(const cv::Point2f &pt1, const cv::Point2f &pt2) {
-    /************************************************************
-     * Step 1: 定义相机内参 (K1, K2)
-     * 参数来源: Matlab 双目标定 (stereoParams.mat)
-     * 含义:
-     *   fx, fy → 焦距（像素）
-     *   cx, cy → 主点坐标（光轴中心）
-     ************************************************************/
-    double fx1 = 475.8266, fy1 = 477.8292, cx1 = 356.0519, cy1 = 272.4657; // 左相机
-    double fx2 = 483.0534, fy2 = 484.4886, cx2 = 375.5120, cy2 = 276.3651; // 右相机
-
+cv::Point3f triangulate(const calib_set &cs, const cv::Point2f &pt1, const cv::Point2f &pt2) {
     /************************************************************
-     * Step 2: 外参（相对位姿）
-     * R: 右相机坐标系相对于左相机坐标系的旋转矩阵
-     * T: 右相机坐标系相对于左相机坐标系的平移向量 (单位: mm 或 cm)
-     ************************************************************/
-    cv::Matx33d R(
-            0.999313,  0.036906, -0.003363,
-            -0.036555,  0.996563,  0.074340,
-            0.006095, -0.074166,  0.997227
-    );
-    cv::Vec3d T(-0.074773, -12.877214, -0.31784);  // 平移向量
-
-    /************************************************************
-     * Step 3: 像素坐标 → 归一化坐标（去除相机内参影响）
-     * 公式:
-     *   x = (u - cx) / fx
-     *   y = (v - cy) / fy
-     * 意义: 将像素坐标投影到单位成像平面 (Z=1) 上
-     ************************************************************/
-    double x1 = (pt1.x - cx1) / fx1;
-    double y1 = (pt1.y - cy1) / fy1;
-    double x2 = (pt2.x - cx2) / fx2;
-    double y2 = (pt2.y - cy2) / fy2;
-
-    /************************************************************
-     * Step 4: 构造两条射线方向向量
-     *   左相机射线: ray1 = normalize([x1, y1, 1])
-     *   右相机射线: ray2 = R * normalize([x2, y2, 1])
-     *
-     * normalize() 保证向量单位化，表示方向而非距离。
+     * Step 1: 查表得到两条视线方向
+     *   左相机射线: a = (x1, y1, 1)
+     *   右相机射线: b = R * (x2, y2, 1)（已旋转至左相机坐标系）
      ************************************************************/
-    cv::Vec3d ray1 = cv::normalize(cv::Vec3d(x1, y1, 1.0));       // 左相机光线
-    cv::Vec3d ray2 = R * cv::normalize(cv::Vec3d(x2, y2, 1.0));   // 将右相机光线旋转至左相机坐标系下
+    ray_set a, b;
+    lookup_rays(cs.rays[0], &pt1, 1, &a);
+    lookup_rays(cs.rays[1], &pt2, 1, &b);
 
     /************************************************************
-     * Step 5: 计算射线交点（或最近点）
-     *   公式:
-     *      d = ray1·ray2
-     *      s = (T·(ray1 - d*ray2)) / (1 - d²)
-     *   推导思路:
-     *      使两条射线间的最短距离最小，
-     *      以左相机射线的参数 s 对应的点作为空间点估计。
+     * Step 2: 计算射线最近点
+     *   以左相机射线的参数 s 对应的点作为空间点估计。
      ************************************************************/
-    cv::Vec3d delta_p = T;          // 右相机相对左相机的平移
-    double d = ray1.dot(ray2);      // 两射线夹角的余弦值
-    double s = delta_p.dot(ray1 - d * ray2) / (1 - d * d);  // 左射线参数解
-    cv::Vec3d X = s * ray1;         // 三维空间点坐标（左相机坐标系下）
+    float T[3], fx;
+    calib_float(cs, T, &fx);
+    ray_pairs r;
+    triangulate_rays(T, fx, a, b, &r);
+    float s = r.s[0][0];
 
     /************************************************************
-     * Step 6: 输出结果
+     * Step 3: 输出结果
      * 返回三维点坐标 (X, Y, Z)
      * 单位取决于标定时 T 的单位（一般为毫米或厘米）
      ************************************************************/
-    return cv::Point3f(X[0], X[1], X[2]);
+    return cv::Point3f(s * a.x[0], s * a.y[0], s * a.z[0]);
 }
 
 /**
- * 函数名: init_camera
- * 功能: 初始化指定的视频设备节点（如 /dev/video21、/dev/video23），
- *       配置图像格式、申请缓冲区、完成内存映射，并启动视频流采集。
- *
- * 适用平台:
- *   - Linux 系统 (V4L2 视频采集接口)
- *   - 例如 RV1106、RK3566 等嵌入式主控平台
+ * 函数名: epipolar_bands
+ * 功能:
+ *   由左相机候选求右相机的极线搜索带：沿左视线在 depth_min..depth_max 之间按逆深度
+ *   （与视差成正比）均匀取 5 个深度投影到右图（含畸变，极线弯曲也能覆盖），
+ *   取外接矩形并向四周扩展 track_half(半径)，再与图像求交。
+ *   基线接近水平或竖直时外接矩形即为沿极线的窄带，面积远小于整帧。
  *
  * 参数:
- *   devname - 摄像头设备文件路径 (如 "/dev/video21")
- *   buffers - 用于存储内存映射后的缓冲区数组指针
- *   vfd     - 摄像头设备文件描述符 (通过引用返回)
+ *   c, n - 左相机候选（整帧坐标）
+ *   w, h - 右图尺寸
+ *   out  - 输出矩形（至多 n 个；投影全部失败或落在图外的候选不产生矩形）
  *
  * 返回值:
- *   返回成功申请的缓冲区数量（通常为2）
+ *   输出的矩形数
+ */
+static int epipolar_bands(const calib_set &cs, const pupil_candidate *c, int n, int w, int h, cv::Rect *out) {
+    const int samples = 5;
+    double inv_near = 1.0 / std::max(g_cfg.depth_min, 1), inv_far = 1.0 / std::max(g_cfg.depth_max, 1);
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        float a[3];
+        lookup_ray(cs.rays[0], c[i].pt, a);
+        float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+        for (int k = 0; k < samples; k++) {
+            double z = 1.0 / (inv_near + (inv_far - inv_near) * k / (samples - 1));
+            double X[3] = { (double)a[0] / a[2] * z, (double)a[1] / a[2] * z, z };
+            cv::Point2f uv;
+            if (!project_point(cs.cal, 1, X, &uv)) continue;
+            x0 = std::min(x0, uv.x); x1 = std::max(x1, uv.x);
+            y0 = std::min(y0, uv.y); y1 = std::max(y1, uv.y);
+        }
+        if (x0 > x1) continue;
+        int margin = track_half(c[i].radius);
+        if (x1 < -margin || y1 < -margin || x0 > w + margin || y0 > h + margin) continue;
+        x0 = std::max(x0, 0.0f); y0 = std::max(y0, 0.0f);            // 远处投影可能极大，先截到图像范围
+        x1 = std::min(x1, (float)w); y1 = std::min(y1, (float)h);
+        cv::Rect r(cvFloor(x0) - margin, cvFloor(y0) - margin, cvCeil(x1) - cvFloor(x0) + 2 * margin + 1,
+                   cvCeil(y1) - cvFloor(y0) + 2 * margin + 1);
+        r = r & cv::Rect(0, 0, w, h);
+        if (r.width > 0 && r.height > 0) out[m++] = r;
+    }
+    return m;
+}
+
+/**
+ * 函数名: match_candidates
+ * 功能: 在左右两路候选中选出属于同一目标的一对，并给出其三维坐标。
+ *
+ * 规则:
+ *   1. 两路都只有一个候选（candidates = 1）时直接配对，不做极线检查（与单目标模式一致）；
+ *   2. 两路首选候选（各自最接近跟踪位置者）的极线距离不超过 epipolar_max_px 时优先取它们，保持跟踪连续；
+ *   3. 否则取极线距离最小且不超过上限的一对；都超过上限视为本帧未检出。
+ *   选中配对的射线参数 s 非有限或不为正（视线平行、目标在相机后方）时同样视为未检出。
+ *   全部 na × nb 个配对的极线距离与三角测量由 triangulate_rays 一次算出。
  *
- * 主要流程:
- *   1. 打开摄像头设备；
- *   2. 配置图像格式 (分辨率、像素格式等)；
- *   3. 申请缓冲区；
- *   4. 执行 mmap() 建立内存映射；
- *   5. 启动视频流 (STREAMON)。
+ * 返回值:
+ *   true 时 *pa / *pb 为配对结果，*P 为三维坐标（左相机坐标系）
  */
-int init_camera(const char *devname, buffer *buffers, int &vfd) {
+static bool match_candidates(const calib_set &cs, const cv::Point2f *a, int na, const cv::Point2f *b, int nb,
+                             cv::Point2f *pa, cv::Point2f *pb, cv::Point3f *P) {
+    if (na == 0 || nb == 0) return false;
+    na = std::min(na, MAX_CANDIDATES);
+    nb = std::min(nb, MAX_CANDIDATES);
+    ray_set ra, rb;
+    lookup_rays(cs.rays[0], a, na, &ra);
+    lookup_rays(cs.rays[1], b, nb, &rb);
+    float T[3], fx;
+    calib_float(cs, T, &fx);
+    ray_pairs r;
+    triangulate_rays(T, fx, ra, rb, &r);
+
+    int bi = 0, bj = 0;
+    if (!(na == 1 && nb == 1) && !(r.err[0][0] <= g_cfg.epipolar_max_px)) {
+        float best = g_cfg.epipolar_max_px;
+        bi = -1;
+        for (int i = 0; i < na; i++)
+            for (int j = 0; j < nb; j++) {
+                if (r.err[i][j] < best) {
+                    best = r.err[i][j];
+                    bi = i;
+                    bj = j;
+                }
+            }
+    }
+    if (bi < 0) return false;
+    float s = r.s[bi][bj];
+    if (!std::isfinite(s) || s <= 0) return false;
+    *pa = a[bi];
+    *pb = b[bj];
+    *P = cv::Point3f(s * ra.x[bi], s * ra.y[bi], s * ra.z[bi]);
+    return true;
+}
 
-    /************************************************************
-     * Step 1: 打开摄像头设备文件
-     *
-     * O_RDWR → 可读可写；
-     * 若打开失败（返回 -1），输出错误并终止程序。
-     ************************************************************/
-    vfd = open(devname, O_RDWR);
-    if (vfd < 0) {
-        perror("Failed to open camera");
-        exit(1);
+/*
+ * 三维位置 α-β 滤波器（每轴独立的匀速模型）
+ *   量测到达时：预测 p = x + v·dt，残差 r = z − p，x = p + α·r，v = v + β·r / dt；
+ *   缺测时按匀速外推，距最近一次量测超过 filter_coast_ms 后失效，下一次量测重新初始化。
+ *   α = 1、β = 0 即原始三角测量结果。
+ */
+struct pose_filter {
+    bool valid = false;
+    double x[3], v[3];                // 位置 / 速度（单位同 T，速度为每秒）
+    long long ts_us;                  // 状态对应的时刻（驱动时间戳）
+};
+
+static bool filter_fresh(const pose_filter &f, long long ts_us) {
+    return f.valid && ts_us - f.ts_us <= (long long)g_cfg.filter_coast_ms * 1000;
+}
+
+static void filter_update(pose_filter &f, const cv::Point3f &z, long long ts_us) {
+    double zz[3] = { z.x, z.y, z.z };
+    double dt = (ts_us - f.ts_us) * 1e-6;
+    if (!filter_fresh(f, ts_us) || dt <= 0) {
+        for (int i = 0; i < 3; i++) { f.x[i] = zz[i]; f.v[i] = 0; }
+    } else {
+        for (int i = 0; i < 3; i++) {
+            double p = f.x[i] + f.v[i] * dt, r = zz[i] - p;
+            f.x[i] = p + g_cfg.filter_alpha * r;
+            f.v[i] += g_cfg.filter_beta * r / dt;
+        }
     }
+    f.valid = true;
+    f.ts_us = ts_us;
+}
 
-    /************************************************************
-     * Step 2: 设置视频采集格式 (VIDIOC_S_FMT)
-     *
-     * V4L2_BUF_TYPE_VIDEO_CAPTURE → 视频采集类型；
-     * 分辨率: WIDTH × HEIGHT；
-     * 像素格式: YUYV (即 YUV422 格式)，每 4 字节代表两个像素；
-     * field: NONE → 逐行扫描 (非隔行)。
-     ************************************************************/
-    struct v4l2_format fmt = {};
-    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmt.fmt.pix.width = WIDTH;
-    fmt.fmt.pix.height = HEIGHT;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+// 外推到 ts_us；滤波器失效时返回 false
+static bool filter_predict(const pose_filter &f, long long ts_us, double out[3]) {
+    if (!filter_fresh(f, ts_us)) return false;
+    double dt = (ts_us - f.ts_us) * 1e-6;
+    for (int i = 0; i < 3; i++) out[i] = f.x[i] + f.v[i] * dt;
+    return true;
+}
 
-    // 将格式设置写入设备
-    ioctl(vfd, VIDIOC_S_FMT, &fmt);
+/*
+ * 滤波器状态的跨线程发布（汇合线程写，检测线程读），seqlock：
+ *   写者先把 seq 置为奇数、写字段、再置为下一个偶数；读者在 seq 为偶数且前后一致时采用。
+ */
+struct pose_hint {
+    std::atomic<unsigned> seq{0};
+    std::atomic<double> x[3], v[3];
+    std::atomic<long long> ts_us{0};
+};
 
-    /************************************************************
-     * Step 3: 申请视频缓冲区 (VIDIOC_REQBUFS)
-     *
-     * 说明:
-     *   - count = 2 → 系统为该设备申请两个帧缓冲；
-     *   - memory = MMAP → 使用内存映射方式；
-     *   - 驱动分配内核缓冲，用户程序通过 mmap() 访问。
-     ************************************************************/
-    struct v4l2_requestbuffers req = {};
-    req.count = 2;  // 通常双缓冲即可实现连续采集
-    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req.memory = V4L2_MEMORY_MMAP;
-    ioctl(vfd, VIDIOC_REQBUFS, &req);
+static void hint_publish(pose_hint &h, const pose_filter &f) {
+    unsigned s = h.seq.load(std::memory_order_relaxed);
+    h.seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < 3; i++) {
+        h.x[i].store(f.x[i], std::memory_order_relaxed);
+        h.v[i].store(f.v[i], std::memory_order_relaxed);
+    }
+    h.ts_us.store(f.ts_us, std::memory_order_relaxed);
+    h.seq.store(s + 2, std::memory_order_release);
+}
 
-    /************************************************************
-     * Step 4: 遍历每个缓冲区，执行 QUERYBUF + MMAP + QBUF 操作
-     *
-     * QUERYBUF → 查询缓冲区信息；
-     * MMAP → 将驱动分配的缓冲区映射到用户空间；
-     * QBUF → 将缓冲区放入驱动的输入队列，准备采集。
-     ************************************************************/
-    for (int i = 0; i < req.count; i++) {
-        struct v4l2_buffer buf = {};
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
-
-        // 查询第 i 个缓冲区的偏移量与长度
-        ioctl(vfd, VIDIOC_QUERYBUF, &buf);
-
-        // 记录缓冲区长度
-        buffers[i].length = buf.length;
-
-        /********************************************************
-         * mmap() 内存映射
-         * 将内核空间的视频缓冲区映射到用户空间；
-         * 这样可以避免数据拷贝，提高帧采集效率。
-         ********************************************************/
-        buffers[i].start = mmap(
-                NULL,                     // 自动选择映射地址
-                buf.length,               // 映射长度
-                PROT_READ | PROT_WRITE,   // 可读写
-                MAP_SHARED,               // 共享映射
-                vfd,                      // 文件描述符
-                buf.m.offset              // 缓冲区偏移
-        );
-
-        // 检查映射结果
-        if (buffers[i].start == MAP_FAILED) {
-            perror("mmap failed");
-            exit(1);
-        }
-
-        // 将缓冲区加入视频输入队列 (即可用于采集)
-        ioctl(vfd, VIDIOC_QBUF, &buf);
+static bool hint_read(const pose_hint &h, pose_filter *f) {
+    for (;;) {
+        unsigned s0 = h.seq.load(std::memory_order_acquire);
+        if (s0 == 0) return false;                        // 尚未发布
+        if (s0 & 1) continue;                             // 写入中
+        for (int i = 0; i < 3; i++) {
+            f->x[i] = h.x[i].load(std::memory_order_relaxed);
+            f->v[i] = h.v[i].load(std::memory_order_relaxed);
+        }
+        f->ts_us = h.ts_us.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (h.seq.load(std::memory_order_relaxed) == s0) {
+            f->valid = true;
+            return true;
+        }
     }
+}
 
-    /************************************************************
-     * Step 5: 启动视频流采集 (VIDIOC_STREAMON)
-     *
-     * 通知驱动开始捕获帧；
-     * 成功后即可通过 DQBUF / QBUF 获取帧数据。
-     ************************************************************/
-    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    ioctl(vfd, VIDIOC_STREAMON, &type);
+/********************** 流水线 *************************
+ *
+ *   采集（主线程）──┬─► 左检测线程 ──┐
+ *                   └─► 右检测线程 ──┴─► 汇合线程（三角测量 + 串口输出）
+ *
+ *   - 主线程只负责按时间戳配对左右帧，把帧引用分别交给两个检测线程，
+ *     因此第 N+1 对帧的采集与第 N 对帧的检测重叠，左右检测在两个核上并行；
+ *   - 各级之间为单生产者/单消费者无锁环形队列，队列满时丢弃新数据而不是阻塞上游；
+ *   - 每对帧带递增序号 seq，汇合线程按 seq 对齐左右结果（某一侧被丢弃时跳过另一侧）。
+ ******************************************************/
+
+/*
+ * 单生产者/单消费者有界无锁队列
+ *   head 只由消费者修改、tail 只由生产者修改（acquire/release 配对）；
+ *   ready 信号量计数可读元素，消费者无数据时睡眠而不是自旋；
+ *   close() 额外 post 一次，消费者取空后 pop() 返回 false 退出。
+ */
+template <typename T, unsigned N>
+struct spsc_queue {
+    static_assert((N & (N - 1)) == 0, "queue length must be a power of two");
+    T slot[N];
+    std::atomic<unsigned> head{0}, tail{0};
+    sem_t ready;
+
+    spsc_queue() { sem_init(&ready, 0, 0); }
+    ~spsc_queue() { sem_destroy(&ready); }
+
+    // 生产者：是否还有空位（只有生产者会减少空位，检查后 push 必然成功）
+    bool has_space() const {
+        return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) < N;
+    }
+    bool push(const T &v) {
+        unsigned t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N) return false;
+        slot[t % N] = v;
+        tail.store(t + 1, std::memory_order_release);
+        sem_post(&ready);
+        return true;
+    }
+    // 消费者：阻塞直到有数据；队列已关闭且取空时返回 false
+    bool pop(T &v) {
+        while (sem_wait(&ready) != 0 && errno == EINTR) {}
+        unsigned h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        v = slot[h % N];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    void close() { sem_post(&ready); }
+};
+
+// 检测任务：一路摄像头的一帧（持有 1 次引用，检测线程转换后释放）
+struct detect_job {
+    unsigned seq;                     // 帧对序号
+    cam_frame *frame;
+};
+
+// 检测结果
+struct detect_result {
+    unsigned seq;                     // 帧对序号
+    long long ts_us;                  // 驱动采集时间戳
+    cv::Point2f pt;                   // 瞳孔中心亚像素坐标（未检出为 (-1, -1)）
+    int ncand;                        // 候选数（0 = 未检出）
+    cv::Point2f cand[MAX_CANDIDATES]; // 全部候选，cand[0] == pt
+};
+
+/*
+ * 左 → 右检测线程的候选传递（epipolar_search = 1）
+ *   左检测线程每帧检测完发布本帧候选并唤醒；右检测线程只在需要重新捕获时等待同一 seq 的结果，
+ *   由此得到极线带。两路帧按相同顺序入队，左线程必然会发布右线程等待的 seq；
+ *   超时（stereo_wait_ms）或左线程已退出时右线程退回整帧搜索。
+ */
+struct epi_channel {
+    std::mutex m;
+    std::condition_variable cv;
+    bool valid = false;               // 已发布过结果
+    bool closed = false;              // 左检测线程已退出
+    unsigned seq = 0;                 // 最近发布的帧对序号
+    int ncand = 0;
+    pupil_candidate cand[MAX_CANDIDATES];
+};
+
+static void epi_publish(epi_channel &ch, unsigned seq, const std::vector<pupil_candidate> &cands) {
+    {
+        std::lock_guard<std::mutex> lk(ch.m);
+        ch.valid = true;
+        ch.seq = seq;
+        ch.ncand = 0;
+        for (const pupil_candidate &c : cands)
+            if (ch.ncand < MAX_CANDIDATES) ch.cand[ch.ncand++] = c;
+    }
+    ch.cv.notify_one();
+}
 
-    // 返回缓冲区数量，供后续使用
-    return req.count;
+static void epi_close(epi_channel &ch) {
+    {
+        std::lock_guard<std::mutex> lk(ch.m);
+        ch.closed = true;
+    }
+    ch.cv.notify_one();
+}
+
+// 等待第 seq 对的左相机候选；成功返回 true 并复制到 out / *n
+static bool epi_wait(epi_channel &ch, unsigned seq, pupil_candidate *out, int *n) {
+    std::unique_lock<std::mutex> lk(ch.m);
+    ch.cv.wait_for(lk, std::chrono::milliseconds(g_cfg.stereo_wait_ms), [&] {
+        return ch.closed || (ch.valid && (int)(ch.seq - seq) >= 0);
+    });
+    if (!ch.valid || ch.seq != seq) return false;
+    *n = ch.ncand;
+    for (int i = 0; i < ch.ncand; i++) out[i] = ch.cand[i];
+    return true;
 }
 
+// 一路检测级：输入帧队列 → 检测线程 → 结果队列
+struct detect_stage {
+    int cam_index;                    // 0 = 左，1 = 右（投影预测位置用）
+    const pose_hint *hint;            // 汇合线程发布的三维预测
+    epi_channel *epi;                 // 左：发布候选；右：重新捕获时读取（epipolar_search = 0 时为空）
+    spsc_queue<detect_job, DETECT_QUEUE_LEN> in;
+    spsc_queue<detect_result, RESULT_QUEUE_LEN> out;
+    std::thread thread;
+    std::atomic<unsigned> dropped{0}; // 结果队列满丢弃的结果数
+};
+
 /**
- * 函数名: capture_frame
- * 功能: 从指定摄像头中读取一帧图像数据，并将其从 YUYV 格式转换为 BGR 格式（OpenCV 可用格式）
+ * 函数名: detect_worker
+ * 功能: 检测线程，循环取帧 → 提取亮度 → 释放帧 → track_pupil() → 结果入队。
  *
- * 调用时机:
- *   - 在主循环中反复调用，用于实时抓取每帧图像。
+ * 注意:
+ *   - 帧数据就是驱动映射内存，提取亮度后立即释放，缓冲尽快重新入队；
+ *   - 亮度图（及调试用 BGR 图）为线程私有，每帧复用同一块内存；
+ *   - 只有 debug_overlay 打开时才做 YUYV→BGR 转换（HEADLESS 构建不含这部分代码）；
+ *   - 汇合线程的三维预测投影到本相机后作为跟踪窗口中心（见 track_pupil）；
+ *   - epipolar_search 打开时，右相机没有预测且未锁定时等待左相机同一帧的候选，
+ *     只在其极线带内搜索（左相机未检出则不搜索），代替整帧由粗到精搜索。
+ */
+void detect_worker(detect_stage *st) {
+    cv::Mat gray, bgr;
+    pupil_tracker tracker;
+    detect_job job;
+    while (st->in.pop(job)) {
+        const cam_device &c = *job.frame->cam;
+        long long t0 = now_us();
+        extract_luma((const uint8_t *)job.frame->start, c.bytesperline, c.width, c.height, gray);
+#if !HEADLESS
+        if (g_cfg.debug_overlay) {
+            // CV_8UC2 (Y0 U Y1 V)，行跨度取驱动给出的 bytesperline
+            cv::Mat yuyv(c.height, c.width, CV_8UC2, job.frame->start, c.bytesperline);
+            cv::cvtColor(yuyv, bgr, cv::COLOR_YUV2BGR_YUYV);
+        }
+#endif
+        detect_result r;
+        r.seq = job.seq;
+        r.ts_us = job.frame->ts_us;
+        cam_frame_release(job.frame);
+        long long t1 = now_us();
+        lat_record(LAT_LUMA, t1 - t0);
+
+        // 三维预测外推到本帧时刻并投影，作为跟踪窗口中心
+        pose_filter f;
+        double X[3];
+        cv::Point2f pred;
+        bool has_pred = hint_read(*st->hint, &f) && filter_predict(f, r.ts_us, X) &&
+                        project_point(calib_current()->cal, st->cam_index, X, &pred) &&
+                        pred.x >= 0 && pred.y >= 0 && pred.x < gray.cols && pred.y < gray.rows;
+
+        // 右相机重新捕获：取左相机同一帧的候选求极线带
+        cv::Rect bands[MAX_CANDIDATES];
+        int nbands = -1;                                  // -1 = 不限制搜索区域
+        if (st->epi && st->cam_index == 1 && track_needs_acquire(tracker, has_pred)) {
+            pupil_candidate lc[MAX_CANDIDATES];
+            int nl = 0;
+            if (epi_wait(*st->epi, r.seq, lc, &nl))
+                nbands = epipolar_bands(*calib_current(), lc, nl, gray.cols, gray.rows, bands);
+            t1 = now_us();                                // 检测耗时不含等待左相机的时间
+        }
+
+        r.pt = track_pupil(tracker, gray, has_pred ? &pred : nullptr, g_cfg.debug_overlay ? &bgr : nullptr,
+                           nbands >= 0 ? bands : nullptr, std::max(nbands, 0));
+        r.ncand = 0;
+        for (const pupil_candidate &q : tracker.det.cands) r.cand[r.ncand++] = q.pt;
+        if (st->epi && st->cam_index == 0) epi_publish(*st->epi, r.seq, tracker.det.cands);
+        lat_record(LAT_DETECT, now_us() - t1);
+        if (!st->out.push(r)) st->dropped++;
+    }
+    if (st->epi && st->cam_index == 0) epi_close(*st->epi);
+}
+
+/*
+ * 串口二进制帧（serial_format = 1 / 2，多字节字段均为小端）
+ *
+ *   偏移  长度  字段
+ *   0     1     同步字节 0xA5
+ *   1     1     类型：bit0..6 = 1 (float32) / 2 (int16 定点)，bit7 = 1 表示滤波外推值（本帧未检出）
+ *   2     1     帧序号（每帧加 1，下位机据此统计丢帧）
+ *   3     4     采集时间戳 us（CLOCK_MONOTONIC 低 32 位，约 71 分钟回绕）
+ *   7     12/6  X, Y, Z：float32 mm，或 int16 = mm × SERIAL_FIXED_SCALE（超量程饱和）
+ *   19/13 2     CRC-16/CCITT-FALSE（多项式 0x1021，初值 0xFFFF），覆盖偏移 1 起到坐标末尾
+ *
+ *   帧长 21 / 15 字节；文本格式 "X,Y,Z\n" 在两位小数下约 20 字节且需 snprintf。
+ *   接收端找 0xA5 后按类型取帧长、校验 CRC，失败则从下一个字节重新找同步。
+ */
+#define SERIAL_SYNC 0xA5
+#define SERIAL_FLAG_PREDICTED 0x80
+#define SERIAL_FRAME_MAX 21
+
+static uint16_t crc16_ccitt(const uint8_t *p, size_t n) {
+    uint16_t crc = 0xFFFF;
+    while (n--) {
+        crc ^= (uint16_t)(*p++ << 8);
+        for (int i = 0; i < 8; i++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+static uint8_t *put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+static uint8_t *put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+/**
+ * 函数名: encode_pose_frame
+ * 功能: 按 serial_format 把一个三维位置编码为二进制帧（格式见上）。
  *
  * 参数:
- *   vfd     - 摄像头文件描述符（由 init_camera() 初始化返回）
- *   buffers - 已映射的摄像头缓冲区数组指针（存放帧数据）
+ *   buf       - 输出缓冲（至少 SERIAL_FRAME_MAX 字节）
+ *   format    - SERIAL_BIN_F32 / SERIAL_BIN_I16
+ *   seq       - 帧序号（取低 8 位）
+ *   ts_us     - 采集时间戳
+ *   X         - 位置（mm）
+ *   predicted - true = 滤波外推值
  *
  * 返回值:
- *   cv::Mat - OpenCV 格式的 BGR 图像帧，可直接用于显示或算法处理
+ *   帧长（字节）
+ */
+static int encode_pose_frame(uint8_t *buf, int format, unsigned seq, long long ts_us, const double X[3],
+                             bool predicted) {
+    uint8_t *p = buf;
+    *p++ = SERIAL_SYNC;
+    *p++ = (uint8_t)(format | (predicted ? SERIAL_FLAG_PREDICTED : 0));
+    *p++ = (uint8_t)seq;
+    p = put_le32(p, (uint32_t)ts_us);
+    for (int i = 0; i < 3; i++) {
+        if (format == SERIAL_BIN_F32) {
+            float f = static_cast<float>(X[i]);
+            uint32_t u;
+            memcpy(&u, &f, sizeof(u));
+            p = put_le32(p, u);
+        } else {
+            double q = std::min(std::max(X[i] * SERIAL_FIXED_SCALE, -32768.0), 32767.0);
+            p = put_le16(p, (uint16_t)(int16_t)std::lround(q));
+        }
+    }
+    p = put_le16(p, crc16_ccitt(buf + 1, (size_t)(p - buf - 1)));
+    return (int)(p - buf);
+}
+
+// 输出消息：一帧已编码的输出（文本行或二进制帧），串口与 UDP 发送同样的字节
+struct output_msg {
+    long long ts_us;                  // 采集时间戳（判断是否过期）
+    int len;
+    char data[64];
+};
+
+/*
+ * 输出级（串口、UDP 各一个）：汇合线程入队 → 发送线程阻塞写 fd；
+ * 某一路慢时只丢该路的样本，不反压汇合、检测或其它输出。
+ */
+struct output_sink {
+    const char *name = "";            // 日志名
+    bool primary = false;             // true = 串口：记录 LAT_SERIAL / LAT_TOTAL
+    int fd = -1;
+    spsc_queue<output_msg, SERIAL_QUEUE_LEN> q;
+    std::thread thread;
+    std::atomic<unsigned> dropped{0}; // 队列满丢弃的样本数
+    std::atomic<unsigned> stale{0};   // 出队时已超过 serial_max_age_ms 丢弃的样本数
+    std::atomic<unsigned> errors{0};  // 写失败的样本数（UDP 对端不可达等）
+};
+
+/**
+ * 函数名: sink_writer
+ * 功能: 输出发送线程，循环取消息 → 丢弃过期样本 → 写满整帧（UDP 为一个数据报）。
  *
- * 采集流程:
- *   1. 从视频缓冲队列中取出一帧 (DQBUF)
- *   2. 将帧数据映射为 OpenCV Mat 对象
- *   3. 将 YUYV 图像转换为 BGR 图像
- *   4. 将缓冲区重新放回队列 (QBUF)，供驱动继续填充
+ * 注意:
+ *   只有本线程会阻塞在 write() 上；接收端跟不上时队列很快写满，
+ *   汇合线程入队失败直接丢弃（dropped），队列中积压的旧样本出队时按采集时间丢弃（stale），
+ *   因此发出的总是较新的位置。写失败只在第一次打印原因，之后只计数。
  */
-cv::Mat capture_frame(int vfd, buffer *buffers) {
-    /************************************************************
-     * Step 1: 从驱动队列中取出一帧图像 (VIDIOC_DQBUF)
-     *
-     * 原理:
-     *   - 驱动采集到视频帧后会将数据放入队列；
-     *   - 用户通过 DQBUF (DeQueue Buffer) 取出可用帧；
-     *   - 此时返回的 buf.index 指示当前使用的缓冲区编号。
-     ************************************************************/
-    struct v4l2_buffer buf = {};
-    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buf.memory = V4L2_MEMORY_MMAP;
-    ioctl(vfd, VIDIOC_DQBUF, &buf);  // 出队 (取出一帧)
+void sink_writer(output_sink *st) {
+    output_msg m;
+    long long max_age_us = g_cfg.serial_max_age_ms * 1000LL;
+    while (st->q.pop(m)) {
+        if (max_age_us > 0 && now_us() - m.ts_us > max_age_us) {
+            st->stale++;
+            continue;
+        }
+        long long t0 = now_us();
+        for (int off = 0; off < m.len;) {
+            ssize_t n = write(st->fd, m.data + off, m.len - off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                if (st->errors++ == 0) fprintf(stderr, "[OUT] %s write: %s\n", st->name, strerror(errno));
+                break;
+            }
+            off += (int)n;
+        }
+        if (!st->primary) continue;
+        long long t1 = now_us();
+        lat_record(LAT_SERIAL, t1 - t0);
+        lat_record(LAT_TOTAL, t1 - m.ts_us);
+    }
+}
 
-    /************************************************************
-     * Step 2: 将YUYV帧数据封装为OpenCV的Mat对象
-     *
-     * OpenCV的Mat构造函数:
-     *   Mat(rows, cols, type, data_pointer)
-     *
-     * 参数解释:
-     *   HEIGHT → 行数
-     *   WIDTH  → 列数
-     *   CV_8UC2 → 每个像素2字节 (YUYV格式: Y1 U Y2 V)
-     *   buffers[buf.index].start → 实际帧数据指针
-     ************************************************************/
-    cv::Mat yuyv(HEIGHT, WIDTH, CV_8UC2, buffers[buf.index].start);
+// 启动一路输出（fd 由 sink 接管）
+static void sink_start(output_sink &s, const char *name, int fd, bool primary) {
+    s.name = name;
+    s.fd = fd;
+    s.primary = primary;
+    s.thread = std::thread(sink_writer, &s);
+}
 
-    /************************************************************
-     * Step 3: 颜色空间转换 (YUYV → BGR)
-     *
-     * 说明:
-     *   - OpenCV 默认使用 BGR 通道顺序；
-     *   - YUYV 是YUV 4:2:2格式，每两个像素共享U、V分量；
-     *   - cv::COLOR_YUV2BGR_YUYV 自动进行像素级转换。
-     ************************************************************/
-    cv::Mat bgr;
-    cv::cvtColor(yuyv, bgr, cv::COLOR_YUV2BGR_YUYV);
+// 发完队列中的样本后结束发送线程并关闭 fd（未启动时无操作）
+static void sink_stop(output_sink &s) {
+    if (s.fd < 0) return;
+    s.q.close();
+    s.thread.join();
+    close(s.fd);
+    s.fd = -1;
+}
 
-    /************************************************************
-     * Step 4: 将缓冲区重新入队 (VIDIOC_QBUF)
-     *
-     * 目的:
-     *   - 告诉驱动该缓冲区已处理完毕；
-     *   - 驱动可以重新填充下一帧图像数据。
-     ************************************************************/
-    ioctl(vfd, VIDIOC_QBUF, &buf);  // 入队 (重新使用此缓冲区)
+// 结果扇出：串口必有，UDP / 共享内存按配置启用；各路互不等待
+struct output_fanout {
+    output_sink serial;
+    output_sink udp;                  // fd < 0 = 未启用
+    pose_shm *shm = nullptr;          // 汇合线程直接写入（不阻塞、不做系统调用）
+};
 
-    /************************************************************
-     * Step 5: 返回转换后的 BGR 图像
-     *
-     * 注意:
-     *   - Mat bgr 是独立拷贝的数据，不依赖内核缓冲；
-     *   - 可安全在函数外使用。
-     ************************************************************/
-    return bgr;
+static void outputs_stop(output_fanout &o) {
+    sink_stop(o.serial);
+    sink_stop(o.udp);
+    if (o.shm) munmap(o.shm, sizeof(*o.shm));
+    o.shm = nullptr;
+}
+
+/**
+ * 函数名: output_worker
+ * 功能: 汇合线程，按序号对齐左右检测结果，两侧都检出瞳孔时三角测量并更新 α-β 滤波器，
+ *       输出滤波后的位置；缺测时在 filter_coast_ms 内输出外推位置。
+ *
+ * 参数:
+ *   l/r       - 左右检测级
+ *   out       - 输出扇出（串口 / UDP 入队失败即丢弃，不等待发送线程）
+ *   hint      - 滤波器状态发布处（检测线程据此预测跟踪窗口）
+ */
+void output_worker(detect_stage *l, detect_stage *r, output_fanout *out, pose_hint *hint) {
+    pose_filter filter;
+    detect_result a, b;
+    bool has_a = false, has_b = false;
+    unsigned out_seq = 0;             // 二进制帧序号
+    for (;;) {
+        if (!has_a && !(has_a = l->out.pop(a))) break;
+        if (!has_b && !(has_b = r->out.pop(b))) break;
+
+        // 一侧结果被丢弃时序号不一致：丢掉较旧的一侧，等待其下一个结果
+        if (a.seq != b.seq) {
+            if ((int)(a.seq - b.seq) < 0) has_a = false;
+            else has_b = false;
+            continue;
+        }
+        has_a = has_b = false;
+        long long t0 = now_us();
+
+        /****************************************************
+         * 三角测量计算三维坐标
+         * match_candidates() → triangulate_rays():
+         *   - 使用双目相机参数 (R, T, K1, K2)；
+         *   - 通过光线最近点算法求出 (X, Y, Z)（全部候选配对一次算出，float32）；
+         *   - 若两个摄像头都检测到瞳孔则执行（多候选时先按极线关联），结果送入滤波器；
+         *   - 否则按滤波器匀速外推（短暂遮挡、眨眼期间输出不中断）。
+         ****************************************************/
+        std::shared_ptr<const calib_set> cs = calib_current();
+        cv::Point2f pa, pb;
+        cv::Point3f P;
+        bool measured = match_candidates(*cs, a.cand, a.ncand, b.cand, b.ncand, &pa, &pb, &P);
+        if (measured) {
+            filter_update(filter, P, a.ts_us);
+            hint_publish(*hint, filter);
+        }
+        double X[3];
+        if (!filter_predict(filter, a.ts_us, X)) continue;
+        cv::Point3f pos(static_cast<float>(X[0]), static_cast<float>(X[1]), static_cast<float>(X[2]));
+
+        /************************************************
+         * 输出结果（串口，及可选的 UDP / 共享内存）
+         * 格式: "X,Y,Z\n"，或二进制帧（serial_format，见 encode_pose_frame）；
+         *       UDP 每个数据报一个样本，内容与串口相同；共享内存格式见 pose_shm.h
+         * 单位: 与标定平移向量 T 一致 (通常为 mm)
+         ************************************************/
+        output_msg m;
+        m.ts_us = a.ts_us;
+        if (g_cfg.serial_format == SERIAL_ASCII)
+            m.len = snprintf(m.data, sizeof(m.data), "%.2f,%.2f,%.2f\n", pos.x, pos.y, pos.z);
+        else
+            m.len = encode_pose_frame((uint8_t *)m.data, g_cfg.serial_format, out_seq++, a.ts_us, X, !measured);
+
+        if (g_cfg.verbose >= 2)
+            printf("%.2f, %.2f, %.2f%s\n", pos.x, pos.y, pos.z, measured ? "" : " (predicted)");
+        if (!out->serial.q.push(m)) out->serial.dropped++;  // 各路发送线程写出
+        if (out->udp.fd >= 0 && !out->udp.q.push(m)) out->udp.dropped++;
+        if (out->shm) {
+            const float xyz[3] = { pos.x, pos.y, pos.z };
+            pose_shm_write(out->shm, a.ts_us, xyz, measured ? 0 : POSE_SHM_FLAG_PREDICTED);
+        }
+        lat_record(LAT_FUSE, now_us() - t0);
+        g_out_samples.fetch_add(1, std::memory_order_relaxed);
+        if (measured) g_out_measured.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 /**
- * 函数名: init_serial_115200
- * 功能: 初始化指定串口设备为 115200 波特率通信模式，用于发送双目测距结果。
+ * 函数名: open_tracking_cam
+ * 功能: 以跟踪用参数打开一路摄像头：精确分辨率 YUYV、固定帧间隔、固定曝光 / 增益。
+ *
+ * 参数:
+ *   cam      - 输出的摄像头对象
+ *   dev      - 视频节点，例如 "/dev/video21"
+ *   ctrl_dev - 曝光 / 增益控件所在节点（空字符串 = 视频节点本身）
+ *
+ * 返回值:
+ *   0 成功；-1 打开失败（控件设置失败只打印警告，不影响跟踪）
+ *
+ * 注意:
+ *   自动曝光在红外照明下会拉长曝光时间，使帧率掉到一半、延迟随亮度漂移，
+ *   因此跟踪时应在配置文件中给出 exposure / gain 的固定值。
+ */
+static int open_tracking_cam(cam_device *cam, const char *dev, const char *ctrl_dev) {
+    static const unsigned int formats[] = { V4L2_PIX_FMT_YUYV, 0 };
+    cam_params p;
+    memset(&p, 0, sizeof(p));
+    p.width = g_cfg.width;
+    p.height = g_cfg.height;
+    p.formats = formats;
+    p.count = CAM_BUFFERS;
+    p.fps = g_cfg.fps > 0 ? (unsigned int)g_cfg.fps : CAM_FPS_MAX;
+    p.flags = CAM_EXACT_SIZE;
+    if (cam_open_ex(cam, dev, &p) != 0) return -1;
+    cam_set_exposure(cam, ctrl_dev, g_cfg.exposure, g_cfg.gain);
+    return 0;
+}
+
+// 波特率数值 → termios 速率常量（不支持时返回 B0）
+static speed_t serial_speed(int baud) {
+    static const struct { int baud; speed_t code; } table[] = {
+        { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+        { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 }, { 500000, B500000 },
+        { 576000, B576000 }, { 921600, B921600 }, { 1000000, B1000000 }, { 1152000, B1152000 },
+        { 1500000, B1500000 }, { 2000000, B2000000 }, { 3000000, B3000000 }, { 4000000, B4000000 },
+    };
+    for (const auto &e : table)
+        if (e.baud == baud) return e.code;
+    return B0;
+}
+
+/**
+ * 函数名: init_serial
+ * 功能: 以原始模式 8N1 打开串口设备，用于发送双目测距结果。
  *
  * 应用场景:
  *   - 用于与下位机（如 MCU、STM32、或其他传感模块）进行串口通信；
@@ -519,19 +2040,25 @@ cv::Mat capture_frame(int vfd, buffer *buffers) {
  *
  * 参数:
  *   device - 串口设备路径，例如 "/dev/ttyS3" 或 "/dev/ttyUSB0"
+ *   baud   - 波特率（serial_speed() 表中的值，如 115200 / 921600 / 1500000）
  *
  * 返回值:
  *   成功返回串口文件描述符 fd；
- *   打开失败返回 -1。
+ *   打开失败或波特率不支持返回 -1。
  *
  * 串口配置说明:
- *   - 波特率: 115200 bps（标准高速通信速率）
- *   - 数据位: 默认 8 位 (CS8)
+ *   - 数据位: 8 位 (CS8)
  *   - 校验位: 无校验 (N)
  *   - 停止位: 1 位
- *   - 控制模式: 原始模式 (Raw Mode)，不进行行缓冲或回显
+ *   - 流控: 无（CLOCAL，不使用 RTS/CTS 与 XON/XOFF）
+ *   - 控制模式: 原始模式 (cfmakeraw)，不做行缓冲、回显与 \n → \r\n 转换，二进制帧原样发出
  */
-int init_serial_115200(const char* device) {
+int init_serial(const char *device, int baud) {
+    speed_t speed = serial_speed(baud);
+    if (speed == B0) {
+        fprintf(stderr, "open serial failed: unsupported baud rate %d\n", baud);
+        return -1;
+    }
 
     /************************************************************
      * Step 1: 打开串口设备文件
@@ -540,54 +2067,377 @@ int init_serial_115200(const char* device) {
      * O_NOCTTY → 不将此设备设置为控制终端；
      * 打开成功后返回文件描述符 fd。
      ************************************************************/
-    int fd = open(device, O_RDWR | O_NOCTTY);
+    int fd = open(device, O_RDWR | O_NOCTTY | O_CLOEXEC);
     if (fd < 0) {
         perror("open serial failed");
         return -1;  // 打开失败返回 -1
     }
 
     /************************************************************
-     * Step 2: 获取当前串口配置
+     * Step 2: 从当前配置出发设为原始模式
      *
-     * termios 结构体:
-     *   - 用于保存和设置串口控制参数；
-     *   - 包含波特率、数据位、停止位、校验方式等。
+     * cfmakeraw():
+     *   - 关闭规范模式、回显、信号字符与输入输出处理；
+     *   - 设为 8 位数据、无校验；
+     * 其余位显式设置，不依赖上一个程序留下的 termios 状态。
      ************************************************************/
     struct termios options;
-    tcgetattr(fd, &options);  // 获取当前配置
+    if (tcgetattr(fd, &options) != 0) {
+        perror("tcgetattr serial");
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&options);
+    options.c_cflag |= CLOCAL | CREAD;       // 忽略调制解调器线，允许接收
+    options.c_cflag &= ~(CSTOPB | CRTSCTS);  // 1 停止位，无硬件流控
+    options.c_iflag &= ~(IXON | IXOFF | IXANY);
+    options.c_cc[VMIN] = 0;                  // read() 不等待（本程序只发送）
+    options.c_cc[VTIME] = 0;
 
     /************************************************************
-     * Step 3: 设置波特率 (115200)
+     * Step 3: 设置波特率
      *
      * cfsetispeed() → 设置输入速度；
      * cfsetospeed() → 设置输出速度；
-     * B115200 → POSIX 宏，代表 115200 bits/s。
+     * 921600 以上的速率需串口控制器时钟支持，设置后回读确认。
      ************************************************************/
-    cfsetispeed(&options, B115200);
-    cfsetospeed(&options, B115200);
+    cfsetispeed(&options, speed);
+    cfsetospeed(&options, speed);
 
     /************************************************************
      * Step 4: 应用新的串口配置
      *
-     * TCSANOW:
-     *   - 立即生效；
-     *   - 不等待输出缓冲区清空。
-     *
-     * 注意:
-     *   此处未修改其他参数（如数据位、校验位、停止位），
-     *   采用系统默认配置（通常为 8N1）。
+     * TCSANOW: 立即生效；随后丢弃缓冲中的残留数据。
      ************************************************************/
-    tcsetattr(fd, TCSANOW, &options);
+    if (tcsetattr(fd, TCSANOW, &options) != 0) {
+        perror("tcsetattr serial");
+        close(fd);
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+    struct termios check;
+    if (tcgetattr(fd, &check) == 0 && cfgetospeed(&check) != speed)
+        fprintf(stderr, "[SERIAL] %s: driver rejected %d baud\n", device, baud);
 
     /************************************************************
      * Step 5: 返回串口文件描述符
      *
-     * 后续可通过 write(fd, buf, len) 发送数据，
-     * 或 read(fd, buf, len) 接收数据。
+     * 后续由串口发送线程 (sink_writer) 独占写入。
      ************************************************************/
+    printf("[SERIAL] %s raw 8N1 @ %d baud\n", device, baud);
     return fd;
 }
 
+/**
+ * 函数名: init_udp
+ * 功能: 解析 "host:port"（IPv6 写作 "[addr]:port"）并创建已 connect 的 UDP 套接字。
+ *
+ * 返回值:
+ *   套接字 fd；解析或创建失败返回 -1（已打印原因）
+ *
+ * 注意:
+ *   connect 后发送线程只需 write()；对端未监听时 write 返回 ECONNREFUSED，
+ *   只计入该路的 errors，不影响串口输出。
+ */
+static int init_udp(const char *dest) {
+    char host[CFG_STR_LEN];
+    snprintf(host, sizeof(host), "%s", dest);
+    char *colon = strrchr(host, ':');
+    if (!colon || !colon[1]) {
+        fprintf(stderr, "[UDP] %s: expected host:port\n", dest);
+        return -1;
+    }
+    *colon = '\0';
+    const char *port = colon + 1, *name = host;
+    if (host[0] == '[' && colon > host && colon[-1] == ']') {
+        colon[-1] = '\0';
+        name = host + 1;
+    }
+
+    addrinfo hints, *res = nullptr;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    int err = getaddrinfo(name, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "[UDP] %s: %s\n", dest, gai_strerror(err));
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd < 0) {
+        fprintf(stderr, "[UDP] %s: %s\n", dest, strerror(errno));
+        return -1;
+    }
+    printf("[UDP] sending to %s\n", dest);
+    return fd;
+}
+
+// 打印各级延迟的 p50 / p99 / 最大值并清空直方图
+static void lat_report() {
+    for (int st = 0; st < LAT_STAGES; st++) {
+        unsigned h[LAT_BINS], n = 0;
+        for (int b = 0; b < LAT_BINS; b++) n += h[b] = g_lat[st][b].exchange(0, std::memory_order_relaxed);
+        if (n == 0) continue;
+        long long p50 = 0, p99 = 0, max = 0;
+        unsigned acc = 0;
+        for (int b = 0; b < LAT_BINS; b++) {
+            if (!h[b]) continue;
+            acc += h[b];
+            if (!p50 && acc * 2 >= n) p50 = lat_bin_upper(b);
+            if (!p99 && acc * 100ULL >= n * 99ULL) p99 = lat_bin_upper(b);
+            max = lat_bin_upper(b);
+        }
+        printf("[STAT]   %-7s n=%-6u p50<=%lldus p99<=%lldus max<=%lldus\n", k_lat_names[st], n, p50, p99, max);
+    }
+}
+
+/**
+ * 函数名: stats_report
+ * 功能: 打印一个报告周期的帧率、累计丢弃数与各级延迟的 p50 / p99 / 最大值，然后清空直方图。
+ *
+ * 参数:
+ *   dt_s  - 距上次报告的时间（秒）
+ *   pairs - 本周期分发给检测线程的帧对数
+ *   drops - 累计丢弃数：检测忙、限速跳过、结果队列满、串口队列满、串口过期、UDP（队列满 + 过期 + 发送失败）
+ */
+static void stats_report(double dt_s, unsigned pairs, const unsigned drops[6]) {
+    unsigned out = g_out_samples.exchange(0, std::memory_order_relaxed);
+    unsigned meas = g_out_measured.exchange(0, std::memory_order_relaxed);
+    printf("[STAT] %.1fs: pairs %.1f/s, out %.1f/s (measured %.1f/s); drop busy=%u rate=%u result=%u "
+           "serial=%u stale=%u udp=%u\n", dt_s, pairs / dt_s, out / dt_s, meas / dt_s, drops[0], drops[1],
+           drops[2], drops[3], drops[4], drops[5]);
+    lat_report();
+    fflush(stdout);
+}
+
+/*
+ * 离线回放（replay 非空时代替实时跟踪）
+ *   按录制顺序在单线程中逐帧执行：提取亮度 → 左右 track_pupil（含三维预测窗口）→ 三角测量 + 滤波，
+ *   不等待帧间隔，尽可能快地运行；各级耗时记入同一组延迟直方图（不含读文件 / JPEG 解码）。
+ *   输入:
+ *     .sdump 文件      - 录制的左右 YUYV 原始帧与驱动时间戳（stereo_dump.h）
+ *     目录             - <dir>/left/N.jpg 与 <dir>/right/N.jpg（双摄显示程序的拍照结果），
+ *                        N 从 0 连续编号，时间戳按 fps（0 时按 30）合成
+ *   参考 CSV（replay_ref）每行 seq,lx,ly,rx,ry，未检出为 -1，# 或非数字开头的行忽略；
+ *   结果 CSV（replay_out）同格式，另附三维坐标，可直接作为下一次回放的参考。
+ */
+#define REPLAY_HIT_PX 5.0     // 检出位置与参考相距不超过此值（像素）才算命中
+
+struct replay_ref_row {
+    cv::Point2f pt[2];                // 左 / 右参考位置（x < 0 = 参考中无瞳孔）
+};
+
+// 读取参考 CSV，按 seq 下标存放（缺失的 seq 标记为无参考）
+static int load_replay_ref(const char *path, std::vector<replay_ref_row> &ref, std::vector<bool> &has) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "[REPLAY] %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned seq;
+        float lx, ly, rx, ry;
+        if (!isdigit((unsigned char)line[0]) || sscanf(line, "%u,%f,%f,%f,%f", &seq, &lx, &ly, &rx, &ry) != 5)
+            continue;
+        if (seq >= ref.size()) {
+            ref.resize(seq + 1);
+            has.resize(seq + 1, false);
+        }
+        ref[seq].pt[0] = cv::Point2f(lx, ly);
+        ref[seq].pt[1] = cv::Point2f(rx, ry);
+        has[seq] = true;
+    }
+    fclose(fp);
+    printf("[REPLAY] Reference %s: %zu frames\n", path, ref.size());
+    return 0;
+}
+
+// 每台相机的精度统计
+struct replay_score {
+    unsigned hit = 0;                 // 参考有、检出且相距 ≤ REPLAY_HIT_PX
+    unsigned miss = 0;                // 参考有、未检出或相距过远
+    unsigned false_pos = 0;           // 参考无、却检出
+    unsigned true_neg = 0;            // 参考无、未检出
+    std::vector<float> err;           // 命中帧的像素误差
+};
+
+static void replay_score_add(replay_score &sc, const cv::Point2f &ref, const cv::Point2f &pt) {
+    bool want = ref.x >= 0, got = pt.x >= 0;
+    if (!want) {
+        if (got) sc.false_pos++;
+        else sc.true_neg++;
+        return;
+    }
+    float e = got ? std::hypot(pt.x - ref.x, pt.y - ref.y) : -1.0f;
+    if (got && e <= REPLAY_HIT_PX) {
+        sc.hit++;
+        sc.err.push_back(e);
+    } else {
+        sc.miss++;
+    }
+}
+
+static void replay_score_print(const char *name, replay_score &sc) {
+    unsigned want = sc.hit + sc.miss;
+    double mean = 0, p95 = 0;
+    if (!sc.err.empty()) {
+        for (float e : sc.err) mean += e;
+        mean /= sc.err.size();
+        size_t k = sc.err.size() * 95 / 100;
+        std::nth_element(sc.err.begin(), sc.err.begin() + k, sc.err.end());
+        p95 = sc.err[k];
+    }
+    printf("[REPLAY] %s: detect %u/%u (%.1f%%), false %u/%u, error mean %.3fpx p95 %.3fpx\n", name, sc.hit, want,
+           want ? 100.0 * sc.hit / want : 0.0, sc.false_pos, sc.false_pos + sc.true_neg, mean, p95);
+}
+
+/**
+ * 函数名: run_replay
+ * 功能: 离线回放 g_cfg.replay，输出处理帧率、各级耗时与（给出参考时的）检测精度。
+ *
+ * 返回值:
+ *   进程退出码：0 成功；1 输入或参考文件无法打开 / 分辨率与配置不符
+ */
+static int run_replay() {
+    // ---------- 1. 打开输入 ----------
+    struct stat sb;
+    bool jpeg_dir = stat(g_cfg.replay, &sb) == 0 && S_ISDIR(sb.st_mode);
+    sdump_reader rd;
+    long long frame_us = 1000000LL / (g_cfg.fps > 0 ? g_cfg.fps : 30);
+#if HEADLESS
+    if (jpeg_dir) {
+        fprintf(stderr, "[REPLAY] %s: JPEG directory replay needs a non-headless build (imgcodecs)\n", g_cfg.replay);
+        return 1;
+    }
+#endif
+    if (!jpeg_dir) {
+        if (sdump_open(&rd, g_cfg.replay) != 0) return 1;
+        if ((int)rd.hdr.width != g_cfg.width || (int)rd.hdr.height != g_cfg.height ||
+            rd.hdr.pixfmt != V4L2_PIX_FMT_YUYV) {
+            fprintf(stderr, "[REPLAY] %s: %ux%u dump, but width/height are %dx%d (YUYV required)\n",
+                    g_cfg.replay, rd.hdr.width, rd.hdr.height, g_cfg.width, g_cfg.height);
+            sdump_close(&rd);
+            return 1;
+        }
+    }
+
+    std::vector<replay_ref_row> ref;
+    std::vector<bool> has_ref;
+    if (g_cfg.replay_ref[0] && load_replay_ref(g_cfg.replay_ref, ref, has_ref) != 0) {
+        if (!jpeg_dir) sdump_close(&rd);
+        return 1;
+    }
+    FILE *out = g_cfg.replay_out[0] ? fopen(g_cfg.replay_out, "w") : NULL;
+    if (g_cfg.replay_out[0] && !out) perror(g_cfg.replay_out);
+    if (out) fprintf(out, "# seq,lx,ly,rx,ry,X,Y,Z\n");
+
+    // ---------- 2. 逐帧处理 ----------
+    std::shared_ptr<const calib_set> cs = calib_current();
+    pupil_tracker trk[2];
+    pose_filter filter;
+    cv::Mat gray[2];
+    replay_score score[2];
+    unsigned frames = 0, both = 0;
+    long long busy_us = 0, t_start = now_us();
+    for (unsigned i = 0;; i++) {
+        unsigned seq = i;
+        long long ts_us;
+        long long t0;
+        if (jpeg_dir) {
+            char path[CFG_STR_LEN + 32];
+            for (int c = 0; c < 2; c++) {
+                snprintf(path, sizeof(path), "%s/%s/%u.jpg", g_cfg.replay, c == 0 ? "left" : "right", i);
+#if !HEADLESS
+                gray[c] = cv::imread(path, cv::IMREAD_GRAYSCALE);
+#endif
+            }
+            if (gray[0].empty() || gray[1].empty()) break;
+            ts_us = i * frame_us;
+            t0 = now_us();
+        } else {
+            const sdump_record *rec = sdump_next(&rd);
+            if (!rec) break;
+            seq = rec->seq;
+            ts_us = rec->ts_us[0];
+            t0 = now_us();
+            for (int c = 0; c < 2; c++)
+                extract_luma(sdump_frame(&rd, c), rd.hdr.bytesperline, g_cfg.width, g_cfg.height, gray[c]);
+            lat_record(LAT_LUMA, (now_us() - t0) / 2);
+        }
+
+        // 检测：与实时流水线相同，三维预测投影到各相机作为跟踪窗口中心
+        cv::Point2f pt[2];
+        double X[3];
+        bool has_pred = filter_predict(filter, ts_us, X);
+        for (int c = 0; c < 2; c++) {
+            cv::Point2f pred;
+            bool use_pred = has_pred && project_point(cs->cal, c, X, &pred) && pred.x >= 0 && pred.y >= 0 &&
+                            pred.x < gray[c].cols && pred.y < gray[c].rows;
+            long long t1 = now_us();
+            cv::Rect bands[MAX_CANDIDATES];
+            int nbands = -1;                              // 顺序执行，左相机结果即在 trk[0] 中
+            if (c == 1 && g_cfg.epipolar_search && track_needs_acquire(trk[1], use_pred))
+                nbands = epipolar_bands(*cs, trk[0].det.cands.data(), (int)trk[0].det.cands.size(),
+                                        gray[1].cols, gray[1].rows, bands);
+            track_pupil(trk[c], gray[c], use_pred ? &pred : nullptr, nullptr, nbands >= 0 ? bands : nullptr,
+                        std::max(nbands, 0));
+            lat_record(LAT_DETECT, now_us() - t1);
+        }
+
+        // 候选关联 + 三角测量 + 滤波
+        long long t2 = now_us();
+        cv::Point3f P(-1, -1, -1);
+        cv::Point2f cand[2][MAX_CANDIDATES];
+        int ncand[2];
+        for (int c = 0; c < 2; c++) {
+            ncand[c] = 0;
+            for (const pupil_candidate &q : trk[c].det.cands) cand[c][ncand[c]++] = q.pt;
+            pt[c] = ncand[c] ? cand[c][0] : cv::Point2f(-1, -1);
+        }
+        if (match_candidates(*cs, cand[0], ncand[0], cand[1], ncand[1], &pt[0], &pt[1], &P)) {
+            filter_update(filter, P, ts_us);
+            both++;
+        }
+        long long t3 = now_us();
+        lat_record(LAT_FUSE, t3 - t2);
+        lat_record(LAT_TOTAL, t3 - t0);
+        busy_us += t3 - t0;
+        frames++;
+
+        if (seq < has_ref.size() && has_ref[seq])
+            for (int c = 0; c < 2; c++) replay_score_add(score[c], ref[seq].pt[c], pt[c]);
+        if (out)
+            fprintf(out, "%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", seq, pt[0].x, pt[0].y, pt[1].x, pt[1].y,
+                    P.x, P.y, P.z);
+    }
+    long long wall_us = now_us() - t_start;
+
+    // ---------- 3. 报告 ----------
+    printf("[REPLAY] %s: %u frame pairs, both detected %u\n", g_cfg.replay, frames, both);
+    if (frames) {
+        printf("[REPLAY] processing %.1f pairs/s (%.3f ms/pair), wall %.1f pairs/s incl. %s\n",
+               frames * 1e6 / std::max(busy_us, 1LL), busy_us / 1000.0 / frames,
+               frames * 1e6 / std::max(wall_us, 1LL), jpeg_dir ? "JPEG decode" : "file read");
+    }
+    lat_report();
+    if (!ref.empty()) {
+        replay_score_print("left ", score[0]);
+        replay_score_print("right", score[1]);
+    }
+    if (out) fclose(out);
+    if (!jpeg_dir) sdump_close(&rd);
+    return 0;
+}
+
 /**
  * 函数名: main
  * 功能: 系统主程序入口，负责整体任务调度与模块协作。
@@ -603,14 +2453,47 @@ int init_serial_115200(const char* device) {
  * 系统流程:
  *   ┌──────────────────────────────────────────────┐
  *   │  1. 启动按键监听线程 (monitor_key_event)     │
- *   │  2. 打开串口 /dev/ttyS3 (115200bps)          │
+ *   │  2. 打开串口 /dev/ttyS3 并启动发送线程       │
  *   │  3. 初始化双摄像头 /dev/video21 和 /dev/video23 │
- *   │  4. 主循环中采集图像 → 检测瞳孔 → 三角测量 → 串口输出 │
+ *   │  4. 主循环采集配对帧 → 左右检测线程并行检测   │
+ *   │     → 汇合线程三角测量 → 串口输出            │
  *   │  5. 按键触发时 g_running=false → 退出循环     │
  *   │  6. 关闭串口并回收线程                       │
  *   └──────────────────────────────────────────────┘
  */
-int main() {
+int main(int argc, char **argv) {
+    // 读取配置文件与命令行覆盖（--help 打印全部参数后退出）
+    int cfg_rc = cfg_parse_args(g_cfg_opts, CFG_COUNT(g_cfg_opts), argc, argv, CONFIG_FILE);
+    if (cfg_rc != 0) return cfg_rc > 0 ? 0 : 1;
+#if HEADLESS
+    if (g_cfg.debug_overlay) {
+        fprintf(stderr, "[CFG] debug_overlay ignored: headless build\n");
+        g_cfg.debug_overlay = 0;
+    }
+#endif
+    if (g_cfg.candidates < 1 || g_cfg.candidates > MAX_CANDIDATES) {
+        fprintf(stderr, "[CFG] candidates must be 1..%d\n", MAX_CANDIDATES);
+        return 1;
+    }
+    if (g_cfg.serial_format < SERIAL_ASCII || g_cfg.serial_format > SERIAL_BIN_I16) {
+        fprintf(stderr, "[CFG] serial_format must be 0, 1 or 2\n");
+        return 1;
+    }
+
+    // 载入双目标定并生成两台相机的视线查找表（逐帧三角测量只查表）
+    if (calib_reload(g_cfg.calib_file) == -2) return 1;
+
+    // 离线回放：不打开摄像头与串口，读完序列后退出
+    if (g_cfg.replay[0]) return run_replay();
+
+    // 屏蔽 SIGHUP / SIGUSR1，使其后创建的线程都继承该屏蔽字，信号统一由主循环的 signalfd 读取
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGHUP);
+    sigaddset(&sigs, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+    int sfd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd < 0) perror("signalfd");
 
     /************************************************************
      * Step 1: 启动按键监听线程
@@ -625,92 +2508,172 @@ int main() {
     /************************************************************
      * Step 2: 初始化串口通信 (/dev/ttyS3)
      *
-     * 波特率: 115200；
+     * 原始模式 8N1，波特率 serial_baud（默认 115200）；
      * 作用:
      *   - 通过 UART 将三维坐标结果发送给下位机；
-     *   - 例如 STM32、Arduino 或 PC 程序。
+     *   - 例如 STM32、Arduino 或 PC 程序；
+     *   - 由独立的发送线程写出，串口慢时丢样本而不拖慢检测。
+     * 可选同时输出到 UDP（udp_dest，独立发送线程）与共享内存（shm_name）。
      ************************************************************/
-    int serial_fd = init_serial_115200("/dev/ttyS3");
-    if (serial_fd < 0) return -1;  // 打开失败直接退出
+    output_fanout outs;
+    output_sink &ser = outs.serial;
+    int ser_fd = init_serial(g_cfg.serial_device, g_cfg.serial_baud);
+    int udp_fd = g_cfg.udp_dest[0] ? init_udp(g_cfg.udp_dest) : -1;
+    if (g_cfg.shm_name[0]) outs.shm = pose_shm_create(g_cfg.shm_name);
+    if (ser_fd < 0 || (g_cfg.udp_dest[0] && udp_fd < 0) || (g_cfg.shm_name[0] && !outs.shm)) {  // 打开失败直接退出
+        if (ser_fd >= 0) close(ser_fd);
+        if (udp_fd >= 0) close(udp_fd);
+        outputs_stop(outs);
+        if (sfd >= 0) close(sfd);
+        g_running = false;
+        key_thread.detach();
+        return -1;
+    }
+    sink_start(ser, "serial", ser_fd, true);
+    if (udp_fd >= 0) sink_start(outs.udp, "udp", udp_fd, false);
+    if (outs.shm) printf("[SHM] writing %s (%d slots)\n", g_cfg.shm_name, POSE_SHM_SLOTS);
 
     /************************************************************
      * Step 3: 初始化双摄像头
      *
      * /dev/video21 → 左相机；
      * /dev/video23 → 右相机；
-     * 每个摄像头申请 2 个缓冲区用于连续采集。
+     * 每个摄像头申请 CAM_BUFFERS 个缓冲区（共享模块 v4l2_camera.h），
+     * 设置帧间隔并固定曝光 / 增益，跟踪帧率与延迟保持恒定。
      ************************************************************/
-    int vfd1, vfd2;
-    buffer buffers1[2], buffers2[2];
-    init_camera("/dev/video21", buffers1, vfd1);
-    init_camera("/dev/video23", buffers2, vfd2);
+    cam_device cam1, cam2;
+    if (open_tracking_cam(&cam1, g_cfg.cam_left, g_cfg.ctrl_left) != 0 ||
+        open_tracking_cam(&cam2, g_cfg.cam_right, g_cfg.ctrl_right) != 0) {
+        outputs_stop(outs);
+        if (sfd >= 0) close(sfd);
+        g_running = false;
+        key_thread.detach();
+        return -1;
+    }
+
+    // 左右帧按驱动时间戳配对
+    cam_stereo sync;
+    cam_stereo_init(&sync, &cam1, &cam2, g_cfg.stereo_sync_us);
+
+    // 启动检测与汇合线程（见“流水线”）
+    detect_stage left, right;
+    pose_hint hint;
+    left.cam_index = 0;
+    right.cam_index = 1;
+    left.hint = right.hint = &hint;
+    epi_channel epi;
+    left.epi = right.epi = g_cfg.epipolar_search ? &epi : nullptr;
+    left.thread = std::thread(detect_worker, &left);
+    right.thread = std::thread(detect_worker, &right);
+    std::thread output_thread(output_worker, &left, &right, &outs, &hint);
+    unsigned seq = 0, busy = 0;       // 帧对序号；检测线程忙而丢弃的帧对数
+    unsigned limited = 0;             // 限速跳过的帧对数
+
+    // 限速：按驱动时间戳排期，早于 due_us 到达的帧对直接释放（摄像头照常采集，省去检测开销）
+    long long period_us = g_cfg.max_rate > 0 ? 1000000LL / g_cfg.max_rate : 0;
+    long long slack_us = cam1.fps_num ? 500000LL * cam1.fps_den / cam1.fps_num : 0;  // 半个摄像头帧间隔，吸收到达抖动
+    long long due_us = 0;
+
+    // 统计报告：每 stats_interval_ms 一次（verbose ≥ 1），或收到 SIGUSR1 时立即打印
+    long long stats_us = g_cfg.verbose >= 1 ? g_cfg.stats_interval_ms * 1000LL : 0;
+    long long t_stats = now_us();
+    unsigned seq_stats = 0;
 
     /************************************************************
-     * Step 4: 主循环 — 图像采集与处理
+     * Step 4: 主循环 — 采集并分发
      *
      * 循环条件:
      *   - g_running == true；
      *   - 若按键线程检测到退出信号则终止。
      ************************************************************/
     while (g_running) {
-        /****************************************************
-         * (1) 从左右相机采集一帧图像
-         * capture_frame():
-         *   - 从驱动缓冲队列取出一帧；
-         *   - 转换为 OpenCV Mat (BGR格式)；
-         ****************************************************/
-        cv::Mat frame1 = capture_frame(vfd1, buffers1);
-        cv::Mat frame2 = capture_frame(vfd2, buffers2);
+        // 信号：kill -HUP <pid> 重新载入标定（新标定集从下一对帧起生效，失败保持原标定）；
+        //       kill -USR1 <pid> 立即打印统计
+        signalfd_siginfo si;
+        bool reload = false, report = false;
+        while (sfd >= 0 && read(sfd, &si, sizeof(si)) == (ssize_t)sizeof(si)) {
+            if (si.ssi_signo == SIGHUP) reload = true;
+            else if (si.ssi_signo == SIGUSR1) report = true;
+        }
+        if (reload) calib_reload(g_cfg.calib_file);
+        long long t_now = now_us();
+        if (report || (stats_us > 0 && t_now - t_stats >= stats_us)) {
+            const unsigned drops[6] = { busy, limited, left.dropped + right.dropped, ser.dropped, ser.stale,
+                                        outs.udp.dropped + outs.udp.stale + outs.udp.errors };
+            stats_report((t_now - t_stats) / 1e6, seq - seq_stats, drops);
+            t_stats = t_now;
+            seq_stats = seq;
+        }
 
         /****************************************************
-         * (2) 瞳孔检测
-         * detect_pupil():
-         *   - 灰度化 + 二值化 + 轮廓提取；
-         *   - 选择最接近图像中心的圆形区域；
-         *   - 返回瞳孔中心坐标。
+         * (1) 从左右相机取一对同步帧
+         * cam_stereo_next():
+         *   - 两路 poll() 并行等待，按驱动时间戳配对（容差 stereo_sync_us）；
+         *   - 循环节奏完全由帧到达驱动，不额外延时；
+         *   - 返回的帧直接引用映射内存，各持有 1 次引用。
          ****************************************************/
-        cv::Point pt1 = detect_pupil(frame1);
-        cv::Point pt2 = detect_pupil(frame2);
+        cam_frame *f1, *f2;
+        if (cam_stereo_next(&sync, &f1, &f2, g_cfg.stereo_wait_ms) != 0) continue;
+        lat_record(LAT_CAPTURE, now_us() - std::max(f1->ts_us, f2->ts_us));
 
         /****************************************************
-         * (3) 三角测量计算三维坐标
-         * triangulate():
-         *   - 使用双目相机参数 (R, T, K1, K2)；
-         *   - 通过光线最近点算法求出 (X, Y, Z)；
-         *   - 若两个摄像头都检测到瞳孔则执行。
+         * (2) 可选限速（max_rate > 0）
+         *   保持 period_us 的节拍；落后超过一个周期（如丢帧）时从当前帧重新排期。
          ****************************************************/
-        if (pt1.x >= 0 && pt2.x >= 0) {
-            cv::Point3f pos = triangulate(pt1, pt2);
-
-            /************************************************
-             * (4) 串口输出结果
-             * 格式: "X,Y,Z\n"
-             * 单位: 与标定平移向量 T 一致 (通常为 mm)
-             ************************************************/
-            char buf[64];
-            int len = snprintf(buf, sizeof(buf), "%.2f,%.2f,%.2f\n",
-                               pos.x, pos.y, pos.z);
-
-            printf("%.2f, %.2f, %.2f\n", pos.x, pos.y, pos.z);
-            write(serial_fd, buf, len);  // 串口发送
+        if (period_us) {
+            long long ts = f1->ts_us;
+            if (ts + slack_us < due_us) {
+                cam_frame_release(f1);
+                cam_frame_release(f2);
+                limited++;
+                continue;
+            }
+            due_us = (ts - due_us < period_us) ? due_us + period_us : ts + period_us;
         }
 
         /****************************************************
-         * (5) 帧率控制
-         * 每帧延时约 10 ms ≈ 100 FPS
-         * 根据硬件性能可调节延时以平衡实时性与稳定性。
+         * (3) 分发给左右检测线程
+         *   两侧都有空位才入队（只有本线程会占用空位），
+         *   否则整对丢弃，保证左右序号一一对应且驱动不缺缓冲。
          ****************************************************/
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (!left.in.has_space() || !right.in.has_space()) {
+            cam_frame_release(f1);
+            cam_frame_release(f2);
+            busy++;
+        } else {
+            left.in.push(detect_job{ seq, f1 });
+            right.in.push(detect_job{ seq, f2 });
+            seq++;
+        }
     }
 
+    // 依次关闭各级：检测线程处理完已入队的帧（并释放）后退出，再结束汇合线程
+    left.in.close();
+    right.in.close();
+    left.thread.join();
+    right.thread.join();
+    left.out.close();
+    right.out.close();
+    output_thread.join();
+    bool has_udp = outs.udp.fd >= 0;
+    outputs_stop(outs);
+    printf("[PIPE] pairs=%u busy_drop=%u rate_skip=%u result_drop=%u/%u serial_drop=%u serial_stale=%u",
+           seq, busy, limited, left.dropped.load(), right.dropped.load(), ser.dropped.load(), ser.stale.load());
+    if (has_udp)
+        printf(" udp_drop=%u udp_err=%u", outs.udp.dropped + outs.udp.stale, outs.udp.errors.load());
+    printf("\n");
+
     /************************************************************
      * Step 5: 退出清理
      *
-     * - 关闭串口；
+     * - 关闭串口（与 UDP / 共享内存，已在上面结束）；
      * - 等待按键线程结束；
      * - 释放资源。
      ************************************************************/
-    close(serial_fd);
+    cam_stereo_release(&sync);
+    cam_close(&cam1);
+    cam_close(&cam2);
+    if (sfd >= 0) close(sfd);
     key_thread.join();  // 等待按键监听线程安全退出
     return 0;
 }
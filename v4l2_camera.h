@@ -0,0 +1,721 @@
+/*
+ * ================================================================
+ * 文件名: v4l2_camera.h
+ * 功能概述:
+ *   双摄显示 (dual_camera_capture_display)、双目瞳孔跟踪 (stereo_pupil_tracking)
+ *   与线圈触发抓拍 (coil_trigger_capture 的 V4L2 后端) 共用的 V4L2 摄像头模块
+ *   （仅头文件，C/C++ 通用）。
+ *
+ *   - cam_open_ex() 按 cam_params 协商：像素格式按偏好列表逐个尝试，
+ *     分辨率可要求精确或接受驱动调整，VIDIOC_S_PARM 设置帧率（回读实际值），
+ *     缓冲数量可配，DMABUF 导出与非阻塞打开可选；cam_open() 为常用的精确 YUYV 封装；
+ *   - cam_set_exposure() 通过 V4L2 控件固定曝光 / 增益（可指向传感器子设备），
+ *     保证帧率与延迟不受自动曝光影响；
+ *   - MMAP 方式申请帧缓冲，并对每个缓冲执行 VIDIOC_EXPBUF 导出 DMABUF，
+ *     供 RGA 等硬件模块直接访问；
+ *   - 每帧带引用计数：预览、JPEG 编码、瞳孔检测等消费者直接读取
+ *     同一块映射内存（不拷贝），各自 cam_frame_ref() / cam_frame_release()；
+ *   - 最后一个消费者释放时才把缓冲 QBUF 回驱动，可在任意线程释放；
+ *   - 每个缓冲的归属（驱动 / 应用）显式记录，cam_dequeue_latest() 一次取空
+ *     已完成的帧只保留最新一帧，消费者慢时丢弃旧帧而不是让驱动缺缓冲；
+ *   - cam_stereo_next() 用 poll() 同时等待两路摄像头，按驱动时间戳
+ *     配对左右帧（超出容差的旧帧丢弃），供双目显示 / 三角测量使用。
+ *
+ * 典型用法:
+ *   struct cam_device cam;
+ *   if (cam_open(&cam, "/dev/video21", 640, 480, V4L2_PIX_FMT_YUYV, CAM_MIN_BUFFERS) != 0) exit(1);
+ *   struct cam_frame *f = cam_dequeue(&cam);   // 引用计数 = 1（或 cam_dequeue_latest / cam_dequeue_timeout）
+ *   cam_frame_ref(f);                          // 交给另一个消费者
+ *   ...                                        // 各消费者读取 f->start
+ *   cam_frame_release(f);                      // 每个消费者各释放一次
+ *   cam_close(&cam);
+ *
+ * 错误处理:
+ *   函数以 perror 打印原因并返回 -1 / NULL，是否退出由调用方决定。
+ * ================================================================
+ */
+#ifndef V4L2_CAMERA_H
+#define V4L2_CAMERA_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <time.h>
+#include <linux/videodev2.h>
+
+#define CAM_MIN_BUFFERS 4             // 推荐最小帧缓冲数量（应用持有 1~2 帧时驱动仍有空闲缓冲）
+#define CAM_MAX_BUFFERS 8             // 单个摄像头最多申请的帧缓冲数量
+
+// 缓冲归属
+enum cam_buf_owner {
+    CAM_OWNER_DRIVER = 0,             // 在驱动队列中等待填充
+    CAM_OWNER_APP    = 1              // 已出队，由应用的一个或多个消费者持有
+};
+
+// cam_params.flags
+#define CAM_EXACT_SIZE 0x1            // 驱动调整分辨率时视为失败（默认接受调整后的尺寸）
+#define CAM_NONBLOCK   0x2            // O_NONBLOCK 打开：cam_try_dequeue() 无帧时立即返回
+#define CAM_NO_DMABUF  0x4            // 不导出 DMABUF（只用 CPU 读取映射内存时节省描述符）
+
+// cam_params.fps：枚举 VIDIOC_ENUM_FRAMEINTERVALS，取当前格式/分辨率下的最短帧间隔
+#define CAM_FPS_MAX    0xFFFFFFFFu
+
+/*
+ * 打开参数（cam_open_ex）
+ *   formats 为以 0 结尾的像素格式偏好列表，驱动接受的第一个即被采用；
+ *   fps 为 0 时不设置帧间隔（沿用驱动默认值），CAM_FPS_MAX 时取驱动支持的最高帧率。
+ */
+struct cam_params {
+    unsigned int width, height;       // 期望分辨率
+    const unsigned int *formats;      // 像素格式偏好列表（V4L2_PIX_FMT_*，0 结尾）
+    unsigned int count;               // 期望缓冲数量（CAM_MIN_BUFFERS~CAM_MAX_BUFFERS）
+    unsigned int fps;                 // 期望帧率（0 = 不设置，CAM_FPS_MAX = 最高）
+    unsigned int flags;               // CAM_EXACT_SIZE | CAM_NONBLOCK | CAM_NO_DMABUF
+};
+
+struct cam_device;
+
+/*
+ * 一个帧缓冲（驱动缓冲序号 index 固定对应一个 cam_frame）
+ *   owner == CAM_OWNER_DRIVER 时 refs 为 0，其余帧字段只在应用持有期间有效。
+ */
+struct cam_frame {
+    struct cam_device *cam;           // 所属摄像头
+    unsigned int index;               // V4L2 缓冲序号
+    void *start;                      // mmap 映射地址（消费者直接读取）
+    size_t length;                    // 映射长度
+    size_t bytesused;                 // 本帧有效数据长度
+    unsigned int sequence;            // 驱动帧序号（用于统计丢帧）
+    long long ts_us;                  // 驱动采集时间戳（微秒，通常为 CLOCK_MONOTONIC）
+    int dma_fd;                       // VIDIOC_EXPBUF 导出的 DMABUF（-1 表示驱动不支持）
+    int refs;                         // 引用计数（原子操作）
+    int owner;                        // enum cam_buf_owner
+};
+
+struct cam_device {
+    int fd;                           // /dev/videoX 文件描述符
+    const char *dev;                  // 设备节点路径（用于日志）
+    unsigned int width, height;       // 驱动实际采用的分辨率
+    unsigned int pixelformat;         // 像素格式（V4L2_PIX_FMT_*）
+    unsigned int bytesperline;        // 行跨度（压缩格式为 0）
+    unsigned int sizeimage;           // 单帧最大字节数
+    unsigned int fps_num, fps_den;    // 驱动实际帧率 = fps_num / fps_den（未知时为 0）
+    int nonblock;                     // 1 = 以 O_NONBLOCK 打开
+    unsigned int count;               // 实际分配的缓冲数量
+    int queued;                       // 当前在驱动队列中的缓冲数（原子操作）
+    unsigned int skipped;             // cam_dequeue_latest() 丢弃的旧帧累计数
+    struct cam_frame frames[CAM_MAX_BUFFERS];
+};
+
+/**
+ * 函数名: cam_queue
+ * 功能: 将缓冲放回驱动采集队列（内部使用）。
+ */
+static inline int cam_queue(struct cam_device *cam, unsigned int index) {
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    if (ioctl(cam->fd, VIDIOC_QBUF, &buf) < 0) {
+        perror("VIDIOC_QBUF failed");
+        return -1;
+    }
+    __atomic_store_n(&cam->frames[index].owner, CAM_OWNER_DRIVER, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&cam->queued, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * 函数名: cam_close
+ * 功能: 停止采集，释放映射内存、DMABUF 描述符并关闭设备。
+ *       调用前所有消费者应已释放各自持有的帧。
+ */
+static inline void cam_close(struct cam_device *cam) {
+    if (cam->fd < 0) return;
+    for (unsigned int i = 0; i < cam->count; i++)
+        if (cam->frames[i].owner == CAM_OWNER_APP)
+            fprintf(stderr, "%s: buffer %u still held (refs=%d) at close\n",
+                    cam->dev, i, cam->frames[i].refs);
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    ioctl(cam->fd, VIDIOC_STREAMOFF, &type);
+    for (unsigned int i = 0; i < cam->count; i++) {
+        struct cam_frame *f = &cam->frames[i];
+        if (f->dma_fd >= 0) close(f->dma_fd);
+        if (f->start && f->start != MAP_FAILED) munmap(f->start, f->length);
+    }
+    close(cam->fd);
+    memset(cam, 0, sizeof(*cam));
+    cam->fd = -1;
+}
+
+/**
+ * 函数名: cam_min_interval
+ * 功能: 枚举指定格式/分辨率的帧间隔，取最短的一个（即最高帧率）。
+ *
+ * 返回值:
+ *   0 成功（结果写入 *best）；-1 驱动不支持枚举
+ */
+static inline int cam_min_interval(int fd, unsigned int pixfmt, unsigned int w, unsigned int h,
+                                   struct v4l2_fract *best) {
+    struct v4l2_frmivalenum iv;
+    memset(&iv, 0, sizeof(iv));
+    iv.pixel_format = pixfmt;
+    iv.width = w;
+    iv.height = h;
+    if (ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &iv) < 0) return -1;
+    if (iv.type != V4L2_FRMIVAL_TYPE_DISCRETE) {
+        *best = iv.stepwise.min;       // CONTINUOUS / STEPWISE：下限即最高帧率
+        return best->denominator ? 0 : -1;
+    }
+    best->numerator = 0;
+    for (; ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &iv) == 0; iv.index++) {
+        const struct v4l2_fract *d = &iv.discrete;
+        if (!d->denominator) continue;
+        // 比较 num/den 的大小：a/b < c/d  <=>  a*d < c*b
+        if (!best->numerator ||
+            (unsigned long long)d->numerator * best->denominator <
+            (unsigned long long)best->numerator * d->denominator)
+            *best = *d;
+    }
+    return best->numerator ? 0 : -1;
+}
+
+/**
+ * 函数名: cam_open_ex
+ * 功能:
+ *   打开摄像头并完成 S_FMT（格式协商）→ S_PARM → REQBUFS → QUERYBUF/mmap/EXPBUF → QBUF → STREAMON。
+ *
+ * 参数:
+ *   cam - 输出的摄像头对象（协商结果见 width/height/pixelformat/fps_num/fps_den）
+ *   dev - 设备节点，如 "/dev/video21"
+ *   p   - 打开参数（见 struct cam_params）
+ *
+ * 返回值:
+ *   0 成功；-1 失败（已打印原因并释放已申请的资源）
+ *
+ * 注意:
+ *   驱动不支持 VIDIOC_S_PARM 时只打印提示，不视为失败。
+ */
+static inline int cam_open_ex(struct cam_device *cam, const char *dev, const struct cam_params *p) {
+    memset(cam, 0, sizeof(*cam));
+    cam->dev = dev;
+    cam->nonblock = (p->flags & CAM_NONBLOCK) != 0;
+    cam->fd = open(dev, O_RDWR | O_CLOEXEC | (cam->nonblock ? O_NONBLOCK : 0));
+    if (cam->fd < 0) {
+        perror(dev);
+        return -1;
+    }
+
+    // ---------- 1. 协商采集格式：按偏好顺序尝试 ----------
+    struct v4l2_format fmt;
+    int found = 0;
+    for (const unsigned int *pf = p->formats; pf && *pf && !found; pf++) {
+        memset(&fmt, 0, sizeof(fmt));
+        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        fmt.fmt.pix.width = p->width;
+        fmt.fmt.pix.height = p->height;
+        fmt.fmt.pix.pixelformat = *pf;
+        fmt.fmt.pix.field = V4L2_FIELD_NONE;
+        found = ioctl(cam->fd, VIDIOC_S_FMT, &fmt) == 0 && fmt.fmt.pix.pixelformat == *pf;
+    }
+    if (!found) {
+        fprintf(stderr, "%s: none of the requested pixel formats is supported\n", dev);
+        cam_close(cam);
+        return -1;
+    }
+    if (fmt.fmt.pix.width != p->width || fmt.fmt.pix.height != p->height) {
+        if (p->flags & CAM_EXACT_SIZE) {
+            fprintf(stderr, "%s: format %ux%u rejected by driver\n", dev, p->width, p->height);
+            cam_close(cam);
+            return -1;
+        }
+        fprintf(stderr, "%s: driver adjusted %ux%u to %ux%u\n", dev, p->width, p->height,
+                fmt.fmt.pix.width, fmt.fmt.pix.height);
+    }
+    cam->width = fmt.fmt.pix.width;
+    cam->height = fmt.fmt.pix.height;
+    cam->pixelformat = fmt.fmt.pix.pixelformat;
+    cam->sizeimage = fmt.fmt.pix.sizeimage;
+    cam->bytesperline = fmt.fmt.pix.bytesperline;
+    if (!cam->bytesperline && (cam->pixelformat == V4L2_PIX_FMT_YUYV || cam->pixelformat == V4L2_PIX_FMT_UYVY))
+        cam->bytesperline = cam->width * 2;
+
+    // ---------- 2. 帧率（VIDIOC_S_PARM，回读驱动实际采用的帧间隔） ----------
+    struct v4l2_streamparm parm;
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (p->fps) {
+        struct v4l2_fract *tpf = &parm.parm.capture.timeperframe;
+        tpf->numerator = 1;
+        tpf->denominator = p->fps;
+        if (p->fps == CAM_FPS_MAX &&
+            cam_min_interval(cam->fd, cam->pixelformat, cam->width, cam->height, tpf) != 0) {
+            fprintf(stderr, "%s: frame intervals not enumerable, keeping default frame rate\n", dev);
+            tpf->denominator = 0;
+        }
+        if (tpf->denominator && ioctl(cam->fd, VIDIOC_S_PARM, &parm) < 0)
+            fprintf(stderr, "%s: VIDIOC_S_PARM not supported, keeping default frame rate\n", dev);
+    }
+    if (ioctl(cam->fd, VIDIOC_G_PARM, &parm) == 0 && parm.parm.capture.timeperframe.denominator) {
+        cam->fps_num = parm.parm.capture.timeperframe.denominator;
+        cam->fps_den = parm.parm.capture.timeperframe.numerator;
+    }
+
+    // ---------- 3. 申请缓冲 ----------
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = p->count > CAM_MAX_BUFFERS ? CAM_MAX_BUFFERS : p->count;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (ioctl(cam->fd, VIDIOC_REQBUFS, &req) < 0 || req.count == 0) {
+        perror("VIDIOC_REQBUFS failed");
+        cam_close(cam);
+        return -1;
+    }
+    if (req.count > CAM_MAX_BUFFERS) req.count = CAM_MAX_BUFFERS;
+    if (req.count < p->count)
+        fprintf(stderr, "%s: driver granted %u of %u buffers\n", dev, req.count, p->count);
+
+    // ---------- 4. 映射、导出 DMABUF 并入队 ----------
+    for (unsigned int i = 0; i < req.count; i++) {
+        struct cam_frame *f = &cam->frames[i];
+        f->cam = cam;
+        f->index = i;
+        f->dma_fd = -1;
+        cam->count = i + 1;            // 出错时 cam_close() 只回收已处理的缓冲
+
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = req.type;
+        buf.memory = req.memory;
+        buf.index = i;
+        if (ioctl(cam->fd, VIDIOC_QUERYBUF, &buf) < 0) {
+            perror("VIDIOC_QUERYBUF failed");
+            cam_close(cam);
+            return -1;
+        }
+
+        f->length = buf.length;
+        f->start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        cam->fd, buf.m.offset);
+        if (f->start == MAP_FAILED) {
+            perror("mmap failed");
+            f->start = NULL;
+            cam_close(cam);
+            return -1;
+        }
+
+        if (!(p->flags & CAM_NO_DMABUF)) {
+            struct v4l2_exportbuffer exp;
+            memset(&exp, 0, sizeof(exp));
+            exp.type = req.type;
+            exp.index = i;
+            exp.flags = O_RDONLY | O_CLOEXEC;
+            f->dma_fd = (ioctl(cam->fd, VIDIOC_EXPBUF, &exp) == 0) ? exp.fd : -1;
+        }
+
+        if (cam_queue(cam, i) != 0) {
+            cam_close(cam);
+            return -1;
+        }
+    }
+
+    // ---------- 5. 启动采集 ----------
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(cam->fd, VIDIOC_STREAMON, &type) < 0) {
+        perror("VIDIOC_STREAMON failed");
+        cam_close(cam);
+        return -1;
+    }
+
+    char fps[24] = "default";
+    if (cam->fps_num) snprintf(fps, sizeof(fps), "%.2f", (double)cam->fps_num / cam->fps_den);
+    printf("[OK] Camera %s initialized (%.4s %ux%u, %s fps, buffers=%u, dmabuf=%s)\n",
+           dev, (const char *)&cam->pixelformat, cam->width, cam->height, fps, cam->count,
+           cam->frames[0].dma_fd >= 0 ? "yes" : "no");
+    return 0;
+}
+
+/**
+ * 函数名: cam_open
+ * 功能: 以精确分辨率、单一像素格式、驱动默认帧率打开摄像头（cam_open_ex 的常用封装）。
+ *
+ * 参数:
+ *   width/height - 期望分辨率（驱动调整即失败）
+ *   pixelformat  - 像素格式，如 V4L2_PIX_FMT_YUYV
+ *   count        - 期望缓冲数量（建议 CAM_MIN_BUFFERS~CAM_MAX_BUFFERS，驱动可能调整）
+ *
+ * 返回值:
+ *   0 成功；-1 失败
+ */
+static inline int cam_open(struct cam_device *cam, const char *dev, unsigned int width,
+                           unsigned int height, unsigned int pixelformat, unsigned int count) {
+    unsigned int formats[2] = { pixelformat, 0 };
+    struct cam_params p;
+    memset(&p, 0, sizeof(p));
+    p.width = width;
+    p.height = height;
+    p.formats = formats;
+    p.count = count;
+    p.flags = CAM_EXACT_SIZE;
+    return cam_open_ex(cam, dev, &p);
+}
+
+/**
+ * 函数名: cam_set_ctrl
+ * 功能:
+ *   设置一个 V4L2 控件：先 VIDIOC_QUERYCTRL 确认存在并把 value 限制到
+ *   [minimum, maximum]、按 step 对齐，再 VIDIOC_S_CTRL 写入并回读实际值。
+ *
+ * 参数:
+ *   fd   - 视频节点或传感器子设备（/dev/v4l-subdevX）的描述符
+ *   dev  - 设备路径（用于日志）
+ *   id   - V4L2_CID_*
+ *
+ * 返回值:
+ *   0 成功；-1 控件不存在 / 被禁用（不打印，调用方可换用备选控件）或写入失败
+ */
+static inline int cam_set_ctrl(int fd, const char *dev, unsigned int id, int value) {
+    struct v4l2_queryctrl q;
+    memset(&q, 0, sizeof(q));
+    q.id = id;
+    if (ioctl(fd, VIDIOC_QUERYCTRL, &q) < 0 || (q.flags & V4L2_CTRL_FLAG_DISABLED)) return -1;
+    if (q.type == V4L2_CTRL_TYPE_INTEGER) {
+        if (value < q.minimum) value = q.minimum;
+        if (value > q.maximum) value = q.maximum;
+        if (q.step > 1) value = q.minimum + (value - q.minimum) / q.step * q.step;
+    }
+    struct v4l2_control c;
+    c.id = id;
+    c.value = value;
+    if (ioctl(fd, VIDIOC_S_CTRL, &c) < 0) {
+        fprintf(stderr, "%s: set '%s' = %d failed: %s\n", dev, (const char *)q.name, value,
+                strerror(errno));
+        return -1;
+    }
+    if (ioctl(fd, VIDIOC_G_CTRL, &c) == 0)
+        printf("[CAM] %s: %s = %d\n", dev, (const char *)q.name, c.value);
+    return 0;
+}
+
+/**
+ * 函数名: cam_set_exposure
+ * 功能:
+ *   固定曝光与增益，避免自动曝光在红外照明下拉长曝光、把帧率降为一半：
+ *   1. 关闭 EXPOSURE_AUTO_PRIORITY（UVC：不允许为曝光降帧率）；
+ *   2. exposure >= 0：EXPOSURE_AUTO 置为手动，写 EXPOSURE_ABSOLUTE（UVC，100us 单位），
+ *      驱动没有时写 EXPOSURE（传感器子设备，通常为行数）；
+ *   3. gain >= 0：关闭 AUTOGAIN，写 ANALOGUE_GAIN，没有时写 GAIN。
+ *
+ * 参数:
+ *   cam      - 已打开的摄像头
+ *   ctrl_dev - 控件所在节点；NULL 或 "" 表示视频节点本身，
+ *              ISP 平台的传感器控件通常在 /dev/v4l-subdevX 上
+ *   exposure - 曝光值（驱动单位，-1 = 保持自动）
+ *   gain     - 增益值（驱动单位，-1 = 保持自动）
+ *
+ * 返回值:
+ *   0 请求的控件均已设置；-1 有控件缺失或写入失败（已打印，摄像头仍可用）
+ */
+static inline int cam_set_exposure(struct cam_device *cam, const char *ctrl_dev, int exposure, int gain) {
+    int fd = cam->fd;
+    const char *dev = cam->dev;
+    if (ctrl_dev && *ctrl_dev) {
+        fd = open(ctrl_dev, O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            perror(ctrl_dev);
+            return -1;
+        }
+        dev = ctrl_dev;
+    }
+    int rc = 0;
+
+    // ---------- 1. 帧率优先于曝光 ----------
+    cam_set_ctrl(fd, dev, V4L2_CID_EXPOSURE_AUTO_PRIORITY, 0);
+
+    // ---------- 2. 手动曝光 ----------
+    if (exposure >= 0) {
+        cam_set_ctrl(fd, dev, V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_MANUAL);
+        if (cam_set_ctrl(fd, dev, V4L2_CID_EXPOSURE_ABSOLUTE, exposure) != 0 &&
+            cam_set_ctrl(fd, dev, V4L2_CID_EXPOSURE, exposure) != 0) {
+            fprintf(stderr, "%s: no usable exposure control\n", dev);
+            rc = -1;
+        }
+    }
+
+    // ---------- 3. 手动增益 ----------
+    if (gain >= 0) {
+        cam_set_ctrl(fd, dev, V4L2_CID_AUTOGAIN, 0);
+        if (cam_set_ctrl(fd, dev, V4L2_CID_ANALOGUE_GAIN, gain) != 0 &&
+            cam_set_ctrl(fd, dev, V4L2_CID_GAIN, gain) != 0) {
+            fprintf(stderr, "%s: no usable gain control\n", dev);
+            rc = -1;
+        }
+    }
+
+    if (fd != cam->fd) close(fd);
+    return rc;
+}
+
+/**
+ * 函数名: cam_dequeue_one
+ * 功能: 执行一次 VIDIOC_DQBUF（内部使用）。
+ *
+ * 返回值:
+ *   帧指针（引用计数 1，归属转为应用）；
+ *   出错返回 NULL；非阻塞打开且暂无帧时返回 NULL 且 errno == EAGAIN（不打印）
+ *
+ * 注意:
+ *   驱动时间戳不是 CLOCK_MONOTONIC 时改用出队时刻的单调时钟，保证各路可比较。
+ */
+static inline struct cam_frame *cam_dequeue_one(struct cam_device *cam) {
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    int ret;
+    do {
+        ret = ioctl(cam->fd, VIDIOC_DQBUF, &buf);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0 && errno == EAGAIN) return NULL;
+    if (ret < 0 || buf.index >= cam->count) {
+        perror("VIDIOC_DQBUF failed");
+        return NULL;
+    }
+
+    struct cam_frame *f = &cam->frames[buf.index];
+    f->bytesused = buf.bytesused;
+    f->sequence = buf.sequence;
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        f->ts_us = (long long)buf.timestamp.tv_sec * 1000000LL + buf.timestamp.tv_usec;
+    } else {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        f->ts_us = (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+    }
+    __atomic_sub_fetch(&cam->queued, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&f->refs, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&f->owner, CAM_OWNER_APP, __ATOMIC_RELEASE);
+    return f;
+}
+
+/**
+ * 函数名: cam_dequeue_timeout
+ * 功能: 最多等待 timeout_ms 毫秒（< 0 一直等待）取出一帧，返回的帧引用计数为 1。
+ *
+ * 返回值:
+ *   帧指针；超时返回 NULL 且 errno == ETIMEDOUT，出错返回 NULL
+ */
+static inline struct cam_frame *cam_dequeue_timeout(struct cam_device *cam, int timeout_ms) {
+    struct pollfd pfd;
+    pfd.fd = cam->fd;
+    pfd.events = POLLIN;
+    for (;;) {
+        pfd.revents = 0;
+        int n = poll(&pfd, 1, timeout_ms);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror("poll camera");
+            return NULL;
+        }
+        if (n == 0) {
+            errno = ETIMEDOUT;
+            return NULL;
+        }
+        if (pfd.revents & (POLLERR | POLLHUP)) {
+            fprintf(stderr, "%s: device error\n", cam->dev);
+            return NULL;
+        }
+        struct cam_frame *f = cam_dequeue_one(cam);
+        if (f || errno != EAGAIN) return f;       // 伪唤醒时继续等待
+    }
+}
+
+/**
+ * 函数名: cam_try_dequeue
+ * 功能: 不等待：有已完成的帧就取出，否则立即返回 NULL（errno == EAGAIN 或 ETIMEDOUT）。
+ */
+static inline struct cam_frame *cam_try_dequeue(struct cam_device *cam) {
+    return cam_dequeue_timeout(cam, 0);
+}
+
+/**
+ * 函数名: cam_dequeue
+ * 功能: 阻塞取出一帧（VIDIOC_DQBUF），返回的帧引用计数为 1。
+ *
+ * 返回值:
+ *   帧指针；出错返回 NULL
+ */
+static inline struct cam_frame *cam_dequeue(struct cam_device *cam) {
+    return cam->nonblock ? cam_dequeue_timeout(cam, -1) : cam_dequeue_one(cam);
+}
+
+/**
+ * 函数名: cam_frame_ref
+ * 功能: 为新的消费者增加一次引用（调用方必须已持有该帧）。
+ */
+static inline void cam_frame_ref(struct cam_frame *f) {
+    __atomic_add_fetch(&f->refs, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * 函数名: cam_frame_release
+ * 功能: 释放一次引用；引用归零时把缓冲放回驱动队列。线程安全。
+ */
+static inline void cam_frame_release(struct cam_frame *f) {
+    if (!f) return;
+    if (__atomic_load_n(&f->owner, __ATOMIC_ACQUIRE) != CAM_OWNER_APP) {
+        fprintf(stderr, "%s: buffer %u released while owned by driver\n", f->cam->dev, f->index);
+        return;
+    }
+    if (__atomic_sub_fetch(&f->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        cam_queue(f->cam, f->index);
+}
+
+/**
+ * 函数名: cam_dequeue_latest
+ * 功能:
+ *   阻塞等待至少一帧，然后把驱动中已完成的帧全部取出，只保留最新一帧，
+ *   较旧的帧立即归还驱动（累计到 cam->skipped）。
+ *   适合预览 / 跟踪这类只关心最新画面的消费者：处理变慢时延迟不会累积，
+ *   驱动手中始终保留空闲缓冲。
+ *
+ * 返回值:
+ *   最新帧（引用计数 1）；出错返回 NULL
+ */
+static inline struct cam_frame *cam_dequeue_latest(struct cam_device *cam) {
+    struct cam_frame *latest = cam_dequeue(cam);
+    if (!latest) return NULL;
+
+    struct pollfd pfd;
+    pfd.fd = cam->fd;
+    pfd.events = POLLIN;
+    // 零超时 poll：仅当还有已完成的帧时继续出队，不会额外阻塞
+    while (__atomic_load_n(&cam->queued, __ATOMIC_RELAXED) > 0 &&
+           poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) {
+        struct cam_frame *f = cam_dequeue_one(cam);
+        if (!f) break;
+        cam_frame_release(latest);
+        cam->skipped++;
+        latest = f;
+    }
+    return latest;
+}
+
+/*
+ * 双目帧同步器：两路摄像头各保留一帧待配对的最新帧（pending），
+ * 时间戳之差不超过 tolerance_us 时作为一对输出。
+ */
+struct cam_stereo {
+    struct cam_device *cam[2];        // [0] 左，[1] 右
+    struct cam_frame *pending[2];     // 尚未配对的最新帧（持有 1 次引用）
+    long long tolerance_us;           // 配对容差（建议取半个帧周期）
+    unsigned int paired;              // 已输出的帧对数
+    unsigned int dropped;             // 因时间戳不匹配或被更新帧覆盖而丢弃的帧数
+    int wake_fd;                      // 可选：与摄像头一起等待的事件 fd（如 eventfd），-1 表示不用
+};
+
+/**
+ * 函数名: cam_stereo_init
+ * 功能: 绑定两路已打开的摄像头并设置配对容差。
+ */
+static inline void cam_stereo_init(struct cam_stereo *st, struct cam_device *left,
+                                   struct cam_device *right, long long tolerance_us) {
+    memset(st, 0, sizeof(*st));
+    st->cam[0] = left;
+    st->cam[1] = right;
+    st->tolerance_us = tolerance_us;
+    st->wake_fd = -1;
+}
+
+/**
+ * 函数名: cam_stereo_release
+ * 功能: 归还尚未配对的帧（退出前调用）。
+ */
+static inline void cam_stereo_release(struct cam_stereo *st) {
+    for (int c = 0; c < 2; c++) {
+        cam_frame_release(st->pending[c]);
+        st->pending[c] = NULL;
+    }
+}
+
+/**
+ * 函数名: cam_stereo_next
+ * 功能:
+ *   poll() 同时等待两路摄像头，哪一路就绪就先取哪一路，两路并行排空；
+ *   两路都有待配对帧后比较时间戳：
+ *     - |左 - 右| <= tolerance_us：输出这一对；
+ *     - 否则丢弃较旧的一帧（它的搭档只会更旧，已被丢弃），继续等待。
+ *   同一路连续到达多帧时只保留最新一帧。
+ *   设置了 wake_fd 时一并等待，它可读即返回 1（由调用方读取 / 清除该 fd），
+ *   使主循环能在等待帧的同时立即响应按键等事件。
+ *
+ * 参数:
+ *   st         - 同步器
+ *   left/right - 输出：配对成功的左右帧（各持有 1 次引用，用完须 cam_frame_release）
+ *   timeout_ms - 等待上限（毫秒），< 0 表示一直等待
+ *
+ * 返回值:
+ *   0 成功；1 wake_fd 就绪（未输出帧对）；-1 超时或出错
+ */
+static inline int cam_stereo_next(struct cam_stereo *st, struct cam_frame **left,
+                                  struct cam_frame **right, int timeout_ms) {
+    *left = *right = NULL;
+    for (;;) {
+        if (st->pending[0] && st->pending[1]) {
+            long long dt = st->pending[0]->ts_us - st->pending[1]->ts_us;
+            if (dt <= st->tolerance_us && dt >= -st->tolerance_us) {
+                *left = st->pending[0];
+                *right = st->pending[1];
+                st->pending[0] = st->pending[1] = NULL;
+                st->paired++;
+                return 0;
+            }
+            int older = dt < 0 ? 0 : 1;           // 时间戳较小的一路
+            cam_frame_release(st->pending[older]);
+            st->pending[older] = NULL;
+            st->dropped++;
+        }
+
+        struct pollfd pfd[3];
+        for (int c = 0; c < 2; c++) {
+            pfd[c].fd = st->cam[c]->fd;
+            pfd[c].events = POLLIN;
+            pfd[c].revents = 0;
+        }
+        pfd[2].fd = st->wake_fd;                  // 负值被 poll 忽略
+        pfd[2].events = POLLIN;
+        pfd[2].revents = 0;
+        int n = poll(pfd, 3, timeout_ms);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n < 0) perror("poll camera");
+            return -1;
+        }
+
+        for (int c = 0; c < 2; c++) {
+            if (pfd[c].revents & (POLLERR | POLLHUP)) {
+                fprintf(stderr, "%s: device error\n", st->cam[c]->dev);
+                return -1;
+            }
+            if (!(pfd[c].revents & POLLIN)) continue;
+            struct cam_frame *f = cam_dequeue_one(st->cam[c]);
+            if (!f && errno == EAGAIN) continue;  // 非阻塞打开时的伪唤醒
+            if (!f) return -1;
+            if (st->pending[c]) {                 // 该路更新帧覆盖未配对的旧帧
+                cam_frame_release(st->pending[c]);
+                st->dropped++;
+            }
+            st->pending[c] = f;
+        }
+        if (pfd[2].revents & POLLIN) return 1;   // 已取出的帧留在 pending，下次继续配对
+    }
+}
+
+#endif /* V4L2_CAMERA_H */